@@ -0,0 +1,85 @@
+// Compares decoding JSON messages in Dart with jsonDecode against native
+// decoding with IpcConnectionOptions.decodeJson. Run on Windows with
+//
+//   flutter test integration_test/json_decode_benchmark_test.dart -d windows
+//
+// For each message size it prints the time until the last message arrived
+// and how much of it the UI isolate spent in jsonDecode.
+
+import 'dart:async';
+import 'dart:convert';
+
+import 'package:flutter_ipc/flutter_ipc.dart';
+import 'package:flutter_test/flutter_test.dart';
+import 'package:integration_test/integration_test.dart';
+
+const _messageCount = 2000;
+
+String _event(int index) => jsonEncode({
+      'type': 'update',
+      'id': index,
+      'name': 'sensor-${index % 97}',
+      'active': true,
+      'value': index * 0.25,
+      'tags': ['alpha', 'beta', 'gamma'],
+    });
+
+String _array(int count) => '[${List.generate(count, _event).join(',')}]';
+
+Future<void> _run(String label, String message, {required bool native}) async {
+  final pipeName = 'json_benchmark_${native ? 'native' : 'dart'}_${message.length}';
+  final server = await FlutterIpc.createServer(pipeName);
+  final client = await FlutterIpc.connect(pipeName,
+      options: IpcConnectionOptions(decodeJson: native));
+  await server.listen();
+
+  final decodeTime = Stopwatch();
+  final done = Completer<void>();
+  var received = 0;
+  void onValue(Object? value) {
+    if (++received == _messageCount) {
+      done.complete();
+    }
+  }
+
+  final StreamSubscription<Object?> subscription = native
+      ? client.jsonStream.listen(onValue)
+      : client.messageStream.listen((text) {
+          decodeTime.start();
+          final value = jsonDecode(text);
+          decodeTime.stop();
+          onValue(value);
+        });
+
+  final total = Stopwatch()..start();
+  for (var i = 0; i < _messageCount; ++i) {
+    unawaited(server.sendMessage(message));
+  }
+  await done.future;
+  total.stop();
+
+  // ignore: avoid_print
+  print('$label, ${native ? 'native' : 'jsonDecode'}: '
+      '${total.elapsedMilliseconds} ms total, '
+      '${decodeTime.elapsedMilliseconds} ms decoding on the UI isolate');
+  await subscription.cancel();
+  await client.disconnect();
+  await server.close();
+}
+
+void main() {
+  IntegrationTestWidgetsFlutterBinding.ensureInitialized();
+
+  testWidgets('decodes JSON natively and with jsonDecode', (tester) async {
+    await tester.runAsync(() async {
+      final samples = {
+        '${_event(0).length}B events': _event(0),
+        '16KB arrays': _array(80),
+      };
+      for (final sample in samples.entries) {
+        await _run(sample.key, sample.value, native: false);
+        await _run(sample.key, sample.value, native: true);
+      }
+    });
+  });
+}
@@ -1,16 +1,754 @@
+import 'dart:convert';
+import 'dart:ffi' as ffi;
+import 'dart:typed_data';
 
 import 'flutter_ipc_platform_interface.dart';
 
 class FlutterIpc {
-  static Future<IpcServer> createServer(String pipeName) async {
-    final serverId = await FlutterIpcPlatform.instance.createServer(pipeName);
+  /// Creates a server on [pipeName]. [options] tune its buffers, queue and
+  /// batching; see [IpcConnectionOptions].
+  ///
+  /// A server for clients that connect with several [connections] needs
+  /// as many; it accepts them all from one client and answers over all of
+  /// them.
+  static Future<IpcServer> createServer(String pipeName, {int connections = 1, IpcConnectionOptions? options}) async {
+    final serverId = await FlutterIpcPlatform.instance.createServer(pipeName, connections: connections, options: options?.toMap());
     return IpcServer._(serverId);
   }
 
-  static Future<IpcClient> connect(String pipeName) async {
-    final clientId = await FlutterIpcPlatform.instance.connect(pipeName);
+  /// Creates a native broker. Servers that join it forward messages to each
+  /// other without a round trip through Dart; see [IpcBroker].
+  static Future<IpcBroker> createBroker() async {
+    final brokerId = await FlutterIpcPlatform.instance.createBroker();
+    return IpcBroker._(brokerId);
+  }
+
+  /// Connects to the server listening on [pipeName].
+  ///
+  /// A [resilient] client outlives its server: messages are kept until the
+  /// server acknowledges them, and the client reconnects in the background,
+  /// with backoff, and resends them into the same session. Sends keep
+  /// succeeding while it reconnects, until its outbox is full. Handles are
+  /// never resent.
+  ///
+  /// With several [connections] the client opens that many instances of
+  /// the pipe and spreads its messages over them, for throughput a single
+  /// pipe cannot reach; it still looks like one client. See
+  /// [IpcConnectionOptions.stripePolicy] and
+  /// [IpcConnectionOptions.orderedStripes]. Pooled clients cannot be
+  /// [resilient].
+  static Future<IpcClient> connect(String pipeName,
+      {bool resilient = false, int connections = 1, IpcConnectionOptions? options}) async {
+    final clientId = await FlutterIpcPlatform.instance
+        .connect(pipeName, resilient: resilient, connections: connections, options: options?.toMap());
     return IpcClient._(clientId);
   }
+
+  /// The server registered for [pipeName] by any process in this session,
+  /// or null if there is none. Servers of this plugin register themselves
+  /// from creation until they are closed or their process exits, so this
+  /// answers without opening the pipe.
+  static Future<IpcServerInfo?> lookupServer(String pipeName) async {
+    final info = await FlutterIpcPlatform.instance.lookupServer(pipeName);
+    return info == null ? null : IpcServerInfo._fromMap(info);
+  }
+
+  /// Waits until a server for [pipeName] is listening, without probing the
+  /// pipe, and returns it; null if none is within [timeout]. [connect]
+  /// right after succeeds unless another client gets there first.
+  static Future<IpcServerInfo?> waitForServer(String pipeName, {Duration timeout = const Duration(seconds: 30)}) async {
+    final info = await FlutterIpcPlatform.instance.waitForServer(pipeName, timeout.inMilliseconds);
+    return info == null ? null : IpcServerInfo._fromMap(info);
+  }
+
+  /// Every server registered in this session.
+  static Future<List<IpcServerInfo>> listServers() async {
+    final servers = await FlutterIpcPlatform.instance.listServers();
+    return servers.map((info) => IpcServerInfo._fromMap(info as Map<Object?, Object?>)).toList();
+  }
+
+  /// Creates a shared memory block that can be attached to a message with
+  /// `sendHandles` instead of streaming its bytes through the pipe.
+  static Future<IpcHandle> createSharedMemory(int size) async {
+    final handleId = await FlutterIpcPlatform.instance.createSharedMemory(size);
+    return IpcHandle._(handleId, IpcHandleKind.sharedMemory, size);
+  }
+
+  /// Caps the memory all connections of this process hold together:
+  /// queued outgoing messages, received messages not handled yet and
+  /// messages still arriving in pieces. [limitBytes] of zero removes the
+  /// cap. Each connection can have a cap of its own as well; see
+  /// [IpcConnectionOptions.memoryLimit].
+  static Future<void> setMemoryBudget(int limitBytes, {IpcMemoryPolicy policy = IpcMemoryPolicy.pauseReads}) async {
+    return FlutterIpcPlatform.instance.setMemoryBudget(limitBytes, policy.name);
+  }
+
+  /// Memory held by all connections of this process, and what the budget
+  /// has done about it.
+  static Future<IpcMemoryStats> getMemoryStats() async {
+    return IpcMemoryStats._fromMap(await FlutterIpcPlatform.instance.getMemoryStats());
+  }
+
+  /// Records every message sent or received by every server and client of
+  /// this process, with its connection, channel and time, to the file at
+  /// [path] until [stopCapture]. The file is mapped into memory at
+  /// [capacityBytes] up front; messages beyond that are dropped, and only
+  /// the first [maxPayloadBytes] of each are kept. Replay a capture with
+  /// the ipc_replay tool.
+  static Future<void> startCapture(String path,
+      {int capacityBytes = 256 * 1024 * 1024, int maxPayloadBytes = 64 * 1024}) async {
+    return FlutterIpcPlatform.instance.startCapture(path, capacityBytes, maxPayloadBytes);
+  }
+
+  /// Ends the capture and cuts its file to the records written.
+  static Future<IpcCaptureStats> stopCapture() async {
+    return IpcCaptureStats._fromMap(await FlutterIpcPlatform.instance.stopCapture());
+  }
+
+  /// Opens a file for reading so its handle can be attached to a message.
+  static Future<IpcHandle> openFile(String path) async {
+    final handleInfo = await FlutterIpcPlatform.instance.openFile(path);
+    return IpcHandle._(handleInfo['handleId'] as String, IpcHandleKind.file, handleInfo['size'] as int);
+  }
+}
+
+enum IpcHandleKind { sharedMemory, file }
+
+/// An OS handle owned by this process. Handles received from a peer refer
+/// to the same memory or file as the sender's; contents are only copied
+/// when read.
+class IpcHandle {
+  final String _handleId;
+  final IpcHandleKind kind;
+  final int size;
+
+  IpcHandle._(this._handleId, this.kind, this.size);
+
+  factory IpcHandle._fromMap(Map<Object?, Object?> map) {
+    return IpcHandle._(
+      map['handleId'] as String,
+      map['kind'] == 'file' ? IpcHandleKind.file : IpcHandleKind.sharedMemory,
+      map['size'] as int,
+    );
+  }
+
+  Future<Uint8List> read({int offset = 0, int? length}) async {
+    return FlutterIpcPlatform.instance.readHandle(_handleId, offset: offset, length: length);
+  }
+
+  Future<void> write(Uint8List data, {int offset = 0}) async {
+    return FlutterIpcPlatform.instance.writeHandle(_handleId, data, offset: offset);
+  }
+
+  Future<void> close() async {
+    return FlutterIpcPlatform.instance.closeHandle(_handleId);
+  }
+}
+
+/// A message received together with handles attached by the peer.
+class IpcHandleMessage {
+  final String message;
+  final List<IpcHandle> handles;
+
+  IpcHandleMessage._(this.message, this.handles);
+
+  factory IpcHandleMessage._fromMap(Map<Object?, Object?> map) {
+    return IpcHandleMessage._(
+      map['message'] as String,
+      (map['handles'] as List<Object?>)
+          .map((handle) => IpcHandle._fromMap(handle as Map<Object?, Object?>))
+          .toList(),
+    );
+  }
+}
+
+/// The latest value of a key sent with `sendMessage(key: ...)`.
+class IpcStateUpdate {
+  final String key;
+  final String message;
+
+  IpcStateUpdate._(this.key, this.message);
+
+  factory IpcStateUpdate._fromMap(Map<Object?, Object?> map) {
+    return IpcStateUpdate._(map['key'] as String, map['message'] as String);
+  }
+}
+
+/// Presets for [IpcConnectionOptions.profile].
+enum IpcTuningProfile {
+  /// Small kernel buffers and chunks, no batching.
+  balanced,
+
+  /// Larger kernel buffers so a writer rarely blocks, and small chunks so a
+  /// large message does not hold up the next one for long.
+  latency,
+
+  /// Large buffers, chunks and flow-control window, and small messages
+  /// batched into one write.
+  throughput,
+
+  /// Starts with large buffers and adjusts the chunk size and batching to
+  /// the sizes of the messages actually sent.
+  auto,
+}
+
+/// How a connection reads from a kernel pipe.
+enum IpcIoBackend {
+  /// A thread per connection, blocked in its reads.
+  threads,
+
+  /// A few threads shared by all connections of the process, each picking
+  /// up a batch of completed reads per wakeup. Scales to many connections.
+  completionPort,
+}
+
+/// How messages are delimited on the pipe.
+enum IpcFraming {
+  /// Length-prefixed frames, spoken between flutter_ipc endpoints.
+  lengthPrefixed,
+
+  /// Newline-terminated text, for talking to existing tools that read and
+  /// write lines, such as newline-delimited JSON. Each line is one
+  /// message; a CR before the newline is dropped. Only text messages can
+  /// be sent, and a message must not contain a newline itself.
+  newline,
+}
+
+/// What happens when a memory limit is exceeded.
+enum IpcMemoryPolicy {
+  /// Stop reading from the pipe until listeners have caught up. Only
+  /// received messages count toward the limit: queued sends drain on what
+  /// reading takes in. The peer's writes block once the pipe buffer is
+  /// full.
+  pauseReads,
+
+  /// Fail new sends until memory is released.
+  rejectSends,
+
+  /// Drop a connection: over its own limit, that connection; over the
+  /// process-wide budget, the one holding the most memory.
+  disconnect,
+}
+
+/// How a pooled server or client picks the connection for each message.
+enum IpcStripePolicy {
+  /// Each connection in turn.
+  roundRobin,
+
+  /// The connection with the fewest bytes waiting to be written, so a
+  /// large message does not hold up the ones after it.
+  leastQueued,
+}
+
+/// Scheduling priority of a connection's I/O threads.
+enum IpcThreadPriority { normal, aboveNormal, highest, timeCritical }
+
+/// Transport tuning of a server or client. The [profile] provides the
+/// defaults; every other field that is set overrides it.
+///
+/// A server's kernel pipe buffers, [instances] and [timeoutMs] apply when
+/// the pipe is created; servers sharing a pipe name must agree on
+/// [instances]. A client's buffers are those of the server it connects to.
+/// Chunking and batching do not apply to connections within this process.
+class IpcConnectionOptions {
+  final IpcTuningProfile? profile;
+
+  /// Sizes of the kernel pipe buffers, in bytes.
+  final int? outBufferSize;
+  final int? inBufferSize;
+
+  /// Maximum number of pipe instances with this name.
+  final int? instances;
+
+  /// Default wait for a busy pipe, used by clients connecting to it.
+  final int? timeoutMs;
+
+  /// Bytes that may be waiting to be written before sends fail. Also
+  /// bounds the outbox of a resilient client, which is otherwise 8 MiB.
+  final int? maxQueuedBytes;
+
+  /// Largest piece a message is split into, so other channels can
+  /// interleave. At most 262144; peers drop a connection whose pieces are
+  /// larger.
+  final int? chunkSize;
+
+  /// Pieces are batched into one write until this many bytes are gathered.
+  /// Zero writes each piece on its own.
+  final int? coalesceBytes;
+
+  /// Flow-control window granted to the peer.
+  final int? windowBytes;
+  final int? windowMessages;
+
+  /// Low-latency mode. A connection's reader and writer threads keep
+  /// polling for this long after running out of work before they block,
+  /// so a message arriving within that time is picked up without a
+  /// scheduler wakeup. Each spinning thread keeps a processor busy; pin
+  /// them with [cpuAffinity], a bit mask of processors, and raise their
+  /// [threadPriority] so they are not preempted. Works with both kernel
+  /// pipes and connections within this process.
+  final int? spinMicros;
+  final int? cpuAffinity;
+  final IpcThreadPriority? threadPriority;
+
+  /// Resilient clients and connections within this process always use
+  /// [IpcIoBackend.threads]. With [IpcIoBackend.completionPort], polling
+  /// only applies to the writer thread.
+  final IpcIoBackend? ioBackend;
+
+  /// Parses incoming text messages as JSON natively, off the UI thread,
+  /// and delivers the decoded maps and lists on `jsonStream` instead of
+  /// `messageStream`. A message that is not valid JSON arrives there as an
+  /// error with code `INVALID_JSON`; the stream carries on after it.
+  final bool? decodeJson;
+
+  /// Both ends must agree on the framing. With [IpcFraming.newline] the
+  /// connection has no channels, flow control or resilience, always reads
+  /// on a thread of its own, and incoming lines longer than
+  /// [maxRecordLength] bytes are dropped.
+  final IpcFraming? framing;
+  final int? maxRecordLength;
+
+  /// Caps the memory held for this server or client, in addition to the
+  /// process-wide [FlutterIpc.setMemoryBudget]. With
+  /// [IpcMemoryPolicy.pauseReads] the connection reads on a thread of its
+  /// own.
+  final int? memoryLimit;
+  final IpcMemoryPolicy? memoryPolicy;
+
+  /// Liveness, in milliseconds. Every [heartbeatIntervalMs] a heartbeat
+  /// goes to the peer, and a peer that has sent nothing for three
+  /// intervals is disconnected; both ends should set it. A connection with
+  /// no messages either way for [idleTimeoutMs] is disconnected as well.
+  /// A server waiting longer than [connectTimeoutMs] for a client stops
+  /// listening, and a resilient client gives up a reconnect that takes
+  /// longer. Each is reported on `messageStream`; heartbeats need
+  /// [IpcFraming.lengthPrefixed].
+  final int? heartbeatIntervalMs;
+  final int? idleTimeoutMs;
+  final int? connectTimeoutMs;
+
+  /// For servers and clients with several connections. With
+  /// [orderedStripes], the default, the messages of each channel arrive in
+  /// the order they were sent, whichever connection they took, and cannot
+  /// have a send timeout. Without it they may overtake each other. Both
+  /// ends must agree on [orderedStripes].
+  final IpcStripePolicy? stripePolicy;
+  final bool? orderedStripes;
+
+  /// Deduplication of repeated large messages. Text and JSON messages of
+  /// at least [blobMinBytes] (4096 by default) are remembered, up to
+  /// [blobCacheBytes] of them per connection, and sending one again only
+  /// costs a short reference. The peer keeps the copies, on top of its
+  /// [memoryLimit], so both ends should set the same size. Needs
+  /// [IpcFraming.lengthPrefixed].
+  final int? blobCacheBytes;
+  final int? blobMinBytes;
+
+  /// The last values of keyed messages kept per connection for state-sync
+  /// channels, see [IpcServer.configureChannel]; 16 MB by default. Keys
+  /// past it go out in full. Both ends should agree on it.
+  final int? stateCacheBytes;
+
+  const IpcConnectionOptions({
+    this.profile,
+    this.outBufferSize,
+    this.inBufferSize,
+    this.instances,
+    this.timeoutMs,
+    this.maxQueuedBytes,
+    this.chunkSize,
+    this.coalesceBytes,
+    this.windowBytes,
+    this.windowMessages,
+    this.spinMicros,
+    this.cpuAffinity,
+    this.threadPriority,
+    this.ioBackend,
+    this.decodeJson,
+    this.framing,
+    this.maxRecordLength,
+    this.memoryLimit,
+    this.memoryPolicy,
+    this.heartbeatIntervalMs,
+    this.idleTimeoutMs,
+    this.connectTimeoutMs,
+    this.stripePolicy,
+    this.orderedStripes,
+    this.blobCacheBytes,
+    this.blobMinBytes,
+    this.stateCacheBytes,
+  });
+
+  Map<String, Object?> toMap() {
+    return {
+      if (profile != null) 'profile': profile!.name,
+      if (outBufferSize != null) 'outBufferSize': outBufferSize,
+      if (inBufferSize != null) 'inBufferSize': inBufferSize,
+      if (instances != null) 'instances': instances,
+      if (timeoutMs != null) 'timeoutMs': timeoutMs,
+      if (maxQueuedBytes != null) 'maxQueuedBytes': maxQueuedBytes,
+      if (chunkSize != null) 'chunkSize': chunkSize,
+      if (coalesceBytes != null) 'coalesceBytes': coalesceBytes,
+      if (windowBytes != null) 'windowBytes': windowBytes,
+      if (windowMessages != null) 'windowMessages': windowMessages,
+      if (spinMicros != null) 'spinMicros': spinMicros,
+      if (cpuAffinity != null) 'cpuAffinity': cpuAffinity,
+      if (threadPriority != null) 'threadPriority': threadPriority!.name,
+      if (ioBackend != null) 'ioBackend': ioBackend!.name,
+      if (decodeJson != null) 'decodeJson': decodeJson,
+      if (framing != null) 'framing': framing!.name,
+      if (maxRecordLength != null) 'maxRecordLength': maxRecordLength,
+      if (memoryLimit != null) 'memoryLimit': memoryLimit,
+      if (memoryPolicy != null) 'memoryPolicy': memoryPolicy!.name,
+      if (heartbeatIntervalMs != null) 'heartbeatIntervalMs': heartbeatIntervalMs,
+      if (idleTimeoutMs != null) 'idleTimeoutMs': idleTimeoutMs,
+      if (connectTimeoutMs != null) 'connectTimeoutMs': connectTimeoutMs,
+      if (stripePolicy != null) 'stripePolicy': stripePolicy!.name,
+      if (orderedStripes != null) 'orderedStripes': orderedStripes,
+      if (blobCacheBytes != null) 'blobCacheBytes': blobCacheBytes,
+      if (blobMinBytes != null) 'blobMinBytes': blobMinBytes,
+      if (stateCacheBytes != null) 'stateCacheBytes': stateCacheBytes,
+    };
+  }
+}
+
+/// A snapshot of the flow control of one connection. All counters are zero
+/// while not [connected].
+class IpcConnectionStats {
+  final bool connected;
+
+  /// Bytes and messages that may still be sent before the peer grants more
+  /// credit. Negative while the last chunk sent overdrew the window.
+  final int sendCreditBytes;
+  final int sendCreditMessages;
+
+  /// Received from the peer but not yet handled by a listener here.
+  final int unconsumedBytes;
+  final int unconsumedMessages;
+
+  /// How often, and for how long in total, outgoing messages waited for
+  /// credit from a slow peer.
+  final int stalls;
+  final Duration stallTime;
+
+  final int queuedFrames;
+
+  /// Queued messages replaced by a newer one of the same key, see
+  /// `configureChannel(conflate: true)`.
+  final int conflatedFrames;
+
+  /// The tuning in effect. [chunkSize] and [coalesceBytes] change over time
+  /// under [IpcTuningProfile.auto].
+  final IpcTuningProfile profile;
+  final int outBufferSize;
+  final int inBufferSize;
+  final int maxQueuedBytes;
+  final int chunkSize;
+  final int coalesceBytes;
+
+  /// The blob caches of the current connection, and their size.
+  final IpcBlobStats blobCache;
+  final int blobCacheBytes;
+
+  /// Keyed messages of the current connection, see [IpcStateSyncStats],
+  /// and the size of the last versions each end keeps.
+  final IpcStateSyncStats stateSync;
+  final int stateCacheBytes;
+
+  /// Memory held for this server or client, counted across connections,
+  /// and its cap; a [memoryLimit] of zero means none.
+  final IpcMemoryStats memory;
+  final int memoryLimit;
+  final IpcMemoryPolicy memoryPolicy;
+
+  /// Set for resilient clients only. Messages in the outbox have been sent
+  /// at least once but are not acknowledged by the server yet.
+  final int? sessionId;
+  final int? reconnects;
+  final int? outboxMessages;
+  final int? outboxBytes;
+  final int? outboxCapacity;
+
+  IpcConnectionStats._fromMap(Map<Object?, Object?> map)
+      : connected = map['connected'] as bool,
+        sendCreditBytes = map['sendCreditBytes'] as int,
+        sendCreditMessages = map['sendCreditMessages'] as int,
+        unconsumedBytes = map['unconsumedBytes'] as int,
+        unconsumedMessages = map['unconsumedMessages'] as int,
+        stalls = map['stalls'] as int,
+        stallTime = Duration(microseconds: map['stallTimeMicros'] as int),
+        queuedFrames = map['queuedFrames'] as int,
+        conflatedFrames = map['conflatedFrames'] as int,
+        profile = IpcTuningProfile.values.byName(map['profile'] as String),
+        outBufferSize = map['outBufferSize'] as int,
+        inBufferSize = map['inBufferSize'] as int,
+        maxQueuedBytes = map['maxQueuedBytes'] as int,
+        chunkSize = map['chunkSize'] as int,
+        coalesceBytes = map['coalesceBytes'] as int,
+        blobCache = IpcBlobStats._fromMap(map['blobCache'] as Map<Object?, Object?>),
+        blobCacheBytes = map['blobCacheBytes'] as int,
+        stateSync = IpcStateSyncStats._fromMap(map['stateSync'] as Map<Object?, Object?>),
+        stateCacheBytes = map['stateCacheBytes'] as int,
+        memory = IpcMemoryStats._fromMap(map['memory'] as Map<Object?, Object?>),
+        memoryLimit = map['memoryLimit'] as int,
+        memoryPolicy = IpcMemoryPolicy.values.byName(map['memoryPolicy'] as String),
+        sessionId = map['sessionId'] as int?,
+        reconnects = map['reconnects'] as int?,
+        outboxMessages = map['outboxMessages'] as int?,
+        outboxBytes = map['outboxBytes'] as int?,
+        outboxCapacity = map['outboxCapacity'] as int?;
+}
+
+/// Counters of the blob caches of one connection, see
+/// [IpcConnectionOptions.blobCacheBytes].
+class IpcBlobStats {
+  /// Messages sent that were large enough to deduplicate, those that went
+  /// out as a reference, and the bytes that saved.
+  final int candidates;
+  final int hits;
+  final int bytesSaved;
+
+  /// Copies kept for the peer, and the references it sent. References to
+  /// a copy that is not kept drop their message.
+  final int heldBlobs;
+  final int heldBytes;
+  final int references;
+  final int unknownReferences;
+
+  /// [hits] out of [candidates]; null before the first candidate.
+  final double? hitRate;
+
+  IpcBlobStats._fromMap(Map<Object?, Object?> map)
+      : candidates = map['candidates'] as int,
+        hits = map['hits'] as int,
+        bytesSaved = map['bytesSaved'] as int,
+        heldBlobs = map['heldBlobs'] as int,
+        heldBytes = map['heldBytes'] as int,
+        references = map['references'] as int,
+        unknownReferences = map['unknownReferences'] as int,
+        hitRate = map['hitRate'] as double?;
+}
+
+/// Counters of the keyed messages of one connection.
+class IpcStateSyncStats {
+  /// Keyed messages sent, how many went out in full and as a diff, and the
+  /// bytes of their values against the bytes that went over the pipe.
+  final int updates;
+  final int snapshots;
+  final int deltas;
+  final int valueBytes;
+  final int encodedBytes;
+
+  /// Last values kept to diff against, and those kept of the peer's keys.
+  final int trackedKeys;
+  final int trackedBytes;
+  final int heldKeys;
+  final int heldBytes;
+
+  /// Diffs from the peer that did not apply to the value held; those
+  /// updates are lost until the next snapshot of their key.
+  final int misses;
+
+  IpcStateSyncStats._fromMap(Map<Object?, Object?> map)
+      : updates = map['updates'] as int,
+        snapshots = map['snapshots'] as int,
+        deltas = map['deltas'] as int,
+        valueBytes = map['valueBytes'] as int,
+        encodedBytes = map['encodedBytes'] as int,
+        trackedKeys = map['trackedKeys'] as int,
+        trackedBytes = map['trackedBytes'] as int,
+        heldKeys = map['heldKeys'] as int,
+        heldBytes = map['heldBytes'] as int,
+        misses = map['misses'] as int;
+}
+
+/// Memory held by the connections of a server or client, or of the whole
+/// process, in bytes.
+class IpcMemoryStats {
+  final int totalBytes;
+  final int peakBytes;
+
+  /// Queued outgoing messages.
+  final int sendBytes;
+
+  /// Received messages not handled by a listener yet.
+  final int receiveBytes;
+
+  /// Messages of which only some pieces have arrived.
+  final int reassemblyBytes;
+
+  /// How often sends were refused, reads were paused and connections were
+  /// dropped for exceeding a limit.
+  final int rejectedSends;
+  final int readPauses;
+  final int disconnects;
+
+  /// The process-wide budget; only set by [FlutterIpc.getMemoryStats].
+  final int? limitBytes;
+  final IpcMemoryPolicy? policy;
+
+  IpcMemoryStats._fromMap(Map<Object?, Object?> map)
+      : totalBytes = map['totalBytes'] as int,
+        peakBytes = map['peakBytes'] as int,
+        sendBytes = map['sendBytes'] as int,
+        receiveBytes = map['receiveBytes'] as int,
+        reassemblyBytes = map['reassemblyBytes'] as int,
+        rejectedSends = map['rejectedSends'] as int,
+        readPauses = map['readPauses'] as int,
+        disconnects = map['disconnects'] as int,
+        limitBytes = map['limitBytes'] as int?,
+        policy = map['policy'] == null ? null : IpcMemoryPolicy.values.byName(map['policy'] as String);
+}
+
+/// What a capture recorded; see [FlutterIpc.startCapture].
+class IpcCaptureStats {
+  final int records;
+  final int bytes;
+
+  /// Records that did not fit in the file.
+  final int dropped;
+
+  IpcCaptureStats._fromMap(Map<Object?, Object?> map)
+      : records = map['records'] as int,
+        bytes = map['bytes'] as int,
+        dropped = map['dropped'] as int;
+}
+
+enum IpcServerState {
+  /// Created but not listening yet.
+  starting,
+
+  /// Listening; a client connects at once.
+  available,
+
+  /// Has its client.
+  busy,
+}
+
+/// A server as the session's registry knows it; see
+/// [FlutterIpc.lookupServer].
+class IpcServerInfo {
+  final String pipeName;
+  final IpcServerState state;
+
+  /// Pipe instances the server opened; more than one for a server created
+  /// with several connections.
+  final int capacity;
+  final int processId;
+
+  IpcServerInfo._fromMap(Map<Object?, Object?> map)
+      : pipeName = map['pipeName'] as String,
+        state = IpcServerState.values.byName(map['state'] as String),
+        capacity = map['capacity'] as int,
+        processId = map['processId'] as int;
+}
+
+/// Forwarding counters of an [IpcBroker].
+class IpcBrokerStats {
+  /// Messages forwarded along a route.
+  final int forwarded;
+
+  /// Messages without a route, delivered to the receiving server's streams.
+  final int unrouted;
+
+  /// Forwarded copies a destination refused because it was not connected
+  /// or its queue was full.
+  final int dropped;
+
+  IpcBrokerStats._fromMap(Map<Object?, Object?> map)
+      : forwarded = map['forwarded'] as int,
+        unrouted = map['unrouted'] as int,
+        dropped = map['dropped'] as int;
+}
+
+/// Routes messages between the clients of a group of servers natively.
+///
+/// A route sends every message received on a channel by one of the member
+/// servers to the clients of the route's destination servers, on the same
+/// channel. The channel serves as a topic (several destinations) or as the
+/// address of one destination. The payload is neither decoded nor copied,
+/// except for each extra destination. Messages without a route, and
+/// messages carrying handles, still arrive on the server's streams.
+class IpcBroker {
+  final String _brokerId;
+
+  IpcBroker._(this._brokerId);
+
+  Future<void> join(IpcServer server) async {
+    return FlutterIpcPlatform.instance.joinBroker(_brokerId, server._serverId);
+  }
+
+  Future<void> leave(IpcServer server) async {
+    return FlutterIpcPlatform.instance.leaveBroker(server._serverId);
+  }
+
+  /// Forwards [channel] to [destinations], replacing the previous route.
+  /// A message is never sent back to the server it arrived on.
+  Future<void> route(int channel, List<IpcServer> destinations) async {
+    return FlutterIpcPlatform.instance.setBrokerRoute(
+        _brokerId, channel, destinations.map((server) => server._serverId).toList());
+  }
+
+  Future<void> removeRoute(int channel) async {
+    return FlutterIpcPlatform.instance.setBrokerRoute(_brokerId, channel, const []);
+  }
+
+  Future<IpcBrokerStats> getStats() async {
+    return IpcBrokerStats._fromMap(
+        await FlutterIpcPlatform.instance.getBrokerStats(_brokerId));
+  }
+
+  /// The members go back to delivering every message to their streams.
+  Future<void> close() async {
+    return FlutterIpcPlatform.instance.closeBroker(_brokerId);
+  }
+}
+
+final _sendPortSend = ffi.DynamicLibrary.open('flutter_ipc_plugin.dll').lookupFunction<
+    ffi.Uint32 Function(ffi.Int64, ffi.Uint16, ffi.Pointer<ffi.Uint8>, ffi.Size),
+    int Function(int, int, ffi.Pointer<ffi.Uint8>, int)>('FlutterIpcSendPortSend', isLeaf: true);
+
+/// Sends messages on a connection from any isolate, straight into its send
+/// queue instead of through the platform thread. Pass the port to
+/// background isolates as it is; any number of them may send at once, and
+/// every message goes over the pipe whole. Messages from one isolate keep
+/// their order. The port closes with its server or client. Windows only.
+class IpcSendPort {
+  final int port;
+
+  const IpcSendPort(this.port);
+
+  /// Queues [message] on [channel]. Throws an [IpcSendException] if it
+  /// cannot be queued.
+  void sendMessage(String message, {int channel = 0}) {
+    sendBytes(utf8.encode(message), channel: channel);
+  }
+
+  /// Queues [bytes] as one message on [channel]. The peer receives bytes
+  /// that are not valid UTF-8 on its `binaryMessageStream`.
+  void sendBytes(Uint8List bytes, {int channel = 0}) {
+    final error = _sendPortSend(port, channel, bytes.address, bytes.length);
+    if (error != 0) {
+      throw IpcSendException(error);
+    }
+  }
+}
+
+class IpcSendException implements Exception {
+  /// The Windows error code.
+  final int errorCode;
+
+  const IpcSendException(this.errorCode);
+
+  /// The send queue is full; the peer is behind, and a retry may succeed.
+  bool get queueFull => errorCode == 1816; // ERROR_NOT_ENOUGH_QUOTA
+
+  /// The server or client is gone, or has no peer.
+  bool get disconnected => errorCode == 6 || errorCode == 233; // ERROR_INVALID_HANDLE, ERROR_PIPE_NOT_CONNECTED
+
+  @override
+  String toString() => 'IpcSendException($errorCode)';
 }
 
 class IpcServer {
@@ -22,14 +760,109 @@ class IpcServer {
     return FlutterIpcPlatform.instance.listen(_serverId);
   }
 
-  Future<void> sendMessage(String message) async {
-    return FlutterIpcPlatform.instance.sendMessageFromServer(_serverId, message);
+  /// Completes once the message has been written to the pipe. Messages on
+  /// different [channel]s are interleaved according to [configureChannel].
+  /// A message still queued after [timeoutMs] is dropped, and the send
+  /// fails with code `SEND_TIMEOUT`.
+  ///
+  /// A message with a [key] is the new value of that key, and arrives on
+  /// the peer's `stateStream`. On a state-sync channel only what changed
+  /// since the last value of the key goes over the pipe, and on a conflating
+  /// one it replaces a value of the key that has not gone out yet.
+  Future<void> sendMessage(String message, {int channel = 0, int? timeoutMs, String? key}) async {
+    return FlutterIpcPlatform.instance.sendMessageFromServer(_serverId, message,
+        channel: channel, timeoutMs: timeoutMs, key: key);
   }
 
+  Future<void> sendHandles(List<IpcHandle> handles,
+      {String message = '', int channel = 0, int? timeoutMs}) async {
+    return FlutterIpcPlatform.instance.sendHandlesFromServer(
+        _serverId, handles.map((handle) => handle._handleId).toList(), message,
+        channel: channel, timeoutMs: timeoutMs);
+  }
+
+  /// Sends any value supported by [StandardMessageCodec] (null, bool, num,
+  /// String, typed data, List and Map) without a JSON round trip.
+  Future<void> sendValue(Object? value, {int channel = 0, int? timeoutMs}) async {
+    return FlutterIpcPlatform.instance.sendValueFromServer(_serverId, value,
+        channel: channel, timeoutMs: timeoutMs);
+  }
+
+  /// Sets how outgoing [channel] (0-65535) shares the pipe. A channel with a
+  /// higher [priority] (0-255) always goes first; channels of equal priority
+  /// get bandwidth in proportion to their [weight]. Large messages are split
+  /// into chunks, so a bulk transfer only delays an urgent message by one
+  /// chunk.
+  ///
+  /// With [stateSync], keyed messages on [channel] go out as binary diffs
+  /// against the last value sent under their key, and every
+  /// [snapshotInterval]-th (1-65535) update of a key in full, from which a
+  /// peer that missed an update recovers. The peer needs no setup.
+  ///
+  /// With [conflate], a keyed message replaces an unsent one of the same key
+  /// still queued for [channel], which then completes at once: a producer
+  /// that outpaces the peer queues at most one value per key, and the peer
+  /// reads the newest. Combined with [stateSync], a replacing update goes out
+  /// in full.
+  Future<void> configureChannel(int channel,
+      {int priority = 0,
+      int weight = 1,
+      bool stateSync = false,
+      int snapshotInterval = 32,
+      bool conflate = false}) async {
+    return FlutterIpcPlatform.instance.configureServerChannel(
+        _serverId, channel, priority: priority, weight: weight,
+        stateSync: stateSync, snapshotInterval: snapshotInterval, conflate: conflate);
+  }
+
+  Future<IpcConnectionStats> getStats() async {
+    return IpcConnectionStats._fromMap(
+        await FlutterIpcPlatform.instance.getServerStats(_serverId));
+  }
+
+  /// A port through which any isolate sends on this server's connection;
+  /// see [IpcSendPort].
+  Future<IpcSendPort> openSendPort() async {
+    return IpcSendPort(await FlutterIpcPlatform.instance.openServerSendPort(_serverId));
+  }
+
+  /// Also reports the connection's timeouts as errors, after which the
+  /// stream carries on: `CONNECT_TIMEOUT`, `HEARTBEAT_MISSED` and
+  /// `IDLE_TIMEOUT` (see [IpcConnectionOptions.heartbeatIntervalMs]).
   Stream<String> get messageStream {
     return FlutterIpcPlatform.instance.getServerMessageStream(_serverId);
   }
 
+  /// Messages from the peer that are not valid UTF-8, as raw bytes. They
+  /// are validated natively and never reach [messageStream].
+  Stream<Uint8List> get binaryMessageStream {
+    return FlutterIpcPlatform.instance.getServerBinaryMessageStream(_serverId);
+  }
+
+  /// With [IpcConnectionOptions.decodeJson], incoming messages decoded as
+  /// JSON, with the same values `jsonDecode` would give.
+  Stream<Object?> get jsonStream {
+    return FlutterIpcPlatform.instance.getServerJsonStream(_serverId);
+  }
+
+  /// Values sent by the peer with `sendValue`.
+  Stream<Object?> get valueStream {
+    return FlutterIpcPlatform.instance.getServerValueStream(_serverId);
+  }
+
+  /// Messages the peer sent with a key, restored in full.
+  Stream<IpcStateUpdate> get stateStream {
+    return FlutterIpcPlatform.instance
+        .getServerStateStream(_serverId)
+        .map(IpcStateUpdate._fromMap);
+  }
+
+  Stream<IpcHandleMessage> get handleMessageStream {
+    return FlutterIpcPlatform.instance
+        .getServerHandleMessageStream(_serverId)
+        .map(IpcHandleMessage._fromMap);
+  }
+
   Future<void> close() async {
     return FlutterIpcPlatform.instance.closeServer(_serverId);
   }
@@ -40,14 +873,109 @@ class IpcClient {
 
   IpcClient._(this._clientId);
 
-  Future<void> sendMessage(String message) async {
-    return FlutterIpcPlatform.instance.sendMessageFromClient(_clientId, message);
+  /// Completes once the message has been written to the pipe. Messages on
+  /// different [channel]s are interleaved according to [configureChannel].
+  /// A message still queued after [timeoutMs] is dropped, and the send
+  /// fails with code `SEND_TIMEOUT`.
+  ///
+  /// A message with a [key] is the new value of that key, and arrives on
+  /// the peer's `stateStream`. On a state-sync channel only what changed
+  /// since the last value of the key goes over the pipe, and on a conflating
+  /// one it replaces a value of the key that has not gone out yet.
+  Future<void> sendMessage(String message, {int channel = 0, int? timeoutMs, String? key}) async {
+    return FlutterIpcPlatform.instance.sendMessageFromClient(_clientId, message,
+        channel: channel, timeoutMs: timeoutMs, key: key);
+  }
+
+  Future<void> sendHandles(List<IpcHandle> handles,
+      {String message = '', int channel = 0, int? timeoutMs}) async {
+    return FlutterIpcPlatform.instance.sendHandlesFromClient(
+        _clientId, handles.map((handle) => handle._handleId).toList(), message,
+        channel: channel, timeoutMs: timeoutMs);
+  }
+
+  /// Sends any value supported by [StandardMessageCodec] (null, bool, num,
+  /// String, typed data, List and Map) without a JSON round trip.
+  Future<void> sendValue(Object? value, {int channel = 0, int? timeoutMs}) async {
+    return FlutterIpcPlatform.instance.sendValueFromClient(_clientId, value,
+        channel: channel, timeoutMs: timeoutMs);
+  }
+
+  /// Sets how outgoing [channel] (0-65535) shares the pipe. A channel with a
+  /// higher [priority] (0-255) always goes first; channels of equal priority
+  /// get bandwidth in proportion to their [weight]. Large messages are split
+  /// into chunks, so a bulk transfer only delays an urgent message by one
+  /// chunk.
+  ///
+  /// With [stateSync], keyed messages on [channel] go out as binary diffs
+  /// against the last value sent under their key, and every
+  /// [snapshotInterval]-th (1-65535) update of a key in full, from which a
+  /// peer that missed an update recovers. The peer needs no setup.
+  ///
+  /// With [conflate], a keyed message replaces an unsent one of the same key
+  /// still queued for [channel], which then completes at once: a producer
+  /// that outpaces the peer queues at most one value per key, and the peer
+  /// reads the newest. Combined with [stateSync], a replacing update goes out
+  /// in full.
+  Future<void> configureChannel(int channel,
+      {int priority = 0,
+      int weight = 1,
+      bool stateSync = false,
+      int snapshotInterval = 32,
+      bool conflate = false}) async {
+    return FlutterIpcPlatform.instance.configureClientChannel(
+        _clientId, channel, priority: priority, weight: weight,
+        stateSync: stateSync, snapshotInterval: snapshotInterval, conflate: conflate);
+  }
+
+  Future<IpcConnectionStats> getStats() async {
+    return IpcConnectionStats._fromMap(
+        await FlutterIpcPlatform.instance.getClientStats(_clientId));
   }
 
+  /// A port through which any isolate sends on this client's connection;
+  /// see [IpcSendPort].
+  Future<IpcSendPort> openSendPort() async {
+    return IpcSendPort(await FlutterIpcPlatform.instance.openClientSendPort(_clientId));
+  }
+
+  /// Also reports the connection's timeouts as errors, after which the
+  /// stream carries on: `CONNECT_TIMEOUT`, `HEARTBEAT_MISSED` and
+  /// `IDLE_TIMEOUT` (see [IpcConnectionOptions.heartbeatIntervalMs]).
   Stream<String> get messageStream {
     return FlutterIpcPlatform.instance.getClientMessageStream(_clientId);
   }
 
+  /// Messages from the peer that are not valid UTF-8, as raw bytes. They
+  /// are validated natively and never reach [messageStream].
+  Stream<Uint8List> get binaryMessageStream {
+    return FlutterIpcPlatform.instance.getClientBinaryMessageStream(_clientId);
+  }
+
+  /// With [IpcConnectionOptions.decodeJson], incoming messages decoded as
+  /// JSON, with the same values `jsonDecode` would give.
+  Stream<Object?> get jsonStream {
+    return FlutterIpcPlatform.instance.getClientJsonStream(_clientId);
+  }
+
+  /// Values sent by the peer with `sendValue`.
+  Stream<Object?> get valueStream {
+    return FlutterIpcPlatform.instance.getClientValueStream(_clientId);
+  }
+
+  /// Messages the peer sent with a key, restored in full.
+  Stream<IpcStateUpdate> get stateStream {
+    return FlutterIpcPlatform.instance
+        .getClientStateStream(_clientId)
+        .map(IpcStateUpdate._fromMap);
+  }
+
+  Stream<IpcHandleMessage> get handleMessageStream {
+    return FlutterIpcPlatform.instance
+        .getClientHandleMessageStream(_clientId)
+        .map(IpcHandleMessage._fromMap);
+  }
+
   Future<void> disconnect() async {
     return FlutterIpcPlatform.instance.disconnect(_clientId);
   }
@@ -1,3 +1,5 @@
+import 'dart:async';
+
 import 'package:flutter/foundation.dart';
 import 'package:flutter/services.dart';
 
@@ -12,18 +14,31 @@ class MethodChannelFlutterIpc extends FlutterIpcPlatform {
   /// Event channels for message streams
   final Map<String, EventChannel> _eventChannels = {};
 
+  /// One shared stream per event channel, so every event is acknowledged
+  /// once however many listeners it has.
+  final Map<String, Stream<Object?>> _streams = {};
+
+  /// Events handed to listeners but not yet acknowledged to the native side.
+  final Map<String, int> _pendingAcks = {};
+  bool _ackFlushScheduled = false;
+
   @override
-  Future<String> createServer(String pipeName) async {
+  Future<String> createServer(String pipeName, {int connections = 1, Map<String, Object?>? options}) async {
     final serverId = await methodChannel.invokeMethod<String>('createServer', {
       'pipeName': pipeName,
+      'connections': connections,
+      'options': options,
     });
     return serverId!;
   }
 
   @override
-  Future<String> connect(String pipeName) async {
+  Future<String> connect(String pipeName, {bool resilient = false, int connections = 1, Map<String, Object?>? options}) async {
     final clientId = await methodChannel.invokeMethod<String>('connect', {
       'pipeName': pipeName,
+      'resilient': resilient,
+      'connections': connections,
+      'options': options,
     });
     return clientId!;
   }
@@ -36,31 +51,35 @@ class MethodChannelFlutterIpc extends FlutterIpcPlatform {
   }
 
   @override
-  Future<void> sendMessageFromServer(String serverId, String message) async {
+  Future<void> sendMessageFromServer(String serverId, String message, {int channel = 0, int? timeoutMs, String? key}) async {
     return methodChannel.invokeMethod<void>('sendMessageFromServer', {
       'serverId': serverId,
       'message': message,
+      'channel': channel,
+      if (timeoutMs != null) 'timeoutMs': timeoutMs,
+      if (key != null) 'key': key,
     });
   }
 
   @override
-  Future<void> sendMessageFromClient(String clientId, String message) async {
+  Future<void> sendMessageFromClient(String clientId, String message, {int channel = 0, int? timeoutMs, String? key}) async {
     return methodChannel.invokeMethod<void>('sendMessageFromClient', {
       'clientId': clientId,
       'message': message,
+      'channel': channel,
+      if (timeoutMs != null) 'timeoutMs': timeoutMs,
+      if (key != null) 'key': key,
     });
   }
 
   @override
   Stream<String> getServerMessageStream(String serverId) {
-    final eventChannel = _getOrCreateEventChannel('server_$serverId');
-    return eventChannel.receiveBroadcastStream().cast<String>();
+    return _receiveStream('server_$serverId').cast<String>();
   }
 
   @override
   Stream<String> getClientMessageStream(String clientId) {
-    final eventChannel = _getOrCreateEventChannel('client_$clientId');
-    return eventChannel.receiveBroadcastStream().cast<String>();
+    return _receiveStream('client_$clientId').cast<String>();
   }
 
   @override
@@ -77,10 +96,356 @@ class MethodChannelFlutterIpc extends FlutterIpcPlatform {
     });
   }
 
+  @override
+  Future<String> createSharedMemory(int size) async {
+    final handleId = await methodChannel.invokeMethod<String>('createSharedMemory', {
+      'size': size,
+    });
+    return handleId!;
+  }
+
+  @override
+  Future<Map<Object?, Object?>> openFile(String path) async {
+    final handleInfo = await methodChannel.invokeMethod<Map<Object?, Object?>>('openFile', {
+      'path': path,
+    });
+    return handleInfo!;
+  }
+
+  @override
+  Future<Uint8List> readHandle(String handleId, {int offset = 0, int? length}) async {
+    final data = await methodChannel.invokeMethod<Uint8List>('readHandle', {
+      'handleId': handleId,
+      'offset': offset,
+      if (length != null) 'length': length,
+    });
+    return data!;
+  }
+
+  @override
+  Future<void> writeHandle(String handleId, Uint8List data, {int offset = 0}) async {
+    return methodChannel.invokeMethod<void>('writeHandle', {
+      'handleId': handleId,
+      'offset': offset,
+      'data': data,
+    });
+  }
+
+  @override
+  Future<void> closeHandle(String handleId) async {
+    return methodChannel.invokeMethod<void>('closeHandle', {
+      'handleId': handleId,
+    });
+  }
+
+  @override
+  Future<void> sendHandlesFromServer(String serverId, List<String> handleIds, String message, {int channel = 0, int? timeoutMs}) async {
+    return methodChannel.invokeMethod<void>('sendHandlesFromServer', {
+      'serverId': serverId,
+      'handleIds': handleIds,
+      'message': message,
+      'channel': channel,
+      if (timeoutMs != null) 'timeoutMs': timeoutMs,
+    });
+  }
+
+  @override
+  Future<void> sendHandlesFromClient(String clientId, List<String> handleIds, String message, {int channel = 0, int? timeoutMs}) async {
+    return methodChannel.invokeMethod<void>('sendHandlesFromClient', {
+      'clientId': clientId,
+      'handleIds': handleIds,
+      'message': message,
+      'channel': channel,
+      if (timeoutMs != null) 'timeoutMs': timeoutMs,
+    });
+  }
+
+  @override
+  Stream<Map<Object?, Object?>> getServerHandleMessageStream(String serverId) {
+    return _receiveStream('server_${serverId}_handles').cast<Map<Object?, Object?>>();
+  }
+
+  @override
+  Stream<Map<Object?, Object?>> getClientHandleMessageStream(String clientId) {
+    return _receiveStream('client_${clientId}_handles').cast<Map<Object?, Object?>>();
+  }
+
+  @override
+  Future<void> sendValueFromServer(String serverId, Object? value, {int channel = 0, int? timeoutMs}) async {
+    return methodChannel.invokeMethod<void>('sendValueFromServer', {
+      'serverId': serverId,
+      'value': value,
+      'channel': channel,
+      if (timeoutMs != null) 'timeoutMs': timeoutMs,
+    });
+  }
+
+  @override
+  Future<void> sendValueFromClient(String clientId, Object? value, {int channel = 0, int? timeoutMs}) async {
+    return methodChannel.invokeMethod<void>('sendValueFromClient', {
+      'clientId': clientId,
+      'value': value,
+      'channel': channel,
+      if (timeoutMs != null) 'timeoutMs': timeoutMs,
+    });
+  }
+
+  @override
+  Stream<Object?> getServerValueStream(String serverId) {
+    return _receiveStream('server_${serverId}_values');
+  }
+
+  @override
+  Stream<Object?> getClientValueStream(String clientId) {
+    return _receiveStream('client_${clientId}_values');
+  }
+
+  @override
+  Stream<Uint8List> getServerBinaryMessageStream(String serverId) {
+    return _receiveStream('server_${serverId}_binary').cast<Uint8List>();
+  }
+
+  @override
+  Stream<Uint8List> getClientBinaryMessageStream(String clientId) {
+    return _receiveStream('client_${clientId}_binary').cast<Uint8List>();
+  }
+
+  @override
+  Stream<Object?> getServerJsonStream(String serverId) {
+    return _receiveStream('server_${serverId}_json');
+  }
+
+  @override
+  Stream<Object?> getClientJsonStream(String clientId) {
+    return _receiveStream('client_${clientId}_json');
+  }
+
+  @override
+  Stream<Map<Object?, Object?>> getServerStateStream(String serverId) {
+    return _receiveStream('server_${serverId}_state').cast<Map<Object?, Object?>>();
+  }
+
+  @override
+  Stream<Map<Object?, Object?>> getClientStateStream(String clientId) {
+    return _receiveStream('client_${clientId}_state').cast<Map<Object?, Object?>>();
+  }
+
+  @override
+  Future<Map<Object?, Object?>> getServerStats(String serverId) async {
+    final stats = await methodChannel.invokeMethod<Map<Object?, Object?>>('getStats', {
+      'serverId': serverId,
+    });
+    return stats!;
+  }
+
+  @override
+  Future<Map<Object?, Object?>> getClientStats(String clientId) async {
+    final stats = await methodChannel.invokeMethod<Map<Object?, Object?>>('getStats', {
+      'clientId': clientId,
+    });
+    return stats!;
+  }
+
+  @override
+  Future<int> openServerSendPort(String serverId) async {
+    final port = await methodChannel.invokeMethod<int>('openSendPort', {
+      'serverId': serverId,
+    });
+    return port!;
+  }
+
+  @override
+  Future<int> openClientSendPort(String clientId) async {
+    final port = await methodChannel.invokeMethod<int>('openSendPort', {
+      'clientId': clientId,
+    });
+    return port!;
+  }
+
+  /// Forwards the events of [channelName] and acknowledges each one after
+  /// its listeners have run. The native side only grants the peer more
+  /// flow-control credit for acknowledged events, so a slow listener slows
+  /// down the sender instead of piling up events.
+  Stream<Object?> _receiveStream(String channelName) {
+    return _streams.putIfAbsent(channelName, () {
+      final source = _getOrCreateEventChannel(channelName).receiveBroadcastStream();
+      StreamSubscription<Object?>? subscription;
+      late final StreamController<Object?> controller;
+      controller = StreamController<Object?>.broadcast(
+        sync: true,
+        onListen: () {
+          subscription = source.listen((event) {
+            controller.add(event);
+            _acknowledge(channelName);
+          }, onError: (Object error, StackTrace stackTrace) {
+            controller.addError(error, stackTrace);
+            _acknowledge(channelName);
+          });
+        },
+        onCancel: () {
+          subscription?.cancel();
+          subscription = null;
+        },
+      );
+      return controller.stream;
+    });
+  }
+
+  void _acknowledge(String channelName) {
+    _pendingAcks.update(channelName, (count) => count + 1, ifAbsent: () => 1);
+    if (!_ackFlushScheduled) {
+      _ackFlushScheduled = true;
+      scheduleMicrotask(_flushAcks);
+    }
+  }
+
+  void _flushAcks() {
+    _ackFlushScheduled = false;
+    final acks = Map.of(_pendingAcks);
+    _pendingAcks.clear();
+    acks.forEach((channelName, count) {
+      methodChannel.invokeMethod<void>('acknowledge', {
+        'stream': channelName,
+        'count': count,
+      });
+    });
+  }
+
   EventChannel _getOrCreateEventChannel(String channelName) {
     return _eventChannels.putIfAbsent(
       channelName,
       () => EventChannel('flutter_ipc_stream_$channelName'),
     );
   }
+
+  @override
+  Future<void> configureServerChannel(String serverId, int channel,
+      {int priority = 0,
+      int weight = 1,
+      bool stateSync = false,
+      int snapshotInterval = 32,
+      bool conflate = false}) async {
+    return methodChannel.invokeMethod<void>('configureChannel', {
+      'serverId': serverId,
+      'channel': channel,
+      'priority': priority,
+      'weight': weight,
+      'stateSync': stateSync,
+      'snapshotInterval': snapshotInterval,
+      'conflate': conflate,
+    });
+  }
+
+  @override
+  Future<void> configureClientChannel(String clientId, int channel,
+      {int priority = 0,
+      int weight = 1,
+      bool stateSync = false,
+      int snapshotInterval = 32,
+      bool conflate = false}) async {
+    return methodChannel.invokeMethod<void>('configureChannel', {
+      'clientId': clientId,
+      'channel': channel,
+      'priority': priority,
+      'weight': weight,
+      'stateSync': stateSync,
+      'snapshotInterval': snapshotInterval,
+      'conflate': conflate,
+    });
+  }
+
+  @override
+  Future<String> createBroker() async {
+    final brokerId = await methodChannel.invokeMethod<String>('createBroker');
+    return brokerId!;
+  }
+
+  @override
+  Future<void> joinBroker(String brokerId, String serverId) async {
+    return methodChannel.invokeMethod<void>('joinBroker', {
+      'brokerId': brokerId,
+      'serverId': serverId,
+    });
+  }
+
+  @override
+  Future<void> leaveBroker(String serverId) async {
+    return methodChannel.invokeMethod<void>('leaveBroker', {
+      'serverId': serverId,
+    });
+  }
+
+  @override
+  Future<void> setBrokerRoute(String brokerId, int channel, List<String> serverIds) async {
+    return methodChannel.invokeMethod<void>('setBrokerRoute', {
+      'brokerId': brokerId,
+      'channel': channel,
+      'serverIds': serverIds,
+    });
+  }
+
+  @override
+  Future<Map<Object?, Object?>> getBrokerStats(String brokerId) async {
+    final stats = await methodChannel.invokeMethod<Map<Object?, Object?>>('getBrokerStats', {
+      'brokerId': brokerId,
+    });
+    return stats!;
+  }
+
+  @override
+  Future<void> closeBroker(String brokerId) async {
+    return methodChannel.invokeMethod<void>('closeBroker', {
+      'brokerId': brokerId,
+    });
+  }
+
+  @override
+  Future<void> setMemoryBudget(int limitBytes, String policy) async {
+    return methodChannel.invokeMethod<void>('setMemoryBudget', {
+      'limitBytes': limitBytes,
+      'policy': policy,
+    });
+  }
+
+  @override
+  Future<Map<Object?, Object?>> getMemoryStats() async {
+    final stats = await methodChannel.invokeMethod<Map<Object?, Object?>>('getMemoryStats');
+    return stats!;
+  }
+
+  @override
+  Future<Map<Object?, Object?>?> lookupServer(String pipeName) async {
+    return methodChannel.invokeMethod<Map<Object?, Object?>>('lookupServer', {
+      'pipeName': pipeName,
+    });
+  }
+
+  @override
+  Future<Map<Object?, Object?>?> waitForServer(String pipeName, int timeoutMs) async {
+    return methodChannel.invokeMethod<Map<Object?, Object?>>('waitForServer', {
+      'pipeName': pipeName,
+      'timeoutMs': timeoutMs,
+    });
+  }
+
+  @override
+  Future<List<Object?>> listServers() async {
+    final servers = await methodChannel.invokeMethod<List<Object?>>('listServers');
+    return servers!;
+  }
+
+  @override
+  Future<void> startCapture(String path, int capacityBytes, int maxPayloadBytes) async {
+    return methodChannel.invokeMethod<void>('startCapture', {
+      'path': path,
+      'capacityBytes': capacityBytes,
+      'maxPayloadBytes': maxPayloadBytes,
+    });
+  }
+
+  @override
+  Future<Map<Object?, Object?>> stopCapture() async {
+    final stats = await methodChannel.invokeMethod<Map<Object?, Object?>>('stopCapture');
+    return stats!;
+  }
 }
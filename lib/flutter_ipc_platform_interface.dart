@@ -1,3 +1,5 @@
+import 'dart:typed_data';
+
 import 'package:plugin_platform_interface/plugin_platform_interface.dart';
 
 import 'flutter_ipc_method_channel.dart';
@@ -23,11 +25,11 @@ abstract class FlutterIpcPlatform extends PlatformInterface {
     _instance = instance;
   }
 
-  Future<String> createServer(String pipeName) {
+  Future<String> createServer(String pipeName, {int connections = 1, Map<String, Object?>? options}) {
     throw UnimplementedError('createServer() has not been implemented.');
   }
 
-  Future<String> connect(String pipeName) {
+  Future<String> connect(String pipeName, {bool resilient = false, int connections = 1, Map<String, Object?>? options}) {
     throw UnimplementedError('connect() has not been implemented.');
   }
 
@@ -35,11 +37,11 @@ abstract class FlutterIpcPlatform extends PlatformInterface {
     throw UnimplementedError('listen() has not been implemented.');
   }
 
-  Future<void> sendMessageFromServer(String serverId, String message) {
+  Future<void> sendMessageFromServer(String serverId, String message, {int channel = 0, int? timeoutMs, String? key}) {
     throw UnimplementedError('sendMessageFromServer() has not been implemented.');
   }
 
-  Future<void> sendMessageFromClient(String clientId, String message) {
+  Future<void> sendMessageFromClient(String clientId, String message, {int channel = 0, int? timeoutMs, String? key}) {
     throw UnimplementedError('sendMessageFromClient() has not been implemented.');
   }
 
@@ -58,4 +60,166 @@ abstract class FlutterIpcPlatform extends PlatformInterface {
   Future<void> disconnect(String clientId) {
     throw UnimplementedError('disconnect() has not been implemented.');
   }
+
+  Future<String> createSharedMemory(int size) {
+    throw UnimplementedError('createSharedMemory() has not been implemented.');
+  }
+
+  Future<Map<Object?, Object?>> openFile(String path) {
+    throw UnimplementedError('openFile() has not been implemented.');
+  }
+
+  Future<Uint8List> readHandle(String handleId, {int offset = 0, int? length}) {
+    throw UnimplementedError('readHandle() has not been implemented.');
+  }
+
+  Future<void> writeHandle(String handleId, Uint8List data, {int offset = 0}) {
+    throw UnimplementedError('writeHandle() has not been implemented.');
+  }
+
+  Future<void> closeHandle(String handleId) {
+    throw UnimplementedError('closeHandle() has not been implemented.');
+  }
+
+  Future<void> sendHandlesFromServer(String serverId, List<String> handleIds, String message, {int channel = 0, int? timeoutMs}) {
+    throw UnimplementedError('sendHandlesFromServer() has not been implemented.');
+  }
+
+  Future<void> sendHandlesFromClient(String clientId, List<String> handleIds, String message, {int channel = 0, int? timeoutMs}) {
+    throw UnimplementedError('sendHandlesFromClient() has not been implemented.');
+  }
+
+  Stream<Map<Object?, Object?>> getServerHandleMessageStream(String serverId) {
+    throw UnimplementedError('getServerHandleMessageStream() has not been implemented.');
+  }
+
+  Stream<Map<Object?, Object?>> getClientHandleMessageStream(String clientId) {
+    throw UnimplementedError('getClientHandleMessageStream() has not been implemented.');
+  }
+
+  Future<void> sendValueFromServer(String serverId, Object? value, {int channel = 0, int? timeoutMs}) {
+    throw UnimplementedError('sendValueFromServer() has not been implemented.');
+  }
+
+  Future<void> sendValueFromClient(String clientId, Object? value, {int channel = 0, int? timeoutMs}) {
+    throw UnimplementedError('sendValueFromClient() has not been implemented.');
+  }
+
+  Stream<Object?> getServerValueStream(String serverId) {
+    throw UnimplementedError('getServerValueStream() has not been implemented.');
+  }
+
+  Stream<Object?> getClientValueStream(String clientId) {
+    throw UnimplementedError('getClientValueStream() has not been implemented.');
+  }
+
+  Stream<Uint8List> getServerBinaryMessageStream(String serverId) {
+    throw UnimplementedError('getServerBinaryMessageStream() has not been implemented.');
+  }
+
+  Stream<Uint8List> getClientBinaryMessageStream(String clientId) {
+    throw UnimplementedError('getClientBinaryMessageStream() has not been implemented.');
+  }
+
+  Stream<Object?> getServerJsonStream(String serverId) {
+    throw UnimplementedError('getServerJsonStream() has not been implemented.');
+  }
+
+  Stream<Object?> getClientJsonStream(String clientId) {
+    throw UnimplementedError('getClientJsonStream() has not been implemented.');
+  }
+
+  Stream<Map<Object?, Object?>> getServerStateStream(String serverId) {
+    throw UnimplementedError('getServerStateStream() has not been implemented.');
+  }
+
+  Stream<Map<Object?, Object?>> getClientStateStream(String clientId) {
+    throw UnimplementedError('getClientStateStream() has not been implemented.');
+  }
+
+  Future<Map<Object?, Object?>> getServerStats(String serverId) {
+    throw UnimplementedError('getServerStats() has not been implemented.');
+  }
+
+  Future<Map<Object?, Object?>> getClientStats(String clientId) {
+    throw UnimplementedError('getClientStats() has not been implemented.');
+  }
+
+  Future<int> openServerSendPort(String serverId) {
+    throw UnimplementedError('openServerSendPort() has not been implemented.');
+  }
+
+  Future<int> openClientSendPort(String clientId) {
+    throw UnimplementedError('openClientSendPort() has not been implemented.');
+  }
+
+  Future<void> configureServerChannel(String serverId, int channel,
+      {int priority = 0,
+      int weight = 1,
+      bool stateSync = false,
+      int snapshotInterval = 32,
+      bool conflate = false}) {
+    throw UnimplementedError('configureServerChannel() has not been implemented.');
+  }
+
+  Future<void> configureClientChannel(String clientId, int channel,
+      {int priority = 0,
+      int weight = 1,
+      bool stateSync = false,
+      int snapshotInterval = 32,
+      bool conflate = false}) {
+    throw UnimplementedError('configureClientChannel() has not been implemented.');
+  }
+
+  Future<String> createBroker() {
+    throw UnimplementedError('createBroker() has not been implemented.');
+  }
+
+  Future<void> joinBroker(String brokerId, String serverId) {
+    throw UnimplementedError('joinBroker() has not been implemented.');
+  }
+
+  Future<void> leaveBroker(String serverId) {
+    throw UnimplementedError('leaveBroker() has not been implemented.');
+  }
+
+  Future<void> setBrokerRoute(String brokerId, int channel, List<String> serverIds) {
+    throw UnimplementedError('setBrokerRoute() has not been implemented.');
+  }
+
+  Future<Map<Object?, Object?>> getBrokerStats(String brokerId) {
+    throw UnimplementedError('getBrokerStats() has not been implemented.');
+  }
+
+  Future<void> closeBroker(String brokerId) {
+    throw UnimplementedError('closeBroker() has not been implemented.');
+  }
+
+  Future<void> setMemoryBudget(int limitBytes, String policy) {
+    throw UnimplementedError('setMemoryBudget() has not been implemented.');
+  }
+
+  Future<Map<Object?, Object?>> getMemoryStats() {
+    throw UnimplementedError('getMemoryStats() has not been implemented.');
+  }
+
+  Future<Map<Object?, Object?>?> lookupServer(String pipeName) {
+    throw UnimplementedError('lookupServer() has not been implemented.');
+  }
+
+  Future<Map<Object?, Object?>?> waitForServer(String pipeName, int timeoutMs) {
+    throw UnimplementedError('waitForServer() has not been implemented.');
+  }
+
+  Future<List<Object?>> listServers() {
+    throw UnimplementedError('listServers() has not been implemented.');
+  }
+
+  Future<void> startCapture(String path, int capacityBytes, int maxPayloadBytes) {
+    throw UnimplementedError('startCapture() has not been implemented.');
+  }
+
+  Future<Map<Object?, Object?>> stopCapture() {
+    throw UnimplementedError('stopCapture() has not been implemented.');
+  }
 }
@@ -24,6 +24,42 @@ public class FlutterIpcPlugin: NSObject, FlutterPlugin {
       result(FlutterError(code: "NOT_IMPLEMENTED", message: "closeServer not implemented yet", details: nil))
     case "disconnect":
       result(FlutterError(code: "NOT_IMPLEMENTED", message: "disconnect not implemented yet", details: nil))
+    case "createSharedMemory":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "createSharedMemory not implemented yet", details: nil))
+    case "openFile":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "openFile not implemented yet", details: nil))
+    case "readHandle":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "readHandle not implemented yet", details: nil))
+    case "writeHandle":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "writeHandle not implemented yet", details: nil))
+    case "closeHandle":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "closeHandle not implemented yet", details: nil))
+    case "sendHandlesFromServer":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "sendHandlesFromServer not implemented yet", details: nil))
+    case "sendHandlesFromClient":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "sendHandlesFromClient not implemented yet", details: nil))
+    case "sendValueFromServer":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "sendValueFromServer not implemented yet", details: nil))
+    case "sendValueFromClient":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "sendValueFromClient not implemented yet", details: nil))
+    case "configureChannel":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "configureChannel not implemented yet", details: nil))
+    case "acknowledge":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "acknowledge not implemented yet", details: nil))
+    case "getStats":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "getStats not implemented yet", details: nil))
+    case "createBroker":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "createBroker not implemented yet", details: nil))
+    case "joinBroker":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "joinBroker not implemented yet", details: nil))
+    case "leaveBroker":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "leaveBroker not implemented yet", details: nil))
+    case "setBrokerRoute":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "setBrokerRoute not implemented yet", details: nil))
+    case "getBrokerStats":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "getBrokerStats not implemented yet", details: nil))
+    case "closeBroker":
+      result(FlutterError(code: "NOT_IMPLEMENTED", message: "closeBroker not implemented yet", details: nil))
     default:
       result(FlutterMethodNotImplemented)
     }
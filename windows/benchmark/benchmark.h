@@ -0,0 +1,45 @@
+#ifndef FLUTTER_PLUGIN_BENCHMARK_BENCHMARK_H_
+#define FLUTTER_PLUGIN_BENCHMARK_BENCHMARK_H_
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace flutter_ipc {
+namespace benchmark {
+
+using Clock = std::chrono::steady_clock;
+
+// Prints one result line: the benchmark |name|, its |config| and the rate
+// of |operations| over |elapsed|.
+void ReportRate(const std::string& name, const std::string& config,
+                uint64_t operations, Clock::duration elapsed);
+
+// Prints the rate of |bytes| processed over |elapsed| in GB/s.
+void ReportThroughput(const std::string& name, const std::string& config,
+                      uint64_t bytes, Clock::duration elapsed);
+
+// Prints the p50, p99, p99.9 and max of |samples|, which it sorts.
+void ReportLatency(const std::string& name, const std::string& config,
+                   std::vector<Clock::duration>* samples);
+
+// Benchmark suites, one per component.
+void RunBlobBenchmarks();
+void RunHandlerPoolBenchmarks();
+void RunIoBackendBenchmarks();
+void RunJsonBenchmarks();
+void RunLatencyBenchmarks();
+void RunPoolBenchmarks();
+void RunProducerBenchmarks();
+void RunRecordBenchmarks();
+void RunRouterBenchmarks();
+void RunShapingBenchmarks();
+void RunStateBenchmarks();
+void RunTimerBenchmarks();
+void RunUtf8Benchmarks();
+
+}  // namespace benchmark
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_BENCHMARK_BENCHMARK_H_
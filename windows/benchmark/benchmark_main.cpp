@@ -0,0 +1,86 @@
+// Micro-benchmarks of the plugin's native components. Run without
+// arguments for every suite, or name the suites to run.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "benchmark.h"
+
+namespace flutter_ipc {
+namespace benchmark {
+
+namespace {
+
+struct Suite {
+  const char* name;
+  void (*run)();
+};
+
+const Suite kSuites[] = {
+  {"blobs", RunBlobBenchmarks},
+  {"handler_pool", RunHandlerPoolBenchmarks},
+  {"io_backend", RunIoBackendBenchmarks},
+  {"json", RunJsonBenchmarks},
+  {"latency", RunLatencyBenchmarks},
+  {"pool", RunPoolBenchmarks},
+  {"producers", RunProducerBenchmarks},
+  {"records", RunRecordBenchmarks},
+  {"router", RunRouterBenchmarks},
+  {"shaping", RunShapingBenchmarks},
+  {"state", RunStateBenchmarks},
+  {"timers", RunTimerBenchmarks},
+  {"utf8", RunUtf8Benchmarks},
+};
+
+}  // namespace
+
+void ReportRate(const std::string& name, const std::string& config,
+                uint64_t operations, Clock::duration elapsed) {
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  printf("%-32s %-28s %12.0f ops/s  (%llu ops in %.1f ms)\n", name.c_str(),
+         config.c_str(), operations / seconds,
+         static_cast<unsigned long long>(operations), seconds * 1000);
+  fflush(stdout);
+}
+
+void ReportThroughput(const std::string& name, const std::string& config,
+                      uint64_t bytes, Clock::duration elapsed) {
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  printf("%-32s %-28s %12.2f GB/s   (%llu MB in %.1f ms)\n", name.c_str(),
+         config.c_str(), bytes / seconds / 1e9,
+         static_cast<unsigned long long>(bytes / 1000000), seconds * 1000);
+  fflush(stdout);
+}
+
+void ReportLatency(const std::string& name, const std::string& config,
+                   std::vector<Clock::duration>* samples) {
+  if (samples->empty()) {
+    return;
+  }
+  std::sort(samples->begin(), samples->end());
+  auto percentile = [samples](double fraction) {
+    size_t index = static_cast<size_t>(fraction * (samples->size() - 1));
+    return std::chrono::duration<double, std::micro>((*samples)[index]).count();
+  };
+  printf("%-32s %-28s p50 %8.1f us  p99 %8.1f us  p99.9 %8.1f us  max %8.1f us\n",
+         name.c_str(), config.c_str(), percentile(0.5), percentile(0.99),
+         percentile(0.999), percentile(1.0));
+  fflush(stdout);
+}
+
+}  // namespace benchmark
+}  // namespace flutter_ipc
+
+int main(int argc, char** argv) {
+  for (const auto& suite : flutter_ipc::benchmark::kSuites) {
+    bool selected = argc < 2;
+    for (int i = 1; i < argc; ++i) {
+      selected |= strcmp(argv[i], suite.name) == 0;
+    }
+    if (selected) {
+      suite.run();
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include <windows.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "completion_port.h"
+#include "flutter_ipc_plugin.h"
+
+namespace flutter_ipc {
+namespace benchmark {
+
+namespace {
+
+constexpr int kMessages = 200000;
+constexpr size_t kPayloadSize = 128;
+
+// Streams |kMessages| frames round-robin over |connections| kernel pipe
+// connections and reports the rate at which the servers receive them. With
+// the completion port, also reports the reader's system calls per message:
+// one GetQueuedCompletionStatusEx per batch and one ReadFile per read. The
+// thread backend issues at least two ReadFile calls per frame (header and
+// payload) on top of the waits.
+void RunStream(IoBackend backend, int connections) {
+  ConnectionOptions options;
+  options.io_backend = backend;
+  std::string prefix = "flutter_ipc_bench_io_" + std::to_string(GetCurrentProcessId()) + "_";
+
+  std::mutex mutex;
+  std::condition_variable done;
+  int received = 0;
+  std::vector<std::unique_ptr<NamedPipeServer>> servers;
+  std::vector<std::unique_ptr<NamedPipeClient>> clients;
+  for (int i = 0; i < connections; ++i) {
+    auto server = std::make_unique<NamedPipeServer>(prefix + std::to_string(i), options);
+    server->SetFrameHandler([&](Frame frame, FrameConsumed consumed) {
+      consumed();
+      std::lock_guard<std::mutex> lock(mutex);
+      if (++received == kMessages) {
+        done.notify_one();
+      }
+    });
+    auto client = std::make_unique<NamedPipeClient>(server->GetPipeName(), false, options);
+    if (!server->Create() || !server->WaitForConnection() || !client->Connect()) {
+      fprintf(stderr, "io_backend: cannot connect pair %d\n", i);
+      return;
+    }
+    servers.push_back(std::move(server));
+    clients.push_back(std::move(client));
+  }
+  for (const auto& server : servers) {
+    while (!server->IsConnected()) {
+      Sleep(1);
+    }
+  }
+
+  auto reader = backend == IoBackend::COMPLETION_PORT ? CompletionPortReader::Acquire() : nullptr;
+  CompletionPortStats before = reader ? reader->GetStats() : CompletionPortStats();
+  std::string payload(kPayloadSize, 'x');
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < kMessages; ++i) {
+    // A full queue just means the pipe is behind; retry.
+    while (!clients[i % connections]->SendFrame(Frame(FrameType::TEXT, payload))) {
+      Sleep(0);
+    }
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return received == kMessages; });
+  }
+  Clock::duration elapsed = Clock::now() - start;
+
+  std::string config = std::string(IoBackendName(backend)) + ", " +
+                       std::to_string(connections) + " connections";
+  ReportRate("io_backend/stream", config, kMessages, elapsed);
+  if (reader) {
+    // Client reads of credit frames are counted too.
+    CompletionPortStats after = reader->GetStats();
+    uint64_t dequeues = after.dequeues - before.dequeues;
+    uint64_t reads = after.reads - before.reads;
+    printf("%-32s %-28s %12.3f syscalls/msg  (%.1f completions/dequeue)\n",
+           "io_backend/syscalls", config.c_str(),
+           static_cast<double>(dequeues + reads) / kMessages,
+           dequeues ? static_cast<double>(after.completions - before.completions) / dequeues : 0.0);
+    fflush(stdout);
+  }
+
+  for (auto& client : clients) {
+    client->Disconnect();
+  }
+  for (auto& server : servers) {
+    server->Close();
+  }
+}
+
+}  // namespace
+
+void RunIoBackendBenchmarks() {
+  for (int connections : {16, 128, 512}) {
+    for (IoBackend backend : {IoBackend::THREADS, IoBackend::COMPLETION_PORT}) {
+      RunStream(backend, connections);
+    }
+  }
+}
+
+}  // namespace benchmark
+}  // namespace flutter_ipc
@@ -0,0 +1,80 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "json_decoder.h"
+#include "value_codec.h"
+
+namespace flutter_ipc {
+namespace benchmark {
+
+namespace {
+
+constexpr size_t kBatchBytes = 16 * 1024 * 1024;
+
+// A typical small message: an event with a few fields and a short list.
+std::string MakeEvent(int index) {
+  return "{\"type\":\"update\",\"id\":" + std::to_string(index) +
+         ",\"name\":\"sensor-" + std::to_string(index % 97) +
+         "\",\"active\":true,\"value\":" + std::to_string(index * 0.25) +
+         ",\"tags\":[\"alpha\",\"beta\",\"gamma\"],\"note\":\"line\\nbreak \\u00e9\"}";
+}
+
+// An array of |count| events, as one message.
+std::string MakeArray(int count) {
+  std::string json = "[";
+  for (int i = 0; i < count; ++i) {
+    json += (i ? "," : "") + MakeEvent(i);
+  }
+  return json + "]";
+}
+
+// Decodes |messages| over and over until |kBatchBytes| have gone through,
+// then the same again with the StandardMessageCodec encoding the platform
+// channel adds before Dart sees the value.
+void RunDecode(const std::string& kind, const std::vector<std::string>& messages) {
+  size_t bytes_per_pass = 0;
+  for (const auto& message : messages) {
+    bytes_per_pass += message.size();
+  }
+  size_t passes = kBatchBytes / bytes_per_pass + 1;
+
+  for (bool encode : {false, true}) {
+    uint64_t decoded = 0;
+    std::string error;
+    Clock::time_point start = Clock::now();
+    for (size_t pass = 0; pass < passes; ++pass) {
+      for (const auto& message : messages) {
+        flutter::EncodableValue value;
+        if (!DecodeJson(message.data(), message.size(), &value, &error)) {
+          fprintf(stderr, "json: %s\n", error.c_str());
+          return;
+        }
+        if (encode) {
+          EncodeValueFrame(value);
+        }
+        ++decoded;
+      }
+    }
+    Clock::duration elapsed = Clock::now() - start;
+    std::string config = kind + (encode ? ", decode+encode" : ", decode");
+    ReportThroughput("json/decode", config, bytes_per_pass * passes, elapsed);
+    ReportRate("json/decode", config, decoded, elapsed);
+  }
+}
+
+}  // namespace
+
+void RunJsonBenchmarks() {
+  std::vector<std::string> small;
+  for (int i = 0; i < 1000; ++i) {
+    small.push_back(MakeEvent(i));
+  }
+  RunDecode("200B events", small);
+  RunDecode("16KB arrays", {MakeArray(80)});
+  RunDecode("1MB array", {MakeArray(5000)});
+}
+
+}  // namespace benchmark
+}  // namespace flutter_ipc
@@ -0,0 +1,107 @@
+#include <windows.h>
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "flutter_ipc_plugin.h"
+
+namespace flutter_ipc {
+namespace benchmark {
+
+namespace {
+
+constexpr int kWarmup = 1000;
+constexpr int kRoundTrips = 20000;
+constexpr uint32_t kSpinMicros = 100;
+
+// Pins to a single processor if the machine has more than |index| of them.
+DWORD_PTR ProcessorMask(int index) {
+  DWORD_PTR process_mask = 0;
+  DWORD_PTR system_mask = 0;
+  GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask);
+  DWORD_PTR mask = static_cast<DWORD_PTR>(1) << index;
+  return (process_mask & mask) ? mask : 0;
+}
+
+// Bounces a frame between a client and a server that echoes it, and reports
+// the round-trip time. The client waits for each reply by polling a flag,
+// so the measurement includes the transport's wakeups only.
+void RunPingPong(bool in_process, bool low_latency, size_t payload_size) {
+  ConnectionOptions server_options;
+  ConnectionOptions client_options;
+  if (low_latency) {
+    server_options.polling.spin_us = kSpinMicros;
+    server_options.polling.affinity_mask = ProcessorMask(1);
+    server_options.polling.thread_priority = THREAD_PRIORITY_HIGHEST;
+    client_options.polling = server_options.polling;
+    client_options.polling.affinity_mask = ProcessorMask(2);
+  }
+
+  std::string pipe_name = "flutter_ipc_bench_ping_" + std::to_string(GetCurrentProcessId());
+  NamedPipeServer server(pipe_name, server_options);
+  server.SetFrameHandler([&server](Frame frame, FrameConsumed consumed) {
+    consumed();
+    server.SendFrame(std::move(frame));
+  });
+  if (!server.Create() || !server.WaitForConnection()) {
+    fprintf(stderr, "latency: cannot create server\n");
+    return;
+  }
+
+  std::atomic<int> replies(0);
+  NamedPipeClient client(pipe_name, false, client_options);
+  client.SetFrameHandler([&replies](Frame frame, FrameConsumed consumed) {
+    consumed();
+    replies.fetch_add(1, std::memory_order_release);
+  });
+  if (!(in_process ? client.ConnectInProcess() : client.Connect())) {
+    fprintf(stderr, "latency: cannot connect client\n");
+    return;
+  }
+  while (!server.IsConnected()) {
+    Sleep(1);
+  }
+
+  std::vector<Clock::duration> samples;
+  samples.reserve(kRoundTrips);
+  std::string payload(payload_size, 'x');
+  for (int i = 0; i < kWarmup + kRoundTrips; ++i) {
+    Clock::time_point sent = Clock::now();
+    if (!client.SendFrame(Frame(FrameType::TEXT, payload))) {
+      fprintf(stderr, "latency: send failed\n");
+      break;
+    }
+    while (replies.load(std::memory_order_acquire) <= i) {
+      YieldProcessor();
+    }
+    if (i >= kWarmup) {
+      samples.push_back(Clock::now() - sent);
+    }
+  }
+
+  client.Disconnect();
+  server.Close();
+  ReportLatency("latency/ping_pong",
+                std::string(in_process ? "in-process" : "kernel pipe") + ", " +
+                    (low_latency ? "spin" : "blocking") + ", " +
+                    std::to_string(payload_size) + " B",
+                &samples);
+}
+
+}  // namespace
+
+void RunLatencyBenchmarks() {
+  for (bool in_process : {true, false}) {
+    for (bool low_latency : {false, true}) {
+      for (size_t payload_size : {64, 4096}) {
+        RunPingPong(in_process, low_latency, payload_size);
+      }
+    }
+  }
+}
+
+}  // namespace benchmark
+}  // namespace flutter_ipc
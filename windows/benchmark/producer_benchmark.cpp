@@ -0,0 +1,107 @@
+#include <windows.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "flutter_ipc_plugin.h"
+
+namespace flutter_ipc {
+namespace benchmark {
+
+namespace {
+
+constexpr int kMessages = 200000;
+constexpr size_t kPayloadSize = 256;
+
+// Sends |kMessages| small frames from |producers| threads at once through
+// one client to a server, and reports the rate at which the server's frame
+// handler receives them. Every frame carries its producer and its index,
+// so that a frame that is torn, or out of order within its producer, is
+// counted.
+void RunProducers(int producers, bool in_process) {
+  ConnectionOptions options = ConnectionOptions::ForProfile(TuningProfile::THROUGHPUT);
+  std::string pipe_name = "flutter_ipc_bench_producers_" + std::to_string(GetCurrentProcessId());
+
+  std::mutex mutex;
+  std::condition_variable done;
+  int received = 0;
+  int corrupted = 0;
+  std::vector<uint32_t> next_index(producers, 0);
+  NamedPipeServer server(pipe_name, options);
+  server.SetFrameHandler([&](Frame frame, FrameConsumed consumed) {
+    uint32_t header[2] = {0, 0};
+    if (frame.payload.size() == kPayloadSize) {
+      memcpy(header, frame.payload.data(), sizeof(header));
+    }
+    consumed();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (frame.payload.size() != kPayloadSize || header[0] >= static_cast<uint32_t>(producers) ||
+        header[1] != next_index[header[0]]++) {
+      ++corrupted;
+    }
+    if (++received == kMessages) {
+      done.notify_one();
+    }
+  });
+  NamedPipeClient client(pipe_name, false, options);
+  if (!server.Create() || !server.WaitForConnection() ||
+      !(in_process ? client.ConnectInProcess() : client.Connect())) {
+    fprintf(stderr, "producers: cannot connect\n");
+    return;
+  }
+
+  Clock::time_point start = Clock::now();
+  std::vector<std::thread> threads;
+  for (int producer = 0; producer < producers; ++producer) {
+    threads.emplace_back([&client, producer, producers]() {
+      std::string payload(kPayloadSize, 'x');
+      uint32_t header[2] = {static_cast<uint32_t>(producer), 0};
+      for (int i = producer; i < kMessages; i += producers) {
+        memcpy(&payload[0], header, sizeof(header));
+        // A full queue just means the pipe is behind; retry.
+        while (!client.SendFrame(Frame(FrameType::TEXT, payload))) {
+          Sleep(0);
+        }
+        ++header[1];
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return received == kMessages; });
+  }
+  Clock::duration elapsed = Clock::now() - start;
+
+  std::string config = std::to_string(producers) + (producers == 1 ? " producer, " : " producers, ") +
+                       (in_process ? "in-process" : "kernel pipe");
+  ReportRate("producers/send", config, kMessages, elapsed);
+  if (corrupted != 0) {
+    fprintf(stderr, "producers: %d frames torn or out of order\n", corrupted);
+  }
+
+  client.Disconnect();
+  server.Close();
+}
+
+}  // namespace
+
+void RunProducerBenchmarks() {
+  for (bool in_process : {true, false}) {
+    for (int producers : {1, 2, 4, 8}) {
+      RunProducers(producers, in_process);
+    }
+  }
+}
+
+}  // namespace benchmark
+}  // namespace flutter_ipc
@@ -0,0 +1,98 @@
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "benchmark.h"
+#include "record_reader.h"
+
+namespace flutter_ipc {
+namespace benchmark {
+
+namespace {
+
+constexpr size_t kTextSize = 4 * 1024 * 1024;
+constexpr int kRepeats = 50;
+
+// |kTextSize| bytes of newline-terminated records of |record_length|.
+std::string MakeLines(size_t record_length) {
+  std::string line(record_length, 'a');
+  for (size_t i = 0; i < record_length; ++i) {
+    line[i] = static_cast<char>('a' + i % 26);
+  }
+  line += '\n';
+  std::string text;
+  while (text.size() + line.size() <= kTextSize) {
+    text += line;
+  }
+  return text;
+}
+
+size_t FindDelimiterMemchr(const char* data, size_t size, char delimiter) {
+  const void* found = memchr(data, delimiter, size);
+  return found ? static_cast<const char*>(found) - data : size;
+}
+
+// Counts the lines of |text| with each scanner.
+void RunScan(const std::string& kind, const std::string& text) {
+  struct Scanner {
+    const char* name;
+    size_t (*find)(const char*, size_t, char);
+  };
+  const Scanner scanners[] = {
+    {"scalar", FindDelimiterScalar},
+    {"memchr", FindDelimiterMemchr},
+    {DelimiterScannerName(), FindDelimiter},
+  };
+  for (const auto& scanner : scanners) {
+    size_t lines = 0;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < kRepeats; ++i) {
+      for (size_t offset = 0; offset < text.size(); ++lines) {
+        offset += scanner.find(text.data() + offset, text.size() - offset, '\n') + 1;
+      }
+    }
+    Clock::duration elapsed = Clock::now() - start;
+    ReportThroughput("records/scan", kind + ", " + scanner.name,
+                     static_cast<uint64_t>(text.size()) * kRepeats, elapsed);
+  }
+}
+
+// Feeds |text| through a RecordReader in reads of |RecordReader::kReadSize|,
+// as a pipe would deliver it.
+void RunReader(const std::string& kind, const std::string& text) {
+  RecordReader reader(1024 * 1024);
+  uint64_t records = 0;
+  size_t bytes = 0;
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < kRepeats; ++i) {
+    for (size_t offset = 0; offset < text.size();) {
+      size_t size = 0;
+      char* buffer = reader.ReadBuffer(&size);
+      size = std::min({size, RecordReader::kReadSize, text.size() - offset});
+      memcpy(buffer, text.data() + offset, size);
+      offset += size;
+      reader.Commit(size, [&](const char* data, size_t length) {
+        ++records;
+        bytes += length;
+      });
+    }
+  }
+  Clock::duration elapsed = Clock::now() - start;
+  ReportThroughput("records/read", kind, static_cast<uint64_t>(text.size()) * kRepeats, elapsed);
+  ReportRate("records/read", kind, records, elapsed);
+}
+
+}  // namespace
+
+void RunRecordBenchmarks() {
+  for (size_t record_length : {80, 1024, 64 * 1024}) {
+    std::string kind = std::to_string(record_length) + "B lines";
+    std::string text = MakeLines(record_length);
+    RunScan(kind, text);
+    RunReader(kind, text);
+  }
+}
+
+}  // namespace benchmark
+}  // namespace flutter_ipc
@@ -0,0 +1,99 @@
+#include <windows.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "flutter_ipc_plugin.h"
+#include "router.h"
+
+namespace flutter_ipc {
+namespace benchmark {
+
+namespace {
+
+constexpr int kMessages = 20000;
+constexpr uint16_t kRoutedChannel = 1;
+
+// Sends |kMessages| frames from one client through a broker to another, one
+// at a time, and reports the time from send to delivery.
+void RunForward(bool in_process, size_t payload_size) {
+  std::string suffix = std::to_string(GetCurrentProcessId());
+  NamedPipeServer source_server("flutter_ipc_bench_source_" + suffix);
+  NamedPipeServer destination_server("flutter_ipc_bench_destination_" + suffix);
+  if (!source_server.Create() || !destination_server.Create() ||
+      !source_server.WaitForConnection() || !destination_server.WaitForConnection()) {
+    fprintf(stderr, "router: cannot create servers\n");
+    return;
+  }
+  auto router = std::make_shared<FrameRouter>();
+  source_server.SetRouter(router, "source");
+  destination_server.SetRouter(router, "destination");
+  router->SetRoute(kRoutedChannel, {"destination"});
+
+  std::mutex mutex;
+  std::condition_variable arrived;
+  std::vector<Clock::duration> samples;
+  samples.reserve(kMessages);
+
+  NamedPipeClient sender(source_server.GetPipeName());
+  NamedPipeClient receiver(destination_server.GetPipeName());
+  receiver.SetFrameHandler([&](Frame frame, FrameConsumed consumed) {
+    Clock::time_point sent;
+    memcpy(&sent, frame.payload.data(), sizeof(sent));
+    Clock::duration latency = Clock::now() - sent;
+    consumed();
+    std::lock_guard<std::mutex> lock(mutex);
+    samples.push_back(latency);
+    arrived.notify_one();
+  });
+  bool connected = in_process
+      ? sender.ConnectInProcess() && receiver.ConnectInProcess()
+      : sender.Connect() && receiver.Connect();
+  if (!connected) {
+    fprintf(stderr, "router: cannot connect clients\n");
+    return;
+  }
+  while (!source_server.IsConnected() || !destination_server.IsConnected()) {
+    Sleep(1);
+  }
+
+  std::string payload(std::max(payload_size, sizeof(Clock::time_point)), 'x');
+  for (int i = 0; i < kMessages; ++i) {
+    Frame frame(FrameType::TEXT, payload);
+    frame.channel = kRoutedChannel;
+    Clock::time_point now = Clock::now();
+    memcpy(&frame.payload[0], &now, sizeof(now));
+    sender.SendFrame(std::move(frame));
+    std::unique_lock<std::mutex> lock(mutex);
+    arrived.wait(lock, [&] { return samples.size() > static_cast<size_t>(i); });
+  }
+
+  sender.Disconnect();
+  receiver.Disconnect();
+  source_server.Close();
+  destination_server.Close();
+  ReportLatency("router/forward",
+                std::string(in_process ? "in-process" : "kernel pipe") + ", " +
+                    std::to_string(payload_size) + " B",
+                &samples);
+}
+
+}  // namespace
+
+void RunRouterBenchmarks() {
+  for (bool in_process : {true, false}) {
+    for (size_t payload_size : {64, 4096, 65536}) {
+      RunForward(in_process, payload_size);
+    }
+  }
+}
+
+}  // namespace benchmark
+}  // namespace flutter_ipc
@@ -0,0 +1,102 @@
+#include <windows.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#include "benchmark.h"
+#include "flutter_ipc_plugin.h"
+
+namespace flutter_ipc {
+namespace benchmark {
+
+namespace {
+
+constexpr int kMessages = 2000;
+constexpr size_t kPayloadSize = 4096;
+
+struct Condition {
+  const char* name = "";
+  ShapingOptions shaping;
+};
+
+// Streams |kMessages| frames from a client to a server under |shaping|,
+// both ways, and reports the rate at which the server's frame handler
+// receives them and how long the client waited for credit.
+void RunStream(bool in_process, const Condition& condition) {
+  ConnectionOptions options;
+  options.shaping = condition.shaping;
+  std::string pipe_name = "flutter_ipc_bench_shaping_" + std::to_string(GetCurrentProcessId());
+
+  std::mutex mutex;
+  std::condition_variable done;
+  int received = 0;
+  NamedPipeServer server(pipe_name, options);
+  server.SetFrameHandler([&](Frame frame, FrameConsumed consumed) {
+    consumed();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (++received == kMessages) {
+      done.notify_one();
+    }
+  });
+  options.shaping.seed += 1;
+  NamedPipeClient client(pipe_name, false, options);
+  if (!server.Create() || !server.WaitForConnection() ||
+      !(in_process ? client.ConnectInProcess() : client.Connect())) {
+    fprintf(stderr, "shaping: cannot connect\n");
+    return;
+  }
+
+  std::string payload(kPayloadSize, 'x');
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < kMessages; ++i) {
+    // A full queue just means the pipe is behind; retry.
+    while (!client.SendFrame(Frame(FrameType::TEXT, payload))) {
+      Sleep(0);
+    }
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return received == kMessages; });
+  }
+  Clock::duration elapsed = Clock::now() - start;
+
+  FlowStats flow;
+  client.GetFlowStats(&flow);
+  ShapingStats shaped = client.GetShapingStats();
+  std::string config = std::string(in_process ? "in-process, " : "kernel pipe, ") + condition.name;
+  ReportRate("shaping/stream", config, kMessages, elapsed);
+  printf("shaping/stream: %llu credit stalls for %.1f ms, writes held %.1f ms, %llu cut short\n",
+         static_cast<unsigned long long>(flow.stalls), flow.stall_time.count() / 1000.0,
+         shaped.write_delay.count() / 1000.0, static_cast<unsigned long long>(shaped.short_writes));
+
+  client.Disconnect();
+  server.Close();
+}
+
+}  // namespace
+
+void RunShapingBenchmarks() {
+  Condition conditions[5];
+  conditions[0].name = "unshaped";
+  conditions[1].name = "20 MB/s";
+  conditions[1].shaping.bandwidth = 20 * 1000 * 1000;
+  conditions[2].name = "jitter 50 us";
+  conditions[2].shaping.jitter_us = 50;
+  conditions[3].name = "short writes";
+  conditions[3].shaping.short_write_rate = 0.2;
+  conditions[3].shaping.short_write_pause_us = 100;
+  conditions[4].name = "read stalls";
+  conditions[4].shaping.read_stall_rate = 0.01;
+  conditions[4].shaping.read_stall_us = 2000;
+  for (bool in_process : {true, false}) {
+    for (const Condition& condition : conditions) {
+      RunStream(in_process, condition);
+    }
+  }
+}
+
+}  // namespace benchmark
+}  // namespace flutter_ipc
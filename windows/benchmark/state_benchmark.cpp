@@ -0,0 +1,97 @@
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "state_sync.h"
+
+namespace flutter_ipc {
+namespace benchmark {
+
+namespace {
+
+constexpr size_t kUpdateBytes = 64 * 1024 * 1024;
+constexpr uint32_t kSnapshotInterval = 32;
+
+// A JSON object of about |size| bytes of numeric fields.
+std::vector<std::string> MakeFields(size_t size) {
+  std::vector<std::string> fields;
+  size_t bytes = 0;
+  for (int i = 0; bytes < size; ++i) {
+    fields.push_back("\"field" + std::to_string(i) + "\": " + std::to_string(i * 7919));
+    bytes += fields.back().size() + 2;
+  }
+  return fields;
+}
+
+std::string Render(const std::vector<std::string>& fields) {
+  std::string document = "{";
+  for (const std::string& field : fields) {
+    document += field;
+    document += ", ";
+  }
+  document += "}";
+  return document;
+}
+
+// Sends updates of a document of |size| bytes, each changing |changes|
+// fields, through an encoder and decoder. Reports updates per second and
+// the bytes that went out against the bytes sending every value in full
+// would have taken.
+void RunUpdates(size_t size, int changes) {
+  std::vector<std::string> fields = MakeFields(size);
+  int updates = static_cast<int>(kUpdateBytes / size);
+  // Rendered ahead of time, so only the encoding is measured.
+  std::vector<std::string> documents;
+  uint32_t seed = 11;
+  for (int i = 0; i < 64; ++i) {
+    for (int change = 0; change < changes; ++change) {
+      seed = seed * 1103515245 + 12345;
+      size_t field = (seed >> 8) % fields.size();
+      fields[field] = "\"field" + std::to_string(field) + "\": " + std::to_string(seed >> 12);
+    }
+    documents.push_back(Render(fields));
+  }
+
+  StateEncoder encoder(64 * 1024 * 1024);
+  StateDecoder decoder(64 * 1024 * 1024);
+  uint64_t full_bytes = 0;
+  uint64_t wire_bytes = 0;
+  int corrupted = 0;
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < updates; ++i) {
+    const std::string& document = documents[i % documents.size()];
+    Frame frame(FrameType::TEXT, document);
+    AddStateKey(&frame, "document");
+    encoder.Encode(&frame, kSnapshotInterval);
+    wire_bytes += frame.payload.size();
+    full_bytes += document.size();
+    std::string key;
+    if (!decoder.Decode(&frame) || !TakeStateKey(&frame, &key) || frame.payload != document) {
+      ++corrupted;
+    }
+  }
+  Clock::duration elapsed = Clock::now() - start;
+
+  std::string config = std::to_string(size / 1024) + " KB, " + std::to_string(changes) + " fields changed";
+  ReportRate("state/updates", config, updates, elapsed);
+  printf("state/updates: %.1f bytes on the wire per update, %.1f%% of the full value\n",
+         static_cast<double>(wire_bytes) / updates, 100.0 * wire_bytes / full_bytes);
+  if (corrupted != 0) {
+    fprintf(stderr, "state: %d updates not restored\n", corrupted);
+  }
+}
+
+}  // namespace
+
+void RunStateBenchmarks() {
+  for (size_t size : {size_t{1024}, size_t{16 * 1024}, size_t{256 * 1024}}) {
+    for (int changes : {1, 8}) {
+      RunUpdates(size, changes);
+    }
+  }
+}
+
+}  // namespace benchmark
+}  // namespace flutter_ipc
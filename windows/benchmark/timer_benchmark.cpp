@@ -0,0 +1,122 @@
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark.h"
+#include "timing_wheel.h"
+
+namespace flutter_ipc {
+namespace benchmark {
+
+namespace {
+
+constexpr int kRounds = 20;
+
+// Delays of up to a minute in 10 ms ticks, like a mix of send deadlines,
+// heartbeats and idle timeouts.
+std::vector<uint64_t> MakeDelays(size_t count) {
+  std::mt19937 random(42);
+  std::uniform_int_distribution<uint64_t> delay(1, 6000);
+  std::vector<uint64_t> delays(count);
+  for (auto& value : delays) {
+    value = delay(random);
+  }
+  return delays;
+}
+
+// Schedules |delays| and cancels them again, as deadlines of frames that
+// leave the queue in time are.
+void RunScheduleCancel(const std::vector<uint64_t>& delays) {
+  std::string config = std::to_string(delays.size()) + " timers";
+  {
+    TimingWheel wheel;
+    std::vector<TimerId> ids(delays.size());
+    Clock::time_point start = Clock::now();
+    for (int round = 0; round < kRounds; ++round) {
+      for (size_t i = 0; i < delays.size(); ++i) {
+        ids[i] = wheel.Schedule(delays[i], [] {});
+      }
+      for (TimerId id : ids) {
+        wheel.Cancel(id);
+      }
+    }
+    ReportRate("timers/schedule+cancel", config + ", wheel", delays.size() * kRounds, Clock::now() - start);
+  }
+  {
+    std::multimap<uint64_t, TimerCallback> timers;
+    std::vector<std::multimap<uint64_t, TimerCallback>::iterator> ids(delays.size());
+    Clock::time_point start = Clock::now();
+    for (int round = 0; round < kRounds; ++round) {
+      for (size_t i = 0; i < delays.size(); ++i) {
+        ids[i] = timers.emplace(delays[i], [] {});
+      }
+      for (auto id : ids) {
+        timers.erase(id);
+      }
+    }
+    ReportRate("timers/schedule+cancel", config + ", multimap", delays.size() * kRounds, Clock::now() - start);
+  }
+}
+
+// Schedules |delays| and lets every one of them expire, tick by tick.
+void RunExpire(const std::vector<uint64_t>& delays) {
+  std::string config = std::to_string(delays.size()) + " timers";
+  uint64_t fired = 0;
+  {
+    TimingWheel wheel;
+    std::vector<std::pair<TimerId, TimerCallback>> expired;
+    Clock::time_point start = Clock::now();
+    for (int round = 0; round < kRounds; ++round) {
+      for (uint64_t delay : delays) {
+        wheel.Schedule(delay, [&fired] { ++fired; });
+      }
+      while (wheel.size() > 0) {
+        wheel.Advance(wheel.now() + 1, &expired);
+        for (auto& timer : expired) {
+          timer.second();
+        }
+        expired.clear();
+      }
+    }
+    ReportRate("timers/expire", config + ", wheel", delays.size() * kRounds, Clock::now() - start);
+  }
+  {
+    std::multimap<uint64_t, TimerCallback> timers;
+    uint64_t now = 0;
+    Clock::time_point start = Clock::now();
+    for (int round = 0; round < kRounds; ++round) {
+      for (uint64_t delay : delays) {
+        timers.emplace(now + delay, [&fired] { ++fired; });
+      }
+      while (!timers.empty()) {
+        ++now;
+        while (!timers.empty() && timers.begin()->first <= now) {
+          timers.begin()->second();
+          timers.erase(timers.begin());
+        }
+      }
+    }
+    ReportRate("timers/expire", config + ", multimap", delays.size() * kRounds, Clock::now() - start);
+  }
+  if (fired != 2 * delays.size() * kRounds) {
+    printf("timers/expire: %llu timers fired, expected %llu\n", static_cast<unsigned long long>(fired),
+           static_cast<unsigned long long>(2 * delays.size() * kRounds));
+  }
+}
+
+}  // namespace
+
+void RunTimerBenchmarks() {
+  for (size_t count : {1000, 100000}) {
+    std::vector<uint64_t> delays = MakeDelays(count);
+    RunScheduleCancel(delays);
+    RunExpire(delays);
+  }
+}
+
+}  // namespace benchmark
+}  // namespace flutter_ipc
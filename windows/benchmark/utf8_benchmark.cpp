@@ -0,0 +1,57 @@
+#include <cstdio>
+#include <string>
+
+#include "benchmark.h"
+#include "utf8.h"
+
+namespace flutter_ipc {
+namespace benchmark {
+
+namespace {
+
+constexpr size_t kTextSize = 1024 * 1024;
+constexpr int kRepeats = 200;
+
+// |kTextSize| bytes of text repeating |sample|.
+std::string MakeText(const std::string& sample) {
+  std::string text;
+  while (text.size() + sample.size() <= kTextSize) {
+    text += sample;
+  }
+  return text;
+}
+
+void RunValidate(const std::string& kind, const std::string& text) {
+  struct Validator {
+    const char* name;
+    bool (*validate)(const char*, size_t);
+  };
+  const Validator validators[] = {
+    {"scalar", IsValidUtf8Scalar},
+    {Utf8ValidatorName(), IsValidUtf8},
+  };
+  for (const auto& validator : validators) {
+    bool valid = true;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < kRepeats; ++i) {
+      valid &= validator.validate(text.data(), text.size());
+    }
+    Clock::duration elapsed = Clock::now() - start;
+    if (!valid) {
+      fprintf(stderr, "utf8: %s rejected valid text\n", validator.name);
+    }
+    ReportThroughput("utf8/validate", kind + ", " + validator.name,
+                     static_cast<uint64_t>(text.size()) * kRepeats, elapsed);
+  }
+}
+
+}  // namespace
+
+void RunUtf8Benchmarks() {
+  RunValidate("ascii", MakeText("The quick brown fox jumps over the lazy dog. "));
+  RunValidate("latin", MakeText(u8"Gr\u00f6\u00dfenwahn f\u00fchrt zu \u00dcbermut, se\u00f1or. "));
+  RunValidate("mixed", MakeText(u8"price 42 \u20ac, \u6771\u4eac \U0001F680 ok. "));
+}
+
+}  // namespace benchmark
+}  // namespace flutter_ipc
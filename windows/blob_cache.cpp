@@ -0,0 +1,385 @@
+#include "blob_cache.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "cpu_features.h"
+
+namespace flutter_ipc {
+
+namespace {
+
+constexpr size_t kStripeSize = 32;
+// The accumulators are scrambled after every block of stripes, so that
+// input cannot cancel out over long payloads.
+constexpr size_t kStripesPerBlock = 16;
+
+constexpr uint64_t kPrime32 = 0x9E3779B1ULL;
+constexpr uint64_t kPrime64A = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime64B = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime64C = 0x165667B19E3779F9ULL;
+
+// Stripe |s| is keyed with the four words from kSecret[s % 4].
+alignas(32) constexpr uint64_t kSecret[8] = {
+  0xBE4BA423396CFEB8ULL, 0x1CAD21F72C81017CULL, 0xDB979083E96DD4DEULL, 0x1F67B3B7A4A44072ULL,
+  0x78E5C0CC4EE679CBULL, 0x2172FFCC7DD05A82ULL, 0x8E2443F7744608B8ULL, 0x4C263A81E69035E0ULL,
+};
+alignas(32) constexpr uint64_t kScrambleKey[4] = {
+  0xCB00C391BB52283CULL, 0xA32E531B8B65D088ULL, 0x4EF90DA297486471ULL, 0xD8ACDEA946EF1938ULL,
+};
+
+#pragma pack(push, 1)
+// Entry of a BLOB frame. The payload is a uint32 count followed by that
+// many entries.
+struct HeldEntry {
+  uint16_t channel;
+  uint64_t low;
+  uint64_t high;
+};
+#pragma pack(pop)
+
+// What follows the sequence numbers of a frame with kFrameFlagBlob: a kind
+// byte and the digest, then for STORE a uint32 count of evicted digests,
+// the digests, and the payload.
+enum BlobKind : uint8_t {
+  STORE = 0,
+  REFERENCE = 1,
+};
+constexpr size_t kDigestSize = 2 * sizeof(uint64_t);
+constexpr size_t kReferenceSize = 1 + kDigestSize;
+
+inline uint64_t Load64(const char* data) {
+  uint64_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+void AppendDigest(std::string* out, const BlobDigest& digest) {
+  out->append(reinterpret_cast<const char*>(&digest.low), sizeof(digest.low));
+  out->append(reinterpret_cast<const char*>(&digest.high), sizeof(digest.high));
+}
+
+BlobDigest ReadDigest(const char* data) {
+  BlobDigest digest;
+  digest.low = Load64(data);
+  digest.high = Load64(data + sizeof(uint64_t));
+  return digest;
+}
+
+// The low and high halves of the 128-bit product, folded together.
+uint64_t MultiplyFold(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+  return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#else
+  uint64_t a_low = a & 0xFFFFFFFF, a_high = a >> 32;
+  uint64_t b_low = b & 0xFFFFFFFF, b_high = b >> 32;
+  uint64_t low_low = a_low * b_low;
+  uint64_t high_low = a_high * b_low;
+  uint64_t low_high = a_low * b_high;
+  uint64_t high_high = a_high * b_high;
+  uint64_t cross = (low_low >> 32) + (high_low & 0xFFFFFFFF) + low_high;
+  uint64_t low = (cross << 32) | (low_low & 0xFFFFFFFF);
+  uint64_t high = high_high + (high_low >> 32) + (cross >> 32);
+  return low ^ high;
+#endif
+}
+
+uint64_t Avalanche(uint64_t hash) {
+  hash ^= hash >> 37;
+  hash *= kPrime64C;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+// Each lane multiplies the two halves of its keyed input and also adds the
+// raw input to its neighbour, so that no input is lost to a zero half.
+void AccumulateScalar(uint64_t acc[4], const char* data, size_t stripes) {
+  for (size_t s = 0; s < stripes; ++s) {
+    const char* stripe = data + s * kStripeSize;
+    const uint64_t* key = kSecret + s % 4;
+    for (int lane = 0; lane < 4; ++lane) {
+      uint64_t input = Load64(stripe + lane * sizeof(uint64_t));
+      uint64_t keyed = input ^ key[lane];
+      acc[lane] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+      acc[lane ^ 1] += input;
+    }
+    if ((s + 1) % kStripesPerBlock == 0) {
+      for (int lane = 0; lane < 4; ++lane) {
+        acc[lane] ^= acc[lane] >> 47;
+        acc[lane] ^= kScrambleKey[lane];
+        acc[lane] *= kPrime32;
+      }
+    }
+  }
+}
+
+#if defined(FLUTTER_IPC_X86)
+
+// AccumulateScalar with the four lanes in one register.
+FLUTTER_IPC_TARGET("avx2")
+void AccumulateAvx2(uint64_t acc[4], const char* data, size_t stripes) {
+  __m256i sum = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc));
+  const __m256i scramble_key = _mm256_load_si256(reinterpret_cast<const __m256i*>(kScrambleKey));
+  const __m256i prime = _mm256_set1_epi32(static_cast<int>(kPrime32));
+  for (size_t s = 0; s < stripes; ++s) {
+    __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + s * kStripeSize));
+    __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kSecret + s % 4));
+    __m256i keyed = _mm256_xor_si256(input, key);
+    __m256i product = _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32));
+    // Swaps neighbouring 64-bit lanes.
+    __m256i swapped = _mm256_shuffle_epi32(input, _MM_SHUFFLE(1, 0, 3, 2));
+    sum = _mm256_add_epi64(sum, _mm256_add_epi64(product, swapped));
+    if ((s + 1) % kStripesPerBlock == 0) {
+      sum = _mm256_xor_si256(sum, _mm256_srli_epi64(sum, 47));
+      sum = _mm256_xor_si256(sum, scramble_key);
+      // A 64-bit multiply by a 32-bit constant, from two 32-bit ones.
+      __m256i low = _mm256_mul_epu32(sum, prime);
+      __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(sum, 32), prime);
+      sum = _mm256_add_epi64(low, _mm256_slli_epi64(high, 32));
+    }
+  }
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), sum);
+}
+
+#endif  // defined(FLUTTER_IPC_X86)
+
+using Accumulate = void (*)(uint64_t acc[4], const char* data, size_t stripes);
+
+BlobDigest Hash(const char* data, size_t size, Accumulate accumulate) {
+  uint64_t acc[4] = {kPrime32, kPrime64A, kPrime64B, kPrime64C};
+  size_t stripes = size / kStripeSize;
+  accumulate(acc, data, stripes);
+  // The rest goes in zero-padded; the length, mixed in below, tells
+  // payloads that differ only in trailing zeros apart.
+  size_t rest = size % kStripeSize;
+  if (rest != 0) {
+    char last[kStripeSize] = {};
+    memcpy(last, data + stripes * kStripeSize, rest);
+    AccumulateScalar(acc, last, 1);
+  }
+
+  BlobDigest digest;
+  digest.low = Avalanche(size * kPrime64A + MultiplyFold(acc[0] ^ kSecret[1], acc[1] ^ kSecret[2]) +
+                         MultiplyFold(acc[2] ^ kSecret[3], acc[3] ^ kSecret[4]));
+  digest.high = Avalanche(~(size * kPrime64B) + MultiplyFold(acc[0] ^ kSecret[5], acc[1] ^ kSecret[6]) +
+                          MultiplyFold(acc[2] ^ kSecret[7], acc[3] ^ kSecret[0]));
+  return digest;
+}
+
+}  // namespace
+
+BlobDigest HashBlob(const char* data, size_t size) {
+#if defined(FLUTTER_IPC_X86)
+  if (GetCpuFeatures().avx2) {
+    return Hash(data, size, AccumulateAvx2);
+  }
+#endif
+  return Hash(data, size, AccumulateScalar);
+}
+
+BlobDigest HashBlobScalar(const char* data, size_t size) {
+  return Hash(data, size, AccumulateScalar);
+}
+
+const char* BlobHashName() {
+#if defined(FLUTTER_IPC_X86)
+  if (GetCpuFeatures().avx2) {
+    return "avx2";
+  }
+#endif
+  return "scalar";
+}
+
+Frame EncodeBlobHeldFrame(const std::vector<BlobHeld>& held) {
+  uint32_t count = static_cast<uint32_t>(held.size());
+  std::string payload(sizeof(count) + count * sizeof(HeldEntry), '\0');
+  memcpy(&payload[0], &count, sizeof(count));
+  size_t offset = sizeof(count);
+  for (const auto& blob : held) {
+    HeldEntry entry = {blob.first, blob.second.low, blob.second.high};
+    memcpy(&payload[offset], &entry, sizeof(entry));
+    offset += sizeof(entry);
+  }
+  Frame frame(FrameType::BLOB, std::move(payload));
+  frame.flags = kFrameFlagControl;
+  return frame;
+}
+
+bool DecodeBlobHeldFrame(const Frame& frame, std::vector<BlobHeld>* held) {
+  uint32_t count = 0;
+  if (frame.type != FrameType::BLOB || frame.payload.size() < sizeof(count)) {
+    return false;
+  }
+  memcpy(&count, frame.payload.data(), sizeof(count));
+  if (frame.payload.size() != sizeof(count) + static_cast<size_t>(count) * sizeof(HeldEntry)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    HeldEntry entry;
+    memcpy(&entry, &frame.payload[sizeof(count) + i * sizeof(HeldEntry)], sizeof(entry));
+    BlobDigest digest;
+    digest.low = entry.low;
+    digest.high = entry.high;
+    held->emplace_back(entry.channel, digest);
+  }
+  return true;
+}
+
+BlobEncoder::BlobEncoder(size_t capacity, size_t min_bytes)
+    : capacity_(capacity), min_bytes_(std::max<size_t>(min_bytes, kReferenceSize)) {}
+
+bool BlobEncoder::Eligible(const Frame& frame, size_t* data_offset) const {
+  // Handles are duplicated anew for every message, so no two are alike.
+  if (capacity_ == 0 || (frame.type != FrameType::TEXT && frame.type != FrameType::VALUE) ||
+      (frame.flags & kFrameFlagBlob)) {
+    return false;
+  }
+  *data_offset = FramePrefixLength(frame.flags);
+  size_t size = frame.payload.size() - std::min(frame.payload.size(), *data_offset);
+  return size >= min_bytes_ && size <= capacity_;
+}
+
+void BlobEncoder::Encode(Frame* frame, size_t data_offset, const BlobDigest& digest) {
+  size_t size = frame->payload.size() - data_offset;
+  ++candidates_;
+  Channel& channel = channels_[frame->channel];
+  auto found = channel.index.find(digest);
+  if (found != channel.index.end()) {
+    channel.lru.splice(channel.lru.begin(), channel.lru, found->second);
+    if (!found->second->held) {
+      // Not confirmed yet: stored again, in case the first copy was never
+      // written. The receiver confirms a blob it already holds.
+      std::string header(1, static_cast<char>(STORE));
+      AppendDigest(&header, digest);
+      header.append(sizeof(uint32_t), '\0');
+      frame->payload.insert(data_offset, header);
+      frame->flags |= kFrameFlagBlob;
+      return;
+    }
+    frame->payload.resize(data_offset);
+    frame->payload.push_back(static_cast<char>(REFERENCE));
+    AppendDigest(&frame->payload, digest);
+    frame->flags |= kFrameFlagBlob;
+    ++hits_;
+    bytes_saved_ += size - kReferenceSize;
+    return;
+  }
+
+  // Room is only made within the channel, whose frames stay in order with
+  // the references to what is evicted.
+  if (size > capacity_ - (bytes_ - channel.bytes)) {
+    return;
+  }
+  std::string header(1, static_cast<char>(STORE));
+  AppendDigest(&header, digest);
+  header.append(sizeof(uint32_t), '\0');
+  uint32_t evicted = 0;
+  while (bytes_ + size > capacity_) {
+    const Entry& oldest = channel.lru.back();
+    AppendDigest(&header, oldest.digest);
+    ++evicted;
+    bytes_ -= oldest.size;
+    channel.bytes -= oldest.size;
+    channel.index.erase(oldest.digest);
+    channel.lru.pop_back();
+  }
+  memcpy(&header[kReferenceSize], &evicted, sizeof(evicted));
+  frame->payload.insert(data_offset, header);
+  frame->flags |= kFrameFlagBlob;
+
+  channel.lru.push_front(Entry{digest, size, false});
+  channel.index[digest] = channel.lru.begin();
+  bytes_ += size;
+  channel.bytes += size;
+}
+
+void BlobEncoder::OnHeld(const std::vector<BlobHeld>& held) {
+  for (const auto& blob : held) {
+    auto channel = channels_.find(blob.first);
+    if (channel == channels_.end()) {
+      continue;
+    }
+    // A blob evicted since it was stored stays forgotten.
+    auto found = channel->second.index.find(blob.second);
+    if (found != channel->second.index.end()) {
+      found->second->held = true;
+    }
+  }
+}
+
+void BlobEncoder::AddStats(BlobStats* stats) const {
+  stats->candidates += candidates_;
+  stats->hits += hits_;
+  stats->bytes_saved += bytes_saved_;
+}
+
+BlobDecoder::BlobDecoder(size_t capacity) : capacity_(capacity) {}
+
+bool BlobDecoder::Decode(Frame* frame, std::vector<BlobHeld>* held) {
+  if (!(frame->flags & kFrameFlagBlob)) {
+    return true;
+  }
+  std::string& payload = frame->payload;
+  size_t offset = FramePrefixLength(frame->flags);
+  if (payload.size() < offset + kReferenceSize) {
+    return false;
+  }
+  uint8_t kind = static_cast<uint8_t>(payload[offset]);
+  BlobDigest digest = ReadDigest(&payload[offset + 1]);
+  Blobs& blobs = channels_[frame->channel];
+
+  if (kind == REFERENCE) {
+    ++references_;
+    auto found = blobs.find(digest);
+    if (found == blobs.end()) {
+      ++unknown_references_;
+      return false;
+    }
+    payload.resize(offset);
+    payload.append(found->second);
+    frame->flags &= ~kFrameFlagBlob;
+    return true;
+  }
+  if (kind != STORE || payload.size() < offset + kReferenceSize + sizeof(uint32_t)) {
+    return false;
+  }
+
+  uint32_t evicted = 0;
+  memcpy(&evicted, &payload[offset + kReferenceSize], sizeof(evicted));
+  size_t evictions = offset + kReferenceSize + sizeof(evicted);
+  if ((payload.size() - evictions) / kDigestSize < evicted) {
+    return false;
+  }
+  for (uint32_t i = 0; i < evicted; ++i) {
+    auto found = blobs.find(ReadDigest(&payload[evictions + i * kDigestSize]));
+    if (found != blobs.end()) {
+      bytes_ -= found->second.size();
+      blobs.erase(found);
+    }
+  }
+
+  size_t data = evictions + static_cast<size_t>(evicted) * kDigestSize;
+  size_t size = payload.size() - data;
+  if (blobs.find(digest) != blobs.end()) {
+    held->emplace_back(frame->channel, digest);
+  } else if (bytes_ + size <= capacity_) {
+    blobs.emplace(digest, payload.substr(data));
+    bytes_ += size;
+    held->emplace_back(frame->channel, digest);
+  }
+  payload.erase(offset, data - offset);
+  frame->flags &= ~kFrameFlagBlob;
+  return true;
+}
+
+void BlobDecoder::AddStats(BlobStats* stats) const {
+  for (const auto& channel : channels_) {
+    stats->held_blobs += channel.second.size();
+  }
+  stats->held_bytes += bytes_;
+  stats->references += references_;
+  stats->unknown_references += unknown_references_;
+}
+
+}  // namespace flutter_ipc
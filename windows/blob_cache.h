@@ -0,0 +1,146 @@
+#ifndef FLUTTER_PLUGIN_BLOB_CACHE_H_
+#define FLUTTER_PLUGIN_BLOB_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "frame.h"
+
+namespace flutter_ipc {
+
+// 128-bit content address of a payload.
+struct BlobDigest {
+  uint64_t low = 0;
+  uint64_t high = 0;
+
+  bool operator==(const BlobDigest& other) const { return low == other.low && high == other.high; }
+};
+
+struct BlobDigestHash {
+  size_t operator()(const BlobDigest& digest) const { return static_cast<size_t>(digest.low); }
+};
+
+// Hashes |data| 32 bytes at a time in four independent lanes, in the
+// manner of XXH3. Uses AVX2 when the processor has it; every
+// implementation gives the same digest, so the ends of a connection may
+// differ. Not cryptographic: it guards against accidents, not a peer
+// crafting collisions with its own payloads.
+BlobDigest HashBlob(const char* data, size_t size);
+
+// The portable implementation. For tests and benchmarks.
+BlobDigest HashBlobScalar(const char* data, size_t size);
+
+// Which implementation HashBlob uses on this processor: "avx2" or
+// "scalar".
+const char* BlobHashName();
+
+// Counters of one connection's blob cache, both directions.
+struct BlobStats {
+  // Frames sent that were large enough to deduplicate, those that went out
+  // as a reference, and the payload bytes that saved.
+  uint64_t candidates = 0;
+  uint64_t hits = 0;
+  uint64_t bytes_saved = 0;
+  // Blobs held for the peer, and the references it sent.
+  uint64_t held_blobs = 0;
+  uint64_t held_bytes = 0;
+  uint64_t references = 0;
+  // References to a blob that is not held; those frames are dropped.
+  uint64_t unknown_references = 0;
+};
+
+// A blob the receiver now holds, by channel.
+using BlobHeld = std::pair<uint16_t, BlobDigest>;
+
+// A BLOB frame tells the sender which blobs the receiver has stored.
+Frame EncodeBlobHeldFrame(const std::vector<BlobHeld>& held);
+bool DecodeBlobHeldFrame(const Frame& frame, std::vector<BlobHeld>* held);
+
+// The sending half of a connection's blob cache. It mirrors what the
+// receiver holds: a payload it has sent in full once is stored by the
+// receiver, and once the receiver has confirmed that with a BLOB frame,
+// the same payload goes out as a 17-byte reference instead.
+//
+// The sender alone decides what the receiver evicts, least recently sent
+// first, and the evictions travel in front of the next stored blob of the
+// same channel. Frames of one channel arrive in the order they were
+// queued, so the receiver can never see a reference to a blob it has
+// already been told to evict. Not thread-safe; Encode() must be called in
+// queue order.
+class BlobEncoder {
+ public:
+  // Keeps up to |capacity| payload bytes in the receiver's cache, of
+  // payloads of at least |min_bytes|.
+  BlobEncoder(size_t capacity, size_t min_bytes);
+
+  // Whether |frame| is worth hashing. |data_offset| receives the length of
+  // the sequence numbers in front of the payload proper, which stay as
+  // they are.
+  bool Eligible(const Frame& frame, size_t* data_offset) const;
+
+  // Rewrites an eligible |frame| whose payload past |data_offset| hashes
+  // to |digest|: as a reference if the receiver holds it, as a stored blob
+  // if there is room for it, or not at all.
+  void Encode(Frame* frame, size_t data_offset, const BlobDigest& digest);
+
+  // Applies a BLOB frame from the receiver.
+  void OnHeld(const std::vector<BlobHeld>& held);
+
+  void AddStats(BlobStats* stats) const;
+
+ private:
+  struct Entry {
+    BlobDigest digest;
+    size_t size;
+    bool held;
+  };
+  struct Channel {
+    size_t bytes = 0;
+    // Most recently sent first.
+    std::list<Entry> lru;
+    std::unordered_map<BlobDigest, std::list<Entry>::iterator, BlobDigestHash> index;
+  };
+
+  size_t capacity_;
+  size_t min_bytes_;
+  size_t bytes_ = 0;
+  std::unordered_map<uint16_t, Channel> channels_;
+  uint64_t candidates_ = 0;
+  uint64_t hits_ = 0;
+  uint64_t bytes_saved_ = 0;
+};
+
+// The receiving half: stores the blobs a BlobEncoder sends, evicts what it
+// is told to, and puts referenced payloads back in place. Holds at most
+// |capacity| bytes whatever the sender thinks, and does not confirm blobs
+// it had no room for. Not thread-safe; frames must be decoded in the
+// order they arrive.
+class BlobDecoder {
+ public:
+  explicit BlobDecoder(size_t capacity);
+
+  // Restores |frame| if it carries kFrameFlagBlob, appending blobs newly
+  // stored to |held|. Returns false for a malformed frame or a reference to
+  // a blob that is not held.
+  bool Decode(Frame* frame, std::vector<BlobHeld>* held);
+
+  void AddStats(BlobStats* stats) const;
+
+ private:
+  using Blobs = std::unordered_map<BlobDigest, std::string, BlobDigestHash>;
+
+  size_t capacity_;
+  size_t bytes_ = 0;
+  std::unordered_map<uint16_t, Blobs> channels_;
+  uint64_t references_ = 0;
+  uint64_t unknown_references_ = 0;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_BLOB_CACHE_H_
@@ -0,0 +1,286 @@
+#include "capture.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace flutter_ipc {
+
+namespace {
+
+constexpr char kCaptureMagic[8] = "FIPCCAP";
+constexpr uint32_t kCaptureVersion = 1;
+// Keeps every record size within its 32-bit field.
+constexpr size_t kMaxCapturedPayload = 1 << 30;
+
+// The running capture. Recorders announce themselves in |recording| before
+// they look at |active_writer|, so StopCapture() can wait them out.
+std::mutex capture_mutex;
+std::atomic<CaptureWriter*> active_writer{nullptr};
+std::atomic<uint64_t> capture_generation{0};
+std::atomic<int> recording{0};
+std::atomic<uint32_t> next_source_id{1};
+
+std::wstring WidePath(const std::string& path) {
+  int wide_length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+  if (wide_length == 0) {
+    return std::wstring();
+  }
+  std::wstring wide_path(wide_length - 1, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wide_path[0], wide_length);
+  return wide_path;
+}
+
+}  // namespace
+
+// static
+std::unique_ptr<CaptureWriter> CaptureWriter::Create(const std::string& path, size_t capacity,
+                                                     size_t max_payload) {
+  if (capacity < sizeof(CaptureFileHeader)) {
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return nullptr;
+  }
+  std::wstring wide_path = WidePath(path);
+  if (wide_path.empty()) {
+    SetLastError(ERROR_INVALID_NAME);
+    return nullptr;
+  }
+  HANDLE file = CreateFileW(
+    wide_path.c_str(),
+    GENERIC_READ | GENERIC_WRITE,
+    FILE_SHARE_READ,
+    NULL,
+    CREATE_ALWAYS,
+    FILE_ATTRIBUTE_NORMAL,
+    NULL
+  );
+  if (file == INVALID_HANDLE_VALUE) {
+    return nullptr;
+  }
+  // Grows the file to |capacity|; Close() cuts it back.
+  HANDLE mapping = CreateFileMappingW(
+    file,
+    NULL,
+    PAGE_READWRITE,
+    static_cast<DWORD>(static_cast<uint64_t>(capacity) >> 32),
+    static_cast<DWORD>(capacity & 0xFFFFFFFF),
+    NULL
+  );
+  if (mapping == NULL) {
+    CloseHandle(file);
+    return nullptr;
+  }
+  void* view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, capacity);
+  if (!view) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return nullptr;
+  }
+  return std::unique_ptr<CaptureWriter>(new CaptureWriter(
+      file, mapping, static_cast<char*>(view), capacity, std::min(max_payload, kMaxCapturedPayload)));
+}
+
+CaptureWriter::CaptureWriter(HANDLE file, HANDLE mapping, char* view, size_t capacity, size_t max_payload)
+    : file_(file), mapping_(mapping), view_(view), capacity_(capacity), max_payload_(max_payload),
+      start_(Clock::now()) {
+  CaptureFileHeader header = {};
+  memcpy(header.magic, kCaptureMagic, sizeof(header.magic));
+  header.version = kCaptureVersion;
+  header.header_size = sizeof(header);
+  header.max_payload = max_payload_;
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+  header.start_time = (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+  memcpy(view_, &header, sizeof(header));
+}
+
+CaptureWriter::~CaptureWriter() {
+  Close();
+}
+
+bool CaptureWriter::Append(CaptureKind kind, uint32_t connection, uint8_t type, uint8_t flags,
+                           uint16_t channel, const std::string& payload) {
+  size_t captured = std::min(payload.size(), max_payload_);
+  uint64_t size = (sizeof(CaptureRecordHeader) + captured + 7) & ~uint64_t{7};
+  uint64_t offset = tail_.fetch_add(size, std::memory_order_relaxed);
+  // Once one record does not fit, no later one does either: the tail has
+  // moved past the end.
+  if (offset + size > capacity_ - sizeof(CaptureFileHeader)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  CaptureRecordHeader header = {};
+  header.size = static_cast<uint32_t>(size);
+  header.connection = connection;
+  header.time_ns = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_).count());
+  header.length = static_cast<uint32_t>(payload.size());
+  header.channel = channel;
+  header.kind = static_cast<uint8_t>(kind);
+  header.type = type;
+  header.flags = flags;
+  char* record = view_ + sizeof(CaptureFileHeader) + offset;
+  memcpy(record + sizeof(header), payload.data(), captured);
+  memcpy(record, &header, sizeof(header));
+  records_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+CaptureStats CaptureWriter::GetStats() const {
+  CaptureStats stats;
+  stats.records = records_.load(std::memory_order_relaxed);
+  stats.bytes = std::min<uint64_t>(tail_.load(std::memory_order_relaxed), capacity_ - sizeof(CaptureFileHeader));
+  stats.dropped = dropped_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void CaptureWriter::Close() {
+  if (!view_) {
+    return;
+  }
+  uint64_t used = GetStats().bytes;
+  UnmapViewOfFile(view_);
+  view_ = nullptr;
+  CloseHandle(mapping_);
+  // Only possible once the file is no longer mapped.
+  LARGE_INTEGER end;
+  end.QuadPart = static_cast<LONGLONG>(sizeof(CaptureFileHeader) + used);
+  SetFilePointerEx(file_, end, NULL, FILE_BEGIN);
+  SetEndOfFile(file_);
+  CloseHandle(file_);
+}
+
+// static
+std::unique_ptr<CaptureReader> CaptureReader::Open(const std::string& path) {
+  std::wstring wide_path = WidePath(path);
+  if (wide_path.empty()) {
+    return nullptr;
+  }
+  HANDLE file = CreateFileW(
+    wide_path.c_str(),
+    GENERIC_READ,
+    FILE_SHARE_READ,
+    NULL,
+    OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL,
+    NULL
+  );
+  if (file == INVALID_HANDLE_VALUE) {
+    return nullptr;
+  }
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart < static_cast<LONGLONG>(sizeof(CaptureFileHeader))) {
+    CloseHandle(file);
+    return nullptr;
+  }
+  HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping == NULL) {
+    CloseHandle(file);
+    return nullptr;
+  }
+  const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!view) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return nullptr;
+  }
+  std::unique_ptr<CaptureReader> reader(new CaptureReader(
+      file, mapping, static_cast<const char*>(view), static_cast<size_t>(file_size.QuadPart)));
+  const CaptureFileHeader& header = reader->header();
+  if (memcmp(header.magic, kCaptureMagic, sizeof(header.magic)) != 0 || header.version != kCaptureVersion ||
+      header.header_size != sizeof(CaptureFileHeader)) {
+    return nullptr;
+  }
+  return reader;
+}
+
+CaptureReader::CaptureReader(HANDLE file, HANDLE mapping, const char* view, size_t size)
+    : file_(file), mapping_(mapping), view_(view), size_(size), offset_(sizeof(CaptureFileHeader)) {}
+
+CaptureReader::~CaptureReader() {
+  UnmapViewOfFile(view_);
+  CloseHandle(mapping_);
+  CloseHandle(file_);
+}
+
+bool CaptureReader::Next(CaptureRecord* record) {
+  if (size_ - offset_ < sizeof(CaptureRecordHeader)) {
+    return false;
+  }
+  CaptureRecordHeader header;
+  memcpy(&header, view_ + offset_, sizeof(header));
+  // A record that was claimed but never written reads as zeros.
+  if (header.size < sizeof(header) || header.size > size_ - offset_) {
+    return false;
+  }
+  record->kind = static_cast<CaptureKind>(header.kind);
+  record->connection = header.connection;
+  record->time = std::chrono::nanoseconds(header.time_ns);
+  record->channel = header.channel;
+  record->type = header.type;
+  record->flags = header.flags;
+  record->length = header.length;
+  record->data = view_ + offset_ + sizeof(header);
+  record->captured = std::min<size_t>({header.length, header.size - sizeof(header),
+                                       static_cast<size_t>(this->header().max_payload)});
+  offset_ += header.size;
+  return true;
+}
+
+CaptureSource::CaptureSource(CaptureRole role, std::string name)
+    : id_(next_source_id.fetch_add(1, std::memory_order_relaxed)), role_(role), name_(std::move(name)) {}
+
+bool StartCapture(const std::string& path, size_t capacity, size_t max_payload) {
+  std::lock_guard<std::mutex> lock(capture_mutex);
+  if (active_writer.load()) {
+    SetLastError(ERROR_BUSY);
+    return false;
+  }
+  std::unique_ptr<CaptureWriter> writer = CaptureWriter::Create(path, capacity, max_payload);
+  if (!writer) {
+    return false;
+  }
+  // Every source is announced again to the new capture.
+  capture_generation.fetch_add(1);
+  active_writer.store(writer.release());
+  return true;
+}
+
+bool StopCapture(CaptureStats* stats) {
+  std::lock_guard<std::mutex> lock(capture_mutex);
+  std::unique_ptr<CaptureWriter> writer(active_writer.exchange(nullptr));
+  if (!writer) {
+    return false;
+  }
+  // Recorders that saw the writer are the last.
+  while (recording.load() != 0) {
+    std::this_thread::yield();
+  }
+  *stats = writer->GetStats();
+  writer->Close();
+  return true;
+}
+
+void CaptureFrame(CaptureSource* source, CaptureKind kind, const Frame& frame) {
+  if (source->id_ == 0 || !active_writer.load(std::memory_order_relaxed)) {
+    return;
+  }
+  recording.fetch_add(1);
+  CaptureWriter* writer = active_writer.load();
+  if (writer) {
+    // A frame of another thread may beat the announcement into the file.
+    uint64_t generation = capture_generation.load();
+    if (source->announced_.exchange(generation) != generation) {
+      writer->Append(CaptureKind::CONNECTION, source->id_, static_cast<uint8_t>(source->role_), 0, 0,
+                     source->name_);
+    }
+    writer->Append(kind, source->id_, static_cast<uint8_t>(frame.type), frame.flags, frame.channel,
+                   frame.payload);
+  }
+  recording.fetch_sub(1);
+}
+
+}  // namespace flutter_ipc
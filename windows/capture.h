@@ -0,0 +1,187 @@
+#ifndef FLUTTER_PLUGIN_CAPTURE_H_
+#define FLUTTER_PLUGIN_CAPTURE_H_
+
+#include <windows.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "frame.h"
+
+namespace flutter_ipc {
+
+// What a capture record holds.
+enum class CaptureKind : uint8_t {
+  CONNECTION = 1,  // A server or client seen first; the payload is its pipe name
+  SENT = 2,        // A frame the application sent
+  RECEIVED = 3,    // A frame handed to the application
+};
+
+enum class CaptureRole : uint8_t {
+  SERVER = 0,
+  CLIENT = 1,
+};
+
+// A capture file is a CaptureFileHeader followed by records, each a
+// CaptureRecordHeader and the first bytes of the payload, padded to 8
+// bytes. A record of size 0, or the end of the file, ends the capture.
+// Little-endian, as written by the machine.
+struct CaptureFileHeader {
+  char magic[8];  // "FIPCCAP"
+  uint32_t version;
+  uint32_t header_size;
+  // Payloads are cut after this many bytes.
+  uint64_t max_payload;
+  // When the capture started, in 100 ns units since 1601 (a FILETIME).
+  uint64_t start_time;
+  uint8_t reserved[32];
+};
+
+struct CaptureRecordHeader {
+  // Bytes of the record, header and padding included.
+  uint32_t size;
+  // The server or client, numbered by its CONNECTION record.
+  uint32_t connection;
+  // Since the capture started.
+  uint64_t time_ns;
+  // Of the whole payload; only min(length, max_payload) bytes follow.
+  uint32_t length;
+  uint16_t channel;
+  uint8_t kind;  // CaptureKind
+  // The FrameType, or for a CONNECTION record the CaptureRole.
+  uint8_t type;
+  uint8_t flags;
+  uint8_t reserved[7];
+};
+
+static_assert(sizeof(CaptureFileHeader) == 64, "capture file header is 64 bytes");
+static_assert(sizeof(CaptureRecordHeader) == 32, "capture record header is 32 bytes");
+
+struct CaptureStats {
+  uint64_t records = 0;
+  uint64_t bytes = 0;
+  // Records that did not fit in the file.
+  uint64_t dropped = 0;
+};
+
+// Appends records to a capture file mapped into memory as a whole, so a
+// record costs one atomic add to claim its place and a copy, from any
+// number of threads at once and without a lock. Records that do not fit
+// in |capacity| are dropped. The file is cut to what was used on Close().
+class CaptureWriter {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Returns null if |path| cannot be created and mapped at |capacity|
+  // bytes.
+  static std::unique_ptr<CaptureWriter> Create(const std::string& path, size_t capacity, size_t max_payload);
+  ~CaptureWriter();
+
+  // Disallow copy and assign.
+  CaptureWriter(const CaptureWriter&) = delete;
+  CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+  // Returns false if the record was dropped.
+  bool Append(CaptureKind kind, uint32_t connection, uint8_t type, uint8_t flags, uint16_t channel,
+              const std::string& payload);
+
+  CaptureStats GetStats() const;
+  // No Append() may be under way or follow.
+  void Close();
+
+ private:
+  CaptureWriter(HANDLE file, HANDLE mapping, char* view, size_t capacity, size_t max_payload);
+
+  HANDLE file_;
+  HANDLE mapping_;
+  char* view_;
+  size_t capacity_;
+  size_t max_payload_;
+  Clock::time_point start_;
+  // Bytes claimed after the file header, including by dropped records.
+  alignas(64) std::atomic<uint64_t> tail_{0};
+  std::atomic<uint64_t> records_{0};
+  std::atomic<uint64_t> dropped_{0};
+};
+
+// One record read back from a capture file. |data| points into the
+// reader's view and holds |captured| bytes of the |length| sent.
+struct CaptureRecord {
+  CaptureKind kind;
+  uint32_t connection;
+  std::chrono::nanoseconds time;
+  uint16_t channel;
+  uint8_t type;
+  uint8_t flags;
+  uint32_t length;
+  const char* data;
+  size_t captured;
+};
+
+// Reads a capture file in the order it was written. Not thread-safe.
+class CaptureReader {
+ public:
+  // Returns null if |path| is not a capture file.
+  static std::unique_ptr<CaptureReader> Open(const std::string& path);
+  ~CaptureReader();
+
+  // Disallow copy and assign.
+  CaptureReader(const CaptureReader&) = delete;
+  CaptureReader& operator=(const CaptureReader&) = delete;
+
+  // Returns false at the end of the capture.
+  bool Next(CaptureRecord* record);
+  void Rewind() { offset_ = sizeof(CaptureFileHeader); }
+
+  const CaptureFileHeader& header() const { return *reinterpret_cast<const CaptureFileHeader*>(view_); }
+
+ private:
+  CaptureReader(HANDLE file, HANDLE mapping, const char* view, size_t size);
+
+  HANDLE file_;
+  HANDLE mapping_;
+  const char* view_;
+  size_t size_;
+  size_t offset_;
+};
+
+// A server or client as captures know it. Each gets a number unique in
+// the process; the lanes of a pool are captured as the pool.
+class CaptureSource {
+ public:
+  CaptureSource(CaptureRole role, std::string name);
+
+  // Leaves this source out of captures.
+  void Disable() { id_ = 0; }
+
+  uint32_t id() const { return id_; }
+  CaptureRole role() const { return role_; }
+  const std::string& name() const { return name_; }
+
+ private:
+  friend void CaptureFrame(CaptureSource* source, CaptureKind kind, const Frame& frame);
+
+  uint32_t id_;
+  CaptureRole role_;
+  std::string name_;
+  // The capture this source was last announced to.
+  std::atomic<uint64_t> announced_{0};
+};
+
+// Starts capturing the frames of every connection in this process to
+// |path|. Fails if a capture is running already.
+bool StartCapture(const std::string& path, size_t capacity, size_t max_payload);
+// Stops the running capture, once no frame is being recorded, and closes
+// its file. Returns false if there is none.
+bool StopCapture(CaptureStats* stats);
+// Records |frame| for |source| if a capture is running. A single atomic
+// load when none is.
+void CaptureFrame(CaptureSource* source, CaptureKind kind, const Frame& frame);
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_CAPTURE_H_
@@ -0,0 +1,226 @@
+#include "channel_mux.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace flutter_ipc {
+
+bool PendingFrame::Start() {
+  uint8_t state = kQueued;
+  return state_.compare_exchange_strong(state, kStarted, std::memory_order_acq_rel) || state == kStarted;
+}
+
+bool PendingFrame::Drop() {
+  uint8_t state = kQueued;
+  return state_.compare_exchange_strong(state, kDropped, std::memory_order_acq_rel);
+}
+
+FrameHeader FrameChunk::Header() const {
+  FrameHeader header = {};
+  header.length = static_cast<uint32_t>(length);
+  header.type = static_cast<uint8_t>(owner->frame.type);
+  header.flags = static_cast<uint8_t>(owner->frame.flags & ~kFrameFlagMoreChunks);
+  if (!last) {
+    header.flags |= kFrameFlagMoreChunks;
+  }
+  header.channel = owner->frame.channel;
+  return header;
+}
+
+Frame FrameChunk::TakeFrame() {
+  if (offset == 0 && last) {
+    return std::move(owner->frame);
+  }
+  FrameHeader header = Header();
+  Frame frame(owner->frame.type, std::string(data(), length));
+  frame.flags = header.flags;
+  frame.channel = header.channel;
+  return frame;
+}
+
+ChannelScheduler::ChannelScheduler(size_t chunk_size) {
+  SetChunkSize(chunk_size);
+}
+
+void ChannelScheduler::SetChunkSize(size_t chunk_size) {
+  // Capped so that a quantum (weight * chunk size) always fits the deficit.
+  chunk_size_ = std::min<size_t>(std::max<size_t>(chunk_size, 1), INT32_MAX);
+}
+
+void ChannelScheduler::ConfigureChannel(uint16_t channel, ChannelOptions options) {
+  options.weight = std::max<uint32_t>(options.weight, 1);
+  Channel& state = channels_[channel];
+  if (!state.frames.empty() && state.options.priority != options.priority) {
+    // Move the active channel over to its new priority level.
+    Level& old_level = levels_[state.options.priority];
+    old_level.erase(std::remove(old_level.begin(), old_level.end(), channel), old_level.end());
+    if (old_level.empty()) {
+      levels_.erase(state.options.priority);
+    }
+    levels_[options.priority].push_back(channel);
+  }
+  if (!options.conflate) {
+    for (auto& entry : state.conflatable) {
+      entry.second->conflatable = false;
+    }
+    state.conflatable.clear();
+  }
+  state.options = options;
+}
+
+void ChannelScheduler::Enqueue(std::shared_ptr<PendingFrame> frame, const std::string* key) {
+  uint16_t channel = frame->frame.channel;
+  Channel& state = channels_[channel];
+  if (state.frames.empty()) {
+    state.deficit = 0;
+    levels_[state.options.priority].push_back(channel);
+  }
+  if (key && state.options.conflate) {
+    frame->conflatable = true;
+    frame->key = *key;
+    auto& indexed = state.conflatable[*key];
+    // An older frame queued alongside it is no longer replaced.
+    if (indexed) {
+      indexed->conflatable = false;
+    }
+    indexed = frame;
+  }
+  state.frames.push_back(std::move(frame));
+  ++queued_frames_;
+}
+
+std::shared_ptr<PendingFrame> ChannelScheduler::FindConflatable(uint16_t channel, const std::string& key) const {
+  auto channel_it = channels_.find(channel);
+  if (channel_it == channels_.end()) {
+    return nullptr;
+  }
+  auto frame_it = channel_it->second.conflatable.find(key);
+  return frame_it == channel_it->second.conflatable.end() ? nullptr : frame_it->second;
+}
+
+void ChannelScheduler::Replace(const std::shared_ptr<PendingFrame>& queued, std::shared_ptr<PendingFrame> frame) {
+  Channel& state = channels_[queued->frame.channel];
+  frame->conflatable = true;
+  frame->key = queued->key;
+  queued->conflatable = false;
+  state.conflatable[frame->key] = frame;
+  // Unstarted, so never the head of a partially sent frame.
+  *std::find(state.frames.begin(), state.frames.end(), queued) = std::move(frame);
+}
+
+bool ChannelScheduler::NextChunk(FrameChunk* chunk) {
+  if (levels_.empty()) {
+    return false;
+  }
+
+  // The most urgent non-empty level; levels are dropped once they drain.
+  auto level_it = levels_.begin();
+  Level& level = level_it->second;
+
+  while (true) {
+    uint16_t channel = level.front();
+    Channel& state = channels_[channel];
+    if (state.deficit <= 0) {
+      state.deficit += static_cast<int64_t>(state.options.weight) * static_cast<int64_t>(chunk_size_);
+      if (level.size() > 1) {
+        level.pop_front();
+        level.push_back(channel);
+        continue;
+      }
+    }
+
+    const auto& head = state.frames.front();
+    size_t remaining = head->frame.payload.size() - state.offset;
+    chunk->owner = head;
+    chunk->offset = state.offset;
+    chunk->length = std::min(remaining, chunk_size_);
+    chunk->last = chunk->length == remaining;
+    if (head->conflatable) {
+      // Started: later frames of the key queue behind it.
+      head->conflatable = false;
+      state.conflatable.erase(head->key);
+    }
+    state.deficit -= static_cast<int64_t>(std::max<size_t>(chunk->length, 1));
+
+    if (chunk->last) {
+      state.frames.pop_front();
+      state.offset = 0;
+      --queued_frames_;
+    } else {
+      state.offset += chunk->length;
+    }
+
+    if (state.frames.empty()) {
+      level.pop_front();
+      state.deficit = 0;
+      if (level.empty()) {
+        levels_.erase(level_it);
+      }
+    } else if (state.deficit <= 0 && level.size() > 1) {
+      level.pop_front();
+      level.push_back(channel);
+    }
+    return true;
+  }
+}
+
+std::deque<std::shared_ptr<PendingFrame>> ChannelScheduler::TakeAll() {
+  std::deque<std::shared_ptr<PendingFrame>> frames;
+  for (auto& channel_pair : channels_) {
+    Channel& state = channel_pair.second;
+    for (auto& frame : state.frames) {
+      frames.push_back(std::move(frame));
+    }
+    state.frames.clear();
+    state.conflatable.clear();
+    state.offset = 0;
+    state.deficit = 0;
+  }
+  levels_.clear();
+  queued_frames_ = 0;
+  return frames;
+}
+
+bool FrameAssembler::Add(Frame chunk, Frame* frame) {
+  if (chunk.flags & kFrameFlagControl) {
+    *frame = std::move(chunk);
+    return true;
+  }
+
+  auto partial_it = partial_.find(chunk.channel);
+  bool more = (chunk.flags & kFrameFlagMoreChunks) != 0;
+
+  if (partial_it == partial_.end()) {
+    if (!more) {
+      *frame = std::move(chunk);
+      return true;
+    }
+    chunk.flags &= ~kFrameFlagMoreChunks;
+    pending_bytes_ += chunk.payload.size();
+    partial_.emplace(chunk.channel, std::move(chunk));
+    return false;
+  }
+
+  partial_it->second.payload += chunk.payload;
+  pending_bytes_ += chunk.payload.size();
+  if (more) {
+    return false;
+  }
+  pending_bytes_ -= partial_it->second.payload.size();
+  *frame = std::move(partial_it->second);
+  partial_.erase(partial_it);
+  return true;
+}
+
+size_t FrameAssembler::GrownFrameBytes(const Frame& chunk) const {
+  if (chunk.flags & kFrameFlagControl) {
+    return 0;
+  }
+  auto partial_it = partial_.find(chunk.channel);
+  if (partial_it != partial_.end()) {
+    return partial_it->second.payload.size() + chunk.payload.size();
+  }
+  return (chunk.flags & kFrameFlagMoreChunks) ? chunk.payload.size() : 0;
+}
+
+}  // namespace flutter_ipc
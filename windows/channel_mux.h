@@ -0,0 +1,153 @@
+#ifndef FLUTTER_PLUGIN_CHANNEL_MUX_H_
+#define FLUTTER_PLUGIN_CHANNEL_MUX_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "frame.h"
+
+namespace flutter_ipc {
+
+// Called once a queued frame has been fully written (|success|) or dropped.
+// |error| is the Windows error code of a failed write, or ERROR_TIMEOUT for
+// a frame whose deadline passed before it was sent.
+using SendCompletion = std::function<void(bool success, uint32_t error)>;
+
+struct ChannelOptions {
+  // Channels with a higher priority always go first (strict priority).
+  uint8_t priority = 0;
+  // Channels of equal priority share the pipe in proportion to their weight
+  // (deficit round robin, one quantum is |weight| chunks).
+  uint32_t weight = 1;
+  // Keyed frames of a state-sync channel go out as diffs against the last
+  // value sent under their key, and every |snapshot_interval|-th update of
+  // a key in full; see StateEncoder. Only the sender needs to set it.
+  bool state_sync = false;
+  uint32_t snapshot_interval = 32;
+  // A keyed frame queued on a conflating channel takes the place of an
+  // unsent one of the same key, so at most one value per key waits and
+  // the peer reads the newest. The replaced frame completes at once.
+  bool conflate = false;
+};
+
+struct PendingFrame {
+  Frame frame;
+  SendCompletion completion;
+  // The timer of a send deadline, 0 if none.
+  uint64_t deadline_timer = 0;
+  // Set for a frame a newer one may replace; see ChannelOptions::conflate.
+  bool conflatable = false;
+  std::string key;
+
+  // Whoever takes a frame out of the queued state settles it: the writer
+  // by starting to send it, or a deadline by dropping it unsent. Both
+  // return whether the frame is theirs.
+  bool Start();
+  bool Drop();
+  bool dropped() const { return state_.load(std::memory_order_acquire) == kDropped; }
+
+ private:
+  static constexpr uint8_t kQueued = 0;
+  static constexpr uint8_t kStarted = 1;
+  static constexpr uint8_t kDropped = 2;
+
+  std::atomic<uint8_t> state_{kQueued};
+};
+
+// A slice of a pending frame, as picked by the scheduler.
+struct FrameChunk {
+  std::shared_ptr<PendingFrame> owner;
+  size_t offset = 0;
+  size_t length = 0;
+  bool last = false;
+
+  FrameHeader Header() const;
+  const char* data() const { return owner->frame.payload.data() + offset; }
+  // Turns the chunk into a standalone frame, moving the payload out when
+  // the chunk is the whole frame.
+  Frame TakeFrame();
+};
+
+// Splits queued frames into chunks and decides which channel writes next, so
+// a large transfer on one channel cannot hold up a small message on a
+// more urgent one for longer than one chunk. Not thread-safe.
+class ChannelScheduler {
+ public:
+  static constexpr size_t kDefaultChunkSize = 16 * 1024;
+
+  explicit ChannelScheduler(size_t chunk_size = kDefaultChunkSize);
+
+  // Takes effect from the next chunk, also midway through a frame.
+  void SetChunkSize(size_t chunk_size);
+  size_t chunk_size() const { return chunk_size_; }
+
+  void ConfigureChannel(uint16_t channel, ChannelOptions options);
+  // Queues |frame| at the back of its channel. On a conflating channel, a
+  // frame with a |key| is indexed until its first chunk goes out.
+  void Enqueue(std::shared_ptr<PendingFrame> frame, const std::string* key = nullptr);
+
+  // The frame queued under |key| on a conflating |channel| that has not
+  // started yet, or null. It may have been dropped.
+  std::shared_ptr<PendingFrame> FindConflatable(uint16_t channel, const std::string& key) const;
+  // Puts |frame|, with the same channel and key, in the place of |queued|,
+  // a frame FindConflatable() returned.
+  void Replace(const std::shared_ptr<PendingFrame>& queued, std::shared_ptr<PendingFrame> frame);
+
+  // Picks the next chunk to write. Returns false if nothing is queued.
+  bool NextChunk(FrameChunk* chunk);
+
+  // Removes every queued frame, including a partially sent one.
+  std::deque<std::shared_ptr<PendingFrame>> TakeAll();
+
+  bool IsEmpty() const { return queued_frames_ == 0; }
+  size_t QueuedFrames() const { return queued_frames_; }
+
+ private:
+  struct Channel {
+    ChannelOptions options;
+    std::deque<std::shared_ptr<PendingFrame>> frames;
+    size_t offset = 0;   // Bytes of the head frame already handed out
+    int64_t deficit = 0;
+    // Unstarted frames of a conflating channel, by key.
+    std::unordered_map<std::string, std::shared_ptr<PendingFrame>> conflatable;
+  };
+
+  // Active channels of one priority, served round robin.
+  using Level = std::deque<uint16_t>;
+
+  size_t chunk_size_;
+  size_t queued_frames_ = 0;
+  std::map<uint16_t, Channel> channels_;
+  std::map<uint8_t, Level, std::greater<uint8_t>> levels_;
+};
+
+// Reassembles chunked frames on the receiving side.
+class FrameAssembler {
+ public:
+  // Returns true with the complete frame in |frame| once |chunk| finishes
+  // one. Unchunked and control frames pass straight through.
+  bool Add(Frame chunk, Frame* frame);
+
+  // Payload bytes the frame |chunk| continues will have once it is added,
+  // or 0 if |chunk| passes straight through. Lets the caller charge or
+  // refuse the growth before Add() makes it.
+  size_t GrownFrameBytes(const Frame& chunk) const;
+
+  // Payload bytes held for frames that are not complete yet.
+  size_t pending_bytes() const { return pending_bytes_; }
+
+ private:
+  std::map<uint16_t, Frame> partial_;
+  size_t pending_bytes_ = 0;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_CHANNEL_MUX_H_
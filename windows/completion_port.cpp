@@ -0,0 +1,248 @@
+#include "completion_port.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace flutter_ipc {
+
+struct CompletionPortReader::Stream {
+  OVERLAPPED overlapped = {};
+  // Received bytes, of which the first |used| are not cut into chunks yet.
+  std::string buffer;
+  size_t used = 0;
+  ChunkHandler on_chunk;
+  CloseHandler on_closed;
+  bool reading = false;
+  // Set while a worker runs the handlers.
+  bool dispatching = false;
+  bool detached = false;
+};
+
+// static
+std::shared_ptr<CompletionPortReader> CompletionPortReader::Acquire() {
+  static std::mutex mutex;
+  static std::weak_ptr<CompletionPortReader> instance;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto reader = instance.lock();
+  if (reader) {
+    return reader;
+  }
+
+  HANDLE port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+  if (port == NULL) {
+    return nullptr;
+  }
+  // A handful of workers is plenty: each one drains a whole batch of
+  // connections per wakeup.
+  size_t workers = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, 4);
+  reader.reset(new CompletionPortReader(port, workers));
+  instance = reader;
+  return reader;
+}
+
+CompletionPortReader::CompletionPortReader(HANDLE port, size_t workers) : port_(port) {
+  for (size_t i = 0; i < workers; ++i) {
+    workers_.emplace_back(&CompletionPortReader::RunWorker, this);
+  }
+}
+
+CompletionPortReader::~CompletionPortReader() {
+  // A completion without an OVERLAPPED tells one worker to exit.
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    PostQueuedCompletionStatus(port_, 0, 0, NULL);
+  }
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  CloseHandle(port_);
+}
+
+bool CompletionPortReader::Attach(HANDLE pipe, ChunkHandler on_chunk, CloseHandler on_closed) {
+  // The association outlives a connection on the same handle, and the
+  // handle is the completion key, so a second attach finds it in place.
+  if (CreateIoCompletionPort(pipe, port_, reinterpret_cast<ULONG_PTR>(pipe), 0) == NULL &&
+      GetLastError() != ERROR_INVALID_PARAMETER) {
+    return false;
+  }
+
+  auto stream = std::make_shared<Stream>();
+  stream->on_chunk = std::move(on_chunk);
+  stream->on_closed = std::move(on_closed);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  // The previous connection on this handle may still be finishing.
+  finished_.wait(lock, [&] { return streams_.find(pipe) == streams_.end(); });
+  streams_[pipe] = stream;
+  if (!IssueRead(pipe, stream.get())) {
+    streams_.erase(pipe);
+    return false;
+  }
+  return true;
+}
+
+void CompletionPortReader::Detach(HANDLE pipe) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = streams_.find(pipe);
+  if (it == streams_.end()) {
+    return;
+  }
+  auto stream = it->second;
+  stream->detached = true;
+  if (stream->reading) {
+    // The aborted read still completes through the port.
+    CancelIoEx(pipe, &stream->overlapped);
+  } else if (!stream->dispatching) {
+    Finish(pipe);
+    return;
+  }
+  finished_.wait(lock, [&] {
+    auto current = streams_.find(pipe);
+    return current == streams_.end() || current->second != stream;
+  });
+}
+
+CompletionPortStats CompletionPortReader::GetStats() const {
+  CompletionPortStats stats;
+  stats.dequeues = dequeues_;
+  stats.completions = completions_;
+  stats.reads = reads_;
+  stats.chunks = chunks_;
+  return stats;
+}
+
+void CompletionPortReader::RunWorker() {
+  OVERLAPPED_ENTRY entries[kMaxBatch];
+  while (true) {
+    ULONG count = 0;
+    if (!GetQueuedCompletionStatusEx(port_, entries, kMaxBatch, &count, INFINITE, FALSE)) {
+      return; // The port is gone
+    }
+    ++dequeues_;
+    completions_ += count;
+
+    bool stop = false;
+    for (ULONG i = 0; i < count; ++i) {
+      if (entries[i].lpOverlapped == NULL) {
+        // Pass on exit requests meant for the other workers.
+        if (stop) {
+          PostQueuedCompletionStatus(port_, 0, 0, NULL);
+        }
+        stop = true;
+        continue;
+      }
+      OnCompletion(reinterpret_cast<HANDLE>(entries[i].lpCompletionKey), entries[i].lpOverlapped);
+    }
+    if (stop) {
+      return;
+    }
+  }
+}
+
+void CompletionPortReader::OnCompletion(HANDLE pipe, OVERLAPPED* overlapped) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = streams_.find(pipe);
+  // Writes and connects on an attached pipe complete through the port as
+  // well, and are not ours to handle.
+  if (it == streams_.end() || &it->second->overlapped != overlapped) {
+    return;
+  }
+  auto stream = it->second;
+  stream->reading = false;
+  if (stream->detached) {
+    Finish(pipe);
+    return;
+  }
+
+  DWORD transferred = 0;
+  // ERROR_MORE_DATA only means the pipe message continues in the next read.
+  bool open = GetOverlappedResult(pipe, &stream->overlapped, &transferred, FALSE) ||
+              GetLastError() == ERROR_MORE_DATA;
+  stream->used += transferred;
+  stream->dispatching = true;
+  lock.unlock();
+
+  std::vector<Frame> chunks;
+  open = TakeChunks(stream.get(), &chunks) && open;
+  chunks_ += chunks.size();
+  for (auto& chunk : chunks) {
+    if (!stream->on_chunk(std::move(chunk))) {
+      open = false;
+      break;
+    }
+  }
+
+  lock.lock();
+  stream->dispatching = false;
+  if (stream->detached) {
+    Finish(pipe);
+    return;
+  }
+  if (open && IssueRead(pipe, stream.get())) {
+    return;
+  }
+
+  // The peer is gone. Detach() waits until the handler has run.
+  stream->dispatching = true;
+  lock.unlock();
+  stream->on_closed();
+  lock.lock();
+  Finish(pipe);
+}
+
+bool CompletionPortReader::IssueRead(HANDLE pipe, Stream* stream) {
+  // Grows the buffer when a chunk is larger than what is left of it.
+  if (stream->buffer.size() - stream->used < kReadSize / 2) {
+    stream->buffer.resize(stream->used + kReadSize);
+  }
+  ZeroMemory(&stream->overlapped, sizeof(OVERLAPPED));
+  stream->reading = true;
+  ++reads_;
+  // Completes through the port even when it finishes at once.
+  if (!ReadFile(pipe, &stream->buffer[stream->used],
+                static_cast<DWORD>(stream->buffer.size() - stream->used), NULL,
+                &stream->overlapped)) {
+    DWORD error = GetLastError();
+    if (error != ERROR_IO_PENDING && error != ERROR_MORE_DATA) {
+      stream->reading = false;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CompletionPortReader::TakeChunks(Stream* stream, std::vector<Frame>* chunks) {
+  size_t offset = 0;
+  bool valid = true;
+  while (stream->used - offset >= sizeof(FrameHeader)) {
+    FrameHeader header;
+    memcpy(&header, &stream->buffer[offset], sizeof(header));
+    if (header.length > kMaxChunkLength) {
+      valid = false;
+      break;
+    }
+    if (stream->used - offset - sizeof(header) < header.length) {
+      break;
+    }
+    Frame chunk;
+    chunk.type = static_cast<FrameType>(header.type);
+    chunk.flags = header.flags;
+    chunk.channel = header.channel;
+    chunk.payload.assign(&stream->buffer[offset + sizeof(header)], header.length);
+    chunks->push_back(std::move(chunk));
+    offset += sizeof(header) + header.length;
+  }
+
+  // Keeps a partial chunk at the front for the next read to complete.
+  if (offset > 0) {
+    memmove(&stream->buffer[0], &stream->buffer[offset], stream->used - offset);
+    stream->used -= offset;
+  }
+  return valid;
+}
+
+void CompletionPortReader::Finish(HANDLE pipe) {
+  streams_.erase(pipe);
+  finished_.notify_all();
+}
+
+}  // namespace flutter_ipc
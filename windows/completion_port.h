@@ -0,0 +1,102 @@
+#ifndef FLUTTER_PLUGIN_COMPLETION_PORT_H_
+#define FLUTTER_PLUGIN_COMPLETION_PORT_H_
+
+#include <windows.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame.h"
+
+namespace flutter_ipc {
+
+struct CompletionPortStats {
+  // GetQueuedCompletionStatusEx calls that returned completions, and the
+  // completions they returned.
+  uint64_t dequeues = 0;
+  uint64_t completions = 0;
+  // ReadFile calls issued, and the frame chunks they delivered.
+  uint64_t reads = 0;
+  uint64_t chunks = 0;
+};
+
+// Reads the kernel pipes of many connections on a few shared threads
+// instead of one blocked thread per connection. Every attached pipe keeps
+// one overlapped read outstanding into a buffer of its own that is reused
+// from read to read; the workers dequeue up to kMaxBatch completions per
+// system call and cut each read into frame chunks.
+//
+// Completions of one pipe are handled one at a time, in order, so its
+// handlers never run concurrently.
+class CompletionPortReader {
+ public:
+  // Returns false to drop the connection.
+  using ChunkHandler = std::function<bool(Frame chunk)>;
+  using CloseHandler = std::function<void()>;
+
+  static constexpr ULONG kMaxBatch = 64;
+  static constexpr DWORD kReadSize = 64 * 1024;
+
+  // Returns the process-wide reader, starting it if nobody holds it. Null if
+  // the completion port cannot be created; callers then read on a thread of
+  // their own. The reader stops when the last holder lets go, which must
+  // not happen on one of its workers.
+  static std::shared_ptr<CompletionPortReader> Acquire();
+
+  ~CompletionPortReader();
+
+  // Disallow copy and assign.
+  CompletionPortReader(const CompletionPortReader&) = delete;
+  CompletionPortReader& operator=(const CompletionPortReader&) = delete;
+
+  // Starts reading |pipe|, which must have been opened for overlapped I/O.
+  // |on_chunk| runs on a worker for every chunk received; |on_closed| runs
+  // once if the pipe breaks or the peer is dropped, after which it is no
+  // longer attached. Returns false if the pipe cannot be associated with
+  // the port.
+  bool Attach(HANDLE pipe, ChunkHandler on_chunk, CloseHandler on_closed);
+
+  // Stops reading |pipe| and waits for its handlers to return; |on_closed|
+  // is not called. Does nothing if |pipe| is not attached. Must not be
+  // called from a handler.
+  void Detach(HANDLE pipe);
+
+  CompletionPortStats GetStats() const;
+
+ private:
+  struct Stream;
+
+  CompletionPortReader(HANDLE port, size_t workers);
+
+  void RunWorker();
+  void OnCompletion(HANDLE pipe, OVERLAPPED* overlapped);
+  // Called with |mutex_| held. Returns false if the pipe is broken.
+  bool IssueRead(HANDLE pipe, Stream* stream);
+  // Cuts the complete chunks off the front of |stream|'s buffer. Returns
+  // false on a chunk longer than kMaxChunkLength; the peer is then dropped.
+  bool TakeChunks(Stream* stream, std::vector<Frame>* chunks);
+  // Called with |mutex_| held once the stream of |pipe| is done with.
+  void Finish(HANDLE pipe);
+
+  HANDLE port_;
+  std::mutex mutex_;
+  std::condition_variable finished_;
+  std::map<HANDLE, std::shared_ptr<Stream>> streams_;
+  std::vector<std::thread> workers_;
+  std::atomic<uint64_t> dequeues_{0};
+  std::atomic<uint64_t> completions_{0};
+  std::atomic<uint64_t> reads_{0};
+  std::atomic<uint64_t> chunks_{0};
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_COMPLETION_PORT_H_
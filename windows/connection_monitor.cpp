@@ -0,0 +1,181 @@
+#include "connection_monitor.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace flutter_ipc {
+
+Frame EncodeHeartbeatFrame() {
+  Frame frame(FrameType::HEARTBEAT, std::string());
+  frame.flags = kFrameFlagControl;
+  return frame;
+}
+
+ConnectionMonitor::ConnectionMonitor(const ConnectionOptions& options)
+    : heartbeat_ms_(options.heartbeat_interval_ms),
+      idle_ms_(options.idle_timeout_ms),
+      connect_ms_(options.connect_timeout_ms),
+      period_ms_(UINT64_MAX) {
+  // Idle connections are found within a quarter of the timeout.
+  if (heartbeat_ms_ != 0) {
+    period_ms_ = heartbeat_ms_;
+  }
+  if (idle_ms_ != 0) {
+    period_ms_ = std::min(period_ms_, std::max<uint64_t>(idle_ms_ / 4, TimerService::kTickMs));
+  }
+  if (heartbeat_ms_ != 0 || idle_ms_ != 0 || connect_ms_ != 0) {
+    timers_ = TimerService::Acquire();
+  }
+}
+
+ConnectionMonitor::~ConnectionMonitor() {
+  Stop();
+}
+
+void ConnectionMonitor::SetTimeoutHandler(TimeoutHandler handler) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  handler_ = std::move(handler);
+}
+
+void ConnectionMonitor::StartConnect(std::function<bool()> abort) {
+  if (!timers_ || connect_ms_ == 0) {
+    return;
+  }
+  timers_->Cancel(Disarm());
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t generation = generation_;
+  abort_ = std::move(abort);
+  timer_ = timers_->Schedule(connect_ms_, [this, generation]() { OnConnectTimeout(generation); });
+}
+
+void ConnectionMonitor::StartConnection(std::weak_ptr<SendQueue> send_queue, std::function<void()> drop) {
+  if (!timers_) {
+    return;
+  }
+  timers_->Cancel(Disarm());
+  if (period_ms_ == UINT64_MAX) {
+    return; // Only a connect timeout
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t generation = generation_;
+  send_queue_ = std::move(send_queue);
+  drop_ = std::move(drop);
+  timed_out_ = false;
+  uint64_t now = TimerService::NowMs();
+  last_heartbeat_ms_ = 0;
+  last_received_ms_.store(now, std::memory_order_relaxed);
+  last_activity_ms_.store(now, std::memory_order_relaxed);
+  // The first check announces this end right away.
+  timer_ = timers_->Schedule(0, [this, generation]() { Check(generation); });
+}
+
+void ConnectionMonitor::Stop() {
+  if (timers_) {
+    timers_->Cancel(Disarm());
+  }
+}
+
+void ConnectionMonitor::OnReceived(bool application) {
+  if (!timers_) {
+    return;
+  }
+  uint64_t now = TimerService::NowMs();
+  last_received_ms_.store(now, std::memory_order_relaxed);
+  if (application) {
+    last_activity_ms_.store(now, std::memory_order_relaxed);
+  }
+}
+
+void ConnectionMonitor::OnSent() {
+  if (timers_ && idle_ms_ != 0) {
+    last_activity_ms_.store(TimerService::NowMs(), std::memory_order_relaxed);
+  }
+}
+
+TimerId ConnectionMonitor::Disarm() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++generation_;
+  TimerId timer = timer_;
+  timer_ = 0;
+  send_queue_.reset();
+  abort_ = nullptr;
+  drop_ = nullptr;
+  return timer;
+}
+
+void ConnectionMonitor::OnConnectTimeout(uint64_t generation) {
+  std::function<bool()> abort;
+  TimeoutHandler handler;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation != generation_) {
+      return;
+    }
+    abort = abort_;
+    handler = handler_;
+  }
+  // Without the lock, as in Check().
+  if (abort && abort() && handler) {
+    handler(Timeout::CONNECT);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (generation == generation_) {
+    timer_ = 0;
+  }
+}
+
+void ConnectionMonitor::Check(uint64_t generation) {
+  std::function<void()> drop;
+  TimeoutHandler handler;
+  Timeout timeout = Timeout::HEARTBEAT;
+  std::shared_ptr<SendQueue> send_queue;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation != generation_) {
+      return;
+    }
+    uint64_t now = TimerService::NowMs();
+    if (!timed_out_) {
+      // Frames may have been stamped by other threads after |now| was taken.
+      uint64_t silent_ms = now - std::min(now, last_received_ms_.load(std::memory_order_relaxed));
+      uint64_t idle_ms = now - std::min(now, last_activity_ms_.load(std::memory_order_relaxed));
+      if (heartbeat_ms_ != 0 && silent_ms >= heartbeat_ms_ * kMissedHeartbeats) {
+        timed_out_ = true;
+        timeout = Timeout::HEARTBEAT;
+        handler = handler_;
+      } else if (idle_ms_ != 0 && idle_ms >= idle_ms_) {
+        timed_out_ = true;
+        timeout = Timeout::IDLE;
+        handler = handler_;
+      }
+    }
+    if (timed_out_) {
+      drop = drop_;
+    }
+
+    if (!timed_out_ && heartbeat_ms_ != 0 && now - last_heartbeat_ms_ >= heartbeat_ms_) {
+      send_queue = send_queue_.lock();
+      last_heartbeat_ms_ = now;
+    }
+  }
+
+  // The callbacks may call back into the connection, so they run without
+  // the lock, like SendQueue's completions. |timer_| still names this
+  // check meanwhile, so Stop() waits for them.
+  if (drop) {
+    drop();
+  }
+  if (handler) {
+    handler(timeout);
+  }
+  if (send_queue) {
+    send_queue->SendControl(EncodeHeartbeatFrame());
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (generation == generation_) {
+    timer_ = timers_->Schedule(period_ms_, [this, generation]() { Check(generation); });
+  }
+}
+
+}  // namespace flutter_ipc
@@ -0,0 +1,97 @@
+#ifndef FLUTTER_PLUGIN_CONNECTION_MONITOR_H_
+#define FLUTTER_PLUGIN_CONNECTION_MONITOR_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "connection_options.h"
+#include "frame.h"
+#include "send_queue.h"
+#include "timing_wheel.h"
+
+namespace flutter_ipc {
+
+// A HEARTBEAT frame only says that its sender is alive.
+Frame EncodeHeartbeatFrame();
+
+// The timeouts of one server or client, kept on the shared TimerService:
+// how long a connect may take, and, once connected, heartbeats to the peer
+// and the check that the peer is alive and the connection in use. Does
+// nothing for options without timeouts. Thread-safe.
+class ConnectionMonitor {
+ public:
+  // A peer that has sent nothing for this many heartbeat intervals is
+  // taken for dead.
+  static constexpr uint32_t kMissedHeartbeats = 3;
+
+  enum class Timeout {
+    CONNECT,    // No connection within connect_timeout_ms
+    HEARTBEAT,  // The peer stopped sending
+    IDLE,       // No application frames within idle_timeout_ms
+  };
+
+  // Runs on the timer thread, once per connect attempt or connection, after
+  // the attempt was aborted or the connection dropped. Must not block.
+  using TimeoutHandler = std::function<void(Timeout timeout)>;
+
+  explicit ConnectionMonitor(const ConnectionOptions& options);
+  ~ConnectionMonitor();
+
+  // Disallow copy and assign.
+  ConnectionMonitor(const ConnectionMonitor&) = delete;
+  ConnectionMonitor& operator=(const ConnectionMonitor&) = delete;
+
+  void SetTimeoutHandler(TimeoutHandler handler);
+
+  // Arms the connect timeout. |abort| runs on the timer thread if it
+  // expires first, and returns whether there was a connect left to abort.
+  void StartConnect(std::function<bool()> abort);
+  // The connection is up: disarms the connect timeout and starts sending
+  // heartbeats through |send_queue|. |drop| runs on the timer thread when
+  // the connection times out, and again every check until Stop(), in case
+  // the first one raced with a read being started.
+  void StartConnection(std::weak_ptr<SendQueue> send_queue, std::function<void()> drop);
+  // Disarms everything. Waits for a check that is running right now, so
+  // must not be called with a lock that |drop| or |abort| takes.
+  void Stop();
+
+  // Every frame received counts as a sign of life; |application| frames,
+  // sent or received, also keep the connection from idling.
+  void OnReceived(bool application);
+  void OnSent();
+
+  bool enabled() const { return timers_ != nullptr; }
+
+ private:
+  void OnConnectTimeout(uint64_t generation);
+  void Check(uint64_t generation);
+  // Cancels the armed timer and invalidates running ones.
+  TimerId Disarm();
+
+  uint64_t heartbeat_ms_;
+  uint64_t idle_ms_;
+  uint64_t connect_ms_;
+  // How often a connection is checked.
+  uint64_t period_ms_;
+  std::shared_ptr<TimerService> timers_;
+
+  std::mutex mutex_;
+  TimeoutHandler handler_;
+  // Bumped by every start and stop, so a stale timer does nothing.
+  uint64_t generation_ = 0;
+  TimerId timer_ = 0;
+  std::weak_ptr<SendQueue> send_queue_;
+  std::function<bool()> abort_;
+  std::function<void()> drop_;
+  bool timed_out_ = false;
+  uint64_t last_heartbeat_ms_ = 0;
+  std::atomic<uint64_t> last_received_ms_{0};
+  std::atomic<uint64_t> last_activity_ms_{0};
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_CONNECTION_MONITOR_H_
@@ -0,0 +1,147 @@
+#include "connection_options.h"
+
+#include <algorithm>
+
+namespace flutter_ipc {
+
+namespace {
+
+constexpr size_t kMinChunkSize = 4 * 1024;
+constexpr size_t kMaxCoalesceBytes = 64 * 1024;
+// Frames up to this size are worth batching.
+constexpr size_t kSmallFrameSize = 2 * 1024;
+
+// Smallest size with |bits| significant bits, i.e. the top of the bucket
+// below.
+size_t BucketLimit(size_t bits) {
+  return bits >= 63 ? SIZE_MAX : (static_cast<size_t>(1) << bits);
+}
+
+size_t BitLength(size_t value) {
+  size_t bits = 0;
+  while (value) {
+    ++bits;
+    value >>= 1;
+  }
+  return bits;
+}
+
+}  // namespace
+
+const char* TuningProfileName(TuningProfile profile) {
+  switch (profile) {
+    case TuningProfile::LATENCY:
+      return "latency";
+    case TuningProfile::THROUGHPUT:
+      return "throughput";
+    case TuningProfile::AUTO:
+      return "auto";
+    default:
+      return "balanced";
+  }
+}
+
+bool ParseTuningProfile(const std::string& name, TuningProfile* profile) {
+  for (TuningProfile candidate : {TuningProfile::BALANCED, TuningProfile::LATENCY,
+                                  TuningProfile::THROUGHPUT, TuningProfile::AUTO}) {
+    if (name == TuningProfileName(candidate)) {
+      *profile = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* IoBackendName(IoBackend backend) {
+  return backend == IoBackend::COMPLETION_PORT ? "completionPort" : "threads";
+}
+
+bool ParseIoBackend(const std::string& name, IoBackend* backend) {
+  for (IoBackend candidate : {IoBackend::THREADS, IoBackend::COMPLETION_PORT}) {
+    if (name == IoBackendName(candidate)) {
+      *backend = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* FramingName(Framing framing) {
+  return framing == Framing::NEWLINE ? "newline" : "lengthPrefixed";
+}
+
+bool ParseFraming(const std::string& name, Framing* framing) {
+  for (Framing candidate : {Framing::LENGTH_PREFIXED, Framing::NEWLINE}) {
+    if (name == FramingName(candidate)) {
+      *framing = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+// static
+ConnectionOptions ConnectionOptions::ForProfile(TuningProfile profile) {
+  ConnectionOptions options;
+  options.profile = profile;
+  switch (profile) {
+    case TuningProfile::LATENCY:
+      // Small chunks keep an urgent frame from waiting behind a large one.
+      options.out_buffer_size = 64 * 1024;
+      options.in_buffer_size = 64 * 1024;
+      options.chunk_size = 4 * 1024;
+      break;
+    case TuningProfile::THROUGHPUT:
+      options.out_buffer_size = 1024 * 1024;
+      options.in_buffer_size = 1024 * 1024;
+      options.max_queued_bytes = 64 * 1024 * 1024;
+      options.chunk_size = kMaxChunkLength;
+      options.coalesce_bytes = kMaxCoalesceBytes;
+      options.receive_window.bytes = 4 * 1024 * 1024;
+      options.receive_window.messages = 4096;
+      break;
+    case TuningProfile::AUTO:
+      // Buffers are fixed when the pipe is created, so start roomy.
+      options.out_buffer_size = 256 * 1024;
+      options.in_buffer_size = 256 * 1024;
+      break;
+    default:
+      break;
+  }
+  return options;
+}
+
+bool AutoTuner::Observe(size_t size, size_t* chunk_size, size_t* coalesce_bytes) {
+  ++buckets_[BitLength(size)];
+  if (++observed_ < kWindow) {
+    return false;
+  }
+
+  size_t median_bits = SIZE_MAX;
+  size_t p90_bits = 0;
+  size_t seen = 0;
+  for (size_t bits = 0; bits < buckets_.size(); ++bits) {
+    seen += buckets_[bits];
+    if (median_bits == SIZE_MAX && seen * 2 >= observed_) {
+      median_bits = bits;
+    }
+    if (seen * 10 >= observed_ * 9) {
+      p90_bits = bits;
+      break;
+    }
+  }
+  buckets_.fill(0);
+  observed_ = 0;
+
+  // Most frames go out in one chunk, without letting one frame hold the
+  // pipe for too long.
+  *chunk_size = std::clamp(BucketLimit(p90_bits), kMinChunkSize, kMaxChunkLength);
+  // Mostly small frames are batched, about 32 to a write.
+  size_t median = BucketLimit(median_bits);
+  *coalesce_bytes = median <= kSmallFrameSize
+      ? std::clamp(median * 32, kMinChunkSize, kMaxCoalesceBytes)
+      : 0;
+  return true;
+}
+
+}  // namespace flutter_ipc
@@ -0,0 +1,169 @@
+#ifndef FLUTTER_PLUGIN_CONNECTION_OPTIONS_H_
+#define FLUTTER_PLUGIN_CONNECTION_OPTIONS_H_
+
+#include <windows.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "channel_mux.h"
+#include "flow_control.h"
+#include "memory_budget.h"
+#include "network_shaper.h"
+#include "polling.h"
+#include "stripe.h"
+
+namespace flutter_ipc {
+
+enum class TuningProfile {
+  BALANCED,    // The defaults
+  LATENCY,     // Small chunks, nothing held back to batch
+  THROUGHPUT,  // Large buffers, chunks and windows; small frames batched
+  AUTO,        // Chunking and batching follow the observed message sizes
+};
+
+const char* TuningProfileName(TuningProfile profile);
+bool ParseTuningProfile(const std::string& name, TuningProfile* profile);
+
+// How a kernel pipe connection reads.
+enum class IoBackend {
+  THREADS,          // A thread per connection, blocked in its reads
+  COMPLETION_PORT,  // Shared CompletionPortReader workers
+};
+
+const char* IoBackendName(IoBackend backend);
+bool ParseIoBackend(const std::string& name, IoBackend* backend);
+
+// How messages are delimited on a kernel pipe.
+enum class Framing {
+  LENGTH_PREFIXED,  // Frames with a FrameHeader, between flutter_ipc peers
+  NEWLINE,          // Newline-terminated text, for line-oriented processes
+};
+
+const char* FramingName(Framing framing);
+bool ParseFraming(const std::string& name, Framing* framing);
+
+// Tuning of one server or client connection. Start from ForProfile() and
+// override single fields.
+struct ConnectionOptions {
+  TuningProfile profile = TuningProfile::BALANCED;
+
+  // Kernel pipe buffers and instance limit, passed to CreateNamedPipe by
+  // servers. Every server sharing a pipe name must agree on the limit.
+  DWORD out_buffer_size = 4096;
+  DWORD in_buffer_size = 4096;
+  DWORD max_instances = 1;
+  // Servers: the pipe's default wait for WaitNamedPipe. Clients: how long
+  // to wait for a busy pipe before failing the connect; 0 fails at once.
+  DWORD timeout_ms = 0;
+
+  // Send queue: the bound on queued payload bytes, the size of the chunks
+  // large frames are split into, and how many bytes of small frames may
+  // be batched into one write (0 writes every chunk by itself).
+  size_t max_queued_bytes = 16 * 1024 * 1024;
+  size_t chunk_size = ChannelScheduler::kDefaultChunkSize;
+  size_t coalesce_bytes = 0;
+
+  // What this end lets its peer send ahead of the application.
+  FlowWindow receive_window;
+
+  // Spinning, pinning and priority of the connection's I/O and writer
+  // threads. Independent of the profile.
+  PollingOptions polling;
+
+  // Falls back to THREADS when no completion port can be created, for
+  // resilient clients, and for connections within this process. Polling
+  // applies to the writer thread only then.
+  IoBackend io_backend = IoBackend::THREADS;
+
+  // Parses inbound text frames as JSON on a handler pool worker and
+  // delivers the resulting values on the endpoint's JSON stream in place
+  // of the text.
+  bool decode_json = false;
+
+  // NEWLINE framing turns the pipe into a byte stream of text records: no
+  // headers, channels, flow control or session, and text messages only.
+  // Such connections always use IoBackend::THREADS and never connect
+  // within this process. Longer inbound records, not counting the newline,
+  // are dropped.
+  Framing framing = Framing::LENGTH_PREFIXED;
+  size_t max_record_length = 1024 * 1024;
+
+  // Caps the memory held for this endpoint: queued outbound frames,
+  // received frames the application has not consumed and frames still
+  // being reassembled. 0 leaves only the process-wide MemoryBudget. A
+  // PAUSE_READS limit uses IoBackend::THREADS, whose reads can wait.
+  size_t memory_limit = 0;
+  BudgetPolicy memory_policy = BudgetPolicy::PAUSE_READS;
+
+  // Liveness, all in milliseconds and 0 to disable. Heartbeats go out
+  // every interval, and the connection drops after
+  // ConnectionMonitor::kMissedHeartbeats intervals without a frame from the
+  // peer; both ends should agree on it. Idle connections drop after the
+  // idle timeout without application frames either way. A server waiting
+  // longer than the connect timeout for a client stops listening, and a
+  // resilient client gives up a reconnect that takes longer.
+  uint32_t heartbeat_interval_ms = 0;
+  uint32_t idle_timeout_ms = 0;
+  uint32_t connect_timeout_ms = 0;
+
+  // Pooling. A client opens |connections| instances of the pipe and
+  // spreads its frames over them by |stripe_policy|; a server accepts that
+  // many from one pooled client and spreads its replies the same way. With
+  // |ordered_stripes| the frames of each channel are numbered, and the
+  // receiving end restores their order; ordered frames cannot have a send
+  // timeout, as a dropped one would hold up the rest. Pools use kernel
+  // pipes with LENGTH_PREFIXED framing, and clients are not resilient.
+  static constexpr uint32_t kMaxConnections = 64;
+  uint32_t connections = 1;
+  StripePolicy stripe_policy = StripePolicy::ROUND_ROBIN;
+  bool ordered_stripes = true;
+
+  // Deduplication of repeated payloads. Text and value messages of at
+  // least |blob_min_bytes| are remembered, up to |blob_cache_bytes| of them
+  // per connection, and the peer keeps a copy; sending one again costs a
+  // 17-byte reference. The peer's copies count on top of its memory_limit.
+  // 0 disables it. Needs LENGTH_PREFIXED framing. Both ends should agree
+  // on the size: a peer with a smaller cache, or none, only ever refers
+  // to fewer payloads.
+  size_t blob_cache_bytes = 0;
+  size_t blob_min_bytes = 4096;
+
+  // The last values of the keys of state-sync channels kept per
+  // connection, to diff against when sending and to apply diffs to when
+  // receiving; see ChannelOptions::state_sync. Keys past it go out in
+  // full. Both ends should agree on it, and it counts on top of
+  // memory_limit. Needs LENGTH_PREFIXED framing; 0 sends keyed frames in
+  // full.
+  size_t state_cache_bytes = 16 * 1024 * 1024;
+
+  // Bandwidth caps, delays, short writes, read stalls and disconnects put
+  // on this endpoint's connections, for load tests and benchmarks; see
+  // NetworkShaper. Each connection of a pool draws from its own seed.
+  ShapingOptions shaping;
+
+  static ConnectionOptions ForProfile(TuningProfile profile);
+};
+
+// Picks the chunk size and batching window of an AUTO connection from the
+// sizes of the frames it sends, re-evaluated every kWindow frames. Not
+// thread-safe.
+class AutoTuner {
+ public:
+  static constexpr size_t kWindow = 1024;
+
+  // Records a frame of |size| bytes. Returns true, with new values in
+  // |chunk_size| and |coalesce_bytes|, when a window completes.
+  bool Observe(size_t size, size_t* chunk_size, size_t* coalesce_bytes);
+
+ private:
+  // Frames by the bit length of their size.
+  std::array<uint32_t, 64> buckets_{};
+  size_t observed_ = 0;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_CONNECTION_OPTIONS_H_
@@ -0,0 +1,38 @@
+#include "cpu_features.h"
+
+namespace flutter_ipc {
+
+namespace {
+
+CpuFeatures DetectCpuFeatures() {
+  CpuFeatures features;
+#if defined(FLUTTER_IPC_X86)
+#if defined(_MSC_VER)
+  int info[4] = {};
+  __cpuid(info, 0);
+  int max_leaf = info[0];
+  __cpuid(info, 1);
+  features.ssse3 = (info[2] & (1 << 9)) != 0;
+  // AVX2 also needs the OS to save the upper halves of the registers.
+  bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+  if (max_leaf >= 7 && os_saves_ymm) {
+    __cpuidex(info, 7, 0);
+    features.avx2 = (info[1] & (1 << 5)) != 0;
+  }
+#else
+  __builtin_cpu_init();
+  features.ssse3 = __builtin_cpu_supports("ssse3");
+  features.avx2 = __builtin_cpu_supports("avx2");
+#endif
+#endif
+  return features;
+}
+
+}  // namespace
+
+const CpuFeatures& GetCpuFeatures() {
+  static const CpuFeatures features = DetectCpuFeatures();
+  return features;
+}
+
+}  // namespace flutter_ipc
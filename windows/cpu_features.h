@@ -0,0 +1,32 @@
+#ifndef FLUTTER_PLUGIN_CPU_FEATURES_H_
+#define FLUTTER_PLUGIN_CPU_FEATURES_H_
+
+// Runtime dispatch for the vectorized scanners. FLUTTER_IPC_X86 is defined
+// when compiling for x86 or x64; code for an instruction set beyond the
+// build's baseline goes into functions marked FLUTTER_IPC_TARGET and only
+// runs once GetCpuFeatures() reports it.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FLUTTER_IPC_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC compiles intrinsics of any instruction set without a target switch.
+#define FLUTTER_IPC_TARGET(features)
+#else
+#define FLUTTER_IPC_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
+namespace flutter_ipc {
+
+struct CpuFeatures {
+  bool ssse3 = false;
+  bool avx2 = false;
+};
+
+// Detected once, on first use. All false on other architectures.
+const CpuFeatures& GetCpuFeatures();
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_CPU_FEATURES_H_
@@ -0,0 +1,119 @@
+#include "flow_control.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace flutter_ipc {
+
+namespace {
+
+#pragma pack(push, 1)
+struct CreditPayload {
+  uint32_t bytes;
+  uint32_t messages;
+};
+#pragma pack(pop)
+
+// Grants are capped so they always fit the wire format.
+uint32_t ClampGrant(uint64_t value) {
+  return static_cast<uint32_t>(std::min<uint64_t>(value, UINT32_MAX));
+}
+
+}  // namespace
+
+Frame EncodeCreditFrame(uint32_t bytes, uint32_t messages) {
+  CreditPayload credit = {bytes, messages};
+  std::string payload(sizeof(credit), '\0');
+  memcpy(&payload[0], &credit, sizeof(credit));
+  Frame frame(FrameType::CREDIT, std::move(payload));
+  frame.flags = kFrameFlagControl;
+  return frame;
+}
+
+bool DecodeCreditFrame(const Frame& frame, uint32_t* bytes, uint32_t* messages) {
+  if (frame.type != FrameType::CREDIT || frame.payload.size() != sizeof(CreditPayload)) {
+    return false;
+  }
+  CreditPayload credit;
+  memcpy(&credit, frame.payload.data(), sizeof(credit));
+  *bytes = credit.bytes;
+  *messages = credit.messages;
+  return true;
+}
+
+FlowController::FlowController(FlowWindow receive_window)
+    : receive_window_(receive_window) {
+  receive_window_.bytes = std::max<uint32_t>(receive_window_.bytes, 1);
+  receive_window_.messages = std::max<uint32_t>(receive_window_.messages, 1);
+}
+
+void FlowController::OnSent(size_t bytes, bool end_of_frame) {
+  send_bytes_ -= static_cast<int64_t>(bytes);
+  // A message is only counted once complete, so partially sent frames on
+  // several channels never wait on each other for message credit.
+  if (end_of_frame) {
+    --send_messages_;
+  }
+}
+
+void FlowController::OnCredit(uint32_t bytes, uint32_t messages) {
+  send_bytes_ += bytes;
+  send_messages_ += messages;
+}
+
+void FlowController::SetStalled(bool stalled, Clock::time_point now) {
+  if (stalled == stalled_) {
+    return;
+  }
+  stalled_ = stalled;
+  if (stalled) {
+    stalled_since_ = now;
+    ++stalls_;
+  } else {
+    stall_time_ += now - stalled_since_;
+  }
+}
+
+void FlowController::OnReceived(size_t bytes) {
+  unconsumed_bytes_ += bytes;
+  ++unconsumed_messages_;
+}
+
+bool FlowController::OnConsumed(size_t bytes, uint32_t* grant_bytes, uint32_t* grant_messages) {
+  unconsumed_bytes_ -= std::min<uint64_t>(bytes, unconsumed_bytes_);
+  if (unconsumed_messages_ > 0) {
+    --unconsumed_messages_;
+  }
+  consumed_bytes_ += bytes;
+  ++consumed_messages_;
+
+  // Once the sender is out of credit, everything in flight is covered by
+  // |consumed_*|, which then exceeds a quarter window; so batching never
+  // holds back the grant that would unblock it.
+  if (consumed_bytes_ < std::max<uint32_t>(receive_window_.bytes / 4, 1) &&
+      consumed_messages_ < std::max<uint32_t>(receive_window_.messages / 4, 1)) {
+    return false;
+  }
+  *grant_bytes = ClampGrant(consumed_bytes_);
+  *grant_messages = ClampGrant(consumed_messages_);
+  consumed_bytes_ -= *grant_bytes;
+  consumed_messages_ -= *grant_messages;
+  return true;
+}
+
+FlowStats FlowController::Stats(Clock::time_point now) const {
+  FlowStats stats;
+  stats.send_credit_bytes = send_bytes_;
+  stats.send_credit_messages = send_messages_;
+  stats.unconsumed_bytes = unconsumed_bytes_;
+  stats.unconsumed_messages = unconsumed_messages_;
+  stats.stalls = stalls_;
+  Clock::duration stall_time = stall_time_;
+  if (stalled_) {
+    stall_time += now - stalled_since_;
+  }
+  stats.stall_time = std::chrono::duration_cast<std::chrono::microseconds>(stall_time);
+  return stats;
+}
+
+}  // namespace flutter_ipc
@@ -0,0 +1,90 @@
+#ifndef FLUTTER_PLUGIN_FLOW_CONTROL_H_
+#define FLUTTER_PLUGIN_FLOW_CONTROL_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "frame.h"
+
+namespace flutter_ipc {
+
+// How much one end is willing to hold of data it has received but its
+// application has not consumed yet.
+struct FlowWindow {
+  static constexpr uint32_t kDefaultBytes = 256 * 1024;
+  static constexpr uint32_t kDefaultMessages = 256;
+
+  uint32_t bytes = kDefaultBytes;
+  uint32_t messages = kDefaultMessages;
+};
+
+struct FlowStats {
+  // What may still be sent before the peer grants more. Negative while the
+  // last chunk sent overdrew the window.
+  int64_t send_credit_bytes = 0;
+  int64_t send_credit_messages = 0;
+  // Received from the peer but not yet consumed by the application.
+  uint64_t unconsumed_bytes = 0;
+  uint64_t unconsumed_messages = 0;
+  // How often, and for how long in total, queued frames waited for credit.
+  uint64_t stalls = 0;
+  std::chrono::microseconds stall_time{0};
+  size_t queued_frames = 0;
+  // Queued frames a newer one of the same key replaced before they went
+  // out, on conflating channels.
+  uint64_t conflated_frames = 0;
+  // Current chunking and batching of the send queue.
+  size_t chunk_size = 0;
+  size_t coalesce_bytes = 0;
+};
+
+// A CREDIT frame grants the peer |bytes| and |messages| more to send.
+Frame EncodeCreditFrame(uint32_t bytes, uint32_t messages);
+bool DecodeCreditFrame(const Frame& frame, uint32_t* bytes, uint32_t* messages);
+
+// Credit accounting for both directions of one connection. The sender
+// starts with no credit; each end announces its receive window when the
+// connection starts and then grants back what its application consumes,
+// in batches of a quarter window. Not thread-safe.
+class FlowController {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit FlowController(FlowWindow receive_window);
+
+  const FlowWindow& receive_window() const { return receive_window_; }
+
+  // Sending side. A chunk goes out while any credit is left, so one larger
+  // than the whole window cannot wedge the connection.
+  bool CanSend() const { return send_bytes_ > 0 && send_messages_ > 0; }
+  void OnSent(size_t bytes, bool end_of_frame);
+  void OnCredit(uint32_t bytes, uint32_t messages);
+  // Records whether queued frames are currently waiting for credit.
+  void SetStalled(bool stalled, Clock::time_point now);
+
+  // Receiving side.
+  void OnReceived(size_t bytes);
+  // Returns true with the credit to grant back once enough of the window
+  // has been consumed.
+  bool OnConsumed(size_t bytes, uint32_t* grant_bytes, uint32_t* grant_messages);
+
+  FlowStats Stats(Clock::time_point now) const;
+
+ private:
+  FlowWindow receive_window_;
+  int64_t send_bytes_ = 0;
+  int64_t send_messages_ = 0;
+  uint64_t unconsumed_bytes_ = 0;
+  uint64_t unconsumed_messages_ = 0;
+  uint64_t consumed_bytes_ = 0;      // Consumed but not granted back yet
+  uint64_t consumed_messages_ = 0;
+  bool stalled_ = false;
+  Clock::time_point stalled_since_;
+  uint64_t stalls_ = 0;
+  Clock::duration stall_time_{0};
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_FLOW_CONTROL_H_
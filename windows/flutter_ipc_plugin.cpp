@@ -3,33 +3,346 @@
 // This must be included before many other Windows headers.
 #include <windows.h>
 
+#include <flutter/event_stream_handler_functions.h>
 #include <flutter/method_channel.h>
 #include <flutter/plugin_registrar_windows.h>
 #include <flutter/standard_method_codec.h>
 
 #include <memory>
+#include <set>
 #include <sstream>
 #include <string>
+#include <algorithm>
 #include <chrono>
+#include <random>
+#include <utility>
+
+#include "json_decoder.h"
+#include "memory_budget.h"
+#include "pipe_io.h"
+#include "utf8.h"
+#include "value_codec.h"
 
 namespace flutter_ipc {
 
+namespace {
+
+// Charges what |chunk| adds to |assembler| to |memory|, before the buffer
+// grows. Returns false if the frame it continues would outgrow what
+// |memory| may hold at all; the peer is then dropped.
+bool ChargeChunk(const FrameAssembler& assembler, MemoryAccount* memory, const Frame& chunk) {
+  size_t frame_bytes = assembler.GrownFrameBytes(chunk);
+  if (frame_bytes == 0) {
+    return true;
+  }
+  size_t limit = memory->frame_limit();
+  if (limit != 0 && frame_bytes > limit) {
+    return false;
+  }
+  memory->SetReassembly(assembler.pending_bytes() + chunk.payload.size());
+  return true;
+}
+
+// Hands a frame read by an I/O thread to |handler|, keeping the flow-control
+// books of the connection's |send_queue|. CREDIT and HEARTBEAT frames are
+// consumed here.
+// Sequenced frames are acknowledged and deduplicated against |session|, if
+// given. Returns false if a frame arrived past a gap in its session, in
+// which case the caller drops the connection.
+bool DispatchFrame(const std::shared_ptr<SendQueue>& send_queue, SessionTracker* session, Frame frame, const FrameHandler& handler) {
+  if (frame.type == FrameType::CREDIT) {
+    send_queue->OnCreditFrame(frame);
+    return true;
+  }
+  if (frame.type == FrameType::HEARTBEAT) {
+    return true; // Only the connection monitor cares
+  }
+  if (frame.type == FrameType::BLOB) {
+    send_queue->OnBlobFrame(frame);
+    return true;
+  }
+  
+  // Credit is counted on the wire size, sequence number included.
+  size_t size = frame.payload.size();
+  send_queue->OnReceived(size);
+  // Before the session check, so that the blob cache and state sync also
+  // follow the replayed duplicates the sender encoded.
+  bool restored = send_queue->DecodeBlob(&frame) && send_queue->DecodeState(&frame);
+  // Memory, on the other hand, is what the restored payload takes.
+  size_t held = frame.payload.size();
+  // The queue may be gone by the time the application gets to the frame;
+  // the memory account, which outlives connections, is kept alive.
+  std::weak_ptr<SendQueue> weak_queue = send_queue;
+  std::shared_ptr<MemoryAccount> memory = send_queue->memory();
+  if (memory) {
+    memory->ChargeReceive(held);
+  }
+  FrameConsumed consumed = [weak_queue, memory, size, held]() {
+    if (auto queue = weak_queue.lock()) {
+      queue->OnConsumed(size);
+    }
+    if (memory) {
+      memory->ReleaseReceive(held);
+    }
+  };
+  if (!restored) {
+    consumed();
+    return true;
+  }
+  
+  if (session && (frame.flags & kFrameFlagSequenced)) {
+    uint64_t sequence = 0;
+    SessionTracker::Verdict verdict = session->Accept(&frame, &sequence);
+    // Replayed duplicates are acknowledged again, or the client would keep
+    // them in its outbox forever.
+    if (verdict == SessionTracker::Verdict::DELIVER || verdict == SessionTracker::Verdict::DUPLICATE) {
+      send_queue->Acknowledge(frame.channel, sequence);
+    }
+    if (verdict != SessionTracker::Verdict::DELIVER) {
+      consumed();
+      return verdict != SessionTracker::Verdict::GAP;
+    }
+  }
+  
+  if (handler) {
+    handler(std::move(frame), std::move(consumed));
+  } else {
+    consumed();
+  }
+  return true;
+}
+
+// Writes whole frames into |pipe| from end |from|.
+ChunkWriter InProcessWriter(std::shared_ptr<InProcessPipe> pipe, InProcessPipe::End from) {
+  return [pipe, from](std::vector<FrameChunk>& chunks) {
+    for (auto& chunk : chunks) {
+      if (!pipe->Write(from, chunk.TakeFrame())) {
+        SetLastError(ERROR_NO_DATA);
+        return false;
+      }
+    }
+    return true;
+  };
+}
+
+// Ends the reads of a connection from the timer thread; the reading thread
+// then takes the connection for lost. A server also disconnects its kernel
+// client, whose handle only the client can close.
+std::function<void()> ConnectionDropper(const std::shared_ptr<InProcessPipe>& in_process, HANDLE pipe, bool server) {
+  if (in_process) {
+    std::weak_ptr<InProcessPipe> weak_pipe = in_process;
+    return [weak_pipe]() {
+      if (auto pipe = weak_pipe.lock()) {
+        pipe->Close();
+      }
+    };
+  }
+  return [pipe, server]() {
+    if (server) {
+      DisconnectNamedPipe(pipe);
+    }
+    CancelIoEx(pipe, NULL);
+  };
+}
+
+// Puts the conditions of |shaper| on |writer|. Records are written whole,
+// so only |split_chunks| frames with a header may be cut short.
+ChunkWriter ShapedWriter(std::shared_ptr<NetworkShaper> shaper, ChunkWriter writer, bool split_chunks,
+                         std::function<void()> drop) {
+  return [shaper, writer, split_chunks, drop](std::vector<FrameChunk>& chunks) {
+    return shaper->Write(chunks, split_chunks, writer, drop);
+  };
+}
+
+// Completion-port reads cannot wait for memory to be released, so a
+// connection that pauses its reads keeps a thread of its own.
+bool UsesCompletionPort(const ConnectionOptions& options) {
+  return options.io_backend == IoBackend::COMPLETION_PORT && options.framing == Framing::LENGTH_PREFIXED &&
+         !(options.memory_limit != 0 && options.memory_policy == BudgetPolicy::PAUSE_READS);
+}
+
+// Records are written whole, so that chunks of different channels cannot
+// interleave within one.
+ConnectionOptions RecordQueueOptions(ConnectionOptions options) {
+  options.chunk_size = SIZE_MAX;
+  if (options.profile == TuningProfile::AUTO) {
+    options.profile = TuningProfile::BALANCED;
+  }
+  return options;
+}
+
+// Memory has no packet size to respect and nothing to gain from batching,
+// so frames are moved whole and one at a time. Nor from a blob cache or
+// diffs.
+ConnectionOptions InProcessQueueOptions(ConnectionOptions options) {
+  options.chunk_size = SIZE_MAX;
+  options.coalesce_bytes = 0;
+  options.blob_cache_bytes = 0;
+  options.state_cache_bytes = 0;
+  if (options.profile == TuningProfile::AUTO) {
+    options.profile = TuningProfile::BALANCED;
+  }
+  return options;
+}
+
+// Every pipe instance of a pool is created with the same instance limit,
+// which has to leave room for all of them.
+ConnectionOptions PoolOptions(ConnectionOptions options) {
+  if (options.connections > 1) {
+    options.max_instances = std::max<DWORD>(options.max_instances, options.connections);
+  }
+  return options;
+}
+
+// The other members of a pool are plain single connections, shaped
+// differently from each other.
+ConnectionOptions PoolLaneOptions(ConnectionOptions options, uint32_t lane) {
+  options.connections = 1;
+  options.shaping.seed += lane;
+  return options;
+}
+
+// Sums the books of the connections of a pool. The chunking and batching
+// are the same on all of them.
+void AddFlowStats(FlowStats* total, const FlowStats& lane) {
+  total->send_credit_bytes += lane.send_credit_bytes;
+  total->send_credit_messages += lane.send_credit_messages;
+  total->unconsumed_bytes += lane.unconsumed_bytes;
+  total->unconsumed_messages += lane.unconsumed_messages;
+  total->stalls += lane.stalls;
+  total->stall_time += lane.stall_time;
+  total->queued_frames += lane.queued_frames;
+  total->conflated_frames += lane.conflated_frames;
+}
+
+// Each connection of a pool keeps its own account; the peak of the sum is
+// not known, so the sum of the peaks stands in for it.
+void AddMemoryStats(MemoryStats* total, const MemoryStats& lane) {
+  total->send_bytes += lane.send_bytes;
+  total->receive_bytes += lane.receive_bytes;
+  total->reassembly_bytes += lane.reassembly_bytes;
+  total->peak_bytes += lane.peak_bytes;
+  total->rejected_sends += lane.rejected_sends;
+  total->read_pauses += lane.read_pauses;
+  total->disconnects += lane.disconnects;
+}
+
+// Each connection of a pool is shaped by itself.
+void AddShapingStats(ShapingStats* total, const ShapingStats& lane) {
+  total->writes += lane.writes;
+  total->short_writes += lane.short_writes;
+  total->read_stalls += lane.read_stalls;
+  total->disconnects += lane.disconnects;
+  total->write_delay += lane.write_delay;
+}
+
+// Each connection of a pool has a blob cache of its own.
+void AddBlobStats(BlobStats* total, const BlobStats& lane) {
+  total->candidates += lane.candidates;
+  total->hits += lane.hits;
+  total->bytes_saved += lane.bytes_saved;
+  total->held_blobs += lane.held_blobs;
+  total->held_bytes += lane.held_bytes;
+  total->references += lane.references;
+  total->unknown_references += lane.unknown_references;
+}
+
+void AddStateSyncStats(StateSyncStats* total, const StateSyncStats& lane) {
+  total->updates += lane.updates;
+  total->snapshots += lane.snapshots;
+  total->deltas += lane.deltas;
+  total->value_bytes += lane.value_bytes;
+  total->encoded_bytes += lane.encoded_bytes;
+  total->tracked_keys += lane.tracked_keys;
+  total->tracked_bytes += lane.tracked_bytes;
+  total->held_keys += lane.held_keys;
+  total->held_bytes += lane.held_bytes;
+  total->misses += lane.misses;
+}
+
+// What a server in |state| offers a client looking it up.
+ServiceState ToServiceState(ServerState state) {
+  switch (state) {
+    case ServerState::LISTENING:
+      return ServiceState::AVAILABLE;
+    case ServerState::CONNECTED:
+      return ServiceState::BUSY;
+    default:
+      return ServiceState::STARTING;
+  }
+}
+
+}  // namespace
+
 // NamedPipeServer Implementation
-NamedPipeServer::NamedPipeServer(const std::string& pipe_name)
-    : pipe_name_(pipe_name), pipe_handle_(INVALID_HANDLE_VALUE), is_connected_(false), state_(ServerState::CREATED) {
+NamedPipeServer::NamedPipeServer(const std::string& pipe_name, ConnectionOptions options)
+    : pipe_name_(pipe_name), options_(PoolOptions(options)), memory_(std::make_shared<MemoryAccount>(options.memory_limit, options.memory_policy)), pipe_handle_(INVALID_HANDLE_VALUE), read_event_(NULL), write_event_(NULL), stop_event_(NULL), is_connected_(false), state_(ServerState::CREATED), monitor_(options), capture_(CaptureRole::SERVER, pipe_name) {
   ZeroMemory(&overlap_, sizeof(OVERLAPPED));
+  if (UsesCompletionPort(options_)) {
+    completion_reader_ = CompletionPortReader::Acquire();
+  }
+  if (options_.shaping.enabled()) {
+    shaper_ = std::make_shared<NetworkShaper>(options_.shaping);
+  }
+  if (options_.connections > 1) {
+    stripe_sender_ = std::make_unique<StripeSender>(options_.stripe_policy, options_.ordered_stripes);
+    reorderer_ = std::make_unique<StripeReorderer>([this](Frame frame, FrameConsumed consumed) {
+      HandleFrame(std::move(frame), std::move(consumed));
+    });
+    for (uint32_t i = 1; i < options_.connections; ++i) {
+      auto lane = std::make_unique<NamedPipeServer>(pipe_name_, PoolLaneOptions(options_, i));
+      lane->is_lane_ = true;
+      lane->frame_handler_ = [this](Frame frame, FrameConsumed consumed) {
+        reorderer_->Add(std::move(frame), std::move(consumed));
+      };
+      lane->capture_.Disable();
+      lanes_.push_back(std::move(lane));
+    }
+  }
 }
 
 NamedPipeServer::~NamedPipeServer() {
+  if (send_port_ != 0) {
+    SendPortRegistry::GetInstance().Close(send_port_);
+  }
   Close();
 }
 
 // NamedPipeClient Implementation
-NamedPipeClient::NamedPipeClient(const std::string& pipe_name)
-    : pipe_name_(pipe_name), pipe_handle_(INVALID_HANDLE_VALUE), is_connected_(false) {
+NamedPipeClient::NamedPipeClient(const std::string& pipe_name, bool resilient, ConnectionOptions options)
+    : pipe_name_(pipe_name), options_(options), memory_(std::make_shared<MemoryAccount>(options.memory_limit, options.memory_policy)), pipe_handle_(INVALID_HANDLE_VALUE), read_event_(NULL), write_event_(NULL), stop_event_(NULL), is_connected_(false), resilient_(resilient), reconnecting_(false), reconnects_(0), monitor_(options), capture_(CaptureRole::CLIENT, pipe_name) {
+  // A resilient client reconnects on its I/O thread, so it keeps one.
+  if (UsesCompletionPort(options_) && !resilient_) {
+    completion_reader_ = CompletionPortReader::Acquire();
+  }
+  if (options_.shaping.enabled()) {
+    shaper_ = std::make_shared<NetworkShaper>(options_.shaping);
+  }
+  if (options_.connections > 1) {
+    stripe_sender_ = std::make_unique<StripeSender>(options_.stripe_policy, options_.ordered_stripes);
+    reorderer_ = std::make_unique<StripeReorderer>([this](Frame frame, FrameConsumed consumed) {
+      CaptureFrame(&capture_, CaptureKind::RECEIVED, frame);
+      if (frame_handler_) {
+        frame_handler_(std::move(frame), std::move(consumed));
+      } else {
+        consumed();
+      }
+    });
+    for (uint32_t i = 1; i < options_.connections; ++i) {
+      auto lane = std::make_unique<NamedPipeClient>(pipe_name_, false, PoolLaneOptions(options_, i));
+      lane->frame_handler_ = [this](Frame frame, FrameConsumed consumed) {
+        reorderer_->Add(std::move(frame), std::move(consumed));
+      };
+      lane->capture_.Disable();
+      lanes_.push_back(std::move(lane));
+    }
+  }
 }
 
 NamedPipeClient::~NamedPipeClient() {
+  if (send_port_ != 0) {
+    SendPortRegistry::GetInstance().Close(send_port_);
+  }
   Disconnect();
 }
 
@@ -38,377 +351,2207 @@ bool NamedPipeClient::Connect() {
     return true; // Already connected
   }
   
+  if (!Prepare() || !OpenPipe()) {
+    return false;
+  }
+  
+  if (stripe_sender_) {
+    std::lock_guard<std::mutex> lock(stripe_mutex_);
+    stripe_sender_->Reset();
+    reorderer_->Reset();
+  }
+  if (!OnTransportOpen()) {
+    DWORD error = GetLastError();
+    CloseTransport();
+    SetLastError(error);
+    return false;
+  }
+  StartIoThread();
+  
+  // The server sees a pool as that many clients, all of which must get in.
+  for (auto& lane : lanes_) {
+    if (!lane->Connect()) {
+      DWORD error = GetLastError();
+      Disconnect();
+      SetLastError(error);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool NamedPipeClient::ConnectInProcess() {
+  if (is_connected_) {
+    return true; // Already connected
+  }
+  
+  // A line-oriented peer is another process by definition, and a pool
+  // needs several pipe instances.
+  if (options_.framing == Framing::NEWLINE || !lanes_.empty() || !Prepare()) {
+    return false;
+  }
+  
+  auto pipe = InProcessPipeRegistry::GetInstance().Connect(pipe_name_);
+  if (!pipe) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_process_ = pipe;
+  }
+  
+  if (!OnTransportOpen()) {
+    DWORD error = GetLastError();
+    CloseTransport();
+    SetLastError(error);
+    return false;
+  }
+  StartIoThread();
+  return true;
+}
+
+bool NamedPipeClient::Prepare() {
+  if (stop_event_ == NULL) {
+    read_event_ = CreateManualResetEvent();
+    write_event_ = CreateManualResetEvent();
+    stop_event_ = CreateManualResetEvent();
+  }
+  
+  if (resilient_ && !outbox_) {
+    // No larger than the send queue takes, so that a new connection can
+    // always take the whole replay.
+    outbox_ = Outbox::Create(std::min(Outbox::kDefaultCapacity, options_.max_queued_bytes));
+    if (!outbox_) {
+      return false;
+    }
+    std::random_device random;
+    session_id_ = (static_cast<uint64_t>(random()) << 32) | random();
+  }
+  return true;
+}
+
+bool NamedPipeClient::OpenPipe() {
   std::string full_pipe_name = "\\\\.\\pipe\\" + pipe_name_;
   
   // Try to connect to the named pipe
-  pipe_handle_ = CreateFileA(
+  HANDLE pipe = CreateFileA(
     full_pipe_name.c_str(),
     GENERIC_READ | GENERIC_WRITE,
     0,              // No sharing
     NULL,           // Default security attributes
     OPEN_EXISTING,  // Opens existing pipe
-    0,              // Default attributes
+    FILE_FLAG_OVERLAPPED, // Lets the reader and writer run concurrently
     NULL            // No template file
   );
   
-  if (pipe_handle_ == INVALID_HANDLE_VALUE) {
+  // A busy pipe frees up once the server listens again; wait for that if
+  // the options allow it.
+  if (pipe == INVALID_HANDLE_VALUE && GetLastError() == ERROR_PIPE_BUSY && options_.timeout_ms > 0 &&
+      WaitNamedPipeA(full_pipe_name.c_str(), options_.timeout_ms)) {
+    pipe = CreateFileA(full_pipe_name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                       OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+  }
+  
+  if (pipe == INVALID_HANDLE_VALUE) {
     return false;
   }
   
-  // Set pipe mode to message mode
-  DWORD mode = PIPE_READMODE_MESSAGE;
+  // Message mode for frames; a line-oriented server's pipe is a byte
+  // stream, which cannot be read in message mode.
+  DWORD mode = options_.framing == Framing::NEWLINE ? PIPE_READMODE_BYTE : PIPE_READMODE_MESSAGE;
   BOOL success = SetNamedPipeHandleState(
-    pipe_handle_,
+    pipe,
     &mode,
     NULL,     // Don't set maximum bytes
     NULL      // Don't set maximum time
   );
   
   if (!success) {
-    CloseHandle(pipe_handle_);
-    pipe_handle_ = INVALID_HANDLE_VALUE;
+    CloseHandle(pipe);
     return false;
   }
   
-  is_connected_ = true;
+  std::lock_guard<std::mutex> lock(mutex_);
+  pipe_handle_ = pipe;
   return true;
 }
 
-void NamedPipeClient::Disconnect() {
-  if (pipe_handle_ != INVALID_HANDLE_VALUE) {
-    CloseHandle(pipe_handle_);
-    pipe_handle_ = INVALID_HANDLE_VALUE;
+bool NamedPipeClient::OpenTransport() {
+  auto pipe = InProcessPipeRegistry::GetInstance().Connect(pipe_name_);
+  if (!pipe) {
+    return OpenPipe();
   }
-  is_connected_ = false;
+  
+  // Checked under the lock so that Disconnect() either sees this pipe or
+  // we see its stop event.
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (WaitForSingleObject(stop_event_, 0) == WAIT_OBJECT_0) {
+    pipe->Close();
+    return false;
+  }
+  in_process_ = pipe;
+  return true;
 }
 
-bool NamedPipeClient::SendMessage(const std::string& message) {
-  if (pipe_handle_ == INVALID_HANDLE_VALUE || !is_connected_) {
-    return false;
+bool NamedPipeClient::OnTransportOpen() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  StartSendQueue();
+  if (resilient_) {
+    // The HELLO goes out ahead of the replay, so the server knows which
+    // session the sequence numbers belong to.
+    send_queue_->SendControl(EncodeHelloFrame(session_id_));
+    // A frame left out would be a gap the server drops the connection
+    // for. The outbox fits the queue, so only the memory budget refuses
+    // a replay, and only for as long as it is full.
+    bool replayed = true;
+    outbox_->ForEach([this, &replayed](Frame frame) {
+      replayed = replayed && send_queue_->Enqueue(std::move(frame), nullptr);
+    });
+    if (!replayed) {
+      return false;
+    }
   }
+  is_connected_ = true;
+  return true;
+}
+
+void NamedPipeClient::CloseTransport() {
+  // Before taking the lock, as the monitor may be dropping the transport.
+  monitor_.Stop();
   
-  // Send message length first (4 bytes)
-  DWORD message_length = static_cast<DWORD>(message.length());
-  DWORD bytes_written = 0;
-  
-  BOOL success = WriteFile(
-    pipe_handle_,
-    &message_length,
-    sizeof(message_length),
-    &bytes_written,
-    NULL
-  );
-  
-  if (!success || bytes_written != sizeof(message_length)) {
-    return false;
+  std::shared_ptr<SendQueue> send_queue;
+  HANDLE pipe = INVALID_HANDLE_VALUE;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    is_connected_ = false;
+    send_queue.swap(send_queue_);
+    std::swap(pipe, pipe_handle_);
+    if (in_process_) {
+      in_process_->Close();
+      in_process_.reset();
+    }
   }
   
-  // Send message content
-  success = WriteFile(
-    pipe_handle_,
-    message.c_str(),
-    message_length,
-    &bytes_written,
-    NULL
-  );
-  
-  return success && bytes_written == message_length;
+  if (send_queue) {
+    send_queue->Stop();
+  }
+  if (pipe != INVALID_HANDLE_VALUE) {
+    CloseHandle(pipe);
+  }
 }
 
-bool NamedPipeServer::Create() {
-  std::string full_pipe_name = "\\\\.\\pipe\\" + pipe_name_;
-  
-  // Try to create the pipe
-  pipe_handle_ = CreateNamedPipeA(
-    full_pipe_name.c_str(),
-    PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
-    PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT,
-    1, // Maximum instances
-    4096, // Output buffer size
-    4096, // Input buffer size
-    0, // Default timeout
-    NULL // Security attributes
-  );
-  
-  // If creation failed due to pipe busy, wait a bit and try again
-  if (pipe_handle_ == INVALID_HANDLE_VALUE && GetLastError() == ERROR_PIPE_BUSY) {
-    Sleep(100); // Wait 100ms for any cleanup to complete
+bool NamedPipeClient::Reconnect() {
+  // Past the connect timeout the client gives up as if disconnected.
+  auto abort = [this]() { return SetEvent(stop_event_) != FALSE; };
+  monitor_.StartConnect(abort);
+  std::mt19937 random(std::random_device{}());
+  for (int attempt = 0;; ++attempt) {
+    // Exponential backoff with full jitter, so that the clients of a
+    // restarted server do not all retry in lockstep.
+    DWORD ceiling = std::min<DWORD>(kReconnectMaxDelayMs, kReconnectBaseDelayMs << std::min(attempt, 16));
+    DWORD delay = std::uniform_int_distribution<DWORD>(0, ceiling)(random);
+    if (WaitForSingleObject(stop_event_, delay) == WAIT_OBJECT_0) {
+      return false;
+    }
     
-    pipe_handle_ = CreateNamedPipeA(
-      full_pipe_name.c_str(),
-      PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
-      PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT,
-      1, // Maximum instances
-      4096, // Output buffer size
-      4096, // Input buffer size
-      0, // Default timeout
-      NULL // Security attributes
-    );
+    if (!OpenTransport()) {
+      continue;
+    }
+    if (OnTransportOpen()) {
+      ++reconnects_;
+      return true;
+    }
+    // The connection started for the replay disarmed the connect timeout.
+    CloseTransport();
+    monitor_.StartConnect(abort);
   }
-  
-  return pipe_handle_ != INVALID_HANDLE_VALUE;
 }
 
-bool NamedPipeServer::WaitForConnection() {
-  if (pipe_handle_ == INVALID_HANDLE_VALUE || state_ != ServerState::CREATED) {
-    return false;
+void NamedPipeClient::Disconnect() {
+  // Wake the I/O thread before tearing anything down underneath it.
+  if (stop_event_ != NULL) {
+    SetEvent(stop_event_);
   }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (in_process_) {
+      in_process_->Close();
+    }
+  }
+  if (io_thread_.joinable()) {
+    io_thread_.join();
+  }
+  if (completion_reader_) {
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pipe = pipe_handle_;
+    }
+    completion_reader_->Detach(pipe);
+    memory_->SetReassembly(0);
+  }
+  reconnecting_ = false;
   
-  state_ = ServerState::LISTENING;
-  
-  BOOL connected = ConnectNamedPipe(pipe_handle_, &overlap_);
+  // The stop event also aborts a write that is blocked on a full pipe.
+  CloseTransport();
+  CloseEvent(&read_event_);
+  CloseEvent(&write_event_);
+  CloseEvent(&stop_event_);
   
-  if (connected) {
-    is_connected_ = true;
-    state_ = ServerState::CONNECTED;
-    return true;
+  for (auto& lane : lanes_) {
+    lane->Disconnect();
+  }
+}
+
+bool NamedPipeClient::SendMessage(const std::string& message) {
+  return SendFrame(Frame(FrameType::TEXT, message));
+}
+
+bool NamedPipeClient::SendFrame(Frame frame, SendCompletion on_complete, uint32_t timeout_ms) {
+  if (options_.framing == Framing::NEWLINE && (frame.type != FrameType::TEXT || (frame.flags & kFrameFlagKeyed))) {
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return false;
+  }
+  CaptureFrame(&capture_, CaptureKind::SENT, frame);
+  if (lanes_.empty()) {
+    return EnqueueFrame(std::move(frame), std::move(on_complete), timeout_ms);
   }
   
-  DWORD error = GetLastError();
-  if (error == ERROR_PIPE_CONNECTED) {
-    is_connected_ = true;
-    state_ = ServerState::CONNECTED;
-    return true;
-  } else if (error == ERROR_IO_PENDING) {
-    // Asynchronous operation - would need event handling for full implementation
-    // For now, return true to indicate operation started
-    return true;
+  // Held across the enqueue, so that numbers go out in queue order.
+  std::lock_guard<std::mutex> lock(stripe_mutex_);
+  std::vector<size_t> queued_bytes{QueuedBytes()};
+  for (auto& lane : lanes_) {
+    queued_bytes.push_back(lane->QueuedBytes());
+  }
+  int picked = stripe_sender_->PickLane(queued_bytes);
+  if (picked < 0) {
+    SetLastError(ERROR_PIPE_NOT_CONNECTED);
+    return false;
   }
   
-  state_ = ServerState::CREATED; // Restore to original state on failure
-  return false;
+  uint16_t channel = frame.channel;
+  if (stripe_sender_->ordered()) {
+    stripe_sender_->Stamp(&frame);
+    timeout_ms = 0;
+  }
+  NamedPipeClient* target = picked == 0 ? this : lanes_[picked - 1].get();
+  if (!target->EnqueueFrame(std::move(frame), std::move(on_complete), timeout_ms)) {
+    return false;
+  }
+  if (stripe_sender_->ordered()) {
+    stripe_sender_->Commit(channel);
+  }
+  return true;
 }
 
-bool NamedPipeServer::SendMessage(const std::string& message) {
-  if (pipe_handle_ == INVALID_HANDLE_VALUE || !is_connected_) {
-    return false;
+int64_t NamedPipeClient::OpenSendPort() {
+  if (send_port_ == 0) {
+    send_port_ = SendPortRegistry::GetInstance().Open([this](Frame frame) { return SendFrame(std::move(frame)); });
   }
+  return send_port_;
+}
+
+bool NamedPipeClient::EnqueueFrame(Frame frame, SendCompletion on_complete, uint32_t timeout_ms) {
+  std::unique_lock<std::mutex> lock(mutex_);
   
-  // Send message length first (4 bytes)
-  DWORD message_length = static_cast<DWORD>(message.length());
-  DWORD bytes_written = 0;
+  // Handles are duplicated into one particular server process, so they are
+  // never stored for a replay into another one.
+  if (!resilient_ || frame.type == FrameType::HANDLES) {
+    std::shared_ptr<SendQueue> send_queue = is_connected_ ? send_queue_ : nullptr;
+    // The queue takes frames from many threads at once.
+    lock.unlock();
+    if (!send_queue) {
+      SetLastError(ERROR_PIPE_NOT_CONNECTED);
+      return false;
+    }
+    if (!send_queue->Enqueue(std::move(frame), std::move(on_complete), timeout_ms)) {
+      return false;
+    }
+    monitor_.OnSent();
+    return true;
+  }
   
-  BOOL success = WriteFile(
-    pipe_handle_,
-    &message_length,
-    sizeof(message_length),
-    &bytes_written,
-    NULL
-  );
+  if (!CanSend()) {
+    SetLastError(ERROR_PIPE_NOT_CONNECTED);
+    return false;
+  }
   
-  if (!success || bytes_written != sizeof(message_length)) {
+  uint64_t& sequence = last_sequence_[frame.channel];
+  AddSequence(&frame, sequence + 1);
+  if (!outbox_->Append(frame)) {
     return false;
   }
   
-  // Send message content
-  success = WriteFile(
-    pipe_handle_,
-    message.c_str(),
-    message_length,
-    &bytes_written,
-    NULL
-  );
+  // While reconnecting there is no queue; the replay picks the frame up.
+  // A frame the queue refuses is taken back, and its number goes to the
+  // next one, so the server never sees a gap.
+  if (send_queue_ && !send_queue_->Enqueue(std::move(frame), nullptr)) {
+    outbox_->RemoveNewest();
+    return false;
+  }
+  ++sequence;
+  lock.unlock();
+  monitor_.OnSent();
   
-  return success && bytes_written == message_length;
+  // Stored frames outlive the connection, so the send is complete here.
+  if (on_complete) {
+    on_complete(true, ERROR_SUCCESS);
+  }
+  return true;
 }
 
-bool NamedPipeServer::ResetForNewConnection() {
-  if (is_connected_) {
-    // Flush any pending writes first
-    FlushFileBuffers(pipe_handle_);
-    
-    // Disconnect existing client
-    if (!DisconnectNamedPipe(pipe_handle_)) {
-      DWORD error = GetLastError();
-      // If no client was connected, that's fine - continue
-      if (error != ERROR_NO_DATA) {
-        return false;
-      }
+void NamedPipeClient::ConfigureChannel(uint16_t channel, ChannelOptions options) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    channel_options_[channel] = options;
+    if (send_queue_) {
+      send_queue_->ConfigureChannel(channel, options);
     }
-    is_connected_ = false;
   }
-  
-  // Wait a brief moment for Windows to clean up the pipe state
-  Sleep(50);
-  
-  // Reset state to allow new connections
-  state_ = ServerState::CREATED;
-  return true;
+  for (auto& lane : lanes_) {
+    lane->ConfigureChannel(channel, options);
+  }
 }
 
-void NamedPipeServer::Close() {
-  if (pipe_handle_ != INVALID_HANDLE_VALUE) {
-    // Force disconnect if connected
-    if (is_connected_) {
-      DisconnectNamedPipe(pipe_handle_);
-      is_connected_ = false;
-    }
-    
-    // Cancel any pending I/O operations
-    CancelIo(pipe_handle_);
-    
-    // Close the handle
-    CloseHandle(pipe_handle_);
-    pipe_handle_ = INVALID_HANDLE_VALUE;
+void NamedPipeClient::SetShedHandler(MemoryAccount::ShedHandler handler) {
+  for (auto& lane : lanes_) {
+    lane->SetShedHandler(handler);
   }
-  state_ = ServerState::CLOSED;
+  memory_->SetShedHandler(std::move(handler));
 }
 
-// static
-void FlutterIpcPlugin::RegisterWithRegistrar(
-    flutter::PluginRegistrarWindows *registrar) {
-  auto channel =
-      std::make_unique<flutter::MethodChannel<flutter::EncodableValue>>(
-          registrar->messenger(), "flutter_ipc",
-          &flutter::StandardMethodCodec::GetInstance());
+void NamedPipeClient::SetTimeoutHandler(ConnectionMonitor::TimeoutHandler handler) {
+  for (auto& lane : lanes_) {
+    lane->SetTimeoutHandler(handler);
+  }
+  monitor_.SetTimeoutHandler(std::move(handler));
+}
 
-  auto plugin = std::make_unique<FlutterIpcPlugin>();
+MemoryStats NamedPipeClient::GetMemoryStats() {
+  MemoryStats stats = memory_->GetStats();
+  for (auto& lane : lanes_) {
+    AddMemoryStats(&stats, lane->GetMemoryStats());
+  }
+  return stats;
+}
 
-  channel->SetMethodCallHandler(
-      [plugin_pointer = plugin.get()](const auto &call, auto result) {
-        plugin_pointer->HandleMethodCall(call, std::move(result));
-      });
+size_t NamedPipeClient::QueuedBytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!is_connected_ || !send_queue_) {
+    return SIZE_MAX;
+  }
+  return send_queue_->queued_bytes();
+}
 
-  registrar->AddPlugin(std::move(plugin));
+bool NamedPipeClient::LanesConnected() const {
+  for (const auto& lane : lanes_) {
+    if (!lane->is_connected_) {
+      return false;
+    }
+  }
+  return true;
 }
 
-FlutterIpcPlugin::FlutterIpcPlugin() {}
+void NamedPipeClient::StartSendQueue() {
+  ChunkWriter writer;
+  ConnectionOptions queue_options = options_;
+  if (in_process_) {
+    writer = InProcessWriter(in_process_, InProcessPipe::End::CLIENT);
+    queue_options = InProcessQueueOptions(options_);
+  } else if (options_.framing == Framing::NEWLINE) {
+    HANDLE pipe = pipe_handle_;
+    writer = [this, pipe](std::vector<FrameChunk>& chunks) {
+      return WriteRecords(pipe, write_event_, stop_event_, chunks);
+    };
+    queue_options = RecordQueueOptions(options_);
+  } else {
+    // The handle is captured because a reconnect replaces |pipe_handle_|.
+    HANDLE pipe = pipe_handle_;
+    writer = [this, pipe](std::vector<FrameChunk>& chunks) {
+      return WriteChunks(pipe, write_event_, stop_event_, chunks);
+    };
+  }
+  if (shaper_) {
+    writer = ShapedWriter(shaper_, std::move(writer), options_.framing == Framing::LENGTH_PREFIXED,
+                          ConnectionDropper(in_process_, pipe_handle_, false));
+  }
+  send_queue_ = std::make_shared<SendQueue>(std::move(writer), queue_options, memory_);
+  for (const auto& channel : channel_options_) {
+    send_queue_->ConfigureChannel(channel.first, channel.second);
+  }
+  monitor_.StartConnection(send_queue_, ConnectionDropper(in_process_, pipe_handle_, false));
+}
 
-FlutterIpcPlugin::~FlutterIpcPlugin() {}
+bool NamedPipeClient::GetPeerProcessId(DWORD* process_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (in_process_) {
+    *process_id = GetCurrentProcessId();
+    return true;
+  }
+  ULONG server_process_id = 0;
+  if (!GetNamedPipeServerProcessId(pipe_handle_, &server_process_id)) {
+    return false;
+  }
+  *process_id = server_process_id;
+  return true;
+}
 
-std::string FlutterIpcPlugin::GenerateServerId() {
-  static int counter = 0;
-  return "server_" + std::to_string(++counter);
+bool NamedPipeClient::GetFlowStats(FlowStats* stats) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!is_connected_ || !send_queue_) {
+      return false;
+    }
+    *stats = send_queue_->GetStats();
+  }
+  FlowStats lane_stats;
+  for (auto& lane : lanes_) {
+    if (lane->GetFlowStats(&lane_stats)) {
+      AddFlowStats(stats, lane_stats);
+    }
+  }
+  return true;
 }
 
-std::string FlutterIpcPlugin::GenerateClientId() {
-  static int counter = 0;
-  return "client_" + std::to_string(++counter);
+BlobStats NamedPipeClient::GetBlobStats() {
+  BlobStats stats;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (is_connected_ && send_queue_) {
+      stats = send_queue_->GetBlobStats();
+    }
+  }
+  for (auto& lane : lanes_) {
+    AddBlobStats(&stats, lane->GetBlobStats());
+  }
+  return stats;
 }
 
-std::string GetWindowsErrorMessage(DWORD error_code) {
-  LPWSTR message_buffer = nullptr;
-  size_t size = FormatMessageW(
-    FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
-    NULL, error_code, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
-    (LPWSTR)&message_buffer, 0, NULL
+StateSyncStats NamedPipeClient::GetStateSyncStats() {
+  StateSyncStats stats;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (is_connected_ && send_queue_) {
+      stats = send_queue_->GetStateSyncStats();
+    }
+  }
+  for (auto& lane : lanes_) {
+    AddStateSyncStats(&stats, lane->GetStateSyncStats());
+  }
+  return stats;
+}
+
+ShapingStats NamedPipeClient::GetShapingStats() {
+  ShapingStats stats;
+  if (shaper_) {
+    stats = shaper_->GetStats();
+  }
+  for (auto& lane : lanes_) {
+    AddShapingStats(&stats, lane->GetShapingStats());
+  }
+  return stats;
+}
+
+bool NamedPipeClient::GetSessionStats(SessionStats* stats) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!outbox_) {
+    return false;
+  }
+  stats->session_id = session_id_;
+  stats->reconnects = reconnects_;
+  stats->outbox_frames = outbox_->count();
+  stats->outbox_bytes = outbox_->size();
+  stats->outbox_capacity = outbox_->capacity();
+  return true;
+}
+
+void NamedPipeClient::StartIoThread() {
+  io_thread_ = std::thread(&NamedPipeClient::RunIoLoop, this);
+}
+
+void NamedPipeClient::RunIoLoop() {
+  ApplyPollingOptions(options_.polling);
+  SpinWait spin(options_.polling.spin_us);
+  while (true) {
+    std::shared_ptr<InProcessPipe> in_process;
+    std::shared_ptr<SendQueue> send_queue;
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      in_process = in_process_;
+      send_queue = send_queue_;
+      pipe = pipe_handle_;
+    }
+    if (!in_process && StartCompletionReads(send_queue, pipe)) {
+      return;
+    }
+    
+    if (options_.framing == Framing::NEWLINE) {
+      RecordReader records(options_.max_record_length);
+      ReadRecords(pipe, read_event_, stop_event_, &records, [&](const char* data, size_t size) {
+        ProcessFrame(send_queue, Frame(FrameType::TEXT, std::string(data, size)));
+        // While paused, nothing more is read; a stop makes the read fail.
+        memory_->WaitForRoom(stop_event_);
+      }, spin);
+    } else {
+      FrameAssembler assembler;
+      Frame chunk;
+      Frame frame;
+      while (memory_->WaitForRoom(stop_event_) &&
+             (in_process ? in_process->Read(InProcessPipe::End::CLIENT, &chunk, spin)
+                         : ReadFrame(pipe, read_event_, stop_event_, &chunk, spin))) {
+        if (!ChargeChunk(assembler, memory_.get(), chunk)) {
+          break;
+        }
+        if (assembler.Add(std::move(chunk), &frame)) {
+          ProcessFrame(send_queue, std::move(frame));
+        }
+        memory_->SetReassembly(assembler.pending_bytes());
+      }
+      memory_->SetReassembly(0);
+    }
+    
+    // The server went away (or Disconnect() stopped us). A resilient
+    // client keeps taking frames into its outbox while it reconnects.
+    if (!resilient_ || WaitForSingleObject(stop_event_, 0) == WAIT_OBJECT_0) {
+      break;
+    }
+    reconnecting_ = true;
+    CloseTransport();
+    bool reconnected = Reconnect();
+    reconnecting_ = false;
+    if (!reconnected) {
+      break;
+    }
+  }
+  
+  is_connected_ = false;
+}
+
+void NamedPipeClient::ProcessFrame(const std::shared_ptr<SendQueue>& send_queue, Frame frame) {
+  if (shaper_) {
+    shaper_->StallRead();
+  }
+  monitor_.OnReceived((frame.flags & kFrameFlagControl) == 0);
+  AckMap acks;
+  if (DecodeAckFrame(frame, &acks)) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (outbox_) {
+      outbox_->Acknowledge(acks);
+    }
+    return;
+  }
+  DispatchFrame(send_queue, nullptr, std::move(frame), [this](Frame frame, FrameConsumed consumed) {
+    ReceiveFrame(std::move(frame), std::move(consumed));
+  });
+}
+
+void NamedPipeClient::ReceiveFrame(Frame frame, FrameConsumed consumed) {
+  // Handles are taken while it is known which process sent them.
+  DWORD peer_process_id = 0;
+  if (frame.type == FrameType::HANDLES &&
+      !(GetPeerProcessId(&peer_process_id) && TakeHandleFrame(&frame, peer_process_id))) {
+    consumed();
+    return;
+  }
+  if (reorderer_) {
+    reorderer_->Add(std::move(frame), std::move(consumed));
+    return;
+  }
+  // From a pooled server, whose numbering only matters to a pool.
+  uint64_t sequence = 0;
+  TakeStripeSequence(&frame, &sequence);
+  CaptureFrame(&capture_, CaptureKind::RECEIVED, frame);
+  if (frame_handler_) {
+    frame_handler_(std::move(frame), std::move(consumed));
+  } else {
+    consumed();
+  }
+}
+
+bool NamedPipeClient::StartCompletionReads(const std::shared_ptr<SendQueue>& send_queue, HANDLE pipe) {
+  if (!completion_reader_) {
+    return false;
+  }
+  // Chunks of one pipe arrive one at a time, so the assembler needs no lock.
+  auto assembler = std::make_shared<FrameAssembler>();
+  return completion_reader_->Attach(
+      pipe,
+      [this, send_queue, assembler](Frame chunk) {
+        if (!ChargeChunk(*assembler, memory_.get(), chunk)) {
+          return false;
+        }
+        Frame frame;
+        if (assembler->Add(std::move(chunk), &frame)) {
+          ProcessFrame(send_queue, std::move(frame));
+        }
+        memory_->SetReassembly(assembler->pending_bytes());
+        return true;
+      },
+      [this]() {
+        memory_->SetReassembly(0);
+        is_connected_ = false;
+      });
+}
+
+bool NamedPipeServer::Create() {
+  std::string full_pipe_name = "\\\\.\\pipe\\" + pipe_name_;
+  // Line-oriented clients write a byte stream, not messages.
+  DWORD pipe_mode = options_.framing == Framing::NEWLINE
+                        ? PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT
+                        : PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT;
+  
+  // Try to create the pipe
+  pipe_handle_ = CreateNamedPipeA(
+    full_pipe_name.c_str(),
+    PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+    pipe_mode,
+    options_.max_instances,
+    options_.out_buffer_size,
+    options_.in_buffer_size,
+    options_.timeout_ms, // Default timeout
+    NULL // Security attributes
   );
   
-  if (size == 0 || message_buffer == nullptr) {
-    return "Unknown error";
+  // If creation failed due to pipe busy, wait a bit and try again
+  if (pipe_handle_ == INVALID_HANDLE_VALUE && GetLastError() == ERROR_PIPE_BUSY) {
+    Sleep(100); // Wait 100ms for any cleanup to complete
+    
+    pipe_handle_ = CreateNamedPipeA(
+      full_pipe_name.c_str(),
+      PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+      pipe_mode,
+      options_.max_instances,
+      options_.out_buffer_size,
+      options_.in_buffer_size,
+      options_.timeout_ms, // Default timeout
+      NULL // Security attributes
+    );
   }
   
-  // Convert from UTF-16 to UTF-8
-  int utf8_length = WideCharToMultiByte(CP_UTF8, 0, message_buffer, -1, NULL, 0, NULL, NULL);
-  if (utf8_length == 0) {
-    LocalFree(message_buffer);
-    return "Error message conversion failed";
+  if (pipe_handle_ == INVALID_HANDLE_VALUE) {
+    return false;
   }
   
-  std::string message(utf8_length - 1, '\0'); // -1 to exclude null terminator
-  WideCharToMultiByte(CP_UTF8, 0, message_buffer, -1, &message[0], utf8_length, NULL, NULL);
-  LocalFree(message_buffer);
+  overlap_.hEvent = CreateManualResetEvent();
+  read_event_ = CreateManualResetEvent();
+  write_event_ = CreateManualResetEvent();
+  stop_event_ = CreateManualResetEvent();
   
-  // Remove trailing newline characters
-  while (!message.empty() && (message.back() == '\n' || message.back() == '\r')) {
-    message.pop_back();
+  for (auto& lane : lanes_) {
+    if (!lane->Create()) {
+      return false;
+    }
+  }
+  // A client in this process cannot take a pool's instances one by one.
+  if (!is_lane_ && lanes_.empty()) {
+    InProcessPipeRegistry::GetInstance().Register(pipe_name_, this);
+  }
+  // Servers that do not fit in the registry are still found by probing.
+  if (!is_lane_) {
+    registration_ = ServiceRegistration::Create(&ServiceRegistry::GetInstance(), pipe_name_,
+                                                static_cast<uint32_t>(1 + lanes_.size()),
+                                                [this]() { return ToServiceState(state_); });
+  }
+  return true;
+}
+
+void NamedPipeServer::SetState(ServerState state) {
+  state_ = state;
+  if (registration_) {
+    registration_->Refresh();
+  }
+}
+
+bool NamedPipeServer::WaitForConnection() {
+  if (lanes_.empty()) {
+    return Listen();
   }
   
-  return message;
+  // A new pooled client numbers its frames from the start again.
+  if (!IsConnected()) {
+    std::lock_guard<std::mutex> lock(stripe_mutex_);
+    stripe_sender_->Reset();
+    reorderer_->Reset();
+  }
+  bool listening = state_ == ServerState::CREATED && Listen();
+  for (auto& lane : lanes_) {
+    if (lane->GetState() == ServerState::CREATED && lane->Listen()) {
+      listening = true;
+    }
+  }
+  return listening;
 }
 
-void FlutterIpcPlugin::HandleMethodCall(
-    const flutter::MethodCall<flutter::EncodableValue> &method_call,
-    std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+bool NamedPipeServer::Listen() {
+  if (pipe_handle_ == INVALID_HANDLE_VALUE || state_ != ServerState::CREATED) {
+    return false;
+  }
   
-  const std::string& method = method_call.method_name();
+  // Reap the I/O thread of a previous connection, if any.
+  StopIoThread();
   
-  if (method == "createServer") {
-    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
-    if (!arguments) {
-      result->Error("INVALID_ARGUMENTS", "Missing arguments for createServer");
-      return;
+  {
+    // A client in this process may already be attached, just like a kernel
+    // client can open the pipe before ConnectNamedPipe is called.
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (in_process_) {
+      StartSendQueue();
+      is_connected_ = true;
+      SetState(ServerState::CONNECTED);
+      StartIoThread(false);
+      return true;
     }
-    
-    auto pipe_name_it = arguments->find(flutter::EncodableValue("pipeName"));
-    if (pipe_name_it == arguments->end()) {
-      result->Error("INVALID_ARGUMENTS", "Missing pipeName argument");
-      return;
+    SetState(ServerState::LISTENING);
+  }
+  
+  BOOL connected = ConnectNamedPipe(pipe_handle_, &overlap_);
+  DWORD error = connected ? ERROR_SUCCESS : GetLastError();
+  
+  if (connected || error == ERROR_PIPE_CONNECTED) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      StartSendQueue();
     }
-    
-    const auto* pipe_name = std::get_if<std::string>(&pipe_name_it->second);
-    if (!pipe_name) {
-      result->Error("INVALID_ARGUMENTS", "pipeName must be a string");
-      return;
+    is_connected_ = true;
+    SetState(ServerState::CONNECTED);
+    StartIoThread(false);
+    return true;
+  } else if (error == ERROR_IO_PENDING) {
+    // The I/O thread completes the connection and then starts reading.
+    monitor_.StartConnect([this]() { return CancelIoEx(pipe_handle_, &overlap_) != FALSE; });
+    StartIoThread(true);
+    return true;
+  }
+  
+  SetState(ServerState::CREATED); // Restore to original state on failure
+  return false;
+}
+
+std::shared_ptr<InProcessPipe> NamedPipeServer::AcceptInProcessClient() {
+  auto pipe = std::make_shared<InProcessPipe>();
+  bool connect_pending = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (is_connected_ || in_process_ || state_ == ServerState::CLOSED) {
+      return nullptr; // Busy, exactly like a second kernel client would see
     }
-    
-    try {
-      // Check if a server with the same pipe name already exists and close it
-      for (auto it = servers_.begin(); it != servers_.end();) {
-        if (it->second->GetPipeName() == *pipe_name) {
-          it->second->Close();
-          it = servers_.erase(it);
-        } else {
-          ++it;
-        }
-      }
-      
-      std::string server_id = GenerateServerId();
-      auto server = std::make_unique<NamedPipeServer>(*pipe_name);
-      
-      if (!server->Create()) {
-        DWORD error = GetLastError();
-        std::string error_msg = "Failed to create named pipe '" + *pipe_name + "': " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
-        result->Error("PIPE_CREATION_FAILED", error_msg);
-        return;
-      }
-      
-      servers_[server_id] = std::move(server);
-      result->Success(flutter::EncodableValue(server_id));
-    } catch (const std::exception& e) {
-      result->Error("CREATE_SERVER_FAILED", e.what());
+    if (options_.framing == Framing::NEWLINE) {
+      return nullptr; // Only takes line-oriented clients, over the kernel pipe
     }
-  } 
-  else if (method == "connect") {
-    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
-    if (!arguments) {
-      result->Error("INVALID_ARGUMENTS", "Missing arguments for connect");
-      return;
+    in_process_ = pipe;
+    connect_pending = state_ == ServerState::LISTENING;
+  }
+  
+  if (connect_pending) {
+    // Abandon the pending ConnectNamedPipe; the local client takes the
+    // single pipe instance instead.
+    StopIoThread();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      StartSendQueue();
     }
-    
-    auto pipe_name_it = arguments->find(flutter::EncodableValue("pipeName"));
-    if (pipe_name_it == arguments->end()) {
-      result->Error("INVALID_ARGUMENTS", "Missing pipeName argument");
+    is_connected_ = true;
+    SetState(ServerState::CONNECTED);
+    StartIoThread(false);
+  }
+  return pipe;
+}
+
+void NamedPipeServer::StartIoThread(bool connect_pending) {
+  io_thread_ = std::thread(&NamedPipeServer::RunIoLoop, this, connect_pending);
+}
+
+void NamedPipeServer::StopIoThread() {
+  // The stop event aborts blocked reads and writes alike.
+  SetEvent(stop_event_);
+  if (io_thread_.joinable()) {
+    io_thread_.join();
+  }
+  if (completion_reader_) {
+    completion_reader_->Detach(pipe_handle_);
+    memory_->SetReassembly(0);
+  }
+  StopSendQueue();
+  ResetEvent(stop_event_);
+}
+
+void NamedPipeServer::RunIoLoop(bool connect_pending) {
+  ApplyPollingOptions(options_.polling);
+  if (connect_pending) {
+    DWORD unused = 0;
+    if (!WaitForOverlapped(pipe_handle_, &overlap_, stop_event_, &unused)) {
+      // Cancelled. Past the connect timeout the server is ready to listen
+      // again; otherwise the caller that stopped us takes care of it.
+      if (WaitForSingleObject(stop_event_, 0) != WAIT_OBJECT_0) {
+        SetState(ServerState::CREATED);
+      }
       return;
     }
     
-    const auto* pipe_name = std::get_if<std::string>(&pipe_name_it->second);
-    if (!pipe_name) {
-      result->Error("INVALID_ARGUMENTS", "pipeName must be a string");
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (in_process_) {
+      // A local client won the race; turn the kernel one away.
+      DisconnectNamedPipe(pipe_handle_);
       return;
     }
-    
-    try {
-      // Wait a brief moment to allow any previous disconnection to complete
-      Sleep(100);
-      
-      // Try to find and reset any existing server with the same pipe name
-      for (auto& server_pair : servers_) {
-        if (server_pair.second->GetPipeName() == *pipe_name) {
-          if (!server_pair.second->ResetForNewConnection()) {
-            result->Error("SERVER_RESET_FAILED", "Failed to reset server for new connection");
-            return;
-          }
-          break;
-        }
+    StartSendQueue();
+    is_connected_ = true;
+    SetState(ServerState::CONNECTED);
+  }
+  
+  std::shared_ptr<InProcessPipe> in_process;
+  std::shared_ptr<SendQueue> send_queue;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_process = in_process_;
+    send_queue = send_queue_;
+  }
+  
+  if (!in_process && StartCompletionReads(send_queue)) {
+    return; // The completion port takes over
+  }
+  
+  SpinWait spin(options_.polling.spin_us);
+  if (options_.framing == Framing::NEWLINE) {
+    RecordReader records(options_.max_record_length);
+    ReadRecords(pipe_handle_, read_event_, stop_event_, &records, [&](const char* data, size_t size) {
+      ProcessFrame(send_queue, Frame(FrameType::TEXT, std::string(data, size)));
+      // While paused, nothing more is read; a stop makes the read fail.
+      memory_->WaitForRoom(stop_event_);
+    }, spin);
+  } else {
+    FrameAssembler assembler;
+    Frame chunk;
+    Frame frame;
+    while (memory_->WaitForRoom(stop_event_) &&
+           (in_process ? in_process->Read(InProcessPipe::End::SERVER, &chunk, spin)
+                       : ReadFrame(pipe_handle_, read_event_, stop_event_, &chunk, spin))) {
+      if (!ChargeChunk(assembler, memory_.get(), chunk)) {
+        break;
       }
-      
-      std::string client_id = GenerateClientId();
-      auto client = std::make_unique<NamedPipeClient>(*pipe_name);
-      
-      if (!client->Connect()) {
-        DWORD error = GetLastError();
-        std::string error_msg;
+      if (assembler.Add(std::move(chunk), &frame) && !ProcessFrame(send_queue, std::move(frame))) {
+        break;
+      }
+      memory_->SetReassembly(assembler.pending_bytes());
+    }
+    memory_->SetReassembly(0);
+  }
+  
+  // Only a vanished peer needs cleaning up here; when we were stopped, the
+  // caller owns the teardown.
+  if (WaitForSingleObject(stop_event_, 0) != WAIT_OBJECT_0) {
+    OnPeerDisconnected();
+  }
+}
+
+bool NamedPipeServer::ProcessFrame(const std::shared_ptr<SendQueue>& send_queue, Frame frame) {
+  if (shaper_) {
+    shaper_->StallRead();
+  }
+  monitor_.OnReceived((frame.flags & kFrameFlagControl) == 0);
+  uint64_t session_id = 0;
+  if (DecodeHelloFrame(frame, &session_id)) {
+    session_.OnHello(session_id);
+    return true;
+  }
+  return DispatchFrame(send_queue, &session_, std::move(frame), [this](Frame frame, FrameConsumed consumed) {
+    ReceiveFrame(std::move(frame), std::move(consumed));
+  });
+}
+
+void NamedPipeServer::ReceiveFrame(Frame frame, FrameConsumed consumed) {
+  // Handles are taken while it is known which process sent them.
+  DWORD peer_process_id = 0;
+  if (frame.type == FrameType::HANDLES &&
+      !(GetPeerProcessId(&peer_process_id) && TakeHandleFrame(&frame, peer_process_id))) {
+    consumed();
+    return;
+  }
+  if (reorderer_) {
+    reorderer_->Add(std::move(frame), std::move(consumed));
+    return;
+  }
+  // From a pooled client, whose numbering only matters to a pool.
+  uint64_t sequence = 0;
+  TakeStripeSequence(&frame, &sequence);
+  HandleFrame(std::move(frame), std::move(consumed));
+}
+
+bool NamedPipeServer::StartCompletionReads(const std::shared_ptr<SendQueue>& send_queue) {
+  if (!completion_reader_) {
+    return false;
+  }
+  // Chunks of one pipe arrive one at a time, so the assembler needs no lock.
+  auto assembler = std::make_shared<FrameAssembler>();
+  return completion_reader_->Attach(
+      pipe_handle_,
+      [this, send_queue, assembler](Frame chunk) {
+        if (!ChargeChunk(*assembler, memory_.get(), chunk)) {
+          return false;
+        }
+        Frame frame;
+        if (assembler->Add(std::move(chunk), &frame) && !ProcessFrame(send_queue, std::move(frame))) {
+          return false;
+        }
+        memory_->SetReassembly(assembler->pending_bytes());
+        return true;
+      },
+      [this]() {
+        memory_->SetReassembly(0);
+        OnPeerDisconnected();
+      });
+}
+
+void NamedPipeServer::HandleFrame(Frame frame, FrameConsumed consumed) {
+  CaptureFrame(&capture_, CaptureKind::RECEIVED, frame);
+  std::shared_ptr<FrameRouter> router;
+  std::string router_id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    router = router_;
+    router_id = router_id_;
+  }
+  if (router && router->Route(router_id, &frame, &consumed)) {
+    return;
+  }
+  
+  if (frame_handler_) {
+    frame_handler_(std::move(frame), std::move(consumed));
+  } else {
+    consumed();
+  }
+}
+
+void NamedPipeServer::SetRouter(std::shared_ptr<FrameRouter> router, const std::string& id) {
+  std::shared_ptr<FrameRouter> previous;
+  std::string previous_id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    previous.swap(router_);
+    previous_id.swap(router_id_);
+    router_ = router;
+    router_id_ = id;
+  }
+  
+  // Outside our lock: the router holds its own while sending to members.
+  if (previous) {
+    previous->RemoveMember(previous_id);
+  }
+  if (router) {
+    router->AddMember(id, [this](Frame frame, SendCompletion on_complete) {
+      return SendFrame(std::move(frame), std::move(on_complete));
+    });
+  }
+}
+
+std::shared_ptr<FrameRouter> NamedPipeServer::GetRouter() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return router_;
+}
+
+void NamedPipeServer::OnPeerDisconnected() {
+  // Writes to the vanished peer fail on their own, so the queue stops
+  // without needing the stop event.
+  StopSendQueue();
+  
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (in_process_) {
+    in_process_->Close();
+    in_process_.reset();
+  } else {
+    // Free the instance so that listen() can accept the next client.
+    DisconnectNamedPipe(pipe_handle_);
+  }
+  is_connected_ = false;
+  SetState(ServerState::CREATED);
+}
+
+bool NamedPipeServer::SendMessage(const std::string& message) {
+  return SendFrame(Frame(FrameType::TEXT, message));
+}
+
+bool NamedPipeServer::SendFrame(Frame frame, SendCompletion on_complete, uint32_t timeout_ms) {
+  if (options_.framing == Framing::NEWLINE && (frame.type != FrameType::TEXT || (frame.flags & kFrameFlagKeyed))) {
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return false;
+  }
+  CaptureFrame(&capture_, CaptureKind::SENT, frame);
+  if (lanes_.empty()) {
+    return EnqueueFrame(std::move(frame), std::move(on_complete), timeout_ms);
+  }
+  
+  // Held across the enqueue, so that numbers go out in queue order.
+  std::lock_guard<std::mutex> lock(stripe_mutex_);
+  std::vector<size_t> queued_bytes{QueuedBytes()};
+  for (auto& lane : lanes_) {
+    queued_bytes.push_back(lane->QueuedBytes());
+  }
+  int picked = stripe_sender_->PickLane(queued_bytes);
+  if (picked < 0) {
+    SetLastError(ERROR_PIPE_NOT_CONNECTED);
+    return false;
+  }
+  
+  uint16_t channel = frame.channel;
+  if (stripe_sender_->ordered()) {
+    stripe_sender_->Stamp(&frame);
+    timeout_ms = 0;
+  }
+  NamedPipeServer* target = picked == 0 ? this : lanes_[picked - 1].get();
+  if (!target->EnqueueFrame(std::move(frame), std::move(on_complete), timeout_ms)) {
+    return false;
+  }
+  if (stripe_sender_->ordered()) {
+    stripe_sender_->Commit(channel);
+  }
+  return true;
+}
+
+int64_t NamedPipeServer::OpenSendPort() {
+  if (send_port_ == 0) {
+    send_port_ = SendPortRegistry::GetInstance().Open([this](Frame frame) { return SendFrame(std::move(frame)); });
+  }
+  return send_port_;
+}
+
+bool NamedPipeServer::EnqueueFrame(Frame frame, SendCompletion on_complete, uint32_t timeout_ms) {
+  std::shared_ptr<SendQueue> send_queue;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    send_queue = send_queue_;
+  }
+  
+  if (!is_connected_ || !send_queue) {
+    SetLastError(ERROR_PIPE_NOT_CONNECTED);
+    return false;
+  }
+  
+  if (!send_queue->Enqueue(std::move(frame), std::move(on_complete), timeout_ms)) {
+    return false;
+  }
+  monitor_.OnSent();
+  return true;
+}
+
+void NamedPipeServer::ConfigureChannel(uint16_t channel, ChannelOptions options) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    channel_options_[channel] = options;
+    if (send_queue_) {
+      send_queue_->ConfigureChannel(channel, options);
+    }
+  }
+  for (auto& lane : lanes_) {
+    lane->ConfigureChannel(channel, options);
+  }
+}
+
+void NamedPipeServer::SetShedHandler(MemoryAccount::ShedHandler handler) {
+  for (auto& lane : lanes_) {
+    lane->SetShedHandler(handler);
+  }
+  memory_->SetShedHandler(std::move(handler));
+}
+
+void NamedPipeServer::SetTimeoutHandler(ConnectionMonitor::TimeoutHandler handler) {
+  for (auto& lane : lanes_) {
+    lane->SetTimeoutHandler(handler);
+  }
+  monitor_.SetTimeoutHandler(std::move(handler));
+}
+
+MemoryStats NamedPipeServer::GetMemoryStats() {
+  MemoryStats stats = memory_->GetStats();
+  for (auto& lane : lanes_) {
+    AddMemoryStats(&stats, lane->GetMemoryStats());
+  }
+  return stats;
+}
+
+bool NamedPipeServer::IsConnected() const {
+  if (is_connected_) {
+    return true;
+  }
+  for (const auto& lane : lanes_) {
+    if (lane->is_connected_) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t NamedPipeServer::QueuedBytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!is_connected_ || !send_queue_) {
+    return SIZE_MAX;
+  }
+  return send_queue_->queued_bytes();
+}
+
+void NamedPipeServer::StartSendQueue() {
+  ChunkWriter writer;
+  ConnectionOptions queue_options = options_;
+  if (in_process_) {
+    writer = InProcessWriter(in_process_, InProcessPipe::End::SERVER);
+    queue_options = InProcessQueueOptions(options_);
+  } else if (options_.framing == Framing::NEWLINE) {
+    writer = [this](std::vector<FrameChunk>& chunks) {
+      return WriteRecords(pipe_handle_, write_event_, stop_event_, chunks);
+    };
+    queue_options = RecordQueueOptions(options_);
+  } else {
+    writer = [this](std::vector<FrameChunk>& chunks) {
+      return WriteChunks(pipe_handle_, write_event_, stop_event_, chunks);
+    };
+  }
+  if (shaper_) {
+    writer = ShapedWriter(shaper_, std::move(writer), options_.framing == Framing::LENGTH_PREFIXED,
+                          ConnectionDropper(in_process_, pipe_handle_, true));
+  }
+  send_queue_ = std::make_shared<SendQueue>(std::move(writer), queue_options, memory_);
+  for (const auto& channel : channel_options_) {
+    send_queue_->ConfigureChannel(channel.first, channel.second);
+  }
+  monitor_.StartConnection(send_queue_, ConnectionDropper(in_process_, pipe_handle_, true));
+}
+
+void NamedPipeServer::StopSendQueue() {
+  // Before taking the lock, as the monitor may be dropping the connection.
+  monitor_.Stop();
+  
+  std::shared_ptr<SendQueue> send_queue;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    send_queue.swap(send_queue_);
+  }
+  if (send_queue) {
+    send_queue->Stop();
+  }
+}
+
+bool NamedPipeServer::GetPeerProcessId(DWORD* process_id) {
+  // Any instance of a pool with a client will do.
+  if (!is_connected_) {
+    for (auto& lane : lanes_) {
+      if (lane->IsConnected()) {
+        return lane->GetPeerProcessId(process_id);
+      }
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (in_process_) {
+      *process_id = GetCurrentProcessId();
+      return true;
+    }
+  }
+  ULONG client_process_id = 0;
+  if (!GetNamedPipeClientProcessId(pipe_handle_, &client_process_id)) {
+    return false;
+  }
+  *process_id = client_process_id;
+  return true;
+}
+
+bool NamedPipeServer::GetFlowStats(FlowStats* stats) {
+  bool connected = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (is_connected_ && send_queue_) {
+      *stats = send_queue_->GetStats();
+      connected = true;
+    }
+  }
+  FlowStats lane_stats;
+  for (auto& lane : lanes_) {
+    if (lane->GetFlowStats(&lane_stats)) {
+      if (connected) {
+        AddFlowStats(stats, lane_stats);
+      } else {
+        *stats = lane_stats;
+        connected = true;
+      }
+    }
+  }
+  return connected;
+}
+
+BlobStats NamedPipeServer::GetBlobStats() {
+  BlobStats stats;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (is_connected_ && send_queue_) {
+      stats = send_queue_->GetBlobStats();
+    }
+  }
+  for (auto& lane : lanes_) {
+    AddBlobStats(&stats, lane->GetBlobStats());
+  }
+  return stats;
+}
+
+StateSyncStats NamedPipeServer::GetStateSyncStats() {
+  StateSyncStats stats;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (is_connected_ && send_queue_) {
+      stats = send_queue_->GetStateSyncStats();
+    }
+  }
+  for (auto& lane : lanes_) {
+    AddStateSyncStats(&stats, lane->GetStateSyncStats());
+  }
+  return stats;
+}
+
+ShapingStats NamedPipeServer::GetShapingStats() {
+  ShapingStats stats;
+  if (shaper_) {
+    stats = shaper_->GetStats();
+  }
+  for (auto& lane : lanes_) {
+    AddShapingStats(&stats, lane->GetShapingStats());
+  }
+  return stats;
+}
+
+bool NamedPipeServer::ResetForNewConnection() {
+  for (auto& lane : lanes_) {
+    if (!lane->ResetForNewConnection()) {
+      return false;
+    }
+  }
+  
+  bool was_in_process = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (in_process_) {
+      in_process_->Close();
+      in_process_.reset();
+      was_in_process = true;
+    }
+  }
+  
+  // Also cancels a pending ConnectNamedPipe.
+  StopIoThread();
+  
+  if (is_connected_ && !was_in_process) {
+    // Flush any pending writes first
+    FlushFileBuffers(pipe_handle_);
+    
+    // Disconnect existing client
+    if (!DisconnectNamedPipe(pipe_handle_)) {
+      DWORD error = GetLastError();
+      // If no client was connected, that's fine - continue
+      if (error != ERROR_NO_DATA) {
+        return false;
+      }
+    }
+  }
+  is_connected_ = false;
+  
+  // Wait a brief moment for Windows to clean up the pipe state
+  Sleep(50);
+  
+  // Reset state to allow new connections
+  SetState(ServerState::CREATED);
+  return true;
+}
+
+void NamedPipeServer::DropConnection() {
+  for (auto& lane : lanes_) {
+    lane->DropConnection();
+  }
+  
+  std::function<void()> drop;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (is_connected_) {
+      drop = ConnectionDropper(in_process_, pipe_handle_, true);
+    }
+  }
+  if (drop) {
+    drop();
+  }
+}
+
+void NamedPipeServer::Close() {
+  InProcessPipeRegistry::GetInstance().Unregister(pipe_name_, this);
+  SetRouter(nullptr, std::string());
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (in_process_) {
+      in_process_->Close();
+      in_process_.reset();
+    }
+  }
+  StopIoThread();
+  // Once the I/O thread no longer changes the state.
+  registration_.reset();
+  
+  if (pipe_handle_ != INVALID_HANDLE_VALUE) {
+    // Force disconnect if connected
+    if (is_connected_) {
+      DisconnectNamedPipe(pipe_handle_);
+    }
+    
+    // Cancel any pending I/O operations
+    CancelIo(pipe_handle_);
+    
+    // Close the handle
+    CloseHandle(pipe_handle_);
+    pipe_handle_ = INVALID_HANDLE_VALUE;
+  }
+  CloseEvent(&overlap_.hEvent);
+  CloseEvent(&read_event_);
+  CloseEvent(&write_event_);
+  CloseEvent(&stop_event_);
+  is_connected_ = false;
+  SetState(ServerState::CLOSED);
+  
+  for (auto& lane : lanes_) {
+    lane->Close();
+  }
+}
+
+// static
+void FlutterIpcPlugin::RegisterWithRegistrar(
+    flutter::PluginRegistrarWindows *registrar) {
+  auto channel =
+      std::make_unique<flutter::MethodChannel<flutter::EncodableValue>>(
+          registrar->messenger(), "flutter_ipc",
+          &flutter::StandardMethodCodec::GetInstance());
+
+  auto plugin = std::make_unique<FlutterIpcPlugin>(registrar->messenger());
+
+  channel->SetMethodCallHandler(
+      [plugin_pointer = plugin.get()](const auto &call, auto result) {
+        plugin_pointer->HandleMethodCall(call, std::move(result));
+      });
+
+  registrar->AddPlugin(std::move(plugin));
+}
+
+FlutterIpcPlugin::FlutterIpcPlugin() : FlutterIpcPlugin(nullptr) {}
+
+FlutterIpcPlugin::FlutterIpcPlugin(flutter::BinaryMessenger* messenger)
+    : messenger_(messenger),
+      task_runner_(std::make_unique<PlatformTaskRunner>()),
+      handler_pool_(std::make_unique<HandlerPool>()),
+      service_watcher_(std::make_unique<ServiceWatcher>(&ServiceRegistry::GetInstance())) {}
+
+FlutterIpcPlugin::~FlutterIpcPlugin() {
+  // The stream handlers capture |this|; detach them from the messenger.
+  for (auto& channel_pair : event_channels_) {
+    channel_pair.second->SetStreamHandler(nullptr);
+  }
+}
+
+namespace {
+
+// Each endpoint has one event channel per kind of inbound frame, named
+// "flutter_ipc_stream_<stream_id><suffix>".
+constexpr const char* kStreamSuffixes[] = {"", "_handles", "_values", "_binary", "_json", "_state"};
+
+const char* HandleKindName(SharedHandleKind kind) {
+  return kind == SharedHandleKind::FILE ? "file" : "sharedMemory";
+}
+
+}  // namespace
+
+FrameHandler FlutterIpcPlugin::RegisterMessageStream(const std::string& stream_id, bool decode_json) {
+  if (messenger_) {
+    for (const char* suffix : kStreamSuffixes) {
+      RegisterEventChannel(stream_id + suffix);
+    }
+  }
+  
+  // Every frame of the endpoint goes through one lane of the handler pool,
+  // so endpoints are processed in parallel but each one in order.
+  uint64_t lane_key = std::hash<std::string>()(stream_id);
+  return [this, stream_id, lane_key, decode_json](Frame frame, FrameConsumed consumed) {
+    handler_pool_->Post(lane_key, [this, stream_id, decode_json, frame = std::move(frame), consumed = std::move(consumed)]() mutable {
+      HandleFrame(stream_id, std::move(frame), decode_json, std::move(consumed));
+    });
+  };
+}
+
+ConnectionMonitor::TimeoutHandler FlutterIpcPlugin::ReportTimeouts(const std::string& stream_id) {
+  uint64_t lane_key = std::hash<std::string>()(stream_id);
+  return [this, stream_id, lane_key](ConnectionMonitor::Timeout timeout) {
+    handler_pool_->Post(lane_key, [this, stream_id, timeout]() {
+      task_runner_->PostTask([this, stream_id, timeout]() {
+        auto sink_it = event_sinks_.find(stream_id);
+        if (sink_it == event_sinks_.end()) {
+          return;
+        }
+        switch (timeout) {
+          case ConnectionMonitor::Timeout::CONNECT:
+            sink_it->second->Error("CONNECT_TIMEOUT", "No connection within the connect timeout");
+            break;
+          case ConnectionMonitor::Timeout::HEARTBEAT:
+            sink_it->second->Error("HEARTBEAT_MISSED", "The peer stopped sending heartbeats; disconnected");
+            break;
+          case ConnectionMonitor::Timeout::IDLE:
+            sink_it->second->Error("IDLE_TIMEOUT", "No messages within the idle timeout; disconnected");
+            break;
+        }
+      });
+    });
+  };
+}
+
+void FlutterIpcPlugin::HandleFrame(const std::string& stream_id, Frame frame, bool decode_json, FrameConsumed consumed) {
+  // Values are decoded here on a pool worker so the platform thread only
+  // has to hand them to the sink.
+  if (frame.type == FrameType::VALUE) {
+    auto value = std::make_shared<flutter::EncodableValue>();
+    bool valid = DecodeValueFrame(frame, value.get());
+    task_runner_->PostTask([this, stream_id, value, valid, consumed = std::move(consumed)]() mutable {
+      AwaitAcknowledgement(DeliverValue(stream_id, *value, valid), std::move(consumed));
+    });
+    return;
+  }
+  
+  // The codec hands strings to Dart as UTF-8, and Dart fails to decode a
+  // malformed one, so such text goes to the binary stream instead.
+  std::string key;
+  bool keyed = frame.type == FrameType::TEXT && TakeStateKey(&frame, &key);
+  bool valid = frame.type != FrameType::TEXT || IsValidUtf8(frame.payload.data(), frame.payload.size());
+  if (keyed && valid && IsValidUtf8(key.data(), key.size())) {
+    task_runner_->PostTask([this, stream_id, key = std::move(key), frame = std::move(frame), consumed = std::move(consumed)]() mutable {
+      AwaitAcknowledgement(DeliverState(stream_id, key, std::move(frame)), std::move(consumed));
+    });
+    return;
+  }
+  valid = valid && !keyed;
+  if (valid && decode_json && frame.type == FrameType::TEXT) {
+    auto value = std::make_shared<flutter::EncodableValue>();
+    auto error = std::make_shared<std::string>();
+    DecodeJson(frame.payload.data(), frame.payload.size(), value.get(), error.get());
+    task_runner_->PostTask([this, stream_id, value, error, consumed = std::move(consumed)]() mutable {
+      AwaitAcknowledgement(DeliverJson(stream_id, *value, *error), std::move(consumed));
+    });
+    return;
+  }
+  
+  task_runner_->PostTask([this, stream_id, valid, frame = std::move(frame), consumed = std::move(consumed)]() mutable {
+    std::string channel_key = valid ? DeliverFrame(stream_id, std::move(frame))
+                                    : DeliverBinary(stream_id, std::move(frame));
+    AwaitAcknowledgement(channel_key, std::move(consumed));
+  });
+}
+
+void FlutterIpcPlugin::RegisterEventChannel(const std::string& channel_key) {
+  auto channel = std::make_unique<flutter::EventChannel<flutter::EncodableValue>>(
+      messenger_, "flutter_ipc_stream_" + channel_key,
+      &flutter::StandardMethodCodec::GetInstance());
+  channel->SetStreamHandler(
+      std::make_unique<flutter::StreamHandlerFunctions<flutter::EncodableValue>>(
+          [this, channel_key](const flutter::EncodableValue* arguments,
+                              std::unique_ptr<flutter::EventSink<flutter::EncodableValue>>&& events)
+              -> std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>> {
+            event_sinks_[channel_key] = std::move(events);
+            return nullptr;
+          },
+          [this, channel_key](const flutter::EncodableValue* arguments)
+              -> std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>> {
+            event_sinks_.erase(channel_key);
+            ReleaseUnacknowledged(channel_key);
+            return nullptr;
+          }));
+  event_channels_[channel_key] = std::move(channel);
+}
+
+void FlutterIpcPlugin::UnregisterMessageStream(const std::string& stream_id) {
+  for (const char* suffix : kStreamSuffixes) {
+    std::string channel_key = stream_id + suffix;
+    
+    auto sink_it = event_sinks_.find(channel_key);
+    if (sink_it != event_sinks_.end()) {
+      sink_it->second->EndOfStream();
+      event_sinks_.erase(sink_it);
+    }
+    ReleaseUnacknowledged(channel_key);
+    
+    auto channel_it = event_channels_.find(channel_key);
+    if (channel_it != event_channels_.end()) {
+      channel_it->second->SetStreamHandler(nullptr);
+      event_channels_.erase(channel_it);
+    }
+  }
+}
+
+std::string FlutterIpcPlugin::DeliverFrame(const std::string& stream_id, Frame frame) {
+  if (frame.type == FrameType::HANDLES) {
+    return DeliverHandleFrame(stream_id, frame);
+  }
+  
+  // Like a broadcast stream, messages arriving with no listener are dropped.
+  auto sink_it = event_sinks_.find(stream_id);
+  if (sink_it == event_sinks_.end()) {
+    return std::string();
+  }
+  sink_it->second->Success(flutter::EncodableValue(std::move(frame.payload)));
+  return sink_it->first;
+}
+
+std::string FlutterIpcPlugin::DeliverState(const std::string& stream_id, const std::string& key, Frame frame) {
+  auto sink_it = event_sinks_.find(stream_id + "_state");
+  if (sink_it == event_sinks_.end()) {
+    return std::string();
+  }
+  sink_it->second->Success(flutter::EncodableValue(flutter::EncodableMap{
+    {flutter::EncodableValue("key"), flutter::EncodableValue(key)},
+    {flutter::EncodableValue("message"), flutter::EncodableValue(std::move(frame.payload))},
+  }));
+  return sink_it->first;
+}
+
+std::string FlutterIpcPlugin::DeliverBinary(const std::string& stream_id, Frame frame) {
+  auto sink_it = event_sinks_.find(stream_id + "_binary");
+  if (sink_it == event_sinks_.end()) {
+    return std::string();
+  }
+  sink_it->second->Success(flutter::EncodableValue(
+      std::vector<uint8_t>(frame.payload.begin(), frame.payload.end())));
+  return sink_it->first;
+}
+
+std::string FlutterIpcPlugin::DeliverJson(const std::string& stream_id, const flutter::EncodableValue& value, const std::string& error) {
+  auto sink_it = event_sinks_.find(stream_id + "_json");
+  if (sink_it == event_sinks_.end()) {
+    return std::string();
+  }
+  
+  if (!error.empty()) {
+    sink_it->second->Error("INVALID_JSON", error);
+  } else {
+    sink_it->second->Success(value);
+  }
+  return sink_it->first;
+}
+
+std::string FlutterIpcPlugin::DeliverValue(const std::string& stream_id, const flutter::EncodableValue& value, bool valid) {
+  auto sink_it = event_sinks_.find(stream_id + "_values");
+  if (sink_it == event_sinks_.end()) {
+    return std::string();
+  }
+  
+  if (!valid) {
+    sink_it->second->Error("INVALID_VALUE", "Received a malformed value frame");
+  } else {
+    sink_it->second->Success(value);
+  }
+  return sink_it->first;
+}
+
+std::string FlutterIpcPlugin::DeliverHandleFrame(const std::string& stream_id, const Frame& frame) {
+  std::vector<std::unique_ptr<SharedHandle>> handles;
+  std::string message;
+  if (!DecodeHandleFrame(frame, &handles, &message)) {
+    return std::string();
+  }
+  
+  // Without a listener the handles are closed again right here.
+  auto sink_it = event_sinks_.find(stream_id + "_handles");
+  if (sink_it == event_sinks_.end()) {
+    return std::string();
+  }
+  
+  flutter::EncodableList handle_list;
+  for (auto& handle : handles) {
+    std::string handle_id = GenerateHandleId();
+    handle_list.push_back(flutter::EncodableValue(flutter::EncodableMap{
+      {flutter::EncodableValue("handleId"), flutter::EncodableValue(handle_id)},
+      {flutter::EncodableValue("kind"), flutter::EncodableValue(HandleKindName(handle->kind()))},
+      {flutter::EncodableValue("size"), flutter::EncodableValue(static_cast<int64_t>(handle->size()))},
+    }));
+    handles_[handle_id] = std::move(handle);
+  }
+  
+  sink_it->second->Success(flutter::EncodableValue(flutter::EncodableMap{
+    {flutter::EncodableValue("message"), flutter::EncodableValue(message)},
+    {flutter::EncodableValue("handles"), flutter::EncodableValue(handle_list)},
+  }));
+  return sink_it->first;
+}
+
+void FlutterIpcPlugin::AwaitAcknowledgement(const std::string& channel_key, FrameConsumed consumed) {
+  if (channel_key.empty()) {
+    consumed(); // Dropped frames count as consumed
+    return;
+  }
+  unacknowledged_[channel_key].push_back(std::move(consumed));
+}
+
+void FlutterIpcPlugin::ReleaseUnacknowledged(const std::string& channel_key) {
+  auto it = unacknowledged_.find(channel_key);
+  if (it == unacknowledged_.end()) {
+    return;
+  }
+  std::deque<FrameConsumed> pending = std::move(it->second);
+  unacknowledged_.erase(it);
+  for (auto& consumed : pending) {
+    consumed();
+  }
+}
+
+bool FlutterIpcPlugin::FindHandles(const flutter::EncodableMap& arguments, std::vector<const SharedHandle*>* handles) {
+  auto handle_ids_it = arguments.find(flutter::EncodableValue("handleIds"));
+  if (handle_ids_it == arguments.end()) {
+    return false;
+  }
+  
+  const auto* handle_ids = std::get_if<flutter::EncodableList>(&handle_ids_it->second);
+  if (!handle_ids) {
+    return false;
+  }
+  
+  for (const auto& handle_id_value : *handle_ids) {
+    const auto* handle_id = std::get_if<std::string>(&handle_id_value);
+    if (!handle_id) {
+      return false;
+    }
+    auto handle_it = handles_.find(*handle_id);
+    if (handle_it == handles_.end()) {
+      return false;
+    }
+    handles->push_back(handle_it->second.get());
+  }
+  return true;
+}
+
+std::string FlutterIpcPlugin::GenerateServerId() {
+  static int counter = 0;
+  return "server_" + std::to_string(++counter);
+}
+
+std::string FlutterIpcPlugin::GenerateClientId() {
+  static int counter = 0;
+  return "client_" + std::to_string(++counter);
+}
+
+std::string FlutterIpcPlugin::GenerateBrokerId() {
+  static int counter = 0;
+  return "broker_" + std::to_string(++counter);
+}
+
+std::map<std::string, std::shared_ptr<FrameRouter>>::iterator FlutterIpcPlugin::FindBroker(const flutter::EncodableMap& arguments) {
+  auto broker_id_it = arguments.find(flutter::EncodableValue("brokerId"));
+  if (broker_id_it == arguments.end()) {
+    return brokers_.end();
+  }
+  const auto* broker_id = std::get_if<std::string>(&broker_id_it->second);
+  return broker_id ? brokers_.find(*broker_id) : brokers_.end();
+}
+
+std::string FlutterIpcPlugin::GenerateHandleId() {
+  static int counter = 0;
+  return "handle_" + std::to_string(++counter);
+}
+
+std::string GetWindowsErrorMessage(DWORD error_code) {
+  LPWSTR message_buffer = nullptr;
+  size_t size = FormatMessageW(
+    FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+    NULL, error_code, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
+    (LPWSTR)&message_buffer, 0, NULL
+  );
+  
+  if (size == 0 || message_buffer == nullptr) {
+    return "Unknown error";
+  }
+  
+  // Convert from UTF-16 to UTF-8
+  int utf8_length = WideCharToMultiByte(CP_UTF8, 0, message_buffer, -1, NULL, 0, NULL, NULL);
+  if (utf8_length == 0) {
+    LocalFree(message_buffer);
+    return "Error message conversion failed";
+  }
+  
+  std::string message(utf8_length - 1, '\0'); // -1 to exclude null terminator
+  WideCharToMultiByte(CP_UTF8, 0, message_buffer, -1, &message[0], utf8_length, NULL, NULL);
+  LocalFree(message_buffer);
+  
+  // Remove trailing newline characters
+  while (!message.empty() && (message.back() == '\n' || message.back() == '\r')) {
+    message.pop_back();
+  }
+  
+  return message;
+}
+
+// Integer arguments arrive as int32 or int64 depending on their magnitude.
+bool GetIntArgument(const flutter::EncodableMap& arguments, const char* name, int64_t* value) {
+  auto it = arguments.find(flutter::EncodableValue(name));
+  if (it == arguments.end()) {
+    return false;
+  }
+  if (const auto* int32_value = std::get_if<int32_t>(&it->second)) {
+    *value = *int32_value;
+    return true;
+  }
+  if (const auto* int64_value = std::get_if<int64_t>(&it->second)) {
+    *value = *int64_value;
+    return true;
+  }
+  return false;
+}
+
+// Reads the optional "options" map of createServer and connect. The
+// profile picks the defaults that the other entries override. Returns false
+// with a description in |error| if an entry is malformed.
+bool GetConnectionOptions(const flutter::EncodableMap& arguments, ConnectionOptions* options, std::string* error) {
+  *options = ConnectionOptions();
+  auto options_it = arguments.find(flutter::EncodableValue("options"));
+  if (options_it == arguments.end() || options_it->second.IsNull()) {
+    return true;
+  }
+  const auto* map = std::get_if<flutter::EncodableMap>(&options_it->second);
+  if (!map) {
+    *error = "options must be a map";
+    return false;
+  }
+  
+  auto profile_it = map->find(flutter::EncodableValue("profile"));
+  if (profile_it != map->end()) {
+    const auto* name = std::get_if<std::string>(&profile_it->second);
+    TuningProfile profile;
+    if (!name || !ParseTuningProfile(*name, &profile)) {
+      *error = "profile must be one of balanced, latency, throughput and auto";
+      return false;
+    }
+    *options = ConnectionOptions::ForProfile(profile);
+  }
+  
+  struct Field {
+    const char* name;
+    int64_t min;
+    int64_t max;
+    std::function<void(int64_t)> apply;
+  };
+  const Field fields[] = {
+    {"outBufferSize", 0, UINT32_MAX, [&](int64_t value) { options->out_buffer_size = static_cast<DWORD>(value); }},
+    {"inBufferSize", 0, UINT32_MAX, [&](int64_t value) { options->in_buffer_size = static_cast<DWORD>(value); }},
+    {"instances", 1, PIPE_UNLIMITED_INSTANCES, [&](int64_t value) { options->max_instances = static_cast<DWORD>(value); }},
+    {"timeoutMs", 0, UINT32_MAX, [&](int64_t value) { options->timeout_ms = static_cast<DWORD>(value); }},
+    {"maxQueuedBytes", 1, INT64_MAX, [&](int64_t value) { options->max_queued_bytes = static_cast<size_t>(value); }},
+    {"chunkSize", 1, static_cast<int64_t>(kMaxChunkLength), [&](int64_t value) { options->chunk_size = static_cast<size_t>(value); }},
+    {"coalesceBytes", 0, INT32_MAX, [&](int64_t value) { options->coalesce_bytes = static_cast<size_t>(value); }},
+    {"windowBytes", 1, UINT32_MAX, [&](int64_t value) { options->receive_window.bytes = static_cast<uint32_t>(value); }},
+    {"windowMessages", 1, UINT32_MAX, [&](int64_t value) { options->receive_window.messages = static_cast<uint32_t>(value); }},
+    {"spinMicros", 0, 1000000, [&](int64_t value) { options->polling.spin_us = static_cast<uint32_t>(value); }},
+    {"cpuAffinity", 0, INT64_MAX, [&](int64_t value) { options->polling.affinity_mask = static_cast<DWORD_PTR>(value); }},
+    {"maxRecordLength", 1, 1 << 30, [&](int64_t value) { options->max_record_length = static_cast<size_t>(value); }},
+    {"memoryLimit", 0, INT64_MAX, [&](int64_t value) { options->memory_limit = static_cast<size_t>(value); }},
+    {"heartbeatIntervalMs", 0, INT32_MAX, [&](int64_t value) { options->heartbeat_interval_ms = static_cast<uint32_t>(value); }},
+    {"idleTimeoutMs", 0, INT32_MAX, [&](int64_t value) { options->idle_timeout_ms = static_cast<uint32_t>(value); }},
+    {"connectTimeoutMs", 0, INT32_MAX, [&](int64_t value) { options->connect_timeout_ms = static_cast<uint32_t>(value); }},
+    {"blobCacheBytes", 0, INT64_MAX, [&](int64_t value) { options->blob_cache_bytes = static_cast<size_t>(value); }},
+    {"blobMinBytes", 64, INT32_MAX, [&](int64_t value) { options->blob_min_bytes = static_cast<size_t>(value); }},
+    {"stateCacheBytes", 0, INT64_MAX, [&](int64_t value) { options->state_cache_bytes = static_cast<size_t>(value); }},
+  };
+  auto backend_it = map->find(flutter::EncodableValue("ioBackend"));
+  if (backend_it != map->end()) {
+    const auto* name = std::get_if<std::string>(&backend_it->second);
+    if (!name || !ParseIoBackend(*name, &options->io_backend)) {
+      *error = "ioBackend must be one of threads and completionPort";
+      return false;
+    }
+  }
+  
+  auto priority_it = map->find(flutter::EncodableValue("threadPriority"));
+  if (priority_it != map->end()) {
+    static const std::map<std::string, int> kPriorities = {
+      {"normal", THREAD_PRIORITY_NORMAL},
+      {"aboveNormal", THREAD_PRIORITY_ABOVE_NORMAL},
+      {"highest", THREAD_PRIORITY_HIGHEST},
+      {"timeCritical", THREAD_PRIORITY_TIME_CRITICAL},
+    };
+    const auto* name = std::get_if<std::string>(&priority_it->second);
+    auto known = name ? kPriorities.find(*name) : kPriorities.end();
+    if (known == kPriorities.end()) {
+      *error = "threadPriority must be one of normal, aboveNormal, highest and timeCritical";
+      return false;
+    }
+    options->polling.thread_priority = known->second;
+  }
+  
+  auto framing_it = map->find(flutter::EncodableValue("framing"));
+  if (framing_it != map->end()) {
+    const auto* name = std::get_if<std::string>(&framing_it->second);
+    if (!name || !ParseFraming(*name, &options->framing)) {
+      *error = "framing must be one of lengthPrefixed and newline";
+      return false;
+    }
+  }
+  
+  auto memory_policy_it = map->find(flutter::EncodableValue("memoryPolicy"));
+  if (memory_policy_it != map->end()) {
+    const auto* name = std::get_if<std::string>(&memory_policy_it->second);
+    if (!name || !ParseBudgetPolicy(*name, &options->memory_policy)) {
+      *error = "memoryPolicy must be one of pauseReads, rejectSends and disconnect";
+      return false;
+    }
+  }
+  
+  auto stripe_policy_it = map->find(flutter::EncodableValue("stripePolicy"));
+  if (stripe_policy_it != map->end()) {
+    const auto* name = std::get_if<std::string>(&stripe_policy_it->second);
+    if (!name || !ParseStripePolicy(*name, &options->stripe_policy)) {
+      *error = "stripePolicy must be one of roundRobin and leastQueued";
+      return false;
+    }
+  }
+  
+  auto ordered_it = map->find(flutter::EncodableValue("orderedStripes"));
+  if (ordered_it != map->end()) {
+    const auto* value = std::get_if<bool>(&ordered_it->second);
+    if (!value) {
+      *error = "orderedStripes must be a bool";
+      return false;
+    }
+    options->ordered_stripes = *value;
+  }
+  
+  auto decode_it = map->find(flutter::EncodableValue("decodeJson"));
+  if (decode_it != map->end()) {
+    const auto* value = std::get_if<bool>(&decode_it->second);
+    if (!value) {
+      *error = "decodeJson must be a bool";
+      return false;
+    }
+    options->decode_json = *value;
+  }
+  
+  for (const auto& field : fields) {
+    if (map->find(flutter::EncodableValue(field.name)) == map->end()) {
+      continue;
+    }
+    int64_t value = 0;
+    if (!GetIntArgument(*map, field.name, &value) || value < field.min || value > field.max) {
+      *error = std::string(field.name) + " must be an integer between " + std::to_string(field.min) + " and " + std::to_string(field.max);
+      return false;
+    }
+    field.apply(value);
+  }
+  
+  // A line-oriented peer would never see the heartbeats, nor send any.
+  if (options->framing == Framing::NEWLINE && options->heartbeat_interval_ms != 0) {
+    *error = "heartbeatIntervalMs needs lengthPrefixed framing";
+    return false;
+  }
+  return true;
+}
+
+flutter::EncodableMap EncodeMemoryStats(const MemoryStats& stats) {
+  return flutter::EncodableMap{
+    {flutter::EncodableValue("totalBytes"), flutter::EncodableValue(static_cast<int64_t>(stats.total()))},
+    {flutter::EncodableValue("peakBytes"), flutter::EncodableValue(static_cast<int64_t>(stats.peak_bytes))},
+    {flutter::EncodableValue("sendBytes"), flutter::EncodableValue(static_cast<int64_t>(stats.send_bytes))},
+    {flutter::EncodableValue("receiveBytes"), flutter::EncodableValue(static_cast<int64_t>(stats.receive_bytes))},
+    {flutter::EncodableValue("reassemblyBytes"), flutter::EncodableValue(static_cast<int64_t>(stats.reassembly_bytes))},
+    {flutter::EncodableValue("rejectedSends"), flutter::EncodableValue(static_cast<int64_t>(stats.rejected_sends))},
+    {flutter::EncodableValue("readPauses"), flutter::EncodableValue(static_cast<int64_t>(stats.read_pauses))},
+    {flutter::EncodableValue("disconnects"), flutter::EncodableValue(static_cast<int64_t>(stats.disconnects))},
+  };
+}
+
+flutter::EncodableMap EncodeBlobStats(const BlobStats& stats) {
+  flutter::EncodableMap map{
+    {flutter::EncodableValue("candidates"), flutter::EncodableValue(static_cast<int64_t>(stats.candidates))},
+    {flutter::EncodableValue("hits"), flutter::EncodableValue(static_cast<int64_t>(stats.hits))},
+    {flutter::EncodableValue("bytesSaved"), flutter::EncodableValue(static_cast<int64_t>(stats.bytes_saved))},
+    {flutter::EncodableValue("heldBlobs"), flutter::EncodableValue(static_cast<int64_t>(stats.held_blobs))},
+    {flutter::EncodableValue("heldBytes"), flutter::EncodableValue(static_cast<int64_t>(stats.held_bytes))},
+    {flutter::EncodableValue("references"), flutter::EncodableValue(static_cast<int64_t>(stats.references))},
+    {flutter::EncodableValue("unknownReferences"), flutter::EncodableValue(static_cast<int64_t>(stats.unknown_references))},
+  };
+  if (stats.candidates != 0) {
+    map[flutter::EncodableValue("hitRate")] = flutter::EncodableValue(static_cast<double>(stats.hits) / stats.candidates);
+  }
+  return map;
+}
+
+flutter::EncodableMap EncodeStateSyncStats(const StateSyncStats& stats) {
+  return flutter::EncodableMap{
+    {flutter::EncodableValue("updates"), flutter::EncodableValue(static_cast<int64_t>(stats.updates))},
+    {flutter::EncodableValue("snapshots"), flutter::EncodableValue(static_cast<int64_t>(stats.snapshots))},
+    {flutter::EncodableValue("deltas"), flutter::EncodableValue(static_cast<int64_t>(stats.deltas))},
+    {flutter::EncodableValue("valueBytes"), flutter::EncodableValue(static_cast<int64_t>(stats.value_bytes))},
+    {flutter::EncodableValue("encodedBytes"), flutter::EncodableValue(static_cast<int64_t>(stats.encoded_bytes))},
+    {flutter::EncodableValue("trackedKeys"), flutter::EncodableValue(static_cast<int64_t>(stats.tracked_keys))},
+    {flutter::EncodableValue("trackedBytes"), flutter::EncodableValue(static_cast<int64_t>(stats.tracked_bytes))},
+    {flutter::EncodableValue("heldKeys"), flutter::EncodableValue(static_cast<int64_t>(stats.held_keys))},
+    {flutter::EncodableValue("heldBytes"), flutter::EncodableValue(static_cast<int64_t>(stats.held_bytes))},
+    {flutter::EncodableValue("misses"), flutter::EncodableValue(static_cast<int64_t>(stats.misses))},
+  };
+}
+
+flutter::EncodableMap EncodeServiceInfo(const ServiceInfo& info) {
+  const char* state = info.state == ServiceState::AVAILABLE ? "available"
+                      : info.state == ServiceState::BUSY    ? "busy"
+                                                            : "starting";
+  return flutter::EncodableMap{
+    {flutter::EncodableValue("pipeName"), flutter::EncodableValue(info.name)},
+    {flutter::EncodableValue("state"), flutter::EncodableValue(state)},
+    {flutter::EncodableValue("capacity"), flutter::EncodableValue(static_cast<int64_t>(info.capacity))},
+    {flutter::EncodableValue("processId"), flutter::EncodableValue(static_cast<int64_t>(info.process_id))},
+  };
+}
+
+// Reads the optional "connections" argument of createServer and connect:
+// how many pipe instances one logical connection is spread over.
+bool GetConnectionsArgument(const flutter::EncodableMap& arguments, ConnectionOptions* options, std::string* error) {
+  if (arguments.find(flutter::EncodableValue("connections")) == arguments.end()) {
+    return true;
+  }
+  int64_t value = 0;
+  if (!GetIntArgument(arguments, "connections", &value) || value < 1 || value > ConnectionOptions::kMaxConnections) {
+    *error = "connections must be an integer between 1 and " + std::to_string(ConnectionOptions::kMaxConnections);
+    return false;
+  }
+  options->connections = static_cast<uint32_t>(value);
+  // Records have no room for stripe sequence numbers.
+  if (options->connections > 1 && options->framing == Framing::NEWLINE) {
+    *error = "connections needs lengthPrefixed framing";
+    return false;
+  }
+  return true;
+}
+
+// Reads the optional "channel" argument of a send call. Frames without one
+// go out on channel 0.
+bool GetChannelArgument(const flutter::EncodableMap& arguments, uint16_t* channel) {
+  *channel = 0;
+  if (arguments.find(flutter::EncodableValue("channel")) == arguments.end()) {
+    return true;
+  }
+  int64_t value = 0;
+  if (!GetIntArgument(arguments, "channel", &value) || value < 0 || value > UINT16_MAX) {
+    return false;
+  }
+  *channel = static_cast<uint16_t>(value);
+  return true;
+}
+
+// Reads the optional "timeoutMs" argument of a send call: how long the
+// frame may wait in the queue. 0, the default, waits forever.
+bool GetTimeoutArgument(const flutter::EncodableMap& arguments, uint32_t* timeout_ms) {
+  *timeout_ms = 0;
+  if (arguments.find(flutter::EncodableValue("timeoutMs")) == arguments.end()) {
+    return true;
+  }
+  int64_t value = 0;
+  if (!GetIntArgument(arguments, "timeoutMs", &value) || value < 0 || value > INT32_MAX) {
+    return false;
+  }
+  *timeout_ms = static_cast<uint32_t>(value);
+  return true;
+}
+
+// Reads the optional "key" argument of a message send, which makes the
+// message a state-sync update; |key| stays null without one.
+bool GetKeyArgument(const flutter::EncodableMap& arguments, const std::string** key) {
+  *key = nullptr;
+  auto key_it = arguments.find(flutter::EncodableValue("key"));
+  if (key_it == arguments.end()) {
+    return true;
+  }
+  *key = std::get_if<std::string>(&key_it->second);
+  return *key && (*key)->size() <= UINT16_MAX;
+}
+
+SendCompletion FlutterIpcPlugin::CompleteSendResult(
+    std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+    const std::string& description, std::function<void()> on_failure) {
+  PlatformTaskRunner* task_runner = task_runner_.get();
+  return [task_runner, result, description, on_failure](bool success, uint32_t error) {
+    if (!success && on_failure) {
+      on_failure();
+    }
+    task_runner->PostTask([result, description, success, error]() {
+      if (success) {
+        result->Success(flutter::EncodableValue(true));
+        return;
+      }
+      std::string error_msg = "Failed to send " + description + ": " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
+      // A frame that outstayed its timeoutMs in the queue.
+      result->Error(error == ERROR_TIMEOUT ? "SEND_TIMEOUT" : "SEND_MESSAGE_FAILED", error_msg);
+    });
+  };
+}
+
+void FlutterIpcPlugin::HandleMethodCall(
+    const flutter::MethodCall<flutter::EncodableValue> &method_call,
+    std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  
+  const std::string& method = method_call.method_name();
+  
+  if (method == "createServer") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for createServer");
+      return;
+    }
+    
+    auto pipe_name_it = arguments->find(flutter::EncodableValue("pipeName"));
+    if (pipe_name_it == arguments->end()) {
+      result->Error("INVALID_ARGUMENTS", "Missing pipeName argument");
+      return;
+    }
+    
+    const auto* pipe_name = std::get_if<std::string>(&pipe_name_it->second);
+    if (!pipe_name) {
+      result->Error("INVALID_ARGUMENTS", "pipeName must be a string");
+      return;
+    }
+    
+    ConnectionOptions options;
+    std::string options_error;
+    if (!GetConnectionOptions(*arguments, &options, &options_error) ||
+        !GetConnectionsArgument(*arguments, &options, &options_error)) {
+      result->Error("INVALID_ARGUMENTS", options_error);
+      return;
+    }
+    
+    try {
+      // Check if a server with the same pipe name already exists and close it
+      for (auto it = servers_.begin(); it != servers_.end();) {
+        if (it->second->GetPipeName() == *pipe_name) {
+          it->second->Close();
+          UnregisterMessageStream("server_" + it->first);
+          it = servers_.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      
+      std::string server_id = GenerateServerId();
+      auto server = std::make_unique<NamedPipeServer>(*pipe_name, options);
+      
+      if (!server->Create()) {
+        DWORD error = GetLastError();
+        std::string error_msg = "Failed to create named pipe '" + *pipe_name + "': " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
+        result->Error("PIPE_CREATION_FAILED", error_msg);
+        return;
+      }
+      
+      server->SetFrameHandler(RegisterMessageStream("server_" + server_id, options.decode_json));
+      server->SetTimeoutHandler(ReportTimeouts("server_" + server_id));
+      // The budget calls from whichever thread charged it, possibly under
+      // the server's locks, so the client is dropped on the platform thread.
+      // The drop does not wait for the I/O thread, which keeps the UI
+      // responsive and lets it do the teardown.
+      server->SetShedHandler([this, server_id]() {
+        task_runner_->PostTask([this, server_id]() {
+          auto it = servers_.find(server_id);
+          if (it != servers_.end()) {
+            it->second->DropConnection();
+          }
+        });
+      });
+      servers_[server_id] = std::move(server);
+      result->Success(flutter::EncodableValue(server_id));
+    } catch (const std::exception& e) {
+      result->Error("CREATE_SERVER_FAILED", e.what());
+    }
+  } 
+  else if (method == "connect") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for connect");
+      return;
+    }
+    
+    auto pipe_name_it = arguments->find(flutter::EncodableValue("pipeName"));
+    if (pipe_name_it == arguments->end()) {
+      result->Error("INVALID_ARGUMENTS", "Missing pipeName argument");
+      return;
+    }
+    
+    const auto* pipe_name = std::get_if<std::string>(&pipe_name_it->second);
+    if (!pipe_name) {
+      result->Error("INVALID_ARGUMENTS", "pipeName must be a string");
+      return;
+    }
+    
+    bool resilient = false;
+    auto resilient_it = arguments->find(flutter::EncodableValue("resilient"));
+    if (resilient_it != arguments->end()) {
+      const auto* value = std::get_if<bool>(&resilient_it->second);
+      if (!value) {
+        result->Error("INVALID_ARGUMENTS", "resilient must be a bool");
+        return;
+      }
+      resilient = *value;
+    }
+    
+    ConnectionOptions options;
+    std::string options_error;
+    if (!GetConnectionOptions(*arguments, &options, &options_error) ||
+        !GetConnectionsArgument(*arguments, &options, &options_error)) {
+      result->Error("INVALID_ARGUMENTS", options_error);
+      return;
+    }
+    // Replay needs sequence numbers, which lines do not carry.
+    if (resilient && options.framing == Framing::NEWLINE) {
+      result->Error("INVALID_ARGUMENTS", "resilient clients need lengthPrefixed framing");
+      return;
+    }
+    // The outbox replays into one session over one connection.
+    if (resilient && options.connections > 1) {
+      result->Error("INVALID_ARGUMENTS", "resilient clients cannot be pooled");
+      return;
+    }
+    
+    try {
+      std::string client_id = GenerateClientId();
+      auto client = std::make_unique<NamedPipeClient>(*pipe_name, resilient, options);
+      client->SetFrameHandler(RegisterMessageStream("client_" + client_id, options.decode_json));
+      client->SetTimeoutHandler(ReportTimeouts("client_" + client_id));
+      client->SetShedHandler([this, client_id]() {
+        task_runner_->PostTask([this, client_id]() {
+          auto it = clients_.find(client_id);
+          if (it != clients_.end()) {
+            it->second->Disconnect();
+          }
+        });
+      });
+      
+      // A server living in this process is wired up through memory, which
+      // skips the kernel pipe and the settle delays below.
+      if (client->ConnectInProcess()) {
+        clients_[client_id] = std::move(client);
+        result->Success(flutter::EncodableValue(client_id));
+        return;
+      }
+      
+      // Wait a brief moment to allow any previous disconnection to complete,
+      // unless the registry says the server is listening already.
+      ServiceInfo service;
+      if (!ServiceRegistry::GetInstance().Lookup(*pipe_name, &service) || service.state != ServiceState::AVAILABLE) {
+        Sleep(100);
+      }
+      
+      // Try to find and reset any existing server with the same pipe name
+      for (auto& server_pair : servers_) {
+        if (server_pair.second->GetPipeName() == *pipe_name) {
+          if (!server_pair.second->ResetForNewConnection()) {
+            UnregisterMessageStream("client_" + client_id);
+            result->Error("SERVER_RESET_FAILED", "Failed to reset server for new connection");
+            return;
+          }
+          break;
+        }
+      }
+      
+      if (!client->Connect()) {
+        DWORD error = GetLastError();
+        UnregisterMessageStream("client_" + client_id);
+        std::string error_msg;
         
         if (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND) {
           error_msg = "Named pipe '" + *pipe_name + "' does not exist. Make sure the server is created and listening.";
@@ -421,78 +2564,530 @@ void FlutterIpcPlugin::HandleMethodCall(
         result->Error("PIPE_CONNECTION_FAILED", error_msg);
         return;
       }
-      
-      clients_[client_id] = std::move(client);
-      result->Success(flutter::EncodableValue(client_id));
+      
+      clients_[client_id] = std::move(client);
+      result->Success(flutter::EncodableValue(client_id));
+    } catch (const std::exception& e) {
+      result->Error("CONNECT_FAILED", e.what());
+    }
+  }
+  else if (method == "listen") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for listen");
+      return;
+    }
+    
+    auto server_id_it = arguments->find(flutter::EncodableValue("serverId"));
+    if (server_id_it == arguments->end()) {
+      result->Error("INVALID_ARGUMENTS", "Missing serverId argument");
+      return;
+    }
+    
+    const auto* server_id = std::get_if<std::string>(&server_id_it->second);
+    if (!server_id) {
+      result->Error("INVALID_ARGUMENTS", "serverId must be a string");
+      return;
+    }
+    
+    auto server_it = servers_.find(*server_id);
+    if (server_it == servers_.end()) {
+      result->Error("SERVER_NOT_FOUND", "Server with given ID not found");
+      return;
+    }
+    
+    try {
+      if (!server_it->second->WaitForConnection()) {
+        DWORD error = GetLastError();
+        std::string error_msg = "Failed to wait for connection on server '" + *server_id + "': " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
+        result->Error("LISTEN_FAILED", error_msg);
+        return;
+      }
+      
+      result->Success(flutter::EncodableValue(true));
+    } catch (const std::exception& e) {
+      result->Error("LISTEN_FAILED", e.what());
+    }
+  }
+  else if (method == "sendMessageFromServer") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for sendMessageFromServer");
+      return;
+    }
+    
+    auto server_id_it = arguments->find(flutter::EncodableValue("serverId"));
+    if (server_id_it == arguments->end()) {
+      result->Error("INVALID_ARGUMENTS", "Missing serverId argument");
+      return;
+    }
+    
+    auto message_it = arguments->find(flutter::EncodableValue("message"));
+    if (message_it == arguments->end()) {
+      result->Error("INVALID_ARGUMENTS", "Missing message argument");
+      return;
+    }
+    
+    const auto* server_id = std::get_if<std::string>(&server_id_it->second);
+    const auto* message = std::get_if<std::string>(&message_it->second);
+    
+    if (!server_id || !message) {
+      result->Error("INVALID_ARGUMENTS", "serverId and message must be strings");
+      return;
+    }
+    
+    auto server_it = servers_.find(*server_id);
+    if (server_it == servers_.end()) {
+      result->Error("SERVER_NOT_FOUND", "Server with given ID not found");
+      return;
+    }
+    
+    if (!server_it->second->IsConnected()) {
+      result->Error("SERVER_NOT_CONNECTED", "Server is not connected to any client");
+      return;
+    }
+    
+    uint16_t channel = 0;
+    if (!GetChannelArgument(*arguments, &channel)) {
+      result->Error("INVALID_ARGUMENTS", "channel must be an integer between 0 and 65535");
+      return;
+    }
+    
+    uint32_t timeout_ms = 0;
+    if (!GetTimeoutArgument(*arguments, &timeout_ms)) {
+      result->Error("INVALID_ARGUMENTS", "timeoutMs must be a non-negative integer");
+      return;
+    }
+    
+    const std::string* key = nullptr;
+    if (!GetKeyArgument(*arguments, &key)) {
+      result->Error("INVALID_ARGUMENTS", "key must be a string of at most 65535 bytes");
+      return;
+    }
+    
+    // Answered by the writer thread once the frame is on the wire.
+    std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> shared_result = std::move(result);
+    try {
+      std::string description = "message from server '" + *server_id + "'";
+      Frame frame(FrameType::TEXT, *message);
+      frame.channel = channel;
+      if (key) {
+        AddStateKey(&frame, *key);
+      }
+      if (!server_it->second->SendFrame(std::move(frame), CompleteSendResult(shared_result, description), timeout_ms)) {
+        DWORD error = GetLastError();
+        std::string error_msg = "Failed to send " + description + ": " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
+        shared_result->Error("SEND_MESSAGE_FAILED", error_msg);
+      }
     } catch (const std::exception& e) {
-      result->Error("CONNECT_FAILED", e.what());
+      shared_result->Error("SEND_MESSAGE_FAILED", e.what());
+    }
+  }
+  else if (method == "sendMessageFromClient") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for sendMessageFromClient");
+      return;
+    }
+    
+    auto client_id_it = arguments->find(flutter::EncodableValue("clientId"));
+    if (client_id_it == arguments->end()) {
+      result->Error("INVALID_ARGUMENTS", "Missing clientId argument");
+      return;
+    }
+    
+    auto message_it = arguments->find(flutter::EncodableValue("message"));
+    if (message_it == arguments->end()) {
+      result->Error("INVALID_ARGUMENTS", "Missing message argument");
+      return;
+    }
+    
+    const auto* client_id = std::get_if<std::string>(&client_id_it->second);
+    const auto* message = std::get_if<std::string>(&message_it->second);
+    
+    if (!client_id || !message) {
+      result->Error("INVALID_ARGUMENTS", "clientId and message must be strings");
+      return;
+    }
+    
+    auto client_it = clients_.find(*client_id);
+    if (client_it == clients_.end()) {
+      result->Error("CLIENT_NOT_FOUND", "Client with given ID not found");
+      return;
+    }
+    
+    if (!client_it->second->CanSend()) {
+      result->Error("CLIENT_NOT_CONNECTED", "Client is not connected to server");
+      return;
+    }
+    
+    uint16_t channel = 0;
+    if (!GetChannelArgument(*arguments, &channel)) {
+      result->Error("INVALID_ARGUMENTS", "channel must be an integer between 0 and 65535");
+      return;
+    }
+    
+    uint32_t timeout_ms = 0;
+    if (!GetTimeoutArgument(*arguments, &timeout_ms)) {
+      result->Error("INVALID_ARGUMENTS", "timeoutMs must be a non-negative integer");
+      return;
+    }
+    
+    const std::string* key = nullptr;
+    if (!GetKeyArgument(*arguments, &key)) {
+      result->Error("INVALID_ARGUMENTS", "key must be a string of at most 65535 bytes");
+      return;
+    }
+    
+    // Answered by the writer thread once the frame is on the wire.
+    std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> shared_result = std::move(result);
+    try {
+      std::string description = "message from client '" + *client_id + "'";
+      Frame frame(FrameType::TEXT, *message);
+      frame.channel = channel;
+      if (key) {
+        AddStateKey(&frame, *key);
+      }
+      if (!client_it->second->SendFrame(std::move(frame), CompleteSendResult(shared_result, description), timeout_ms)) {
+        DWORD error = GetLastError();
+        std::string error_msg = "Failed to send " + description + ": " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
+        shared_result->Error("SEND_MESSAGE_FAILED", error_msg);
+      }
+    } catch (const std::exception& e) {
+      shared_result->Error("SEND_MESSAGE_FAILED", e.what());
+    }
+  }
+  else if (method == "sendValueFromServer") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for sendValueFromServer");
+      return;
+    }
+    
+    auto server_id_it = arguments->find(flutter::EncodableValue("serverId"));
+    if (server_id_it == arguments->end()) {
+      result->Error("INVALID_ARGUMENTS", "Missing serverId argument");
+      return;
+    }
+    
+    // A missing value is sent as null.
+    auto value_it = arguments->find(flutter::EncodableValue("value"));
+    const flutter::EncodableValue null_value;
+    const flutter::EncodableValue& value = value_it != arguments->end() ? value_it->second : null_value;
+    
+    const auto* server_id = std::get_if<std::string>(&server_id_it->second);
+    if (!server_id) {
+      result->Error("INVALID_ARGUMENTS", "serverId must be a string");
+      return;
+    }
+    
+    auto server_it = servers_.find(*server_id);
+    if (server_it == servers_.end()) {
+      result->Error("SERVER_NOT_FOUND", "Server with given ID not found");
+      return;
+    }
+    
+    if (!server_it->second->IsConnected()) {
+      result->Error("SERVER_NOT_CONNECTED", "Server is not connected to any client");
+      return;
+    }
+    
+    uint16_t channel = 0;
+    if (!GetChannelArgument(*arguments, &channel)) {
+      result->Error("INVALID_ARGUMENTS", "channel must be an integer between 0 and 65535");
+      return;
+    }
+    
+    uint32_t timeout_ms = 0;
+    if (!GetTimeoutArgument(*arguments, &timeout_ms)) {
+      result->Error("INVALID_ARGUMENTS", "timeoutMs must be a non-negative integer");
+      return;
+    }
+    
+    std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> shared_result = std::move(result);
+    try {
+      std::string description = "value from server '" + *server_id + "'";
+      // Serialized straight from the decoded method call argument.
+      Frame frame = EncodeValueFrame(value);
+      frame.channel = channel;
+      if (!server_it->second->SendFrame(std::move(frame), CompleteSendResult(shared_result, description), timeout_ms)) {
+        DWORD error = GetLastError();
+        std::string error_msg = "Failed to send " + description + ": " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
+        shared_result->Error("SEND_MESSAGE_FAILED", error_msg);
+      }
+    } catch (const std::exception& e) {
+      shared_result->Error("SEND_MESSAGE_FAILED", e.what());
+    }
+  }
+  else if (method == "sendValueFromClient") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for sendValueFromClient");
+      return;
+    }
+    
+    auto client_id_it = arguments->find(flutter::EncodableValue("clientId"));
+    if (client_id_it == arguments->end()) {
+      result->Error("INVALID_ARGUMENTS", "Missing clientId argument");
+      return;
+    }
+    
+    // A missing value is sent as null.
+    auto value_it = arguments->find(flutter::EncodableValue("value"));
+    const flutter::EncodableValue null_value;
+    const flutter::EncodableValue& value = value_it != arguments->end() ? value_it->second : null_value;
+    
+    const auto* client_id = std::get_if<std::string>(&client_id_it->second);
+    if (!client_id) {
+      result->Error("INVALID_ARGUMENTS", "clientId must be a string");
+      return;
+    }
+    
+    auto client_it = clients_.find(*client_id);
+    if (client_it == clients_.end()) {
+      result->Error("CLIENT_NOT_FOUND", "Client with given ID not found");
+      return;
+    }
+    
+    if (!client_it->second->CanSend()) {
+      result->Error("CLIENT_NOT_CONNECTED", "Client is not connected to server");
+      return;
+    }
+    
+    uint16_t channel = 0;
+    if (!GetChannelArgument(*arguments, &channel)) {
+      result->Error("INVALID_ARGUMENTS", "channel must be an integer between 0 and 65535");
+      return;
+    }
+    
+    uint32_t timeout_ms = 0;
+    if (!GetTimeoutArgument(*arguments, &timeout_ms)) {
+      result->Error("INVALID_ARGUMENTS", "timeoutMs must be a non-negative integer");
+      return;
+    }
+    
+    std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> shared_result = std::move(result);
+    try {
+      std::string description = "value from client '" + *client_id + "'";
+      // Serialized straight from the decoded method call argument.
+      Frame frame = EncodeValueFrame(value);
+      frame.channel = channel;
+      if (!client_it->second->SendFrame(std::move(frame), CompleteSendResult(shared_result, description), timeout_ms)) {
+        DWORD error = GetLastError();
+        std::string error_msg = "Failed to send " + description + ": " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
+        shared_result->Error("SEND_MESSAGE_FAILED", error_msg);
+      }
+    } catch (const std::exception& e) {
+      shared_result->Error("SEND_MESSAGE_FAILED", e.what());
+    }
+  }
+  else if (method == "closeServer") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for closeServer");
+      return;
+    }
+    
+    auto server_id_it = arguments->find(flutter::EncodableValue("serverId"));
+    if (server_id_it == arguments->end()) {
+      result->Error("INVALID_ARGUMENTS", "Missing serverId argument");
+      return;
+    }
+    
+    const auto* server_id = std::get_if<std::string>(&server_id_it->second);
+    if (!server_id) {
+      result->Error("INVALID_ARGUMENTS", "serverId must be a string");
+      return;
+    }
+    
+    auto server_it = servers_.find(*server_id);
+    if (server_it == servers_.end()) {
+      result->Error("SERVER_NOT_FOUND", "Server with given ID not found");
+      return;
+    }
+    
+    try {
+      server_it->second->Close();
+      servers_.erase(server_it);
+      UnregisterMessageStream("server_" + *server_id);
+      result->Success(flutter::EncodableValue(true));
+    } catch (const std::exception& e) {
+      result->Error("CLOSE_SERVER_FAILED", e.what());
+    }
+  }
+  else if (method == "disconnect") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for disconnect");
+      return;
+    }
+    
+    auto client_id_it = arguments->find(flutter::EncodableValue("clientId"));
+    if (client_id_it == arguments->end()) {
+      result->Error("INVALID_ARGUMENTS", "Missing clientId argument");
+      return;
+    }
+    
+    const auto* client_id = std::get_if<std::string>(&client_id_it->second);
+    if (!client_id) {
+      result->Error("INVALID_ARGUMENTS", "clientId must be a string");
+      return;
+    }
+    
+    auto client_it = clients_.find(*client_id);
+    if (client_it == clients_.end()) {
+      result->Error("CLIENT_NOT_FOUND", "Client with given ID not found");
+      return;
+    }
+    
+    try {
+      client_it->second->Disconnect();
+      clients_.erase(client_it);
+      UnregisterMessageStream("client_" + *client_id);
+      result->Success(flutter::EncodableValue(true));
+    } catch (const std::exception& e) {
+      result->Error("DISCONNECT_FAILED", e.what());
+    }
+  }
+  else if (method == "createSharedMemory") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    int64_t size = 0;
+    if (!arguments || !GetIntArgument(*arguments, "size", &size) || size <= 0) {
+      result->Error("INVALID_ARGUMENTS", "size must be a positive integer");
+      return;
     }
+    
+    auto handle = SharedHandle::CreateSharedMemory(static_cast<uint64_t>(size));
+    if (!handle) {
+      DWORD error = GetLastError();
+      std::string error_msg = "Failed to create shared memory: " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
+      result->Error("HANDLE_CREATION_FAILED", error_msg);
+      return;
+    }
+    
+    std::string handle_id = GenerateHandleId();
+    handles_[handle_id] = std::move(handle);
+    result->Success(flutter::EncodableValue(handle_id));
   }
-  else if (method == "listen") {
+  else if (method == "openFile") {
     const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
     if (!arguments) {
-      result->Error("INVALID_ARGUMENTS", "Missing arguments for listen");
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for openFile");
       return;
     }
     
-    auto server_id_it = arguments->find(flutter::EncodableValue("serverId"));
-    if (server_id_it == arguments->end()) {
-      result->Error("INVALID_ARGUMENTS", "Missing serverId argument");
+    auto path_it = arguments->find(flutter::EncodableValue("path"));
+    const auto* path = path_it != arguments->end() ? std::get_if<std::string>(&path_it->second) : nullptr;
+    if (!path) {
+      result->Error("INVALID_ARGUMENTS", "path must be a string");
       return;
     }
     
-    const auto* server_id = std::get_if<std::string>(&server_id_it->second);
-    if (!server_id) {
-      result->Error("INVALID_ARGUMENTS", "serverId must be a string");
+    auto handle = SharedHandle::OpenFile(*path);
+    if (!handle) {
+      DWORD error = GetLastError();
+      std::string error_msg = "Failed to open file '" + *path + "': " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
+      result->Error("HANDLE_CREATION_FAILED", error_msg);
       return;
     }
     
-    auto server_it = servers_.find(*server_id);
-    if (server_it == servers_.end()) {
-      result->Error("SERVER_NOT_FOUND", "Server with given ID not found");
+    std::string handle_id = GenerateHandleId();
+    flutter::EncodableMap handle_info = {
+      {flutter::EncodableValue("handleId"), flutter::EncodableValue(handle_id)},
+      {flutter::EncodableValue("size"), flutter::EncodableValue(static_cast<int64_t>(handle->size()))},
+    };
+    handles_[handle_id] = std::move(handle);
+    result->Success(flutter::EncodableValue(handle_info));
+  }
+  else if (method == "readHandle" || method == "writeHandle" || method == "closeHandle") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for " + method);
       return;
     }
     
-    try {
-      if (!server_it->second->WaitForConnection()) {
-        DWORD error = GetLastError();
-        std::string error_msg = "Failed to wait for connection on server '" + *server_id + "': " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
-        result->Error("LISTEN_FAILED", error_msg);
+    auto handle_id_it = arguments->find(flutter::EncodableValue("handleId"));
+    const auto* handle_id = handle_id_it != arguments->end() ? std::get_if<std::string>(&handle_id_it->second) : nullptr;
+    if (!handle_id) {
+      result->Error("INVALID_ARGUMENTS", "handleId must be a string");
+      return;
+    }
+    
+    auto handle_it = handles_.find(*handle_id);
+    if (handle_it == handles_.end()) {
+      result->Error("HANDLE_NOT_FOUND", "Handle with given ID not found");
+      return;
+    }
+    
+    if (method == "closeHandle") {
+      handles_.erase(handle_it);
+      result->Success(flutter::EncodableValue(true));
+      return;
+    }
+    
+    int64_t offset = 0;
+    GetIntArgument(*arguments, "offset", &offset);
+    if (offset < 0) {
+      result->Error("INVALID_ARGUMENTS", "offset must not be negative");
+      return;
+    }
+    
+    bool success = false;
+    std::vector<uint8_t> data;
+    if (method == "readHandle") {
+      int64_t length = static_cast<int64_t>(handle_it->second->size()) - offset;
+      GetIntArgument(*arguments, "length", &length);
+      success = length >= 0 && handle_it->second->Read(offset, static_cast<size_t>(length), &data);
+    } else {
+      auto data_it = arguments->find(flutter::EncodableValue("data"));
+      const auto* bytes = data_it != arguments->end() ? std::get_if<std::vector<uint8_t>>(&data_it->second) : nullptr;
+      if (!bytes) {
+        result->Error("INVALID_ARGUMENTS", "data must be a Uint8List");
         return;
       }
-      
+      success = handle_it->second->Write(offset, bytes->data(), bytes->size());
+    }
+    
+    if (!success) {
+      DWORD error = GetLastError();
+      std::string error_msg = "Failed to access handle '" + *handle_id + "': " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
+      result->Error("HANDLE_ACCESS_FAILED", error_msg);
+      return;
+    }
+    
+    if (method == "readHandle") {
+      result->Success(flutter::EncodableValue(std::move(data)));
+    } else {
       result->Success(flutter::EncodableValue(true));
-    } catch (const std::exception& e) {
-      result->Error("LISTEN_FAILED", e.what());
     }
   }
-  else if (method == "sendMessageFromServer") {
+  else if (method == "sendHandlesFromServer") {
     const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
     if (!arguments) {
-      result->Error("INVALID_ARGUMENTS", "Missing arguments for sendMessageFromServer");
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for sendHandlesFromServer");
       return;
     }
     
     auto server_id_it = arguments->find(flutter::EncodableValue("serverId"));
-    if (server_id_it == arguments->end()) {
-      result->Error("INVALID_ARGUMENTS", "Missing serverId argument");
-      return;
-    }
-    
     auto message_it = arguments->find(flutter::EncodableValue("message"));
-    if (message_it == arguments->end()) {
-      result->Error("INVALID_ARGUMENTS", "Missing message argument");
+    if (server_id_it == arguments->end() || message_it == arguments->end()) {
+      result->Error("INVALID_ARGUMENTS", "Missing serverId or message argument");
       return;
     }
     
     const auto* server_id = std::get_if<std::string>(&server_id_it->second);
     const auto* message = std::get_if<std::string>(&message_it->second);
-    
     if (!server_id || !message) {
       result->Error("INVALID_ARGUMENTS", "serverId and message must be strings");
       return;
     }
     
+    std::vector<const SharedHandle*> handles;
+    if (!FindHandles(*arguments, &handles)) {
+      result->Error("HANDLE_NOT_FOUND", "handleIds must list open handles");
+      return;
+    }
+    
     auto server_it = servers_.find(*server_id);
     if (server_it == servers_.end()) {
       result->Error("SERVER_NOT_FOUND", "Server with given ID not found");
@@ -504,135 +3099,568 @@ void FlutterIpcPlugin::HandleMethodCall(
       return;
     }
     
+    uint16_t channel = 0;
+    if (!GetChannelArgument(*arguments, &channel)) {
+      result->Error("INVALID_ARGUMENTS", "channel must be an integer between 0 and 65535");
+      return;
+    }
+    
+    uint32_t timeout_ms = 0;
+    if (!GetTimeoutArgument(*arguments, &timeout_ms)) {
+      result->Error("INVALID_ARGUMENTS", "timeoutMs must be a non-negative integer");
+      return;
+    }
+    
+    std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> shared_result = std::move(result);
     try {
-      if (!server_it->second->SendMessage(*message)) {
+      Frame frame;
+      std::vector<uint64_t> copies;
+      if (!EncodeHandleFrame(handles, *message, &frame, &copies)) {
         DWORD error = GetLastError();
-        std::string error_msg = "Failed to send message from server '" + *server_id + "': " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
-        result->Error("SEND_MESSAGE_FAILED", error_msg);
+        std::string error_msg = "Failed to duplicate handles for server '" + *server_id + "': " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
+        shared_result->Error("HANDLE_DUPLICATION_FAILED", error_msg);
         return;
       }
       
-      result->Success(flutter::EncodableValue(true));
+      // Copies the peer never takes would leak here.
+      std::string description = "handles from server '" + *server_id + "'";
+      auto release_handles = [copies]() {
+        ReleaseHandleCopies(copies);
+      };
+      frame.channel = channel;
+      if (!server_it->second->SendFrame(std::move(frame), CompleteSendResult(shared_result, description, release_handles), timeout_ms)) {
+        DWORD error = GetLastError();
+        release_handles();
+        std::string error_msg = "Failed to send " + description + ": " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
+        shared_result->Error("SEND_MESSAGE_FAILED", error_msg);
+      }
     } catch (const std::exception& e) {
-      result->Error("SEND_MESSAGE_FAILED", e.what());
+      shared_result->Error("SEND_MESSAGE_FAILED", e.what());
     }
   }
-  else if (method == "sendMessageFromClient") {
+  else if (method == "sendHandlesFromClient") {
     const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
     if (!arguments) {
-      result->Error("INVALID_ARGUMENTS", "Missing arguments for sendMessageFromClient");
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for sendHandlesFromClient");
       return;
     }
     
     auto client_id_it = arguments->find(flutter::EncodableValue("clientId"));
-    if (client_id_it == arguments->end()) {
-      result->Error("INVALID_ARGUMENTS", "Missing clientId argument");
-      return;
-    }
-    
     auto message_it = arguments->find(flutter::EncodableValue("message"));
-    if (message_it == arguments->end()) {
-      result->Error("INVALID_ARGUMENTS", "Missing message argument");
+    if (client_id_it == arguments->end() || message_it == arguments->end()) {
+      result->Error("INVALID_ARGUMENTS", "Missing clientId or message argument");
       return;
     }
     
     const auto* client_id = std::get_if<std::string>(&client_id_it->second);
     const auto* message = std::get_if<std::string>(&message_it->second);
-    
     if (!client_id || !message) {
       result->Error("INVALID_ARGUMENTS", "clientId and message must be strings");
       return;
     }
     
+    std::vector<const SharedHandle*> handles;
+    if (!FindHandles(*arguments, &handles)) {
+      result->Error("HANDLE_NOT_FOUND", "handleIds must list open handles");
+      return;
+    }
+    
     auto client_it = clients_.find(*client_id);
     if (client_it == clients_.end()) {
       result->Error("CLIENT_NOT_FOUND", "Client with given ID not found");
       return;
     }
     
-    if (!client_it->second->IsConnected()) {
+    if (!client_it->second->CanSend()) {
       result->Error("CLIENT_NOT_CONNECTED", "Client is not connected to server");
       return;
     }
     
+    uint16_t channel = 0;
+    if (!GetChannelArgument(*arguments, &channel)) {
+      result->Error("INVALID_ARGUMENTS", "channel must be an integer between 0 and 65535");
+      return;
+    }
+    
+    uint32_t timeout_ms = 0;
+    if (!GetTimeoutArgument(*arguments, &timeout_ms)) {
+      result->Error("INVALID_ARGUMENTS", "timeoutMs must be a non-negative integer");
+      return;
+    }
+    
+    std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> shared_result = std::move(result);
     try {
-      if (!client_it->second->SendMessage(*message)) {
+      Frame frame;
+      std::vector<uint64_t> copies;
+      if (!EncodeHandleFrame(handles, *message, &frame, &copies)) {
         DWORD error = GetLastError();
-        std::string error_msg = "Failed to send message from client '" + *client_id + "': " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
-        result->Error("SEND_MESSAGE_FAILED", error_msg);
+        std::string error_msg = "Failed to duplicate handles for client '" + *client_id + "': " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
+        shared_result->Error("HANDLE_DUPLICATION_FAILED", error_msg);
         return;
       }
       
-      result->Success(flutter::EncodableValue(true));
+      // Copies the peer never takes would leak here.
+      std::string description = "handles from client '" + *client_id + "'";
+      auto release_handles = [copies]() {
+        ReleaseHandleCopies(copies);
+      };
+      frame.channel = channel;
+      if (!client_it->second->SendFrame(std::move(frame), CompleteSendResult(shared_result, description, release_handles), timeout_ms)) {
+        DWORD error = GetLastError();
+        release_handles();
+        std::string error_msg = "Failed to send " + description + ": " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
+        shared_result->Error("SEND_MESSAGE_FAILED", error_msg);
+      }
     } catch (const std::exception& e) {
-      result->Error("SEND_MESSAGE_FAILED", e.what());
+      shared_result->Error("SEND_MESSAGE_FAILED", e.what());
     }
   }
-  else if (method == "closeServer") {
+  else if (method == "acknowledge") {
+    // Dart has handed |count| events of one stream to its listeners.
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    int64_t count = 0;
+    if (!arguments || !GetIntArgument(*arguments, "count", &count) || count < 0) {
+      result->Error("INVALID_ARGUMENTS", "count must be a non-negative integer");
+      return;
+    }
+    
+    auto stream_it = arguments->find(flutter::EncodableValue("stream"));
+    const auto* stream = stream_it != arguments->end() ? std::get_if<std::string>(&stream_it->second) : nullptr;
+    if (!stream) {
+      result->Error("INVALID_ARGUMENTS", "stream must be a string");
+      return;
+    }
+    
+    auto pending_it = unacknowledged_.find(*stream);
+    if (pending_it != unacknowledged_.end()) {
+      auto& pending = pending_it->second;
+      for (int64_t i = 0; i < count && !pending.empty(); ++i) {
+        FrameConsumed consumed = std::move(pending.front());
+        pending.pop_front();
+        consumed();
+      }
+      if (pending.empty()) {
+        unacknowledged_.erase(pending_it);
+      }
+    }
+    result->Success(flutter::EncodableValue(true));
+  }
+  else if (method == "getStats") {
     const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
     if (!arguments) {
-      result->Error("INVALID_ARGUMENTS", "Missing arguments for closeServer");
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for getStats");
       return;
     }
     
+    FlowStats stats;
+    SessionStats session;
+    BlobStats blobs;
+    StateSyncStats state_sync;
+    MemoryStats memory;
+    ConnectionOptions options;
+    bool connected = false;
+    bool resilient = false;
     auto server_id_it = arguments->find(flutter::EncodableValue("serverId"));
-    if (server_id_it == arguments->end()) {
-      result->Error("INVALID_ARGUMENTS", "Missing serverId argument");
+    auto client_id_it = arguments->find(flutter::EncodableValue("clientId"));
+    if (server_id_it != arguments->end()) {
+      const auto* server_id = std::get_if<std::string>(&server_id_it->second);
+      auto server_it = server_id ? servers_.find(*server_id) : servers_.end();
+      if (server_it == servers_.end()) {
+        result->Error("SERVER_NOT_FOUND", "Server with given ID not found");
+        return;
+      }
+      connected = server_it->second->GetFlowStats(&stats);
+      blobs = server_it->second->GetBlobStats();
+      state_sync = server_it->second->GetStateSyncStats();
+      memory = server_it->second->GetMemoryStats();
+      options = server_it->second->options();
+    } else if (client_id_it != arguments->end()) {
+      const auto* client_id = std::get_if<std::string>(&client_id_it->second);
+      auto client_it = client_id ? clients_.find(*client_id) : clients_.end();
+      if (client_it == clients_.end()) {
+        result->Error("CLIENT_NOT_FOUND", "Client with given ID not found");
+        return;
+      }
+      connected = client_it->second->GetFlowStats(&stats);
+      blobs = client_it->second->GetBlobStats();
+      state_sync = client_it->second->GetStateSyncStats();
+      resilient = client_it->second->GetSessionStats(&session);
+      memory = client_it->second->GetMemoryStats();
+      options = client_it->second->options();
+    } else {
+      result->Error("INVALID_ARGUMENTS", "Missing serverId or clientId argument");
       return;
     }
     
-    const auto* server_id = std::get_if<std::string>(&server_id_it->second);
-    if (!server_id) {
-      result->Error("INVALID_ARGUMENTS", "serverId must be a string");
+    // Without a connection every counter reads zero.
+    flutter::EncodableMap stats_map{
+      {flutter::EncodableValue("connected"), flutter::EncodableValue(connected)},
+      {flutter::EncodableValue("sendCreditBytes"), flutter::EncodableValue(stats.send_credit_bytes)},
+      {flutter::EncodableValue("sendCreditMessages"), flutter::EncodableValue(stats.send_credit_messages)},
+      {flutter::EncodableValue("unconsumedBytes"), flutter::EncodableValue(static_cast<int64_t>(stats.unconsumed_bytes))},
+      {flutter::EncodableValue("unconsumedMessages"), flutter::EncodableValue(static_cast<int64_t>(stats.unconsumed_messages))},
+      {flutter::EncodableValue("stalls"), flutter::EncodableValue(static_cast<int64_t>(stats.stalls))},
+      {flutter::EncodableValue("stallTimeMicros"), flutter::EncodableValue(static_cast<int64_t>(stats.stall_time.count()))},
+      {flutter::EncodableValue("queuedFrames"), flutter::EncodableValue(static_cast<int64_t>(stats.queued_frames))},
+      {flutter::EncodableValue("conflatedFrames"), flutter::EncodableValue(static_cast<int64_t>(stats.conflated_frames))},
+      // The tuning in effect; chunking and batching change over time with
+      // the auto profile.
+      {flutter::EncodableValue("profile"), flutter::EncodableValue(TuningProfileName(options.profile))},
+      {flutter::EncodableValue("outBufferSize"), flutter::EncodableValue(static_cast<int64_t>(options.out_buffer_size))},
+      {flutter::EncodableValue("inBufferSize"), flutter::EncodableValue(static_cast<int64_t>(options.in_buffer_size))},
+      {flutter::EncodableValue("maxQueuedBytes"), flutter::EncodableValue(static_cast<int64_t>(options.max_queued_bytes))},
+      {flutter::EncodableValue("chunkSize"), flutter::EncodableValue(static_cast<int64_t>(connected ? stats.chunk_size : options.chunk_size))},
+      {flutter::EncodableValue("coalesceBytes"), flutter::EncodableValue(static_cast<int64_t>(connected ? stats.coalesce_bytes : options.coalesce_bytes))},
+      {flutter::EncodableValue("blobCache"), flutter::EncodableValue(EncodeBlobStats(blobs))},
+      {flutter::EncodableValue("blobCacheBytes"), flutter::EncodableValue(static_cast<int64_t>(options.blob_cache_bytes))},
+      {flutter::EncodableValue("stateSync"), flutter::EncodableValue(EncodeStateSyncStats(state_sync))},
+      {flutter::EncodableValue("stateCacheBytes"), flutter::EncodableValue(static_cast<int64_t>(options.state_cache_bytes))},
+      // Kept across connections, unlike the counters above.
+      {flutter::EncodableValue("memory"), flutter::EncodableValue(EncodeMemoryStats(memory))},
+      {flutter::EncodableValue("memoryLimit"), flutter::EncodableValue(static_cast<int64_t>(options.memory_limit))},
+      {flutter::EncodableValue("memoryPolicy"), flutter::EncodableValue(BudgetPolicyName(options.memory_policy))},
+    };
+    if (resilient) {
+      stats_map[flutter::EncodableValue("sessionId")] = flutter::EncodableValue(static_cast<int64_t>(session.session_id));
+      stats_map[flutter::EncodableValue("reconnects")] = flutter::EncodableValue(static_cast<int64_t>(session.reconnects));
+      stats_map[flutter::EncodableValue("outboxMessages")] = flutter::EncodableValue(static_cast<int64_t>(session.outbox_frames));
+      stats_map[flutter::EncodableValue("outboxBytes")] = flutter::EncodableValue(static_cast<int64_t>(session.outbox_bytes));
+      stats_map[flutter::EncodableValue("outboxCapacity")] = flutter::EncodableValue(static_cast<int64_t>(session.outbox_capacity));
+    }
+    result->Success(flutter::EncodableValue(stats_map));
+  }
+  else if (method == "openSendPort") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for openSendPort");
       return;
     }
     
-    auto server_it = servers_.find(*server_id);
+    // Any thread, or isolate, may send through the port with the C API.
+    int64_t port = 0;
+    auto server_id_it = arguments->find(flutter::EncodableValue("serverId"));
+    auto client_id_it = arguments->find(flutter::EncodableValue("clientId"));
+    if (server_id_it != arguments->end()) {
+      const auto* server_id = std::get_if<std::string>(&server_id_it->second);
+      auto server_it = server_id ? servers_.find(*server_id) : servers_.end();
+      if (server_it == servers_.end()) {
+        result->Error("SERVER_NOT_FOUND", "Server with given ID not found");
+        return;
+      }
+      port = server_it->second->OpenSendPort();
+    } else if (client_id_it != arguments->end()) {
+      const auto* client_id = std::get_if<std::string>(&client_id_it->second);
+      auto client_it = client_id ? clients_.find(*client_id) : clients_.end();
+      if (client_it == clients_.end()) {
+        result->Error("CLIENT_NOT_FOUND", "Client with given ID not found");
+        return;
+      }
+      port = client_it->second->OpenSendPort();
+    } else {
+      result->Error("INVALID_ARGUMENTS", "Missing serverId or clientId argument");
+      return;
+    }
+    result->Success(flutter::EncodableValue(port));
+  }
+  else if (method == "configureChannel") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for configureChannel");
+      return;
+    }
+    
+    int64_t channel = 0;
+    if (!GetIntArgument(*arguments, "channel", &channel) || channel < 0 || channel > UINT16_MAX) {
+      result->Error("INVALID_ARGUMENTS", "channel must be an integer between 0 and 65535");
+      return;
+    }
+    
+    ChannelOptions options;
+    int64_t priority = options.priority;
+    int64_t weight = options.weight;
+    if ((arguments->count(flutter::EncodableValue("priority")) && !GetIntArgument(*arguments, "priority", &priority)) ||
+        (arguments->count(flutter::EncodableValue("weight")) && !GetIntArgument(*arguments, "weight", &weight))) {
+      result->Error("INVALID_ARGUMENTS", "priority and weight must be integers");
+      return;
+    }
+    if (priority < 0 || priority > UINT8_MAX || weight < 1 || weight > UINT16_MAX) {
+      result->Error("INVALID_ARGUMENTS", "priority must be between 0 and 255 and weight between 1 and 65535");
+      return;
+    }
+    options.priority = static_cast<uint8_t>(priority);
+    options.weight = static_cast<uint32_t>(weight);
+    
+    auto state_sync_it = arguments->find(flutter::EncodableValue("stateSync"));
+    if (state_sync_it != arguments->end()) {
+      const auto* state_sync = std::get_if<bool>(&state_sync_it->second);
+      if (!state_sync) {
+        result->Error("INVALID_ARGUMENTS", "stateSync must be a boolean");
+        return;
+      }
+      options.state_sync = *state_sync;
+    }
+    auto conflate_it = arguments->find(flutter::EncodableValue("conflate"));
+    if (conflate_it != arguments->end()) {
+      const auto* conflate = std::get_if<bool>(&conflate_it->second);
+      if (!conflate) {
+        result->Error("INVALID_ARGUMENTS", "conflate must be a boolean");
+        return;
+      }
+      options.conflate = *conflate;
+    }
+    int64_t snapshot_interval = options.snapshot_interval;
+    if (arguments->count(flutter::EncodableValue("snapshotInterval")) &&
+        (!GetIntArgument(*arguments, "snapshotInterval", &snapshot_interval) || snapshot_interval < 1 || snapshot_interval > UINT16_MAX)) {
+      result->Error("INVALID_ARGUMENTS", "snapshotInterval must be an integer between 1 and 65535");
+      return;
+    }
+    options.snapshot_interval = static_cast<uint32_t>(snapshot_interval);
+    
+    // Exactly one of serverId and clientId names the endpoint.
+    auto server_id_it = arguments->find(flutter::EncodableValue("serverId"));
+    auto client_id_it = arguments->find(flutter::EncodableValue("clientId"));
+    if (server_id_it != arguments->end()) {
+      const auto* server_id = std::get_if<std::string>(&server_id_it->second);
+      auto server_it = server_id ? servers_.find(*server_id) : servers_.end();
+      if (server_it == servers_.end()) {
+        result->Error("SERVER_NOT_FOUND", "Server with given ID not found");
+        return;
+      }
+      server_it->second->ConfigureChannel(static_cast<uint16_t>(channel), options);
+    } else if (client_id_it != arguments->end()) {
+      const auto* client_id = std::get_if<std::string>(&client_id_it->second);
+      auto client_it = client_id ? clients_.find(*client_id) : clients_.end();
+      if (client_it == clients_.end()) {
+        result->Error("CLIENT_NOT_FOUND", "Client with given ID not found");
+        return;
+      }
+      client_it->second->ConfigureChannel(static_cast<uint16_t>(channel), options);
+    } else {
+      result->Error("INVALID_ARGUMENTS", "Missing serverId or clientId argument");
+      return;
+    }
+    
+    result->Success(flutter::EncodableValue(true));
+  }
+  else if (method == "setMemoryBudget") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for setMemoryBudget");
+      return;
+    }
+    
+    int64_t limit = 0;
+    if (!GetIntArgument(*arguments, "limitBytes", &limit) || limit < 0) {
+      result->Error("INVALID_ARGUMENTS", "limitBytes must be a non-negative integer");
+      return;
+    }
+    BudgetPolicy policy = BudgetPolicy::PAUSE_READS;
+    auto policy_it = arguments->find(flutter::EncodableValue("policy"));
+    if (policy_it != arguments->end()) {
+      const auto* name = std::get_if<std::string>(&policy_it->second);
+      if (!name || !ParseBudgetPolicy(*name, &policy)) {
+        result->Error("INVALID_ARGUMENTS", "policy must be one of pauseReads, rejectSends and disconnect");
+        return;
+      }
+    }
+    
+    MemoryBudget::GetInstance().Configure(static_cast<size_t>(limit), policy);
+    result->Success(flutter::EncodableValue(true));
+  }
+  else if (method == "getMemoryStats") {
+    MemoryBudget& budget = MemoryBudget::GetInstance();
+    flutter::EncodableMap stats_map = EncodeMemoryStats(budget.GetStats());
+    stats_map[flutter::EncodableValue("limitBytes")] = flutter::EncodableValue(static_cast<int64_t>(budget.limit()));
+    stats_map[flutter::EncodableValue("policy")] = flutter::EncodableValue(BudgetPolicyName(budget.policy()));
+    result->Success(flutter::EncodableValue(stats_map));
+  }
+  else if (method == "startCapture") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for startCapture");
+      return;
+    }
+    
+    auto path_it = arguments->find(flutter::EncodableValue("path"));
+    const auto* path = path_it == arguments->end() ? nullptr : std::get_if<std::string>(&path_it->second);
+    int64_t capacity = 0;
+    int64_t max_payload = 0;
+    if (!path || !GetIntArgument(*arguments, "capacityBytes", &capacity) || capacity <= 0 ||
+        !GetIntArgument(*arguments, "maxPayloadBytes", &max_payload) || max_payload < 0) {
+      result->Error("INVALID_ARGUMENTS", "path, capacityBytes and maxPayloadBytes are required");
+      return;
+    }
+    
+    if (!StartCapture(*path, static_cast<size_t>(capacity), static_cast<size_t>(max_payload))) {
+      DWORD error = GetLastError();
+      std::string error_msg = "Failed to start capture to " + *path + ": " + GetWindowsErrorMessage(error) + " (Code: " + std::to_string(error) + ")";
+      result->Error("CAPTURE_FAILED", error_msg);
+      return;
+    }
+    result->Success(flutter::EncodableValue(true));
+  }
+  else if (method == "stopCapture") {
+    CaptureStats stats;
+    if (!StopCapture(&stats)) {
+      result->Error("CAPTURE_NOT_RUNNING", "No capture is running");
+      return;
+    }
+    result->Success(flutter::EncodableValue(flutter::EncodableMap{
+      {flutter::EncodableValue("records"), flutter::EncodableValue(static_cast<int64_t>(stats.records))},
+      {flutter::EncodableValue("bytes"), flutter::EncodableValue(static_cast<int64_t>(stats.bytes))},
+      {flutter::EncodableValue("dropped"), flutter::EncodableValue(static_cast<int64_t>(stats.dropped))},
+    }));
+  }
+  else if (method == "lookupServer" || method == "waitForServer") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for " + method);
+      return;
+    }
+    
+    auto pipe_name_it = arguments->find(flutter::EncodableValue("pipeName"));
+    const auto* pipe_name = pipe_name_it == arguments->end() ? nullptr : std::get_if<std::string>(&pipe_name_it->second);
+    if (!pipe_name) {
+      result->Error("INVALID_ARGUMENTS", "pipeName must be a string");
+      return;
+    }
+    
+    if (method == "lookupServer") {
+      ServiceInfo info;
+      if (!ServiceRegistry::GetInstance().Lookup(*pipe_name, &info)) {
+        result->Success();
+        return;
+      }
+      result->Success(flutter::EncodableValue(EncodeServiceInfo(info)));
+      return;
+    }
+    
+    int64_t timeout_ms = 0;
+    if (!GetIntArgument(*arguments, "timeoutMs", &timeout_ms) || timeout_ms < 0 || timeout_ms >= INFINITE) {
+      result->Error("INVALID_ARGUMENTS", "timeoutMs must be a non-negative integer");
+      return;
+    }
+    // Answered on the platform thread once the server is available, or
+    // with null once the timeout passes.
+    std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> shared_result = std::move(result);
+    PlatformTaskRunner* task_runner = task_runner_.get();
+    service_watcher_->Watch(*pipe_name, static_cast<uint32_t>(timeout_ms),
+                            [task_runner, shared_result](bool found, const ServiceInfo& info) {
+      flutter::EncodableValue value = found ? flutter::EncodableValue(EncodeServiceInfo(info)) : flutter::EncodableValue();
+      task_runner->PostTask([shared_result, value]() { shared_result->Success(value); });
+    });
+  }
+  else if (method == "listServers") {
+    flutter::EncodableList servers;
+    for (const ServiceInfo& info : ServiceRegistry::GetInstance().List()) {
+      servers.push_back(flutter::EncodableValue(EncodeServiceInfo(info)));
+    }
+    result->Success(flutter::EncodableValue(servers));
+  }
+  else if (method == "createBroker") {
+    std::string broker_id = GenerateBrokerId();
+    brokers_[broker_id] = std::make_shared<FrameRouter>();
+    result->Success(flutter::EncodableValue(broker_id));
+  }
+  else if (method == "joinBroker" || method == "leaveBroker") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    if (!arguments) {
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for " + method);
+      return;
+    }
+    
+    auto server_id_it = arguments->find(flutter::EncodableValue("serverId"));
+    const auto* server_id = server_id_it != arguments->end() ? std::get_if<std::string>(&server_id_it->second) : nullptr;
+    auto server_it = server_id ? servers_.find(*server_id) : servers_.end();
     if (server_it == servers_.end()) {
       result->Error("SERVER_NOT_FOUND", "Server with given ID not found");
       return;
     }
     
-    try {
-      server_it->second->Close();
-      servers_.erase(server_it);
+    if (method == "leaveBroker") {
+      server_it->second->SetRouter(nullptr, std::string());
       result->Success(flutter::EncodableValue(true));
-    } catch (const std::exception& e) {
-      result->Error("CLOSE_SERVER_FAILED", e.what());
+      return;
+    }
+    
+    auto broker_it = FindBroker(*arguments);
+    if (broker_it == brokers_.end()) {
+      result->Error("BROKER_NOT_FOUND", "Broker with given ID not found");
+      return;
     }
+    // Routes name members by their server ID.
+    server_it->second->SetRouter(broker_it->second, *server_id);
+    result->Success(flutter::EncodableValue(true));
   }
-  else if (method == "disconnect") {
+  else if (method == "setBrokerRoute") {
     const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
     if (!arguments) {
-      result->Error("INVALID_ARGUMENTS", "Missing arguments for disconnect");
+      result->Error("INVALID_ARGUMENTS", "Missing arguments for setBrokerRoute");
       return;
     }
     
-    auto client_id_it = arguments->find(flutter::EncodableValue("clientId"));
-    if (client_id_it == arguments->end()) {
-      result->Error("INVALID_ARGUMENTS", "Missing clientId argument");
+    auto broker_it = FindBroker(*arguments);
+    if (broker_it == brokers_.end()) {
+      result->Error("BROKER_NOT_FOUND", "Broker with given ID not found");
       return;
     }
     
-    const auto* client_id = std::get_if<std::string>(&client_id_it->second);
-    if (!client_id) {
-      result->Error("INVALID_ARGUMENTS", "clientId must be a string");
+    int64_t channel = 0;
+    if (!GetIntArgument(*arguments, "channel", &channel) || channel < 0 || channel > UINT16_MAX) {
+      result->Error("INVALID_ARGUMENTS", "channel must be an integer between 0 and 65535");
       return;
     }
     
-    auto client_it = clients_.find(*client_id);
-    if (client_it == clients_.end()) {
-      result->Error("CLIENT_NOT_FOUND", "Client with given ID not found");
+    auto server_ids_it = arguments->find(flutter::EncodableValue("serverIds"));
+    const auto* server_ids = server_ids_it != arguments->end() ? std::get_if<flutter::EncodableList>(&server_ids_it->second) : nullptr;
+    if (!server_ids) {
+      result->Error("INVALID_ARGUMENTS", "serverIds must be a list");
       return;
     }
+    std::set<std::string> destinations;
+    for (const auto& value : *server_ids) {
+      const auto* server_id = std::get_if<std::string>(&value);
+      if (!server_id) {
+        result->Error("INVALID_ARGUMENTS", "serverIds must contain strings");
+        return;
+      }
+      destinations.insert(*server_id);
+    }
     
-    try {
-      client_it->second->Disconnect();
-      clients_.erase(client_it);
-      result->Success(flutter::EncodableValue(true));
-    } catch (const std::exception& e) {
-      result->Error("DISCONNECT_FAILED", e.what());
+    broker_it->second->SetRoute(static_cast<uint16_t>(channel), std::move(destinations));
+    result->Success(flutter::EncodableValue(true));
+  }
+  else if (method == "getBrokerStats") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    auto broker_it = arguments ? FindBroker(*arguments) : brokers_.end();
+    if (broker_it == brokers_.end()) {
+      result->Error("BROKER_NOT_FOUND", "Broker with given ID not found");
+      return;
+    }
+    
+    RouterStats stats = broker_it->second->GetStats();
+    result->Success(flutter::EncodableValue(flutter::EncodableMap{
+      {flutter::EncodableValue("forwarded"), flutter::EncodableValue(static_cast<int64_t>(stats.forwarded))},
+      {flutter::EncodableValue("unrouted"), flutter::EncodableValue(static_cast<int64_t>(stats.unrouted))},
+      {flutter::EncodableValue("dropped"), flutter::EncodableValue(static_cast<int64_t>(stats.dropped))},
+    }));
+  }
+  else if (method == "closeBroker") {
+    const auto* arguments = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    auto broker_it = arguments ? FindBroker(*arguments) : brokers_.end();
+    if (broker_it == brokers_.end()) {
+      result->Error("BROKER_NOT_FOUND", "Broker with given ID not found");
+      return;
+    }
+    
+    // Members go back to delivering everything to Dart.
+    for (auto& server_pair : servers_) {
+      if (server_pair.second->GetRouter() == broker_it->second) {
+        server_pair.second->SetRouter(nullptr, std::string());
+      }
     }
+    brokers_.erase(broker_it);
+    result->Success(flutter::EncodableValue(true));
   }
   else {
     result->NotImplemented();
@@ -1,16 +1,53 @@
 #ifndef FLUTTER_PLUGIN_FLUTTER_IPC_PLUGIN_H_
 #define FLUTTER_PLUGIN_FLUTTER_IPC_PLUGIN_H_
 
+#include <flutter/event_channel.h>
 #include <flutter/method_channel.h>
 #include <flutter/plugin_registrar_windows.h>
 
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <map>
+#include <thread>
+#include <vector>
 #include <windows.h>
 
+#include "blob_cache.h"
+#include "capture.h"
+#include "channel_mux.h"
+#include "completion_port.h"
+#include "connection_monitor.h"
+#include "connection_options.h"
+#include "flow_control.h"
+#include "frame.h"
+#include "handler_pool.h"
+#include "in_process_pipe.h"
+#include "memory_budget.h"
+#include "network_shaper.h"
+#include "outbox.h"
+#include "platform_task_runner.h"
+#include "router.h"
+#include "send_port.h"
+#include "send_queue.h"
+#include "service_registry.h"
+#include "session.h"
+#include "shared_handle.h"
+#include "state_sync.h"
+#include "stripe.h"
+
 namespace flutter_ipc {
 
+// Returns the flow-control credit of a received frame to the peer. Must be
+// called exactly once, from any thread, when the application has taken it.
+using FrameConsumed = std::function<void()>;
+
+// Invoked on a pipe I/O thread for every frame received from the peer.
+using FrameHandler = std::function<void(Frame frame, FrameConsumed consumed)>;
+
 enum class ServerState {
   CREATED,    // Server created but not listening yet
   LISTENING,  // Waiting for client connections
@@ -20,46 +57,278 @@ enum class ServerState {
 
 class NamedPipeServer {
  public:
-  NamedPipeServer(const std::string& pipe_name);
+  NamedPipeServer(const std::string& pipe_name, ConnectionOptions options = ConnectionOptions());
   ~NamedPipeServer();
 
   bool Create();
+  // A pool listens on each of its instances that has no client.
   bool WaitForConnection();
   bool SendMessage(const std::string& message);
+  // Queues |frame| on its channel. |on_complete| runs on the writer thread
+  // once the frame has been written or dropped, or on the timer thread if
+  // it is still queued after |timeout_ms| (0 waits forever).
+  bool SendFrame(Frame frame, SendCompletion on_complete = nullptr, uint32_t timeout_ms = 0);
+  // A SendPortRegistry port that sends through SendFrame(), from any
+  // thread, until this object is destroyed. Opened on first use; called on
+  // the platform thread.
+  int64_t OpenSendPort();
   bool ResetForNewConnection();
+  // Drops the client of each instance without waiting for it to go; the
+  // reading thread then frees the instance for the next one. Unlike
+  // ResetForNewConnection(), does not block.
+  void DropConnection();
   void Close();
+
+  // Attaches a client from this process through memory instead of the
+  // kernel pipe. Returns null if the server already has a client. Called by
+  // InProcessPipeRegistry.
+  std::shared_ptr<InProcessPipe> AcceptInProcessClient();
+
+  void SetFrameHandler(FrameHandler handler) { frame_handler_ = std::move(handler); }
+
+  // Sets the scheduling of |channel|. Kept across reconnects.
+  void ConfigureChannel(uint16_t channel, ChannelOptions options);
+
+  // Joins the broker |router| as member |id|, leaving any previous one.
+  // Frames it routes bypass the frame handler. Null leaves the broker.
+  void SetRouter(std::shared_ptr<FrameRouter> router, const std::string& id);
+  std::shared_ptr<FrameRouter> GetRouter();
+
+  // Process ID of the connected client, used as the target when attaching
+  // handles to a message.
+  bool GetPeerProcessId(DWORD* process_id);
+
+  // Returns false if no client is connected.
+  bool GetFlowStats(FlowStats* stats);
+  // The blob caches and state sync of the current connection; zero
+  // without one.
+  BlobStats GetBlobStats();
+  StateSyncStats GetStateSyncStats();
+  // What ConnectionOptions::shaping did to this server's connections.
+  ShapingStats GetShapingStats();
+  // Memory held for this server, across its connections and the
+  // instances of a pool.
+  MemoryStats GetMemoryStats();
+  // |handler| runs when the memory budget drops the connection.
+  void SetShedHandler(MemoryAccount::ShedHandler handler);
+  // |handler| runs when a connect, heartbeat or idle timeout expires.
+  void SetTimeoutHandler(ConnectionMonitor::TimeoutHandler handler);
   
   bool IsValid() const { return pipe_handle_ != INVALID_HANDLE_VALUE; }
   bool IsListening() const { return state_ == ServerState::LISTENING || state_ == ServerState::CONNECTED; }
-  bool IsConnected() const { return is_connected_; }
+  // For a pool, whether any of its instances has a client.
+  bool IsConnected() const;
   ServerState GetState() const { return state_; }
   const std::string& GetPipeName() const { return pipe_name_; }
+  const ConnectionOptions& options() const { return options_; }
 
  private:
+  // Listens on this pipe instance.
+  bool Listen();
+  // Also publishes |state| to ServiceRegistry.
+  void SetState(ServerState state);
+  // Queues |frame| on this pipe instance.
+  bool EnqueueFrame(Frame frame, SendCompletion on_complete, uint32_t timeout_ms);
+  // Puts the frames of a pool back in order before HandleFrame(). The
+  // other instances hand theirs straight to |reorderer_|.
+  void ReceiveFrame(Frame frame, FrameConsumed consumed);
+  // Bytes queued on this instance; SIZE_MAX while it has no client.
+  size_t QueuedBytes();
+  void StartIoThread(bool connect_pending);
+  void StopIoThread();
+  void RunIoLoop(bool connect_pending);
+  void OnPeerDisconnected();
+  // Called with |mutex_| held once a client is attached.
+  void StartSendQueue();
+  void StopSendQueue();
+  // Offers |frame| to the broker, then to the frame handler.
+  void HandleFrame(Frame frame, FrameConsumed consumed);
+  // Handles a reassembled frame from the client. Returns false if the
+  // connection has to be dropped.
+  bool ProcessFrame(const std::shared_ptr<SendQueue>& send_queue, Frame frame);
+  // Hands the reads of the kernel pipe to |completion_reader_|. Returns
+  // false if the I/O thread has to keep reading.
+  bool StartCompletionReads(const std::shared_ptr<SendQueue>& send_queue);
+
   std::string pipe_name_;
+  ConnectionOptions options_;
+  // Shared with the send queues and with received frames not consumed yet.
+  std::shared_ptr<MemoryAccount> memory_;
   HANDLE pipe_handle_;
   OVERLAPPED overlap_;
-  bool is_connected_;
-  ServerState state_;
+  HANDLE read_event_;
+  HANDLE write_event_;
+  HANDLE stop_event_;
+  std::atomic<bool> is_connected_;
+  std::atomic<ServerState> state_;
+  std::mutex mutex_;
+  std::shared_ptr<InProcessPipe> in_process_;
+  std::shared_ptr<SendQueue> send_queue_;
+  std::map<uint16_t, ChannelOptions> channel_options_;
+  // Outlives connections, so a resilient client's replay is deduplicated.
+  SessionTracker session_;
+  std::shared_ptr<FrameRouter> router_;
+  std::string router_id_;
+  // Set for IoBackend::COMPLETION_PORT.
+  std::shared_ptr<CompletionPortReader> completion_reader_;
+  ConnectionMonitor monitor_;
+  // Set if ConnectionOptions::shaping is; outlives connections.
+  std::shared_ptr<NetworkShaper> shaper_;
+  // 0 until OpenSendPort().
+  int64_t send_port_ = 0;
+  // Disabled for the lanes of a pool, which are captured as the pool.
+  CaptureSource capture_;
+  // In ServiceRegistry from Create() to Close(). Null for the lanes of a
+  // pool, which is registered as one server.
+  std::unique_ptr<ServiceRegistration> registration_;
+  // The other pipe instances of a pool, which pass their frames to this
+  // one. Empty unless ConnectionOptions::connections > 1.
+  std::vector<std::unique_ptr<NamedPipeServer>> lanes_;
+  // Set on the other instances, which stay out of InProcessPipeRegistry.
+  bool is_lane_ = false;
+  // Guards |stripe_sender_|, so that frames are numbered in queue order.
+  std::mutex stripe_mutex_;
+  std::unique_ptr<StripeSender> stripe_sender_;
+  std::unique_ptr<StripeReorderer> reorderer_;
+  std::thread io_thread_;
+  FrameHandler frame_handler_;
 };
 
 class NamedPipeClient {
  public:
-  NamedPipeClient(const std::string& pipe_name);
+  // A |resilient| client survives the loss of its server: frames are kept
+  // in an outbox until acknowledged, and the client reconnects in the
+  // background and replays them into the same session.
+  NamedPipeClient(const std::string& pipe_name, bool resilient = false,
+                  ConnectionOptions options = ConnectionOptions());
   ~NamedPipeClient();
 
   bool Connect();
+  // Connects to a server in this process without going through the kernel.
+  // Returns false if there is no such server or it is busy.
+  bool ConnectInProcess();
   bool SendMessage(const std::string& message);
+  // Queues |frame| on its channel. |on_complete| runs on the writer thread
+  // once the frame has been written or dropped, or on the timer thread if
+  // it is still queued after |timeout_ms| (0 waits forever); for a
+  // resilient client, once it is in the outbox, and frames in the outbox
+  // never time out.
+  bool SendFrame(Frame frame, SendCompletion on_complete = nullptr, uint32_t timeout_ms = 0);
+  // A SendPortRegistry port that sends through SendFrame(), from any
+  // thread, until this object is destroyed. Opened on first use; called on
+  // the platform thread.
+  int64_t OpenSendPort();
   void Disconnect();
+
+  void SetFrameHandler(FrameHandler handler) { frame_handler_ = std::move(handler); }
+
+  // Sets the scheduling of |channel|. Kept across reconnects.
+  void ConfigureChannel(uint16_t channel, ChannelOptions options);
+
+  // Process ID of the server, used as the target when attaching handles to
+  // a message.
+  bool GetPeerProcessId(DWORD* process_id);
+
+  // Returns false if not connected.
+  bool GetFlowStats(FlowStats* stats);
+  // The blob caches and state sync of the current connection; zero
+  // without one.
+  BlobStats GetBlobStats();
+  StateSyncStats GetStateSyncStats();
+  // What ConnectionOptions::shaping did to this client's connections.
+  ShapingStats GetShapingStats();
+  // Returns false if the client is not resilient.
+  bool GetSessionStats(SessionStats* stats);
+  // Memory held for this client, across reconnects and the connections of
+  // a pool.
+  MemoryStats GetMemoryStats();
+  // |handler| runs when the memory budget drops the connection.
+  void SetShedHandler(MemoryAccount::ShedHandler handler);
+  // |handler| runs when a connect, heartbeat or idle timeout expires.
+  void SetTimeoutHandler(ConnectionMonitor::TimeoutHandler handler);
   
-  bool IsValid() const { return pipe_handle_ != INVALID_HANDLE_VALUE; }
-  bool IsConnected() const { return is_connected_; }
+  bool IsValid() const { return pipe_handle_ != INVALID_HANDLE_VALUE || in_process_ != nullptr; }
+  // A pool is connected while all of its connections are.
+  bool IsConnected() const { return is_connected_ && LanesConnected(); }
+  bool IsInProcess() const { return in_process_ != nullptr; }
+  // True while frames are accepted, which includes a resilient client's
+  // reconnect.
+  bool CanSend() const { return IsConnected() || (resilient_ && reconnecting_); }
   const std::string& GetPipeName() const { return pipe_name_; }
+  const ConnectionOptions& options() const { return options_; }
 
  private:
+  static constexpr DWORD kReconnectBaseDelayMs = 50;
+  static constexpr DWORD kReconnectMaxDelayMs = 5000;
+
+  // Queues |frame| on this connection, or stores it for a resilient client.
+  bool EnqueueFrame(Frame frame, SendCompletion on_complete, uint32_t timeout_ms);
+  // Puts the frames of a pool back in order before the frame handler. The
+  // other connections hand theirs straight to |reorderer_|.
+  void ReceiveFrame(Frame frame, FrameConsumed consumed);
+  // Bytes queued on this connection; SIZE_MAX while it is down.
+  size_t QueuedBytes();
+  bool LanesConnected() const;
+  void StartIoThread();
+  void RunIoLoop();
+  // Called with |mutex_| held once the transport is open.
+  void StartSendQueue();
+
+  // Creates the events and, for a resilient client, the outbox and session.
+  bool Prepare();
+  bool OpenPipe();
+  // Opens whichever transport the server offers, preferring memory.
+  bool OpenTransport();
+  // Starts the send queue and replays the outbox into it. Returns false if
+  // the replay is refused; the transport is then closed again.
+  bool OnTransportOpen();
+  void CloseTransport();
+  // Handles a reassembled frame from the server.
+  void ProcessFrame(const std::shared_ptr<SendQueue>& send_queue, Frame frame);
+  // Hands the reads of |pipe| to |completion_reader_|. Returns false if the
+  // I/O thread has to keep reading.
+  bool StartCompletionReads(const std::shared_ptr<SendQueue>& send_queue, HANDLE pipe);
+  // Retries with backoff until connected or stopped.
+  bool Reconnect();
+
   std::string pipe_name_;
+  ConnectionOptions options_;
+  // Shared with the send queues and with received frames not consumed yet.
+  std::shared_ptr<MemoryAccount> memory_;
   HANDLE pipe_handle_;
-  bool is_connected_;
+  HANDLE read_event_;
+  HANDLE write_event_;
+  HANDLE stop_event_;
+  std::atomic<bool> is_connected_;
+  // Guards the transport, which a reconnect replaces, and the outbox.
+  std::mutex mutex_;
+  std::shared_ptr<InProcessPipe> in_process_;
+  std::shared_ptr<SendQueue> send_queue_;
+  std::map<uint16_t, ChannelOptions> channel_options_;
+  bool resilient_;
+  std::unique_ptr<Outbox> outbox_;
+  uint64_t session_id_ = 0;
+  AckMap last_sequence_;
+  std::atomic<bool> reconnecting_;
+  std::atomic<uint64_t> reconnects_;
+  // Set for IoBackend::COMPLETION_PORT.
+  std::shared_ptr<CompletionPortReader> completion_reader_;
+  ConnectionMonitor monitor_;
+  // Set if ConnectionOptions::shaping is; outlives connections.
+  std::shared_ptr<NetworkShaper> shaper_;
+  // 0 until OpenSendPort().
+  int64_t send_port_ = 0;
+  // Disabled for the lanes of a pool, which are captured as the pool.
+  CaptureSource capture_;
+  // The other connections of a pool, which pass their frames to this one.
+  // Empty unless ConnectionOptions::connections > 1.
+  std::vector<std::unique_ptr<NamedPipeClient>> lanes_;
+  // Guards |stripe_sender_|, so that frames are numbered in queue order.
+  std::mutex stripe_mutex_;
+  std::unique_ptr<StripeSender> stripe_sender_;
+  std::unique_ptr<StripeReorderer> reorderer_;
+  std::thread io_thread_;
+  FrameHandler frame_handler_;
 };
 
 class FlutterIpcPlugin : public flutter::Plugin {
@@ -68,6 +337,9 @@ class FlutterIpcPlugin : public flutter::Plugin {
 
   FlutterIpcPlugin();
 
+  // |messenger| is used for the per-server and per-client message streams.
+  explicit FlutterIpcPlugin(flutter::BinaryMessenger* messenger);
+
   virtual ~FlutterIpcPlugin();
 
   // Disallow copy and assign.
@@ -80,10 +352,64 @@ class FlutterIpcPlugin : public flutter::Plugin {
       std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
 
  private:
+  // Sets up the event channels backing the Dart streams of endpoint
+  // |stream_id| and returns the handler that feeds them from a pipe I/O
+  // thread. With |decode_json| its text frames are parsed as JSON.
+  FrameHandler RegisterMessageStream(const std::string& stream_id, bool decode_json);
+  // Processes a frame of |stream_id| on a handler pool worker and hands the
+  // result to the platform thread.
+  void HandleFrame(const std::string& stream_id, Frame frame, bool decode_json, FrameConsumed consumed);
+  // Returns the handler that reports the timeouts of endpoint |stream_id|
+  // as errors on its message stream, after the frames received before.
+  ConnectionMonitor::TimeoutHandler ReportTimeouts(const std::string& stream_id);
+  void UnregisterMessageStream(const std::string& stream_id);
+  void RegisterEventChannel(const std::string& channel_key);
+  // The Deliver methods return the key of the event channel that took the
+  // frame, or an empty string if it was dropped for lack of a listener.
+  std::string DeliverFrame(const std::string& stream_id, Frame frame);
+  std::string DeliverHandleFrame(const std::string& stream_id, const Frame& frame);
+  // Text frames that are not valid UTF-8, as bytes.
+  std::string DeliverBinary(const std::string& stream_id, Frame frame);
+  // Keyed text frames, with their key, already restored from any diff.
+  std::string DeliverState(const std::string& stream_id, const std::string& key, Frame frame);
+  std::string DeliverValue(const std::string& stream_id, const flutter::EncodableValue& value, bool valid);
+  // Decoded text frames, or |error| if a frame was not valid JSON.
+  std::string DeliverJson(const std::string& stream_id, const flutter::EncodableValue& value, const std::string& error);
+  // Holds |consumed| until Dart acknowledges the event sent on
+  // |channel_key|, so a slow listener throttles its peer.
+  void AwaitAcknowledgement(const std::string& channel_key, FrameConsumed consumed);
+  void ReleaseUnacknowledged(const std::string& channel_key);
+
+  // Completes |result| of a send call on the platform thread once the
+  // frame has left the queue. |on_failure| runs first if it was dropped.
+  SendCompletion CompleteSendResult(
+      std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+      const std::string& description, std::function<void()> on_failure = nullptr);
+
+  // Resolves the "handleIds" argument of a send call.
+  bool FindHandles(const flutter::EncodableMap& arguments, std::vector<const SharedHandle*>* handles);
+
+  flutter::BinaryMessenger* messenger_;
+  // Declared before the pipes so it outlives their I/O threads.
+  std::unique_ptr<PlatformTaskRunner> task_runner_;
+  // Fed by the pipes and feeding the task runner, so it is declared between
+  // the two.
+  std::unique_ptr<HandlerPool> handler_pool_;
+  // Answers waitForServer; declared after the task runner it posts to.
+  std::unique_ptr<ServiceWatcher> service_watcher_;
+  std::map<std::string, std::unique_ptr<flutter::EventChannel<flutter::EncodableValue>>> event_channels_;
+  std::map<std::string, std::unique_ptr<flutter::EventSink<flutter::EncodableValue>>> event_sinks_;
+  std::map<std::string, std::deque<FrameConsumed>> unacknowledged_;
   std::map<std::string, std::unique_ptr<NamedPipeServer>> servers_;
   std::map<std::string, std::unique_ptr<NamedPipeClient>> clients_;
+  std::map<std::string, std::unique_ptr<SharedHandle>> handles_;
+  std::map<std::string, std::shared_ptr<FrameRouter>> brokers_;
   std::string GenerateServerId();
   std::string GenerateClientId();
+  std::string GenerateHandleId();
+  std::string GenerateBrokerId();
+  // Looks up the "brokerId" argument; end() if missing or unknown.
+  std::map<std::string, std::shared_ptr<FrameRouter>>::iterator FindBroker(const flutter::EncodableMap& arguments);
 };
 
 }  // namespace flutter_ipc
@@ -1,8 +1,13 @@
 #include "include/flutter_ipc/flutter_ipc_plugin_c_api.h"
 
 #include <flutter/plugin_registrar_windows.h>
+#include <windows.h>
+
+#include <new>
+#include <string>
 
 #include "flutter_ipc_plugin.h"
+#include "send_port.h"
 
 void FlutterIpcPluginCApiRegisterWithRegistrar(
     FlutterDesktopPluginRegistrarRef registrar) {
@@ -10,3 +15,19 @@ void FlutterIpcPluginCApiRegisterWithRegistrar(
       flutter::PluginRegistrarManager::GetInstance()
           ->GetRegistrar<flutter::PluginRegistrarWindows>(registrar));
 }
+
+uint32_t FlutterIpcSendPortSend(int64_t port, uint16_t channel,
+                                const uint8_t* data, size_t length) {
+  // No exception may cross into the caller.
+  try {
+    flutter_ipc::Frame frame(flutter_ipc::FrameType::TEXT,
+                             std::string(reinterpret_cast<const char*>(data), length));
+    frame.channel = channel;
+    if (!flutter_ipc::SendPortRegistry::GetInstance().Send(port, std::move(frame))) {
+      return GetLastError();
+    }
+    return ERROR_SUCCESS;
+  } catch (const std::bad_alloc&) {
+    return ERROR_NOT_ENOUGH_MEMORY;
+  }
+}
@@ -0,0 +1,90 @@
+#ifndef FLUTTER_PLUGIN_FRAME_H_
+#define FLUTTER_PLUGIN_FRAME_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace flutter_ipc {
+
+// What a frame's payload holds.
+enum class FrameType : uint8_t {
+  TEXT = 0,       // A UTF-8 string message
+  HANDLES = 1,    // Duplicated OS handles followed by a string message
+  VALUE = 2,      // A value in the StandardMessageCodec binary format
+  CREDIT = 3,     // Flow-control credit granted by the receiver (control)
+  HELLO = 4,      // Session ID announced by a resilient client (control)
+  ACK = 5,        // Last sequence number received per channel (control)
+  HEARTBEAT = 6,  // Sign of life between application frames (control)
+  BLOB = 7,       // Blobs the receiver now holds for the sender (control)
+};
+
+// Set on every chunk of a frame except the last. Chunks of different
+// channels may interleave on the pipe; the receiver reassembles them per
+// channel.
+constexpr uint8_t kFrameFlagMoreChunks = 0x01;
+
+// Set on protocol frames that are handled by the transport itself. They are
+// never chunked and may arrive between the chunks of another frame.
+constexpr uint8_t kFrameFlagControl = 0x02;
+
+// Set on frames whose payload starts with a uint64 sequence number, which
+// lets a resumed session drop replays of frames it already delivered.
+constexpr uint8_t kFrameFlagSequenced = 0x04;
+
+// Set on frames whose payload starts with a uint64 stripe sequence number,
+// which lets the receiver restore the order of frames sent over the
+// several connections of a pool.
+constexpr uint8_t kFrameFlagStriped = 0x08;
+
+// Set on frames whose payload, past any sequence numbers, is a blob to
+// store or a reference to one stored before; see BlobEncoder.
+constexpr uint8_t kFrameFlagBlob = 0x10;
+
+// Set on text frames whose payload, past any sequence numbers, starts with
+// the key of a state-sync update; see AddStateKey().
+constexpr uint8_t kFrameFlagKeyed = 0x20;
+
+// Set on keyed frames whose value was replaced by a snapshot or delta
+// header and body; see StateEncoder.
+constexpr uint8_t kFrameFlagDelta = 0x40;
+
+// Length of the sequence numbers in front of the payload proper of a frame
+// with |flags|. Codecs that rewrite the payload leave them as they are.
+inline size_t FramePrefixLength(uint8_t flags) {
+  return ((flags & kFrameFlagSequenced) ? sizeof(uint64_t) : 0) +
+         ((flags & kFrameFlagStriped) ? sizeof(uint64_t) : 0);
+}
+
+#pragma pack(push, 1)
+// Fixed-size header in front of every frame on the pipe.
+struct FrameHeader {
+  uint32_t length;    // Payload bytes following the header
+  uint8_t type;       // FrameType
+  uint8_t flags;
+  uint16_t channel;   // Logical channel the frame belongs to
+};
+#pragma pack(pop)
+
+static_assert(sizeof(FrameHeader) == 8, "FrameHeader must stay 8 bytes");
+
+// No chunk on a pipe is longer. Readers drop a peer that claims more
+// rather than allocate what the header asks for.
+constexpr size_t kMaxChunkLength = 256 * 1024;
+
+// A single unit of transfer between two endpoints.
+struct Frame {
+  Frame() = default;
+  Frame(FrameType type, std::string payload)
+      : type(type), payload(std::move(payload)) {}
+
+  FrameType type = FrameType::TEXT;
+  uint8_t flags = 0;
+  uint16_t channel = 0;
+  std::string payload;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_FRAME_H_
@@ -0,0 +1,149 @@
+#include "handler_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace flutter_ipc {
+
+namespace {
+
+// Index of the pool worker running on this thread, so that lanes made
+// runnable by a task stay on the worker that is already warm.
+thread_local const HandlerPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+// Spreads sequential keys (such as counters) evenly over the lanes.
+uint64_t MixKey(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+}  // namespace
+
+HandlerPool::HandlerPool(size_t workers)
+    : lanes_(kLaneCount), next_worker_(0), runnable_lanes_(0), steals_(0) {
+  if (workers == 0) {
+    workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < workers; ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  // Started only once every queue exists, since workers steal from all.
+  for (size_t i = 0; i < workers; ++i) {
+    workers_[i]->thread = std::thread(&HandlerPool::RunWorker, this, i);
+  }
+}
+
+HandlerPool::~HandlerPool() {
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    stopping_ = true;
+  }
+  idle_.notify_all();
+  for (auto& worker : workers_) {
+    worker->thread.join();
+  }
+}
+
+void HandlerPool::Post(uint64_t key, Task task) {
+  Lane* lane = &lanes_[MixKey(key) % lanes_.size()];
+  {
+    std::lock_guard<std::mutex> lock(lane->mutex);
+    lane->tasks.push_back(std::move(task));
+    if (lane->scheduled) {
+      return;  // Whoever holds the lane will get to it
+    }
+    lane->scheduled = true;
+  }
+  Schedule(lane);
+}
+
+void HandlerPool::Schedule(Lane* lane) {
+  size_t target = current_pool == this
+      ? current_worker
+      : next_worker_++ % workers_.size();
+  {
+    std::lock_guard<std::mutex> lock(workers_[target]->mutex);
+    workers_[target]->runnable.push_back(lane);
+  }
+  ++runnable_lanes_;
+  // Taking the lock orders the count against a worker about to sleep.
+  { std::lock_guard<std::mutex> lock(idle_mutex_); }
+  idle_.notify_one();
+}
+
+HandlerPool::Lane* HandlerPool::FindLane(size_t self) {
+  // Our own queue is served oldest first, so a lane that yielded goes
+  // behind the others; thieves take from the other end.
+  {
+    Worker& worker = *workers_[self];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (!worker.runnable.empty()) {
+      Lane* lane = worker.runnable.front();
+      worker.runnable.pop_front();
+      return lane;
+    }
+  }
+  for (size_t i = 1; i < workers_.size(); ++i) {
+    Worker& victim = *workers_[(self + i) % workers_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.runnable.empty()) {
+      Lane* lane = victim.runnable.back();
+      victim.runnable.pop_back();
+      ++steals_;
+      return lane;
+    }
+  }
+  return nullptr;
+}
+
+void HandlerPool::RunLane(Lane* lane) {
+  for (size_t i = 0; i < kLaneBatch; ++i) {
+    Task task;
+    {
+      std::lock_guard<std::mutex> lock(lane->mutex);
+      if (lane->tasks.empty()) {
+        lane->scheduled = false;
+        return;
+      }
+      task = std::move(lane->tasks.front());
+      lane->tasks.pop_front();
+    }
+    task();
+  }
+
+  // Still busy: requeue it so other lanes on this worker get a turn.
+  {
+    std::lock_guard<std::mutex> lock(lane->mutex);
+    if (lane->tasks.empty()) {
+      lane->scheduled = false;
+      return;
+    }
+  }
+  Schedule(lane);
+}
+
+void HandlerPool::RunWorker(size_t self) {
+  current_pool = this;
+  current_worker = self;
+  while (true) {
+    Lane* lane = FindLane(self);
+    if (lane) {
+      --runnable_lanes_;
+      RunLane(lane);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    idle_.wait(lock, [this] { return stopping_ || runnable_lanes_ > 0; });
+    if (stopping_) {
+      return;
+    }
+  }
+}
+
+}  // namespace flutter_ipc
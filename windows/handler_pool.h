@@ -0,0 +1,81 @@
+#ifndef FLUTTER_PLUGIN_HANDLER_POOL_H_
+#define FLUTTER_PLUGIN_HANDLER_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace flutter_ipc {
+
+// Runs message handlers on a fixed set of worker threads. Tasks are posted
+// with a key (such as a connection) and sharded onto ordered lanes: tasks
+// with the same key run one at a time, in the order they were posted, while
+// different lanes run in parallel. Each worker keeps its own queue of
+// runnable lanes and steals from the others when it runs dry.
+class HandlerPool {
+ public:
+  using Task = std::function<void()>;
+
+  // Runnable tasks are spread over this many lanes. Keys that share a lane
+  // are also ordered with respect to each other.
+  static constexpr size_t kLaneCount = 256;
+
+  // A lane runs at most this many tasks before it yields its worker.
+  static constexpr size_t kLaneBatch = 32;
+
+  // |workers| of 0 uses one per hardware thread.
+  explicit HandlerPool(size_t workers = 0);
+  // Stops the workers. Tasks that have not started are dropped.
+  ~HandlerPool();
+
+  // Disallow copy and assign.
+  HandlerPool(const HandlerPool&) = delete;
+  HandlerPool& operator=(const HandlerPool&) = delete;
+
+  // Queues |task| behind the earlier tasks of |key|. Safe to call from any
+  // thread, including from a task.
+  void Post(uint64_t key, Task task);
+
+  size_t worker_count() const { return workers_.size(); }
+  // Lanes taken from another worker's queue so far.
+  uint64_t steals() const { return steals_; }
+
+ private:
+  struct Lane {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    // Set while the lane sits in a worker queue or is running.
+    bool scheduled = false;
+  };
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Lane*> runnable;
+    std::thread thread;
+  };
+
+  void Schedule(Lane* lane);
+  Lane* FindLane(size_t self);
+  void RunLane(Lane* lane);
+  void RunWorker(size_t self);
+
+  std::vector<Lane> lanes_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<size_t> next_worker_;
+  std::atomic<int64_t> runnable_lanes_;
+  std::atomic<uint64_t> steals_;
+  std::mutex idle_mutex_;
+  std::condition_variable idle_;
+  bool stopping_ = false;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_HANDLER_POOL_H_
@@ -0,0 +1,83 @@
+#include "in_process_pipe.h"
+
+#include "flutter_ipc_plugin.h"
+
+namespace flutter_ipc {
+
+bool InProcessPipe::Write(End from, Frame frame) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+      return false;
+    }
+    End to = from == End::SERVER ? End::CLIENT : End::SERVER;
+    QueueFor(to).push_back(std::move(frame));
+    CountFor(to).fetch_add(1, std::memory_order_release);
+  }
+  readable_.notify_all();
+  return true;
+}
+
+bool InProcessPipe::Read(End end, Frame* frame, const SpinWait& spin) {
+  auto& count = CountFor(end);
+  spin.Until([&count] { return count.load(std::memory_order_acquire) > 0; });
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto& queue = QueueFor(end);
+  readable_.wait(lock, [&] { return closed_ || !queue.empty(); });
+  if (queue.empty()) {
+    return false;
+  }
+  *frame = std::move(queue.front());
+  queue.pop_front();
+  count.fetch_sub(1, std::memory_order_relaxed);
+  return true;
+}
+
+void InProcessPipe::Close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+  }
+  readable_.notify_all();
+}
+
+bool InProcessPipe::IsClosed() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return closed_;
+}
+
+// static
+InProcessPipeRegistry& InProcessPipeRegistry::GetInstance() {
+  static InProcessPipeRegistry instance;
+  return instance;
+}
+
+void InProcessPipeRegistry::Register(const std::string& pipe_name,
+                                     NamedPipeServer* server) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  servers_[pipe_name] = server;
+}
+
+void InProcessPipeRegistry::Unregister(const std::string& pipe_name,
+                                       NamedPipeServer* server) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = servers_.find(pipe_name);
+  if (it != servers_.end() && it->second == server) {
+    servers_.erase(it);
+  }
+}
+
+std::shared_ptr<InProcessPipe> InProcessPipeRegistry::Connect(
+    const std::string& pipe_name) {
+  // The lock is held across the attach so the server cannot be closed and
+  // unregistered underneath us.
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = servers_.find(pipe_name);
+  if (it == servers_.end()) {
+    return nullptr;
+  }
+  return it->second->AcceptInProcessClient();
+}
+
+}  // namespace flutter_ipc
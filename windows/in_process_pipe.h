@@ -0,0 +1,86 @@
+#ifndef FLUTTER_PLUGIN_IN_PROCESS_PIPE_H_
+#define FLUTTER_PLUGIN_IN_PROCESS_PIPE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "frame.h"
+#include "polling.h"
+
+namespace flutter_ipc {
+
+class NamedPipeServer;
+
+// In-memory stand-in for a kernel named pipe, used when the server and the
+// client live in the same process. Frames are moved between the two ends,
+// so the payload buffer is handed over by pointer instead of being copied
+// through the kernel.
+class InProcessPipe {
+ public:
+  enum class End { SERVER, CLIENT };
+
+  InProcessPipe() = default;
+
+  // Disallow copy and assign.
+  InProcessPipe(const InProcessPipe&) = delete;
+  InProcessPipe& operator=(const InProcessPipe&) = delete;
+
+  // Queues |frame| for the opposite end. Fails once the pipe is closed.
+  bool Write(End from, Frame frame);
+
+  // Blocks until a frame for |end| is available, polling for up to the
+  // |spin| budget first. Frames queued before the pipe was closed are still
+  // delivered; returns false after that.
+  bool Read(End end, Frame* frame, const SpinWait& spin = SpinWait());
+
+  // Closes both ends and wakes any blocked reader.
+  void Close();
+  bool IsClosed() const;
+
+ private:
+  std::deque<Frame>& QueueFor(End end) {
+    return end == End::SERVER ? to_server_ : to_client_;
+  }
+  std::atomic<size_t>& CountFor(End end) {
+    return end == End::SERVER ? to_server_count_ : to_client_count_;
+  }
+
+  mutable std::mutex mutex_;
+  std::condition_variable readable_;
+  std::deque<Frame> to_server_;
+  std::deque<Frame> to_client_;
+  // Queue sizes, readable without the lock by a spinning reader.
+  std::atomic<size_t> to_server_count_{0};
+  std::atomic<size_t> to_client_count_{0};
+  bool closed_ = false;
+};
+
+// Process-wide table of servers by pipe name, so a client created by any
+// plugin instance in this process can find a local server without probing
+// the kernel.
+class InProcessPipeRegistry {
+ public:
+  static InProcessPipeRegistry& GetInstance();
+
+  void Register(const std::string& pipe_name, NamedPipeServer* server);
+  void Unregister(const std::string& pipe_name, NamedPipeServer* server);
+
+  // Returns a pipe attached to the local server for |pipe_name|, or null if
+  // there is none or it already has a client.
+  std::shared_ptr<InProcessPipe> Connect(const std::string& pipe_name);
+
+ private:
+  InProcessPipeRegistry() = default;
+
+  std::mutex mutex_;
+  std::map<std::string, NamedPipeServer*> servers_;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_IN_PROCESS_PIPE_H_
@@ -2,6 +2,8 @@
 #define FLUTTER_PLUGIN_FLUTTER_IPC_PLUGIN_C_API_H_
 
 #include <flutter_plugin_registrar.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef FLUTTER_PLUGIN_IMPL
 #define FLUTTER_PLUGIN_EXPORT __declspec(dllexport)
@@ -16,6 +18,15 @@ extern "C" {
 FLUTTER_PLUGIN_EXPORT void FlutterIpcPluginCApiRegisterWithRegistrar(
     FlutterDesktopPluginRegistrarRef registrar);
 
+// Queues the |length| bytes at |data| as one message on |channel| of the
+// connection behind |port|, a port from the openSendPort method. Safe from
+// any thread, including Dart isolates calling through dart:ffi; messages
+// never interleave on the pipe. Returns 0 once queued, or a Windows error
+// code: ERROR_INVALID_HANDLE for a closed port, ERROR_PIPE_NOT_CONNECTED
+// without a peer and ERROR_NOT_ENOUGH_QUOTA while the send queue is full.
+FLUTTER_PLUGIN_EXPORT uint32_t FlutterIpcSendPortSend(int64_t port, uint16_t channel,
+                                                      const uint8_t* data, size_t length);
+
 #if defined(__cplusplus)
 }  // extern "C"
 #endif
@@ -0,0 +1,412 @@
+#include "json_decoder.h"
+
+#include <charconv>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLUTTER_IPC_JSON_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace flutter_ipc {
+
+namespace {
+
+// Deeper documents are refused rather than risking the worker's stack.
+constexpr int kMaxDepth = 512;
+
+class JsonParser {
+ public:
+  JsonParser(const char* data, size_t size, std::string* error)
+      : begin_(data), position_(data), end_(data + size), error_(error) {}
+
+  bool Parse(flutter::EncodableValue* value) {
+    SkipWhitespace();
+    if (!ParseValue(value, 0)) {
+      return false;
+    }
+    SkipWhitespace();
+    if (position_ != end_) {
+      return Fail("unexpected trailing characters");
+    }
+    return true;
+  }
+
+ private:
+  bool Fail(const char* message) {
+    *error_ = std::string(message) + " at offset " + std::to_string(position_ - begin_);
+    return false;
+  }
+
+  void SkipWhitespace() {
+    while (position_ != end_ && (*position_ == ' ' || *position_ == '\n' ||
+                                 *position_ == '\r' || *position_ == '\t')) {
+      ++position_;
+    }
+  }
+
+  bool Consume(const char* literal, size_t length) {
+    if (static_cast<size_t>(end_ - position_) < length ||
+        memcmp(position_, literal, length) != 0) {
+      return Fail("invalid literal");
+    }
+    position_ += length;
+    return true;
+  }
+
+  bool ParseValue(flutter::EncodableValue* value, int depth) {
+    if (position_ == end_) {
+      return Fail("unexpected end of input");
+    }
+    switch (*position_) {
+      case '{':
+        return ParseObject(value, depth + 1);
+      case '[':
+        return ParseArray(value, depth + 1);
+      case '"':
+        return ParseString(&value->emplace<std::string>());
+      case 't':
+        value->emplace<bool>(true);
+        return Consume("true", 4);
+      case 'f':
+        value->emplace<bool>(false);
+        return Consume("false", 5);
+      case 'n':
+        value->emplace<std::monostate>();
+        return Consume("null", 4);
+      default:
+        return ParseNumber(value);
+    }
+  }
+
+  bool ParseObject(flutter::EncodableValue* value, int depth) {
+    if (depth > kMaxDepth) {
+      return Fail("nesting too deep");
+    }
+    ++position_;  // '{'
+    // Filled in place: constructing an EncodableValue from a container
+    // copies it.
+    auto& map = value->emplace<flutter::EncodableMap>();
+    SkipWhitespace();
+    if (position_ != end_ && *position_ == '}') {
+      ++position_;
+      return true;
+    }
+    while (true) {
+      if (position_ == end_ || *position_ != '"') {
+        return Fail("expected a string key");
+      }
+      flutter::EncodableValue key;
+      if (!ParseString(&key.emplace<std::string>())) {
+        return false;
+      }
+      SkipWhitespace();
+      if (position_ == end_ || *position_ != ':') {
+        return Fail("expected ':'");
+      }
+      ++position_;
+      SkipWhitespace();
+      flutter::EncodableValue& element = map[std::move(key)];
+      if (!ParseValue(&element, depth)) {
+        return false;
+      }
+      SkipWhitespace();
+      if (position_ == end_) {
+        return Fail("unterminated object");
+      }
+      if (*position_ == '}') {
+        ++position_;
+        return true;
+      }
+      if (*position_ != ',') {
+        return Fail("expected ',' or '}'");
+      }
+      ++position_;
+      SkipWhitespace();
+    }
+  }
+
+  bool ParseArray(flutter::EncodableValue* value, int depth) {
+    if (depth > kMaxDepth) {
+      return Fail("nesting too deep");
+    }
+    ++position_;  // '['
+    auto& list = value->emplace<flutter::EncodableList>();
+    SkipWhitespace();
+    if (position_ != end_ && *position_ == ']') {
+      ++position_;
+      return true;
+    }
+    while (true) {
+      list.emplace_back();
+      if (!ParseValue(&list.back(), depth)) {
+        return false;
+      }
+      SkipWhitespace();
+      if (position_ == end_) {
+        return Fail("unterminated array");
+      }
+      if (*position_ == ']') {
+        ++position_;
+        return true;
+      }
+      if (*position_ != ',') {
+        return Fail("expected ',' or ']'");
+      }
+      ++position_;
+      SkipWhitespace();
+    }
+  }
+
+  // Returns the first quote, backslash or control character at or after
+  // |from|, or |end_|.
+  const char* FindSpecial(const char* from) const {
+#if defined(FLUTTER_IPC_JSON_SSE2)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    while (end_ - from >= 16) {
+      __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from));
+      // Unsigned bytes <= 0x1F are left unchanged by the max.
+      __m128i special = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(bytes, quote), _mm_cmpeq_epi8(bytes, backslash)),
+          _mm_cmpeq_epi8(_mm_max_epu8(bytes, control), control));
+      int mask = _mm_movemask_epi8(special);
+      if (mask != 0) {
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanForward(&index, static_cast<unsigned long>(mask));
+        return from + index;
+#else
+        return from + __builtin_ctz(static_cast<unsigned>(mask));
+#endif
+      }
+      from += 16;
+    }
+#endif
+    while (from != end_ && *from != '"' && *from != '\\' &&
+           static_cast<uint8_t>(*from) >= 0x20) {
+      ++from;
+    }
+    return from;
+  }
+
+  bool ParseHex4(uint32_t* code_unit) {
+    if (end_ - position_ < 4) {
+      return Fail("truncated \\u escape");
+    }
+    uint32_t result = 0;
+    for (int i = 0; i < 4; ++i) {
+      char c = position_[i];
+      result <<= 4;
+      if (c >= '0' && c <= '9') {
+        result |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        result |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        result |= c - 'A' + 10;
+      } else {
+        return Fail("invalid \\u escape");
+      }
+    }
+    position_ += 4;
+    *code_unit = result;
+    return true;
+  }
+
+  static void AppendUtf8(uint32_t code_point, std::string* out) {
+    if (code_point < 0x80) {
+      out->push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+      out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+      out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+      out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+  }
+
+  bool ParseEscape(std::string* out) {
+    ++position_;  // '\\'
+    if (position_ == end_) {
+      return Fail("unterminated string");
+    }
+    char c = *position_++;
+    switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+        out->push_back(c);
+        return true;
+      case 'b':
+        out->push_back('\b');
+        return true;
+      case 'f':
+        out->push_back('\f');
+        return true;
+      case 'n':
+        out->push_back('\n');
+        return true;
+      case 'r':
+        out->push_back('\r');
+        return true;
+      case 't':
+        out->push_back('\t');
+        return true;
+      case 'u':
+        break;
+      default:
+        --position_;
+        return Fail("invalid escape");
+    }
+
+    uint32_t code_point = 0;
+    if (!ParseHex4(&code_point)) {
+      return false;
+    }
+    if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+      // A UTF-8 string can only hold a surrogate as part of a pair.
+      uint32_t low = 0;
+      if (end_ - position_ < 2 || position_[0] != '\\' || position_[1] != 'u') {
+        return Fail("unpaired surrogate");
+      }
+      position_ += 2;
+      if (!ParseHex4(&low)) {
+        return false;
+      }
+      if (low < 0xDC00 || low > 0xDFFF) {
+        return Fail("unpaired surrogate");
+      }
+      code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+    } else if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+      return Fail("unpaired surrogate");
+    }
+    AppendUtf8(code_point, out);
+    return true;
+  }
+
+  bool ParseString(std::string* out) {
+    ++position_;  // '"'
+    while (true) {
+      const char* special = FindSpecial(position_);
+      out->append(position_, special);
+      position_ = special;
+      if (position_ == end_) {
+        return Fail("unterminated string");
+      }
+      if (*position_ == '"') {
+        ++position_;
+        return true;
+      }
+      if (*position_ != '\\') {
+        return Fail("control character in string");
+      }
+      if (!ParseEscape(out)) {
+        return false;
+      }
+    }
+  }
+
+  bool ParseNumber(flutter::EncodableValue* value) {
+    // Checks the JSON grammar first; from_chars accepts more than it.
+    const char* start = position_;
+    const char* p = position_;
+    if (p != end_ && *p == '-') {
+      ++p;
+    }
+    if (p == end_ || *p < '0' || *p > '9') {
+      return Fail("unexpected character");
+    }
+    if (*p == '0') {
+      ++p;
+    } else {
+      while (p != end_ && *p >= '0' && *p <= '9') {
+        ++p;
+      }
+    }
+    bool integral = true;
+    if (p != end_ && *p == '.') {
+      integral = false;
+      ++p;
+      if (p == end_ || *p < '0' || *p > '9') {
+        position_ = p;
+        return Fail("invalid number");
+      }
+      while (p != end_ && *p >= '0' && *p <= '9') {
+        ++p;
+      }
+    }
+    if (p != end_ && (*p == 'e' || *p == 'E')) {
+      integral = false;
+      ++p;
+      if (p != end_ && (*p == '+' || *p == '-')) {
+        ++p;
+      }
+      if (p == end_ || *p < '0' || *p > '9') {
+        position_ = p;
+        return Fail("invalid number");
+      }
+      while (p != end_ && *p >= '0' && *p <= '9') {
+        ++p;
+      }
+    }
+    position_ = p;
+
+    if (integral) {
+      int64_t integer = 0;
+      // Integers beyond 64 bits fall through to double, as with jsonDecode.
+      if (std::from_chars(start, p, integer).ec == std::errc()) {
+        if (integer >= std::numeric_limits<int32_t>::min() &&
+            integer <= std::numeric_limits<int32_t>::max()) {
+          value->emplace<int32_t>(static_cast<int32_t>(integer));
+        } else {
+          value->emplace<int64_t>(integer);
+        }
+        return true;
+      }
+    }
+    double number = 0;
+    auto result = std::from_chars(start, p, number);
+    if (result.ec == std::errc::result_out_of_range) {
+      // Left unset by from_chars: infinity on overflow, zero on underflow.
+      const char* exponent = std::find_if(start, p, [](char c) { return c == 'e' || c == 'E'; });
+      bool underflow = exponent != p && exponent[1] == '-';
+      number = underflow ? 0.0 : std::numeric_limits<double>::infinity();
+      number = *start == '-' ? -number : number;
+    } else if (result.ec != std::errc()) {
+      position_ = start;
+      return Fail("invalid number");
+    }
+    value->emplace<double>(number);
+    return true;
+  }
+
+  const char* begin_;
+  const char* position_;
+  const char* end_;
+  std::string* error_;
+};
+
+}  // namespace
+
+bool DecodeJson(const char* data, size_t size, flutter::EncodableValue* value,
+                std::string* error) {
+  JsonParser parser(data, size, error);
+  return parser.Parse(value);
+}
+
+}  // namespace flutter_ipc
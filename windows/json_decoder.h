@@ -0,0 +1,24 @@
+#ifndef FLUTTER_PLUGIN_JSON_DECODER_H_
+#define FLUTTER_PLUGIN_JSON_DECODER_H_
+
+#include <flutter/encodable_value.h>
+
+#include <cstddef>
+#include <string>
+
+namespace flutter_ipc {
+
+// Parses the JSON text |data| (RFC 8259) straight into |value|: objects
+// become EncodableMaps with string keys, arrays EncodableLists, integers
+// int32_t or int64_t when they fit and double otherwise, which is what
+// jsonDecode would have produced on the Dart side. A repeated object key
+// keeps its last value.
+//
+// |data| must be valid UTF-8. On failure returns false and describes the
+// problem and its byte offset in |error|.
+bool DecodeJson(const char* data, size_t size, flutter::EncodableValue* value,
+                std::string* error);
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_JSON_DECODER_H_
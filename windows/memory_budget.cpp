@@ -0,0 +1,257 @@
+#include "memory_budget.h"
+
+#include <algorithm>
+
+namespace flutter_ipc {
+
+namespace {
+
+void AddBytes(uint64_t* field, int64_t delta) {
+  *field = static_cast<uint64_t>(static_cast<int64_t>(*field) + delta);
+}
+
+}  // namespace
+
+const char* BudgetPolicyName(BudgetPolicy policy) {
+  switch (policy) {
+    case BudgetPolicy::PAUSE_READS:
+      return "pauseReads";
+    case BudgetPolicy::REJECT_SENDS:
+      return "rejectSends";
+    case BudgetPolicy::DISCONNECT:
+      return "disconnect";
+  }
+  return "pauseReads";
+}
+
+bool ParseBudgetPolicy(const std::string& name, BudgetPolicy* policy) {
+  for (BudgetPolicy candidate :
+       {BudgetPolicy::PAUSE_READS, BudgetPolicy::REJECT_SENDS, BudgetPolicy::DISCONNECT}) {
+    if (name == BudgetPolicyName(candidate)) {
+      *policy = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+// static
+MemoryBudget& MemoryBudget::GetInstance() {
+  static MemoryBudget instance;
+  return instance;
+}
+
+void MemoryBudget::Configure(size_t limit, BudgetPolicy policy) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  limit_ = limit;
+  policy_ = policy;
+  // A raised limit may release paused readers; a lowered one takes effect
+  // with the next charge.
+  paused_ = paused_ && policy_ == BudgetPolicy::PAUSE_READS && limit_ != 0 &&
+            stats_.inbound() > limit_;
+  for (MemoryAccount* account : accounts_) {
+    account->UpdateRoom();
+  }
+}
+
+MemoryStats MemoryBudget::GetStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+size_t MemoryBudget::limit() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return limit_;
+}
+
+BudgetPolicy MemoryBudget::policy() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return policy_;
+}
+
+MemoryAccount::MemoryAccount(size_t limit, BudgetPolicy policy, MemoryBudget* budget)
+    : budget_(budget), limit_(limit), policy_(policy),
+      room_event_(CreateEventW(NULL, TRUE, TRUE, NULL)) {
+  std::lock_guard<std::mutex> lock(budget_->mutex_);
+  budget_->accounts_.insert(this);
+  UpdateRoom();
+}
+
+MemoryAccount::~MemoryAccount() {
+  {
+    std::lock_guard<std::mutex> lock(budget_->mutex_);
+    // Whatever is still charged goes with the account.
+    Change(Kind::SEND, -static_cast<int64_t>(stats_.send_bytes));
+    Change(Kind::RECEIVE, -static_cast<int64_t>(stats_.receive_bytes));
+    Change(Kind::REASSEMBLY, -static_cast<int64_t>(stats_.reassembly_bytes));
+    budget_->accounts_.erase(this);
+    Enforce();
+  }
+  CloseHandle(room_event_);
+}
+
+void MemoryAccount::SetShedHandler(ShedHandler handler) {
+  std::lock_guard<std::mutex> lock(budget_->mutex_);
+  shed_handler_ = std::move(handler);
+}
+
+bool MemoryAccount::ChargeSend(size_t bytes) {
+  std::lock_guard<std::mutex> lock(budget_->mutex_);
+  bool over_own = policy_ == BudgetPolicy::REJECT_SENDS && limit_ != 0 &&
+                  stats_.total() + bytes > limit_;
+  bool over_global = budget_->policy_ == BudgetPolicy::REJECT_SENDS && budget_->limit_ != 0 &&
+                     budget_->stats_.total() + bytes > budget_->limit_;
+  if (over_own || over_global) {
+    ++stats_.rejected_sends;
+    ++budget_->stats_.rejected_sends;
+    return false;
+  }
+  Change(Kind::SEND, static_cast<int64_t>(bytes));
+  Enforce();
+  return true;
+}
+
+void MemoryAccount::ReleaseSend(size_t bytes) {
+  std::lock_guard<std::mutex> lock(budget_->mutex_);
+  Change(Kind::SEND, -static_cast<int64_t>(bytes));
+  Enforce();
+}
+
+void MemoryAccount::ChargeReceive(size_t bytes) {
+  std::lock_guard<std::mutex> lock(budget_->mutex_);
+  Change(Kind::RECEIVE, static_cast<int64_t>(bytes));
+  Enforce();
+}
+
+void MemoryAccount::ReleaseReceive(size_t bytes) {
+  std::lock_guard<std::mutex> lock(budget_->mutex_);
+  Change(Kind::RECEIVE, -static_cast<int64_t>(bytes));
+  Enforce();
+}
+
+void MemoryAccount::SetReassembly(size_t bytes) {
+  std::lock_guard<std::mutex> lock(budget_->mutex_);
+  if (bytes == stats_.reassembly_bytes) {
+    return;
+  }
+  Change(Kind::REASSEMBLY, static_cast<int64_t>(bytes) - static_cast<int64_t>(stats_.reassembly_bytes));
+  Enforce();
+}
+
+size_t MemoryAccount::frame_limit() {
+  std::lock_guard<std::mutex> lock(budget_->mutex_);
+  if (limit_ == 0 || budget_->limit_ == 0) {
+    return std::max(limit_, budget_->limit_);
+  }
+  return std::min(limit_, budget_->limit_);
+}
+
+bool MemoryAccount::WaitForRoom(HANDLE stop_event) {
+  HANDLE events[] = {room_event_, stop_event};
+  DWORD count = stop_event != NULL ? 2 : 1;
+  return WaitForMultipleObjects(count, events, FALSE, INFINITE) == WAIT_OBJECT_0;
+}
+
+MemoryStats MemoryAccount::GetStats() {
+  std::lock_guard<std::mutex> lock(budget_->mutex_);
+  return stats_;
+}
+
+void MemoryAccount::Change(Kind kind, int64_t delta) {
+  uint64_t* own = nullptr;
+  uint64_t* global = nullptr;
+  switch (kind) {
+    case Kind::SEND:
+      own = &stats_.send_bytes;
+      global = &budget_->stats_.send_bytes;
+      break;
+    case Kind::RECEIVE:
+      own = &stats_.receive_bytes;
+      global = &budget_->stats_.receive_bytes;
+      break;
+    case Kind::REASSEMBLY:
+      own = &stats_.reassembly_bytes;
+      global = &budget_->stats_.reassembly_bytes;
+      break;
+  }
+  AddBytes(own, delta);
+  AddBytes(global, delta);
+  stats_.peak_bytes = std::max(stats_.peak_bytes, stats_.total());
+  budget_->stats_.peak_bytes = std::max(budget_->stats_.peak_bytes, budget_->stats_.total());
+  if (stats_.total() == 0) {
+    shed_ = false;
+  }
+}
+
+void MemoryAccount::Enforce() {
+  // Pausing: each account against its own limit, and all of them at once
+  // against the global one.
+  bool was_paused = paused_;
+  paused_ = policy_ == BudgetPolicy::PAUSE_READS && InboundOverLimit();
+  if (paused_ && !was_paused) {
+    ++stats_.read_pauses;
+  }
+  bool was_globally_paused = budget_->paused_;
+  budget_->paused_ = budget_->policy_ == BudgetPolicy::PAUSE_READS && budget_->limit_ != 0 &&
+                     budget_->stats_.inbound() > budget_->limit_;
+  if (budget_->paused_ != was_globally_paused) {
+    if (budget_->paused_) {
+      ++budget_->stats_.read_pauses;
+    }
+    for (MemoryAccount* account : budget_->accounts_) {
+      account->UpdateRoom();
+    }
+  } else if (paused_ != was_paused) {
+    UpdateRoom();
+  }
+
+  // Disconnecting: an account over its own limit goes itself. Over the
+  // global limit the largest account goes, unless an earlier victim still
+  // has memory to give back.
+  if (policy_ == BudgetPolicy::DISCONNECT && OverLimit() && !shed_) {
+    Shed(this);
+  }
+  if (budget_->policy_ != BudgetPolicy::DISCONNECT || budget_->limit_ == 0 ||
+      budget_->stats_.total() <= budget_->limit_) {
+    return;
+  }
+  MemoryAccount* victim = nullptr;
+  for (MemoryAccount* account : budget_->accounts_) {
+    if (account->shed_) {
+      return;
+    }
+    if (!victim || account->stats_.total() > victim->stats_.total()) {
+      victim = account;
+    }
+  }
+  if (victim && victim->stats_.total() > 0) {
+    Shed(victim);
+  }
+}
+
+bool MemoryAccount::OverLimit() const {
+  return limit_ != 0 && stats_.total() > limit_;
+}
+
+bool MemoryAccount::InboundOverLimit() const {
+  return limit_ != 0 && stats_.inbound() > limit_;
+}
+
+void MemoryAccount::UpdateRoom() {
+  if (paused_ || budget_->paused_) {
+    ResetEvent(room_event_);
+  } else {
+    SetEvent(room_event_);
+  }
+}
+
+void MemoryAccount::Shed(MemoryAccount* victim) {
+  victim->shed_ = true;
+  ++victim->stats_.disconnects;
+  ++budget_->stats_.disconnects;
+  if (victim->shed_handler_) {
+    victim->shed_handler_();
+  }
+}
+
+}  // namespace flutter_ipc
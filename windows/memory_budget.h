@@ -0,0 +1,145 @@
+#ifndef FLUTTER_PLUGIN_MEMORY_BUDGET_H_
+#define FLUTTER_PLUGIN_MEMORY_BUDGET_H_
+
+#include <windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+
+namespace flutter_ipc {
+
+// What happens once a budget is exceeded.
+enum class BudgetPolicy {
+  PAUSE_READS,   // Stop reading from the pipe until received memory is released
+  REJECT_SENDS,  // Fail sends with ERROR_NOT_ENOUGH_QUOTA
+  DISCONNECT,    // Drop the connection holding the most memory
+};
+
+const char* BudgetPolicyName(BudgetPolicy policy);
+bool ParseBudgetPolicy(const std::string& name, BudgetPolicy* policy);
+
+struct MemoryStats {
+  // Held right now: queued outbound payloads, inbound frames the
+  // application has not consumed, and partially reassembled frames.
+  uint64_t send_bytes = 0;
+  uint64_t receive_bytes = 0;
+  uint64_t reassembly_bytes = 0;
+  uint64_t peak_bytes = 0;
+  // Enforcement so far.
+  uint64_t rejected_sends = 0;
+  uint64_t read_pauses = 0;
+  uint64_t disconnects = 0;
+
+  uint64_t total() const { return send_bytes + receive_bytes + reassembly_bytes; }
+  // What reading adds to. Pausing reads looks at this alone: queued sends
+  // drain on the credit the peer grants, which only reading takes in.
+  uint64_t inbound() const { return receive_bytes + reassembly_bytes; }
+};
+
+class MemoryAccount;
+
+// The process-wide budget that every MemoryAccount also counts against.
+// Unlimited until configured.
+class MemoryBudget {
+ public:
+  static MemoryBudget& GetInstance();
+
+  MemoryBudget() = default;
+
+  // Disallow copy and assign.
+  MemoryBudget(const MemoryBudget&) = delete;
+  MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+  // A |limit| of 0 removes the cap.
+  void Configure(size_t limit, BudgetPolicy policy);
+
+  MemoryStats GetStats();
+  size_t limit();
+  BudgetPolicy policy();
+
+ private:
+  friend class MemoryAccount;
+
+  std::mutex mutex_;
+  size_t limit_ = 0;
+  BudgetPolicy policy_ = BudgetPolicy::PAUSE_READS;
+  MemoryStats stats_;
+  // Set while inbound memory is over a PAUSE_READS limit.
+  bool paused_ = false;
+  std::set<MemoryAccount*> accounts_;
+};
+
+// The memory held on behalf of one endpoint, across its connections,
+// checked against a limit of its own and against the process-wide budget.
+// Thread-safe.
+//
+// Pausing only takes effect where the reading thread calls WaitForRoom()
+// between reads; the completion-port backend does not.
+class MemoryAccount {
+ public:
+  // Called, under the budget's lock, when this account is to be shed. Must
+  // not block; typically it posts the disconnect to another thread.
+  using ShedHandler = std::function<void()>;
+
+  // A |limit| of 0 leaves only the process-wide budget.
+  MemoryAccount(size_t limit, BudgetPolicy policy,
+                MemoryBudget* budget = &MemoryBudget::GetInstance());
+  ~MemoryAccount();
+
+  // Disallow copy and assign.
+  MemoryAccount(const MemoryAccount&) = delete;
+  MemoryAccount& operator=(const MemoryAccount&) = delete;
+
+  void SetShedHandler(ShedHandler handler);
+
+  // Returns false, charging nothing, if a REJECT_SENDS limit would be
+  // exceeded.
+  bool ChargeSend(size_t bytes);
+  void ReleaseSend(size_t bytes);
+  void ChargeReceive(size_t bytes);
+  void ReleaseReceive(size_t bytes);
+  void SetReassembly(size_t bytes);
+  // The most one frame may take up: the smaller of this account's limit
+  // and the budget's, or 0 if neither is set. A peer reassembling a larger
+  // frame is dropped.
+  size_t frame_limit();
+
+  // Blocks while reads are paused. Returns false if |stop_event| was
+  // signaled first.
+  bool WaitForRoom(HANDLE stop_event);
+
+  MemoryStats GetStats();
+
+ private:
+  friend class MemoryBudget;
+
+  enum class Kind { SEND, RECEIVE, REASSEMBLY };
+
+  // All called with the budget's lock held.
+  void Change(Kind kind, int64_t delta);
+  // Applies the policies after a charge.
+  void Enforce();
+  bool OverLimit() const;
+  bool InboundOverLimit() const;
+  void UpdateRoom();
+  void Shed(MemoryAccount* victim);
+
+  MemoryBudget* budget_;
+  size_t limit_;
+  BudgetPolicy policy_;
+  MemoryStats stats_;
+  ShedHandler shed_handler_;
+  // Set once shed, until the account is empty again.
+  bool shed_ = false;
+  bool paused_ = false;
+  // Signaled while reads may go ahead.
+  HANDLE room_event_;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_MEMORY_BUDGET_H_
@@ -0,0 +1,71 @@
+#ifndef FLUTTER_PLUGIN_MPSC_QUEUE_H_
+#define FLUTTER_PLUGIN_MPSC_QUEUE_H_
+
+#include <atomic>
+#include <utility>
+
+namespace flutter_ipc {
+
+// An unbounded queue that any number of threads push to without a lock,
+// and one consumer at a time pops from. A push is a single atomic exchange,
+// so producers never wait for each other or for the consumer. This is
+// Vyukov's intrusive MPSC queue with a stub node.
+template <typename T>
+class MpscQueue {
+ public:
+  MpscQueue() : head_(new Node()), tail_(head_) {}
+  ~MpscQueue() {
+    T value;
+    while (Pop(&value)) {
+    }
+    delete head_;
+  }
+
+  // Disallow copy and assign.
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  // From any thread.
+  void Push(T value) {
+    Node* node = new Node();
+    node->value = std::move(value);
+    Node* previous = tail_.exchange(node, std::memory_order_acq_rel);
+    // Until this store the consumer sees the queue end at |previous|.
+    previous->next.store(node, std::memory_order_seq_cst);
+  }
+
+  // From the consumer. Returns false if the queue is empty, or if the
+  // newest push has not linked its node yet; that producer has not
+  // returned from Push() either.
+  bool Pop(T* value) {
+    Node* next = head_->next.load(std::memory_order_acquire);
+    if (!next) {
+      return false;
+    }
+    *value = std::move(next->value);
+    delete head_;
+    head_ = next;
+    return true;
+  }
+
+  // From the consumer. Sequentially consistent with Push(), so a consumer
+  // that announces it goes to sleep and then finds the queue empty is
+  // sure to be seen by the next producer.
+  bool Empty() const { return head_->next.load(std::memory_order_seq_cst) == nullptr; }
+
+ private:
+  struct Node {
+    std::atomic<Node*> next{nullptr};
+    T value{};
+  };
+
+  // The last node popped, whose value is gone; its |next| is the oldest
+  // entry. Only the consumer touches it.
+  Node* head_;
+  // The newest node. Kept off the consumer's cache line.
+  alignas(64) std::atomic<Node*> tail_;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_MPSC_QUEUE_H_
@@ -0,0 +1,171 @@
+#include "network_shaper.h"
+
+#include <windows.h>
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace flutter_ipc {
+
+namespace {
+
+using Clock = NetworkShaper::Clock;
+
+// The system timer is coarse, so sleeps most of the way and yields the
+// rest.
+void WaitUntil(Clock::time_point deadline) {
+  constexpr auto kSlack = std::chrono::milliseconds(2);
+  if (deadline - Clock::now() > kSlack) {
+    std::this_thread::sleep_until(deadline - kSlack);
+  }
+  while (Clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+}
+
+size_t WireSize(const FrameChunk& chunk) {
+  return sizeof(FrameHeader) + chunk.length;
+}
+
+}  // namespace
+
+uint64_t NetworkShaper::Random::Next() {
+  uint64_t z = (state_ += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+double NetworkShaper::Random::NextDouble() {
+  return static_cast<double>(Next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+NetworkShaper::NetworkShaper(const ShapingOptions& options)
+    : options_(options),
+      write_random_(options.seed),
+      read_random_(options.seed ^ 0x5DEECE66Dull) {}
+
+NetworkShaper::WritePlan NetworkShaper::PlanWrite(size_t bytes, Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Every write takes the same draws, so that one choice never shifts the
+  // stream under the others.
+  double disconnect = write_random_.NextDouble();
+  double jitter = write_random_.NextDouble();
+  double spike = write_random_.NextDouble();
+  double short_write = write_random_.NextDouble();
+  uint64_t split = write_random_.Next();
+
+  WritePlan plan;
+  ++stats_.writes;
+  if (disconnect < options_.disconnect_rate) {
+    plan.disconnect = true;
+    ++stats_.disconnects;
+    return plan;
+  }
+  Clock::time_point start = std::max(now, link_free_);
+  if (options_.bandwidth != 0) {
+    start += std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(static_cast<double>(bytes) / options_.bandwidth));
+  }
+  link_free_ = start;
+  double delay_us = options_.latency_us - options_.jitter_us * std::log(1 - jitter);
+  if (spike < options_.spike_rate) {
+    delay_us += options_.spike_us;
+  }
+  plan.start = start + std::chrono::duration_cast<Clock::duration>(
+                           std::chrono::duration<double, std::micro>(delay_us));
+  stats_.write_delay += std::chrono::duration_cast<std::chrono::microseconds>(plan.start - now);
+  if (bytes > 1 && short_write < options_.short_write_rate) {
+    plan.split = 1 + static_cast<size_t>(split % (bytes - 1));
+    plan.pause = std::chrono::microseconds(options_.short_write_pause_us);
+  }
+  return plan;
+}
+
+NetworkShaper::Clock::duration NetworkShaper::PlanRead() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (read_random_.NextDouble() >= options_.read_stall_rate) {
+    return Clock::duration::zero();
+  }
+  ++stats_.read_stalls;
+  return std::chrono::microseconds(options_.read_stall_us);
+}
+
+bool NetworkShaper::Write(std::vector<FrameChunk>& chunks, bool split_chunks, const ChunkWrite& write,
+                          const std::function<void()>& drop) {
+  size_t bytes = 0;
+  for (const auto& chunk : chunks) {
+    bytes += WireSize(chunk);
+  }
+  WritePlan plan = PlanWrite(bytes, Clock::now());
+  if (plan.disconnect) {
+    if (drop) {
+      drop();
+    }
+    SetLastError(ERROR_BROKEN_PIPE);
+    return false;
+  }
+  WaitUntil(plan.start);
+  if (plan.split == 0) {
+    return write(chunks);
+  }
+
+  std::vector<FrameChunk> first;
+  std::vector<FrameChunk> rest;
+  SplitChunks(chunks, plan.split, split_chunks, &first, &rest);
+  if (rest.empty()) {
+    return write(chunks);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.short_writes;
+  }
+  if (!write(first)) {
+    return false;
+  }
+  WaitUntil(Clock::now() + plan.pause);
+  return write(rest);
+}
+
+void NetworkShaper::StallRead() {
+  Clock::duration stall = PlanRead();
+  if (stall != Clock::duration::zero()) {
+    WaitUntil(Clock::now() + stall);
+  }
+}
+
+ShapingStats NetworkShaper::GetStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void SplitChunks(const std::vector<FrameChunk>& chunks, size_t split, bool split_chunks,
+                 std::vector<FrameChunk>* first, std::vector<FrameChunk>* rest) {
+  size_t offset = 0;
+  for (const auto& chunk : chunks) {
+    size_t end = offset + WireSize(chunk);
+    if (offset >= split) {
+      rest->push_back(chunk);
+    } else if (end <= split || !split_chunks || chunk.length < 2 ||
+               (chunk.owner->frame.flags & kFrameFlagControl)) {
+      // Control frames pass the reassembly as they are, so stay whole.
+      first->push_back(chunk);
+    } else {
+      // The cut lands in the payload, leaving at least a byte either side.
+      size_t length = std::min(std::max(split - offset, sizeof(FrameHeader) + 1) - sizeof(FrameHeader),
+                               chunk.length - 1);
+      FrameChunk head = chunk;
+      head.length = length;
+      head.last = false;
+      FrameChunk tail = chunk;
+      tail.offset += length;
+      tail.length -= length;
+      first->push_back(std::move(head));
+      rest->push_back(std::move(tail));
+    }
+    offset = end;
+  }
+}
+
+}  // namespace flutter_ipc
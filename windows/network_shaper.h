@@ -0,0 +1,134 @@
+#ifndef FLUTTER_PLUGIN_NETWORK_SHAPER_H_
+#define FLUTTER_PLUGIN_NETWORK_SHAPER_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "channel_mux.h"
+
+namespace flutter_ipc {
+
+// Degraded conditions a NetworkShaper puts on a connection, for testing
+// and benchmarks. All zero leaves the connection alone.
+struct ShapingOptions {
+  // Seeds every random choice. The same seed makes the same choices for
+  // the same sequence of writes and reads, on every platform.
+  uint64_t seed = 1;
+  // Bytes per second the connection carries, 0 for no cap. A write waits
+  // for the link until the writes before it have gone through.
+  uint64_t bandwidth = 0;
+  // How long every write is held on top: |latency_us|, plus a draw from
+  // an exponential distribution of mean |jitter_us|, plus |spike_us| with
+  // probability |spike_rate|.
+  uint32_t latency_us = 0;
+  uint32_t jitter_us = 0;
+  double spike_rate = 0;
+  uint32_t spike_us = 0;
+  // Probability that a write goes out in two parts, |short_write_pause_us|
+  // apart. The cut may fall in the middle of a frame.
+  double short_write_rate = 0;
+  uint32_t short_write_pause_us = 0;
+  // Probability that the reader stalls for |read_stall_us| before it
+  // hands on a frame, as a slow consumer would. With
+  // IoBackend::COMPLETION_PORT that holds up a shared worker.
+  double read_stall_rate = 0;
+  uint32_t read_stall_us = 0;
+  // Probability that a write drops the connection instead.
+  double disconnect_rate = 0;
+
+  bool enabled() const {
+    return bandwidth != 0 || latency_us != 0 || jitter_us != 0 || spike_rate > 0 ||
+           short_write_rate > 0 || read_stall_rate > 0 || disconnect_rate > 0;
+  }
+};
+
+// What a NetworkShaper did to a connection.
+struct ShapingStats {
+  uint64_t writes = 0;
+  uint64_t short_writes = 0;
+  uint64_t read_stalls = 0;
+  uint64_t disconnects = 0;
+  // Time writes were held back, for the bandwidth cap and latency.
+  std::chrono::microseconds write_delay{0};
+};
+
+// Decorates a connection's transport with the conditions of a
+// ShapingOptions: writes are paced, delayed, cut short or fail with a
+// dropped connection, and reads stall. Choices come from two seeded
+// streams, one for writes and one for reads, so one direction does not
+// change the other. Works the same over kernel and in-process pipes.
+// Thread-safe.
+class NetworkShaper {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using ChunkWrite = std::function<bool(std::vector<FrameChunk>& chunks)>;
+
+  // How one write goes out.
+  struct WritePlan {
+    // Drop the connection instead.
+    bool disconnect = false;
+    // When the write may start.
+    Clock::time_point start;
+    // Bytes to send before a pause of |pause|; 0 sends the write whole.
+    size_t split = 0;
+    Clock::duration pause{0};
+  };
+
+  explicit NetworkShaper(const ShapingOptions& options);
+
+  // Disallow copy and assign.
+  NetworkShaper(const NetworkShaper&) = delete;
+  NetworkShaper& operator=(const NetworkShaper&) = delete;
+
+  // Plans a write of |bytes| that is ready at |now|.
+  WritePlan PlanWrite(size_t bytes, Clock::time_point now);
+  // How long the reader stalls before the next frame; mostly zero.
+  Clock::duration PlanRead();
+
+  // Writes |chunks| with |write| as planned. Data chunks are cut in two
+  // for a short write only with |split_chunks|; otherwise the cut moves to
+  // the end of a chunk. A planned disconnect calls |drop| and fails with
+  // ERROR_BROKEN_PIPE.
+  bool Write(std::vector<FrameChunk>& chunks, bool split_chunks, const ChunkWrite& write,
+             const std::function<void()>& drop);
+  // Stalls the calling reader if the plan says so.
+  void StallRead();
+
+  ShapingStats GetStats();
+
+ private:
+  // SplitMix64, whose output does not depend on the standard library.
+  class Random {
+   public:
+    explicit Random(uint64_t seed) : state_(seed) {}
+    uint64_t Next();
+    // Uniform in [0, 1).
+    double NextDouble();
+
+   private:
+    uint64_t state_;
+  };
+
+  ShapingOptions options_;
+  std::mutex mutex_;
+  Random write_random_;
+  Random read_random_;
+  // When the bytes written so far have gone through the bandwidth cap.
+  Clock::time_point link_free_;
+  ShapingStats stats_;
+};
+
+// Splits |chunks|, whose wire size counts a FrameHeader per chunk, after
+// |split| bytes into |first| and |rest|. With |split_chunks| a data chunk
+// across the cut becomes two chunks of the same frame; otherwise it goes
+// to |first| whole.
+void SplitChunks(const std::vector<FrameChunk>& chunks, size_t split, bool split_chunks,
+                 std::vector<FrameChunk>* first, std::vector<FrameChunk>* rest);
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_NETWORK_SHAPER_H_
@@ -0,0 +1,131 @@
+#include "outbox.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace flutter_ipc {
+
+// static
+std::unique_ptr<Outbox> Outbox::Create(size_t capacity) {
+  HANDLE mapping = CreateFileMappingW(
+    INVALID_HANDLE_VALUE, // Backed by the paging file
+    NULL,
+    PAGE_READWRITE,
+    static_cast<DWORD>(static_cast<uint64_t>(capacity) >> 32),
+    static_cast<DWORD>(capacity & 0xFFFFFFFF),
+    NULL
+  );
+  if (mapping == NULL) {
+    return nullptr;
+  }
+  void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, capacity);
+  if (!view) {
+    CloseHandle(mapping);
+    return nullptr;
+  }
+  return std::unique_ptr<Outbox>(new Outbox(mapping, static_cast<char*>(view), capacity));
+}
+
+Outbox::Outbox(HANDLE mapping, char* view, size_t capacity)
+    : mapping_(mapping), view_(view), capacity_(capacity) {}
+
+Outbox::~Outbox() {
+  UnmapViewOfFile(view_);
+  CloseHandle(mapping_);
+}
+
+bool Outbox::Append(const Frame& frame) {
+  // Records reuse the wire header, so each one reads back as a frame.
+  FrameHeader header = {};
+  header.length = static_cast<uint32_t>(frame.payload.size());
+  header.type = static_cast<uint8_t>(frame.type);
+  header.flags = frame.flags;
+  header.channel = frame.channel;
+
+  size_t record_size = sizeof(header) + frame.payload.size();
+  if (record_size > capacity_ - used_) {
+    SetLastError(ERROR_NOT_ENOUGH_QUOTA);
+    return false;
+  }
+
+  size_t tail = (head_ + used_) % capacity_;
+  CopyIn(tail, &header, sizeof(header));
+  CopyIn((tail + sizeof(header)) % capacity_, frame.payload.data(), frame.payload.size());
+  used_ += record_size;
+  ++count_;
+  newest_size_ = record_size;
+  return true;
+}
+
+void Outbox::RemoveNewest() {
+  if (newest_size_ == 0) {
+    return;
+  }
+  used_ -= newest_size_;
+  --count_;
+  newest_size_ = 0;
+}
+
+void Outbox::Acknowledge(const AckMap& acks) {
+  for (const auto& ack : acks) {
+    uint64_t& acked = acked_[ack.first];
+    acked = std::max(acked, ack.second);
+  }
+
+  // Channels are acknowledged independently, so a record stays until every
+  // record in front of it is acknowledged too.
+  while (count_ > 0) {
+    FrameHeader header;
+    CopyOut(head_, &header, sizeof(header));
+    uint64_t sequence = 0;
+    CopyOut((head_ + sizeof(header)) % capacity_, &sequence, sizeof(sequence));
+    auto acked_it = acked_.find(header.channel);
+    if (acked_it == acked_.end() || sequence > acked_it->second) {
+      break;
+    }
+    size_t record_size = sizeof(header) + header.length;
+    head_ = (head_ + record_size) % capacity_;
+    used_ -= record_size;
+    --count_;
+  }
+  if (count_ == 0) {
+    newest_size_ = 0;
+  }
+}
+
+void Outbox::ForEach(const std::function<void(Frame frame)>& visit) const {
+  size_t offset = head_;
+  for (size_t i = 0; i < count_; ++i) {
+    Frame frame = ReadRecord(offset);
+    offset = (offset + sizeof(FrameHeader) + frame.payload.size()) % capacity_;
+    visit(std::move(frame));
+  }
+}
+
+void Outbox::CopyIn(size_t offset, const void* data, size_t length) {
+  size_t first = std::min(length, capacity_ - offset);
+  memcpy(view_ + offset, data, first);
+  memcpy(view_, static_cast<const char*>(data) + first, length - first);
+}
+
+void Outbox::CopyOut(size_t offset, void* data, size_t length) const {
+  size_t first = std::min(length, capacity_ - offset);
+  memcpy(data, view_ + offset, first);
+  memcpy(static_cast<char*>(data) + first, view_, length - first);
+}
+
+Frame Outbox::ReadRecord(size_t offset) const {
+  FrameHeader header;
+  CopyOut(offset, &header, sizeof(header));
+  Frame frame;
+  frame.type = static_cast<FrameType>(header.type);
+  frame.flags = header.flags;
+  frame.channel = header.channel;
+  frame.payload.resize(header.length);
+  if (header.length > 0) {
+    CopyOut((offset + sizeof(header)) % capacity_, &frame.payload[0], header.length);
+  }
+  return frame;
+}
+
+}  // namespace flutter_ipc
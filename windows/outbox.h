@@ -0,0 +1,68 @@
+#ifndef FLUTTER_PLUGIN_OUTBOX_H_
+#define FLUTTER_PLUGIN_OUTBOX_H_
+
+#include <windows.h>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+#include "frame.h"
+#include "session.h"
+
+namespace flutter_ipc {
+
+// Append-only log of sequenced frames that the peer has not acknowledged
+// yet, kept in a pagefile-backed section outside the heap. Records are
+// appended at the tail and dropped from the head as acknowledgements come
+// in, wrapping around the fixed-size mapping. Not thread-safe.
+class Outbox {
+ public:
+  static constexpr size_t kDefaultCapacity = 8 * 1024 * 1024;
+
+  static std::unique_ptr<Outbox> Create(size_t capacity = kDefaultCapacity);
+  ~Outbox();
+
+  // Disallow copy and assign.
+  Outbox(const Outbox&) = delete;
+  Outbox& operator=(const Outbox&) = delete;
+
+  // Appends a sequenced frame. Fails with ERROR_NOT_ENOUGH_QUOTA if the
+  // outbox is full.
+  bool Append(const Frame& frame);
+  // Takes back the record of the last Append(), for a frame that could not
+  // be queued after all. Only valid right after it.
+  void RemoveNewest();
+
+  // Drops the records at the head that |acks| covers.
+  void Acknowledge(const AckMap& acks);
+
+  // Calls |visit| with every record still held, oldest first.
+  void ForEach(const std::function<void(Frame frame)>& visit) const;
+
+  size_t size() const { return used_; }
+  size_t count() const { return count_; }
+  size_t capacity() const { return capacity_; }
+
+ private:
+  Outbox(HANDLE mapping, char* view, size_t capacity);
+
+  // Copy in and out of the ring, wrapping at the end of the view.
+  void CopyIn(size_t offset, const void* data, size_t length);
+  void CopyOut(size_t offset, void* data, size_t length) const;
+  Frame ReadRecord(size_t offset) const;
+
+  HANDLE mapping_;
+  char* view_;
+  size_t capacity_;
+  size_t head_ = 0;   // Offset of the oldest record
+  size_t used_ = 0;
+  size_t count_ = 0;
+  // Size of the record appended last, 0 once it is taken back.
+  size_t newest_size_ = 0;
+  AckMap acked_;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_OUTBOX_H_
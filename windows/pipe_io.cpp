@@ -0,0 +1,176 @@
+#include "pipe_io.h"
+
+#include <algorithm>
+#include <string>
+
+namespace flutter_ipc {
+
+bool WaitForOverlapped(HANDLE pipe, OVERLAPPED* overlapped, HANDLE stop_event, DWORD* transferred,
+                       const SpinWait& spin) {
+  // The kernel updates the OVERLAPPED in place, so polling it costs no
+  // system call.
+  if (spin.Until([overlapped] { return HasOverlappedIoCompleted(overlapped); })) {
+    return GetOverlappedResult(pipe, overlapped, transferred, FALSE) != FALSE;
+  }
+  if (stop_event != NULL) {
+    HANDLE events[] = {overlapped->hEvent, stop_event};
+    if (WaitForMultipleObjects(2, events, FALSE, INFINITE) != WAIT_OBJECT_0) {
+      CancelIoEx(pipe, overlapped);
+      GetOverlappedResult(pipe, overlapped, transferred, TRUE);
+      SetLastError(ERROR_OPERATION_ABORTED);
+      return false;
+    }
+  }
+  return GetOverlappedResult(pipe, overlapped, transferred, TRUE) != FALSE;
+}
+
+bool WriteExact(HANDLE pipe, HANDLE event, HANDLE stop_event, const void* data, DWORD size) {
+  OVERLAPPED overlapped;
+  ZeroMemory(&overlapped, sizeof(OVERLAPPED));
+  // The low bit keeps the completion off a completion port the pipe may be
+  // associated with for reading; waits on the event are unaffected.
+  overlapped.hEvent = reinterpret_cast<HANDLE>(reinterpret_cast<ULONG_PTR>(event) | 1);
+
+  DWORD bytes_written = 0;
+  if (!WriteFile(pipe, data, size, &bytes_written, &overlapped) && GetLastError() != ERROR_IO_PENDING) {
+    return false;
+  }
+
+  return WaitForOverlapped(pipe, &overlapped, stop_event, &bytes_written) && bytes_written == size;
+}
+
+bool ReadExact(HANDLE pipe, HANDLE event, HANDLE stop_event, void* data, DWORD size,
+               const SpinWait& spin) {
+  BYTE* buffer = static_cast<BYTE*>(data);
+  DWORD total_read = 0;
+
+  while (total_read < size) {
+    OVERLAPPED overlapped;
+    ZeroMemory(&overlapped, sizeof(OVERLAPPED));
+    overlapped.hEvent = event;
+
+    DWORD bytes_read = 0;
+    if (!ReadFile(pipe, buffer + total_read, size - total_read, &bytes_read, &overlapped)) {
+      DWORD error = GetLastError();
+      if (error != ERROR_IO_PENDING && error != ERROR_MORE_DATA) {
+        return false;
+      }
+    }
+
+    // ERROR_MORE_DATA only means the pipe message is longer than what we
+    // asked for; the rest is picked up by the next read.
+    if (!WaitForOverlapped(pipe, &overlapped, stop_event, &bytes_read, spin) && GetLastError() != ERROR_MORE_DATA) {
+      return false;
+    }
+    total_read += bytes_read;
+  }
+
+  return true;
+}
+
+bool WriteChunk(HANDLE pipe, HANDLE event, HANDLE stop_event, const FrameChunk& chunk) {
+  FrameHeader header = chunk.Header();
+  if (!WriteExact(pipe, event, stop_event, &header, sizeof(header))) {
+    return false;
+  }
+
+  // An empty payload is just its header.
+  return header.length == 0 || WriteExact(pipe, event, stop_event, chunk.data(), header.length);
+}
+
+bool WriteChunks(HANDLE pipe, HANDLE event, HANDLE stop_event, const std::vector<FrameChunk>& chunks) {
+  if (chunks.size() == 1) {
+    return WriteChunk(pipe, event, stop_event, chunks.front());
+  }
+
+  std::string buffer;
+  for (const auto& chunk : chunks) {
+    FrameHeader header = chunk.Header();
+    buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer.append(chunk.data(), chunk.length);
+  }
+  return WriteExact(pipe, event, stop_event, buffer.data(), static_cast<DWORD>(buffer.size()));
+}
+
+bool ReadFrame(HANDLE pipe, HANDLE event, HANDLE stop_event, Frame* frame,
+               const SpinWait& spin) {
+  FrameHeader header = {};
+  if (!ReadExact(pipe, event, stop_event, &header, sizeof(header), spin)) {
+    return false;
+  }
+
+  if (header.length > kMaxChunkLength) {
+    SetLastError(ERROR_INVALID_DATA);
+    return false;
+  }
+  frame->type = static_cast<FrameType>(header.type);
+  frame->flags = header.flags;
+  frame->channel = header.channel;
+  frame->payload.resize(header.length);
+  return header.length == 0 || ReadExact(pipe, event, stop_event, &frame->payload[0], header.length, spin);
+}
+
+bool WriteRecords(HANDLE pipe, HANDLE event, HANDLE stop_event, const std::vector<FrameChunk>& chunks) {
+  std::string buffer;
+  for (const auto& chunk : chunks) {
+    FrameType type = chunk.owner->frame.type;
+    if (type == FrameType::CREDIT || type == FrameType::HELLO || type == FrameType::ACK ||
+        type == FrameType::HEARTBEAT) {
+      continue;
+    }
+    buffer.append(chunk.data(), chunk.length);
+    if (chunk.last) {
+      buffer.push_back('\n');
+    }
+  }
+  return buffer.empty() ||
+         WriteExact(pipe, event, stop_event, buffer.data(), static_cast<DWORD>(buffer.size()));
+}
+
+bool ReadSome(HANDLE pipe, HANDLE event, HANDLE stop_event, void* data, DWORD size, DWORD* read,
+              const SpinWait& spin) {
+  *read = 0;
+  // A peer in message mode may write empty messages; they carry nothing.
+  while (*read == 0) {
+    OVERLAPPED overlapped;
+    ZeroMemory(&overlapped, sizeof(OVERLAPPED));
+    overlapped.hEvent = event;
+    if (!ReadFile(pipe, data, size, read, &overlapped)) {
+      DWORD error = GetLastError();
+      if (error != ERROR_IO_PENDING && error != ERROR_MORE_DATA) {
+        return false;
+      }
+    }
+    if (!WaitForOverlapped(pipe, &overlapped, stop_event, read, spin) && GetLastError() != ERROR_MORE_DATA) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ReadRecords(HANDLE pipe, HANDLE event, HANDLE stop_event, RecordReader* reader,
+                 const RecordReader::RecordHandler& on_record, const SpinWait& spin) {
+  while (true) {
+    size_t size = 0;
+    char* buffer = reader->ReadBuffer(&size);
+    DWORD read = 0;
+    if (!ReadSome(pipe, event, stop_event, buffer, static_cast<DWORD>(std::min<size_t>(size, MAXDWORD)),
+                  &read, spin)) {
+      return;
+    }
+    reader->Commit(read, on_record);
+  }
+}
+
+HANDLE CreateManualResetEvent() {
+  return CreateEventW(NULL, TRUE, FALSE, NULL);
+}
+
+void CloseEvent(HANDLE* event) {
+  if (*event != NULL) {
+    CloseHandle(*event);
+    *event = NULL;
+  }
+}
+
+}  // namespace flutter_ipc
@@ -0,0 +1,60 @@
+#ifndef FLUTTER_PLUGIN_PIPE_IO_H_
+#define FLUTTER_PLUGIN_PIPE_IO_H_
+
+#include <windows.h>
+
+#include <vector>
+
+#include "channel_mux.h"
+#include "frame.h"
+#include "polling.h"
+#include "record_reader.h"
+
+namespace flutter_ipc {
+
+// Blocking helpers for pipe handles opened with FILE_FLAG_OVERLAPPED. Both
+// ends use overlapped handles so that the I/O thread can block in a read
+// while the platform thread writes. |event| is a manual-reset event owned
+// by the caller, one per concurrent operation. Reads and writes give up
+// early once |stop_event| is signaled. Given a |spin| budget, a read that
+// has to wait polls for its completion before blocking.
+
+bool WriteExact(HANDLE pipe, HANDLE event, HANDLE stop_event, const void* data, DWORD size);
+bool ReadExact(HANDLE pipe, HANDLE event, HANDLE stop_event, void* data, DWORD size,
+               const SpinWait& spin = SpinWait());
+
+// Writes one scheduled chunk as a FrameHeader followed by its slice of the
+// payload.
+bool WriteChunk(HANDLE pipe, HANDLE event, HANDLE stop_event, const FrameChunk& chunk);
+// Writes a batch of chunks in order. Several chunks are copied into a
+// single write; the reader does not care where writes begin and end.
+bool WriteChunks(HANDLE pipe, HANDLE event, HANDLE stop_event, const std::vector<FrameChunk>& chunks);
+// Reads one chunk. Fails with ERROR_INVALID_DATA, before reading its
+// payload, on a chunk longer than kMaxChunkLength.
+bool ReadFrame(HANDLE pipe, HANDLE event, HANDLE stop_event, Frame* frame,
+               const SpinWait& spin = SpinWait());
+
+// Newline framing. Writes the data frames of a batch of whole-frame chunks
+// as newline-terminated records, without headers; control frames mean
+// nothing to a peer that speaks lines and are left out.
+bool WriteRecords(HANDLE pipe, HANDLE event, HANDLE stop_event, const std::vector<FrameChunk>& chunks);
+// Reads whatever the pipe has, at least one byte and at most |size|.
+bool ReadSome(HANDLE pipe, HANDLE event, HANDLE stop_event, void* data, DWORD size, DWORD* read,
+              const SpinWait& spin = SpinWait());
+// Reads into |reader| until the pipe breaks or |stop_event| is signaled,
+// passing every complete record to |on_record|.
+void ReadRecords(HANDLE pipe, HANDLE event, HANDLE stop_event, RecordReader* reader,
+                 const RecordReader::RecordHandler& on_record, const SpinWait& spin = SpinWait());
+
+// Waits for |overlapped| to complete, or cancels it if |stop_event| (which
+// may be NULL) is signaled first. The stop event is not looked at while
+// spinning.
+bool WaitForOverlapped(HANDLE pipe, OVERLAPPED* overlapped, HANDLE stop_event, DWORD* transferred,
+                       const SpinWait& spin = SpinWait());
+
+HANDLE CreateManualResetEvent();
+void CloseEvent(HANDLE* event);
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_PIPE_IO_H_
@@ -0,0 +1,79 @@
+#include "platform_task_runner.h"
+
+#include <utility>
+
+namespace flutter_ipc {
+
+namespace {
+
+constexpr wchar_t kWindowClassName[] = L"FlutterIpcPlatformTaskRunner";
+constexpr UINT kRunTasksMessage = WM_APP + 1;
+
+}  // namespace
+
+PlatformTaskRunner::PlatformTaskRunner() : window_(nullptr) {
+  HINSTANCE instance = GetModuleHandleW(nullptr);
+
+  WNDCLASSEXW window_class{};
+  window_class.cbSize = sizeof(window_class);
+  window_class.lpfnWndProc = &PlatformTaskRunner::WindowProc;
+  window_class.hInstance = instance;
+  window_class.lpszClassName = kWindowClassName;
+  // Fails harmlessly with ERROR_CLASS_ALREADY_EXISTS for later instances.
+  RegisterClassExW(&window_class);
+
+  window_ = CreateWindowExW(0, kWindowClassName, L"", 0, 0, 0, 0, 0,
+                            HWND_MESSAGE, nullptr, instance, nullptr);
+  if (window_) {
+    SetWindowLongPtrW(window_, GWLP_USERDATA,
+                      reinterpret_cast<LONG_PTR>(this));
+  }
+}
+
+PlatformTaskRunner::~PlatformTaskRunner() {
+  if (window_) {
+    SetWindowLongPtrW(window_, GWLP_USERDATA, 0);
+    DestroyWindow(window_);
+    window_ = nullptr;
+  }
+}
+
+void PlatformTaskRunner::PostTask(std::function<void()> task) {
+  bool was_empty;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    was_empty = tasks_.empty();
+    tasks_.push_back(std::move(task));
+  }
+  // One wakeup drains the whole queue, so only post when it was idle.
+  if (was_empty && window_) {
+    PostMessageW(window_, kRunTasksMessage, 0, 0);
+  }
+}
+
+void PlatformTaskRunner::RunPendingTasks() {
+  std::deque<std::function<void()>> tasks;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks.swap(tasks_);
+  }
+  for (auto& task : tasks) {
+    task();
+  }
+}
+
+// static
+LRESULT CALLBACK PlatformTaskRunner::WindowProc(HWND window, UINT message,
+                                                WPARAM wparam, LPARAM lparam) {
+  if (message == kRunTasksMessage) {
+    auto* runner = reinterpret_cast<PlatformTaskRunner*>(
+        GetWindowLongPtrW(window, GWLP_USERDATA));
+    if (runner) {
+      runner->RunPendingTasks();
+    }
+    return 0;
+  }
+  return DefWindowProcW(window, message, wparam, lparam);
+}
+
+}  // namespace flutter_ipc
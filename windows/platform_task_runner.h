@@ -0,0 +1,41 @@
+#ifndef FLUTTER_PLUGIN_PLATFORM_TASK_RUNNER_H_
+#define FLUTTER_PLUGIN_PLATFORM_TASK_RUNNER_H_
+
+#include <windows.h>
+
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace flutter_ipc {
+
+// Runs closures on the platform thread. Flutter channels may only be used
+// from that thread, so pipe I/O threads hand their results over through
+// this. Backed by a message-only window owned by the thread that created
+// the runner.
+class PlatformTaskRunner {
+ public:
+  PlatformTaskRunner();
+  ~PlatformTaskRunner();
+
+  // Disallow copy and assign.
+  PlatformTaskRunner(const PlatformTaskRunner&) = delete;
+  PlatformTaskRunner& operator=(const PlatformTaskRunner&) = delete;
+
+  // Queues |task| to run on the platform thread. Safe to call from any
+  // thread. Tasks still queued when the runner is destroyed are dropped.
+  void PostTask(std::function<void()> task);
+
+ private:
+  static LRESULT CALLBACK WindowProc(HWND window, UINT message, WPARAM wparam,
+                                     LPARAM lparam);
+  void RunPendingTasks();
+
+  HWND window_;
+  std::mutex mutex_;
+  std::deque<std::function<void()>> tasks_;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_PLATFORM_TASK_RUNNER_H_
@@ -0,0 +1,16 @@
+#include "polling.h"
+
+namespace flutter_ipc {
+
+void ApplyPollingOptions(const PollingOptions& options) {
+  // Best effort: a mask naming no available processor, or a priority the
+  // process may not use, leaves the thread as it was.
+  if (options.affinity_mask != 0) {
+    SetThreadAffinityMask(GetCurrentThread(), options.affinity_mask);
+  }
+  if (options.thread_priority != THREAD_PRIORITY_NORMAL) {
+    SetThreadPriority(GetCurrentThread(), options.thread_priority);
+  }
+}
+
+}  // namespace flutter_ipc
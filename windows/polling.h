@@ -0,0 +1,76 @@
+#ifndef FLUTTER_PLUGIN_POLLING_H_
+#define FLUTTER_PLUGIN_POLLING_H_
+
+#include <windows.h>
+
+#include <chrono>
+#include <cstdint>
+
+namespace flutter_ipc {
+
+// Low-latency mode of a connection's I/O and writer threads. By default
+// both block in the kernel as soon as there is nothing to do; waking them
+// up again costs a trip through the scheduler.
+struct PollingOptions {
+  // How long a thread with nothing to do keeps polling before it blocks.
+  // 0 blocks at once.
+  uint32_t spin_us = 0;
+  // Processors the threads may run on; 0 leaves them unpinned.
+  DWORD_PTR affinity_mask = 0;
+  int thread_priority = THREAD_PRIORITY_NORMAL;
+
+  bool IsDefault() const {
+    return spin_us == 0 && affinity_mask == 0 && thread_priority == THREAD_PRIORITY_NORMAL;
+  }
+};
+
+// Applies the affinity and priority of |options| to the calling thread.
+void ApplyPollingOptions(const PollingOptions& options);
+
+// Busy-waits for a condition for a bounded time. Polls with the processor's
+// pause hint, backing off, and gives up the time slice to other ready
+// threads in the second half of the budget so a spinning thread does not
+// starve the one it waits for on a busy machine.
+class SpinWait {
+ public:
+  SpinWait() = default;
+  explicit SpinWait(uint32_t spin_us) : budget_(spin_us) {}
+
+  bool enabled() const { return budget_.count() > 0; }
+
+  // Returns true as soon as |ready| does, false once the budget is spent.
+  template <typename Predicate>
+  bool Until(Predicate ready) const {
+    if (!enabled()) {
+      return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    uint32_t pauses = 1;
+    while (!ready()) {
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      if (elapsed >= budget_) {
+        return false;
+      }
+      if (elapsed * 2 >= budget_) {
+        SwitchToThread();
+        continue;
+      }
+      for (uint32_t i = 0; i < pauses; ++i) {
+        YieldProcessor();
+      }
+      if (pauses < kMaxPauses) {
+        pauses *= 2;
+      }
+    }
+    return true;
+  }
+
+ private:
+  static constexpr uint32_t kMaxPauses = 64;
+
+  std::chrono::microseconds budget_{0};
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_POLLING_H_
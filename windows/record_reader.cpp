@@ -0,0 +1,171 @@
+#include "record_reader.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "cpu_features.h"
+
+namespace flutter_ipc {
+
+namespace {
+
+#if defined(FLUTTER_IPC_X86)
+
+inline size_t LowestBit(uint32_t mask) {
+#if defined(_MSC_VER)
+  unsigned long index = 0;
+  _BitScanForward(&index, mask);
+  return index;
+#else
+  return static_cast<size_t>(__builtin_ctz(mask));
+#endif
+}
+
+FLUTTER_IPC_TARGET("sse2")
+size_t FindDelimiterSse2(const char* data, size_t size, char delimiter) {
+  const __m128i needle = _mm_set1_epi8(delimiter);
+  size_t offset = 0;
+  for (; offset + 16 <= size; offset += 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+    if (mask != 0) {
+      return offset + LowestBit(mask);
+    }
+  }
+  return offset + FindDelimiterScalar(data + offset, size - offset, delimiter);
+}
+
+FLUTTER_IPC_TARGET("avx2")
+size_t FindDelimiterAvx2(const char* data, size_t size, char delimiter) {
+  const __m256i needle = _mm256_set1_epi8(delimiter);
+  size_t offset = 0;
+  // Four blocks per iteration, tested together, keep the loop short.
+  for (; offset + 128 <= size; offset += 128) {
+    const __m256i* blocks = reinterpret_cast<const __m256i*>(data + offset);
+    __m256i match0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(blocks), needle);
+    __m256i match1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(blocks + 1), needle);
+    __m256i match2 = _mm256_cmpeq_epi8(_mm256_loadu_si256(blocks + 2), needle);
+    __m256i match3 = _mm256_cmpeq_epi8(_mm256_loadu_si256(blocks + 3), needle);
+    __m256i any = _mm256_or_si256(_mm256_or_si256(match0, match1), _mm256_or_si256(match2, match3));
+    if (!_mm256_testz_si256(any, any)) {
+      const __m256i matches[] = {match0, match1, match2, match3};
+      for (size_t i = 0;; ++i) {
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(matches[i]));
+        if (mask != 0) {
+          return offset + 32 * i + LowestBit(mask);
+        }
+      }
+    }
+  }
+  for (; offset + 32 <= size; offset += 32) {
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset)), needle)));
+    if (mask != 0) {
+      return offset + LowestBit(mask);
+    }
+  }
+  return offset + FindDelimiterSse2(data + offset, size - offset, delimiter);
+}
+
+#endif  // FLUTTER_IPC_X86
+
+size_t RoundUpToPowerOfTwo(size_t value) {
+  size_t result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+}  // namespace
+
+size_t FindDelimiterScalar(const char* data, size_t size, char delimiter) {
+  for (size_t i = 0; i < size; ++i) {
+    if (data[i] == delimiter) {
+      return i;
+    }
+  }
+  return size;
+}
+
+size_t FindDelimiter(const char* data, size_t size, char delimiter) {
+#if defined(FLUTTER_IPC_X86)
+  if (GetCpuFeatures().avx2) {
+    return FindDelimiterAvx2(data, size, delimiter);
+  }
+  return FindDelimiterSse2(data, size, delimiter);
+#else
+  return FindDelimiterScalar(data, size, delimiter);
+#endif
+}
+
+const char* DelimiterScannerName() {
+#if defined(FLUTTER_IPC_X86)
+  return GetCpuFeatures().avx2 ? "avx2" : "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+RecordReader::RecordReader(size_t max_record_length)
+    : max_record_length_(max_record_length),
+      // Room for a whole record plus a full read behind it.
+      capacity_(RoundUpToPowerOfTwo(max_record_length + 1 + kReadSize)),
+      ring_(new char[capacity_]) {}
+
+char* RecordReader::ReadBuffer(size_t* size) {
+  size_t offset = static_cast<size_t>(tail_ & (capacity_ - 1));
+  size_t free = capacity_ - static_cast<size_t>(tail_ - head_);
+  *size = std::min(free, capacity_ - offset);
+  return &ring_[offset];
+}
+
+void RecordReader::Commit(size_t size, const RecordHandler& on_record) {
+  tail_ += size;
+  while (scanned_ < tail_) {
+    size_t offset = static_cast<size_t>(scanned_ & (capacity_ - 1));
+    size_t span = static_cast<size_t>(std::min<uint64_t>(tail_ - scanned_, capacity_ - offset));
+    size_t found = FindDelimiter(&ring_[offset], span, '\n');
+    scanned_ += found;
+    if (found == span) {
+      continue;  // On to the part behind the wrap, if any
+    }
+
+    uint64_t length = scanned_ - head_;
+    if (discarding_) {
+      discarding_ = false;
+    } else if (length > max_record_length_) {
+      ++dropped_;
+    } else {
+      Deliver(head_, static_cast<size_t>(length), on_record);
+    }
+    head_ = ++scanned_;
+  }
+
+  // A pending record over the limit can never be delivered; dropping its
+  // bytes right away keeps room in the ring for the next read.
+  if (!discarding_ && tail_ - head_ > max_record_length_) {
+    discarding_ = true;
+    ++dropped_;
+  }
+  if (discarding_) {
+    head_ = tail_;
+  }
+}
+
+void RecordReader::Deliver(uint64_t start, size_t length, const RecordHandler& on_record) {
+  size_t offset = static_cast<size_t>(start & (capacity_ - 1));
+  const char* data = &ring_[offset];
+  if (offset + length > capacity_) {
+    size_t first = capacity_ - offset;
+    scratch_.assign(data, first);
+    scratch_.append(&ring_[0], length - first);
+    data = scratch_.data();
+  }
+  if (length > 0 && data[length - 1] == '\r') {
+    --length;
+  }
+  on_record(data, length);
+}
+
+}  // namespace flutter_ipc
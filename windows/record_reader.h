@@ -0,0 +1,77 @@
+#ifndef FLUTTER_PLUGIN_RECORD_READER_H_
+#define FLUTTER_PLUGIN_RECORD_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace flutter_ipc {
+
+// Returns the offset of the first |delimiter| in |data|, or |size| if there
+// is none. Scans 128 bytes per iteration with AVX2 when the processor has
+// it, 16 with SSE2 otherwise.
+size_t FindDelimiter(const char* data, size_t size, char delimiter);
+
+// The portable implementation, one byte at a time. For tests and
+// benchmarks.
+size_t FindDelimiterScalar(const char* data, size_t size, char delimiter);
+
+// Which implementation FindDelimiter uses on this processor: "avx2",
+// "sse2" or "scalar".
+const char* DelimiterScannerName();
+
+// Cuts newline-delimited records out of a byte stream, for peers that write
+// lines instead of frames. The stream is read straight into a ring buffer
+// and records are handed out as slices of it, so a record is only copied
+// when it wraps around the end of the ring. A CR before the newline is
+// dropped with it.
+//
+// A record longer than |max_record_length| bytes is dropped whole, and
+// reading resumes after its newline. Not thread-safe.
+class RecordReader {
+ public:
+  // |data| is only valid during the call.
+  using RecordHandler = std::function<void(const char* data, size_t size)>;
+
+  static constexpr size_t kReadSize = 64 * 1024;
+
+  explicit RecordReader(size_t max_record_length);
+
+  // Disallow copy and assign.
+  RecordReader(const RecordReader&) = delete;
+  RecordReader& operator=(const RecordReader&) = delete;
+
+  // The free space of the ring to read into next, contiguous and never
+  // empty.
+  char* ReadBuffer(size_t* size);
+
+  // Takes |size| bytes that were read into ReadBuffer() and passes every
+  // record they complete to |on_record|, in order.
+  void Commit(size_t size, const RecordHandler& on_record);
+
+  // Records dropped for being too long.
+  uint64_t dropped() const { return dropped_; }
+
+ private:
+  void Deliver(uint64_t start, size_t length, const RecordHandler& on_record);
+
+  size_t max_record_length_;
+  size_t capacity_;  // A power of two
+  std::unique_ptr<char[]> ring_;
+  // Stream offsets: the start of the pending record, how far the pending
+  // bytes have been searched for a newline, and the end of the data.
+  uint64_t head_ = 0;
+  uint64_t scanned_ = 0;
+  uint64_t tail_ = 0;
+  // Set while skipping the rest of a record that grew too long.
+  bool discarding_ = false;
+  uint64_t dropped_ = 0;
+  // Holds a record that wraps around the end of the ring.
+  std::string scratch_;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_RECORD_READER_H_
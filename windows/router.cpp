@@ -0,0 +1,79 @@
+#include "router.h"
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace flutter_ipc {
+
+void FrameRouter::AddMember(const std::string& id, Sender send) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  members_[id] = std::move(send);
+}
+
+void FrameRouter::RemoveMember(const std::string& id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  members_.erase(id);
+}
+
+void FrameRouter::SetRoute(uint16_t channel, std::set<std::string> destinations) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (destinations.empty()) {
+    routes_.erase(channel);
+  } else {
+    routes_[channel] = std::move(destinations);
+  }
+}
+
+bool FrameRouter::Route(const std::string& from, Frame* frame, std::function<void()>* consumed) {
+  // Held while sending, so RemoveMember() waits for us.
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto route_it = frame->type == FrameType::HANDLES ? routes_.end() : routes_.find(frame->channel);
+  if (route_it == routes_.end()) {
+    ++stats_.unrouted;
+    return false;
+  }
+  
+  std::vector<const Sender*> destinations;
+  for (const auto& id : route_it->second) {
+    auto member_it = members_.find(id);
+    if (id != from && member_it != members_.end()) {
+      destinations.push_back(&member_it->second);
+    }
+  }
+  if (destinations.empty()) {
+    ++stats_.unrouted;
+    return false;
+  }
+  
+  auto remaining = std::make_shared<std::atomic<size_t>>(destinations.size());
+  auto on_sent = [remaining, consumed = std::move(*consumed)]() {
+    if (--*remaining == 0) {
+      consumed();
+    }
+  };
+  PrepareForward(frame);
+  for (size_t i = 0; i < destinations.size(); ++i) {
+    // Only fan-out copies the payload; the last destination takes it.
+    Frame copy = i + 1 < destinations.size() ? *frame : std::move(*frame);
+    if (!(*destinations[i])(std::move(copy), [on_sent](bool success, uint32_t error) { on_sent(); })) {
+      ++stats_.dropped;
+      on_sent();
+    }
+  }
+  ++stats_.forwarded;
+  return true;
+}
+
+// static
+void FrameRouter::PrepareForward(Frame* frame) {
+  frame->flags &= kFrameFlagKeyed;
+}
+
+RouterStats FrameRouter::GetStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+}  // namespace flutter_ipc
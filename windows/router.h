@@ -0,0 +1,72 @@
+#ifndef FLUTTER_PLUGIN_ROUTER_H_
+#define FLUTTER_PLUGIN_ROUTER_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "channel_mux.h"
+#include "frame.h"
+
+namespace flutter_ipc {
+
+struct RouterStats {
+  uint64_t forwarded = 0;   // Frames taken by a route
+  uint64_t unrouted = 0;    // Frames left for the hub
+  uint64_t dropped = 0;     // Copies a destination refused
+};
+
+// Native broker shared by a group of servers. A route maps a channel of the
+// frame header, used as a topic or as the address of a destination, to the
+// member servers it is forwarded to. Matching frames move straight from the
+// source's I/O thread into the destinations' send queues, payload
+// untouched; everything else is left to the hub application.
+class FrameRouter {
+ public:
+  // Queues a frame on a member's connection, as NamedPipeServer::SendFrame
+  // does.
+  using Sender = std::function<bool(Frame frame, SendCompletion on_complete)>;
+
+  FrameRouter() = default;
+
+  // Disallow copy and assign.
+  FrameRouter(const FrameRouter&) = delete;
+  FrameRouter& operator=(const FrameRouter&) = delete;
+
+  // Called by NamedPipeServer::SetRouter.
+  void AddMember(const std::string& id, Sender send);
+  // Once this returns the router no longer sends to |id|.
+  void RemoveMember(const std::string& id);
+
+  // Routes |channel| to the members in |destinations|. An empty set removes
+  // the route.
+  void SetRoute(uint16_t channel, std::set<std::string> destinations);
+
+  // Forwards |frame|, received by member |from|, along its route. Returns
+  // false, leaving both arguments alone, if the frame is not routed. Frames
+  // are never sent back to their source, and frames carrying handles are
+  // never routed since the handles were duplicated into this process.
+  // |consumed| runs once every copy has left its destination's queue, so a
+  // slow destination throttles the sender.
+  bool Route(const std::string& from, Frame* frame, std::function<void()>* consumed);
+
+  // Readies a received |frame| for the next hop: flags that described its
+  // encoding on the way in are cleared, but a state-sync key stays with
+  // its payload so that the destination still syncs and conflates by it.
+  static void PrepareForward(Frame* frame);
+
+  RouterStats GetStats();
+
+ private:
+  std::mutex mutex_;
+  std::map<std::string, Sender> members_;
+  std::map<uint16_t, std::set<std::string>> routes_;
+  RouterStats stats_;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_ROUTER_H_
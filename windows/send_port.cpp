@@ -0,0 +1,39 @@
+#include "send_port.h"
+
+#include <windows.h>
+
+#include <mutex>
+#include <utility>
+
+namespace flutter_ipc {
+
+// static
+SendPortRegistry& SendPortRegistry::GetInstance() {
+  static SendPortRegistry instance;
+  return instance;
+}
+
+int64_t SendPortRegistry::Open(Sender sender) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  int64_t port = next_port_++;
+  senders_[port] = std::move(sender);
+  return port;
+}
+
+void SendPortRegistry::Close(int64_t port) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  senders_.erase(port);
+}
+
+bool SendPortRegistry::Send(int64_t port, Frame frame) {
+  // Held shared across the send, so that Close() waits for it.
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  auto sender = senders_.find(port);
+  if (sender == senders_.end()) {
+    SetLastError(ERROR_INVALID_HANDLE);
+    return false;
+  }
+  return sender->second(std::move(frame));
+}
+
+}  // namespace flutter_ipc
@@ -0,0 +1,44 @@
+#ifndef FLUTTER_PLUGIN_SEND_PORT_H_
+#define FLUTTER_PLUGIN_SEND_PORT_H_
+
+#include <cstdint>
+#include <functional>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "frame.h"
+
+namespace flutter_ipc {
+
+// Process-wide table of connections that accept frames by number, for
+// senders that cannot hold a pointer to one: native threads and Dart
+// isolates, through the C API. Sends through different ports, or the same
+// one, never wait for each other; only opening and closing a port does.
+class SendPortRegistry {
+ public:
+  // Queues a frame; reports failures through GetLastError().
+  using Sender = std::function<bool(Frame frame)>;
+
+  static SendPortRegistry& GetInstance();
+
+  // Returns a new port for |sender|. Ports are never reused.
+  int64_t Open(Sender sender);
+  // Returns once no send through |port| is under way, after which its
+  // sender is never called again.
+  void Close(int64_t port);
+
+  // Returns false, with ERROR_INVALID_HANDLE if |port| is closed or with
+  // the error of its sender.
+  bool Send(int64_t port, Frame frame);
+
+ private:
+  SendPortRegistry() = default;
+
+  std::shared_mutex mutex_;
+  std::unordered_map<int64_t, Sender> senders_;
+  int64_t next_port_ = 1;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_SEND_PORT_H_
@@ -0,0 +1,535 @@
+#include "send_queue.h"
+
+#include <windows.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace flutter_ipc {
+
+SendQueue::SendQueue(ChunkWriter writer, const ConnectionOptions& options,
+                     std::shared_ptr<MemoryAccount> memory)
+    : writer_(std::move(writer)),
+      scheduler_(options.chunk_size),
+      flow_(options.receive_window),
+      blob_decoder_(options.blob_cache_bytes),
+      state_decoder_(options.state_cache_bytes),
+      memory_(std::move(memory)),
+      max_queued_bytes_(options.max_queued_bytes),
+      coalesce_bytes_(options.coalesce_bytes),
+      polling_(options.polling),
+      flow_control_(options.framing == Framing::LENGTH_PREFIXED) {
+  if (options.profile == TuningProfile::AUTO) {
+    tuner_ = std::make_unique<AutoTuner>();
+  }
+  if (options.blob_cache_bytes != 0 && flow_control_) {
+    blob_encoder_ = std::make_unique<BlobEncoder>(options.blob_cache_bytes, options.blob_min_bytes);
+  }
+  if (options.state_cache_bytes != 0 && flow_control_) {
+    state_sync_ = std::make_shared<StateSync>(options.state_cache_bytes);
+  }
+  // The peer may not send anything until we announce our window.
+  if (flow_control_) {
+    control_frames_.push_back(EncodeCreditFrame(flow_.receive_window().bytes,
+                                                flow_.receive_window().messages));
+  }
+  thread_ = std::thread(&SendQueue::Run, this);
+}
+
+SendQueue::~SendQueue() {
+  Stop();
+}
+
+bool SendQueue::Enqueue(Frame frame, SendCompletion completion, uint32_t timeout_ms) {
+  auto pending = std::make_shared<PendingFrame>();
+  pending->frame = std::move(frame);
+  pending->completion = std::move(completion);
+  // Keyed frames of state-sync channels become diffs first, and the blob
+  // cache sees the result. The lock is held until the frame is queued, so
+  // that diffs go out in the order they were taken, but the writer is not
+  // held up by the diffing.
+  std::unique_lock<std::mutex> state_lock;
+  std::string key;
+  bool keyed = ReadStateKey(pending->frame, &key);
+  if (state_sync_ && keyed) {
+    state_lock = std::unique_lock<std::mutex>(state_sync_->mutex);
+    auto interval = state_sync_->intervals.find(pending->frame.channel);
+    if (interval == state_sync_->intervals.end()) {
+      state_lock.unlock();
+    } else {
+      {
+        // An update about to replace an unsent one goes in full; the peer
+        // never sees the version in between.
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (FindReplaceable(pending->frame.channel, key)) {
+          state_sync_->encoder.Resync(pending->frame.channel, key);
+        }
+      }
+      state_sync_->encoder.Encode(&pending->frame, interval->second);
+      // The peer never sees a dropped update, so the next one goes in full.
+      std::weak_ptr<StateSync> weak_state = state_sync_;
+      uint16_t channel = pending->frame.channel;
+      pending->completion = [weak_state, channel, key, completion = std::move(pending->completion)](bool success, uint32_t error) {
+        auto state = weak_state.lock();
+        if (!success && state) {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          state->encoder.Resync(channel, key);
+        }
+        if (completion) {
+          completion(success, error);
+        }
+      };
+    }
+  }
+  // Hashed before taking the lock; the encoder itself has to see frames
+  // in queue order.
+  size_t data_offset = 0;
+  BlobDigest digest;
+  bool dedupe = blob_encoder_ && blob_encoder_->Eligible(pending->frame, &data_offset);
+  if (dedupe) {
+    digest = HashBlob(pending->frame.payload.data() + data_offset, pending->frame.payload.size() - data_offset);
+  }
+  if (!keyed && !dedupe && timeout_ms == 0) {
+    return Post(pending);
+  }
+  std::shared_ptr<PendingFrame> replaced;
+  if (!Admit(pending, keyed ? &key : nullptr, dedupe ? &digest : nullptr, data_offset, timeout_ms, &replaced)) {
+    if (state_lock.owns_lock()) {
+      state_sync_->encoder.Resync(pending->frame.channel, key);
+    }
+    return false;
+  }
+  if (state_lock.owns_lock()) {
+    state_lock.unlock();
+  }
+  Wake();
+  // Its value is superseded by one that is still on its way.
+  if (replaced) {
+    CancelDeadline(*replaced);
+    if (replaced->completion) {
+      replaced->completion(true, ERROR_SUCCESS);
+    }
+  }
+  return true;
+}
+
+std::shared_ptr<PendingFrame> SendQueue::FindReplaceable(uint16_t channel, const std::string& key) {
+  auto queued = scheduler_.FindConflatable(channel, key);
+  // A stored blob may carry evictions the peer has to see, and a frame
+  // numbered for an ordered pool or a session leaves a gap the peer would
+  // wait on.
+  if (queued && (queued->frame.flags & (kFrameFlagBlob | kFrameFlagStriped | kFrameFlagSequenced))) {
+    return nullptr;
+  }
+  return queued;
+}
+
+bool SendQueue::Post(const std::shared_ptr<PendingFrame>& pending) {
+  // Announced before |stopping_| is read, so FailAll() waits for this post.
+  posting_.fetch_add(1);
+  if (stopping_.load()) {
+    posting_.fetch_sub(1);
+    SetLastError(ERROR_NO_DATA); // Same error as writing to a closed pipe
+    return false;
+  }
+  size_t size = pending->frame.payload.size();
+  if (!Reserve(size, 0)) {
+    posting_.fetch_sub(1);
+    SetLastError(ERROR_NOT_ENOUGH_QUOTA);
+    return false;
+  }
+  if (memory_ && !memory_->ChargeSend(size)) {
+    queued_bytes_ -= size;
+    posting_.fetch_sub(1);
+    SetLastError(ERROR_NOT_ENOUGH_QUOTA);
+    return false;
+  }
+  posted_.Push(pending);
+  posting_.fetch_sub(1);
+  wakeups_.fetch_add(1);
+  if (sleeping_.load()) {
+    // The writer holds the lock until it waits, so this notify reaches it.
+    std::lock_guard<std::mutex> lock(mutex_);
+    wakeup_.notify_one();
+  }
+  return true;
+}
+
+bool SendQueue::Reserve(size_t size, size_t replaced) {
+  size_t queued = queued_bytes_.load(std::memory_order_relaxed);
+  do {
+    // A single oversized frame is still accepted into an empty queue.
+    if (queued != 0 && queued - replaced + size > max_queued_bytes_) {
+      return false;
+    }
+  } while (!queued_bytes_.compare_exchange_weak(queued, queued + size, std::memory_order_relaxed));
+  return true;
+}
+
+void SendQueue::DrainPosted() {
+  std::shared_ptr<PendingFrame> pending;
+  while (posted_.Pop(&pending)) {
+    size_t chunk_size = 0;
+    if (tuner_ && tuner_->Observe(pending->frame.payload.size(), &chunk_size, &coalesce_bytes_)) {
+      scheduler_.SetChunkSize(chunk_size);
+    }
+    scheduler_.Enqueue(std::move(pending));
+  }
+}
+
+bool SendQueue::Admit(const std::shared_ptr<PendingFrame>& pending, const std::string* key,
+                      const BlobDigest* digest, size_t data_offset, uint32_t timeout_ms,
+                      std::shared_ptr<PendingFrame>* replaced) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (stopping_) {
+    SetLastError(ERROR_NO_DATA); // Same error as writing to a closed pipe
+    return false;
+  }
+  // Frames posted before this one go first.
+  DrainPosted();
+  // A stored blob that is refused below, or dropped later, is stored
+  // again the next time: references wait for the peer's confirmation.
+  if (digest) {
+    blob_encoder_->Encode(&pending->frame, data_offset, *digest);
+  }
+  size_t size = pending->frame.payload.size();
+  std::shared_ptr<PendingFrame> queued = key ? FindReplaceable(pending->frame.channel, *key) : nullptr;
+  size_t queued_size = queued ? queued->frame.payload.size() : 0;
+  if (!Reserve(size, queued_size)) {
+    SetLastError(ERROR_NOT_ENOUGH_QUOTA);
+    return false;
+  }
+  if (memory_ && !memory_->ChargeSend(size)) {
+    queued_bytes_ -= size;
+    SetLastError(ERROR_NOT_ENOUGH_QUOTA);
+    return false;
+  }
+  size_t chunk_size = 0;
+  if (tuner_ && tuner_->Observe(size, &chunk_size, &coalesce_bytes_)) {
+    scheduler_.SetChunkSize(chunk_size);
+  }
+  if (timeout_ms != 0) {
+    if (!timers_) {
+      timers_ = TimerService::Acquire();
+    }
+    // Held weakly, so a frame that is long gone does not linger.
+    std::weak_ptr<PendingFrame> weak_pending = pending;
+    pending->deadline_timer = timers_->Schedule(timeout_ms, [weak_pending]() {
+      auto expired = weak_pending.lock();
+      if (expired && expired->Drop() && expired->completion) {
+        expired->completion(false, ERROR_TIMEOUT);
+      }
+    });
+  }
+  if (!queued) {
+    scheduler_.Enqueue(pending, key);
+    return true;
+  }
+  queued_bytes_ -= queued_size;
+  if (memory_) {
+    memory_->ReleaseSend(queued_size);
+  }
+  scheduler_.Replace(queued, pending);
+  ++conflated_;
+  // Settled by the caller, unless its deadline got to it first.
+  if (queued->Drop()) {
+    *replaced = std::move(queued);
+  }
+  return true;
+}
+
+void SendQueue::ConfigureChannel(uint16_t channel, ChannelOptions options) {
+  if (state_sync_) {
+    std::lock_guard<std::mutex> lock(state_sync_->mutex);
+    if (options.state_sync) {
+      state_sync_->intervals[channel] = options.snapshot_interval;
+    } else {
+      state_sync_->intervals.erase(channel);
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  scheduler_.ConfigureChannel(channel, options);
+}
+
+void SendQueue::OnCreditFrame(const Frame& frame) {
+  uint32_t bytes = 0;
+  uint32_t messages = 0;
+  if (!DecodeCreditFrame(frame, &bytes, &messages)) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    flow_.OnCredit(bytes, messages);
+  }
+  Wake();
+}
+
+bool SendQueue::DecodeBlob(Frame* frame) {
+  if (!(frame->flags & kFrameFlagBlob)) {
+    return true;
+  }
+  std::vector<BlobHeld> held;
+  bool restored = false;
+  {
+    std::lock_guard<std::mutex> lock(decode_mutex_);
+    restored = blob_decoder_.Decode(frame, &held);
+  }
+  if (!held.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_held_.insert(pending_held_.end(), held.begin(), held.end());
+    }
+    Wake();
+  }
+  return restored;
+}
+
+bool SendQueue::DecodeState(Frame* frame) {
+  if (!(frame->flags & kFrameFlagKeyed)) {
+    return true;
+  }
+  std::lock_guard<std::mutex> lock(decode_mutex_);
+  return state_decoder_.Decode(frame);
+}
+
+void SendQueue::OnBlobFrame(const Frame& frame) {
+  std::vector<BlobHeld> held;
+  if (!DecodeBlobHeldFrame(frame, &held)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (blob_encoder_) {
+    blob_encoder_->OnHeld(held);
+  }
+}
+
+void SendQueue::SendControl(Frame frame) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    control_frames_.push_back(std::move(frame));
+  }
+  Wake();
+}
+
+void SendQueue::Acknowledge(uint16_t channel, uint64_t sequence) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t& pending = pending_acks_[channel];
+    pending = std::max(pending, sequence);
+  }
+  Wake();
+}
+
+void SendQueue::OnReceived(size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  flow_.OnReceived(bytes);
+}
+
+void SendQueue::OnConsumed(size_t bytes) {
+  uint32_t grant_bytes = 0;
+  uint32_t grant_messages = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_ || !flow_.OnConsumed(bytes, &grant_bytes, &grant_messages) || !flow_control_) {
+      return;
+    }
+    control_frames_.push_back(EncodeCreditFrame(grant_bytes, grant_messages));
+  }
+  Wake();
+}
+
+FlowStats SendQueue::GetStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  DrainPosted();
+  FlowStats stats = flow_.Stats(FlowController::Clock::now());
+  stats.queued_frames = scheduler_.QueuedFrames();
+  stats.conflated_frames = conflated_;
+  stats.chunk_size = scheduler_.chunk_size();
+  stats.coalesce_bytes = coalesce_bytes_;
+  return stats;
+}
+
+BlobStats SendQueue::GetBlobStats() {
+  BlobStats stats;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (blob_encoder_) {
+      blob_encoder_->AddStats(&stats);
+    }
+  }
+  std::lock_guard<std::mutex> lock(decode_mutex_);
+  blob_decoder_.AddStats(&stats);
+  return stats;
+}
+
+StateSyncStats SendQueue::GetStateSyncStats() {
+  StateSyncStats stats;
+  if (state_sync_) {
+    std::lock_guard<std::mutex> lock(state_sync_->mutex);
+    state_sync_->encoder.AddStats(&stats);
+  }
+  std::lock_guard<std::mutex> lock(decode_mutex_);
+  state_decoder_.AddStats(&stats);
+  return stats;
+}
+
+size_t SendQueue::queued_bytes() {
+  return queued_bytes_.load(std::memory_order_relaxed);
+}
+
+void SendQueue::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  Wake();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void SendQueue::Wake() {
+  wakeups_.fetch_add(1, std::memory_order_release);
+  wakeup_.notify_one();
+}
+
+void SendQueue::Run() {
+  ApplyPollingOptions(polling_);
+  SpinWait spin(polling_.spin_us);
+  // Set after a spin that found nothing, so the next idle pass blocks.
+  bool spun = false;
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto has_credit = [this]() { return !flow_control_ || flow_.CanSend(); };
+  while (true) {
+    DrainPosted();
+    bool can_send = !scheduler_.IsEmpty() && has_credit();
+    flow_.SetStalled(!scheduler_.IsEmpty() && !has_credit(), FlowController::Clock::now());
+    if (stopping_) {
+      FailAll(lock, ERROR_OPERATION_ABORTED);
+      return;
+    }
+    if (!pending_acks_.empty()) {
+      control_frames_.push_back(EncodeAckFrame(pending_acks_));
+      pending_acks_.clear();
+    }
+    if (!pending_held_.empty()) {
+      control_frames_.push_back(EncodeBlobHeldFrame(pending_held_));
+      pending_held_.clear();
+    }
+    if (control_frames_.empty() && !can_send) {
+      if (spin.enabled() && !spun) {
+        // The state is checked again under the lock afterwards, so a change
+        // whose wakeup was missed while spinning is not lost.
+        uint64_t seen = wakeups_.load(std::memory_order_acquire);
+        lock.unlock();
+        spun = !spin.Until([&] { return wakeups_.load(std::memory_order_acquire) != seen; });
+        lock.lock();
+        continue;
+      }
+      // Posts take no lock, so look once more after saying so; a post the
+      // look misses sees |sleeping_| and notifies under the lock.
+      sleeping_.store(true);
+      if (posted_.Empty()) {
+        wakeup_.wait(lock);
+      }
+      sleeping_.store(false);
+      spun = false;
+      continue;
+    }
+    spun = false;
+
+    // Control frames go first. With a batching window, more chunks join
+    // the batch until it fills up; without one, every chunk goes alone.
+    std::vector<FrameChunk> batch;
+    size_t batch_bytes = 0;
+    auto has_room = [&]() { return batch.empty() || batch_bytes < coalesce_bytes_; };
+    while (!control_frames_.empty() && has_room()) {
+      FrameChunk chunk;
+      chunk.owner = std::make_shared<PendingFrame>();
+      chunk.owner->frame = std::move(control_frames_.front());
+      chunk.length = chunk.owner->frame.payload.size();
+      chunk.last = true;
+      control_frames_.pop_front();
+      batch_bytes += sizeof(FrameHeader) + chunk.length;
+      batch.push_back(std::move(chunk));
+    }
+    while (!scheduler_.IsEmpty() && has_credit() && has_room()) {
+      FrameChunk chunk;
+      scheduler_.NextChunk(&chunk);
+      if (chunk.last) {
+        queued_bytes_ -= chunk.owner->frame.payload.size();
+        if (memory_) {
+          memory_->ReleaseSend(chunk.owner->frame.payload.size());
+        }
+      }
+      // A frame whose deadline passed while queued is skipped chunk by
+      // chunk; its completion has run already.
+      if (!chunk.owner->Start()) {
+        continue;
+      }
+      flow_.OnSent(chunk.length, chunk.last);
+      batch_bytes += sizeof(FrameHeader) + chunk.length;
+      batch.push_back(std::move(chunk));
+    }
+    if (batch.empty()) {
+      continue; // Only expired frames
+    }
+
+    // Write without the lock so producers can keep queueing.
+    lock.unlock();
+    bool success = writer_(batch);
+    DWORD error = success ? ERROR_SUCCESS : GetLastError();
+    // A frame whose last chunk was in a failed batch fails here; a
+    // partially sent frame is still in the scheduler and fails below.
+    for (auto& chunk : batch) {
+      if (!chunk.last) {
+        continue;
+      }
+      CancelDeadline(*chunk.owner);
+      if (chunk.owner->completion) {
+        chunk.owner->completion(success, error);
+      }
+    }
+    lock.lock();
+
+    if (!success) {
+      // The transport is broken; nothing queued behind this batch can make
+      // it either.
+      stopping_ = true;
+      FailAll(lock, error);
+      return;
+    }
+  }
+}
+
+void SendQueue::FailAll(std::unique_lock<std::mutex>& lock, uint32_t error) {
+  // Once |stopping_| is set, the posts still under way are the last.
+  while (posting_.load() != 0) {
+    std::this_thread::yield();
+  }
+  DrainPosted();
+  auto frames = scheduler_.TakeAll();
+  if (memory_) {
+    memory_->ReleaseSend(queued_bytes_);
+  }
+  queued_bytes_ = 0;
+  lock.unlock();
+  for (auto& frame : frames) {
+    // Once the deadline cannot fire any more, the frame is ours unless it
+    // expired already.
+    CancelDeadline(*frame);
+    bool queued = frame->Drop();
+    if (frame->completion && (queued || !frame->dropped())) {
+      frame->completion(false, error);
+    }
+  }
+  lock.lock();
+}
+
+void SendQueue::CancelDeadline(const PendingFrame& frame) {
+  if (frame.deadline_timer != 0) {
+    timers_->Cancel(frame.deadline_timer);
+  }
+}
+
+}  // namespace flutter_ipc
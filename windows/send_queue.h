@@ -0,0 +1,198 @@
+#ifndef FLUTTER_PLUGIN_SEND_QUEUE_H_
+#define FLUTTER_PLUGIN_SEND_QUEUE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "blob_cache.h"
+#include "channel_mux.h"
+#include "connection_options.h"
+#include "flow_control.h"
+#include "memory_budget.h"
+#include "mpsc_queue.h"
+#include "session.h"
+#include "state_sync.h"
+#include "timing_wheel.h"
+
+namespace flutter_ipc {
+
+// Writes a batch of chunks to the transport, in order. Runs on the send
+// queue's thread and reports failures through GetLastError().
+using ChunkWriter = std::function<bool(std::vector<FrameChunk>& chunks)>;
+
+// Outbound frames of one connection. Frames are queued per channel and a
+// dedicated writer thread drains them in scheduler order, so callers never
+// block on a full pipe. The writer only sends within the credit granted by
+// the peer, and the queue also grants credit back for frames received on
+// the same connection as they are consumed. With newline framing there is
+// no credit and frames go out as soon as they are queued.
+//
+// The queue also keeps both halves of the connection's blob cache and
+// state sync: large payloads it has sent before go out as references,
+// keyed updates on state-sync channels go out as diffs, and frames from
+// the peer are restored with DecodeBlob() and DecodeState().
+//
+// Any number of threads may queue frames at once. Frames that depend on
+// nothing else queued (no key, no cached blob, no deadline) are posted to
+// a lock-free queue that the writer drains, so producers do not contend
+// for the lock; the others are queued under it, behind every frame posted
+// before them.
+class SendQueue {
+ public:
+  // Frames queued beyond |options.max_queued_bytes| are refused, so a
+  // sender that outpaces its peer cannot grow the queue without bound.
+  // Queued payloads are also charged to |memory|, if given, which may
+  // refuse them as well.
+  SendQueue(ChunkWriter writer, const ConnectionOptions& options,
+            std::shared_ptr<MemoryAccount> memory = nullptr);
+  ~SendQueue();
+
+  // Disallow copy and assign.
+  SendQueue(const SendQueue&) = delete;
+  SendQueue& operator=(const SendQueue&) = delete;
+
+  // Queues |frame|. |completion| (which may be null) runs on the writer
+  // thread once the frame is written or dropped, or on the caller's once a
+  // newer frame of its key replaces it on a conflating channel. Returns false, with
+  // ERROR_NO_DATA if the queue has stopped or ERROR_NOT_ENOUGH_QUOTA if it
+  // is full or over its memory budget; |completion| is not called in that
+  // case. A frame not started within |timeout_ms| (0 for no deadline) is
+  // dropped, and |completion| fails with ERROR_TIMEOUT on the timer thread.
+  // Thread-safe; frames from one thread go out in the order queued.
+  bool Enqueue(Frame frame, SendCompletion completion, uint32_t timeout_ms = 0);
+
+  void ConfigureChannel(uint16_t channel, ChannelOptions options);
+
+  // Applies a CREDIT frame received from the peer.
+  void OnCreditFrame(const Frame& frame);
+
+  // Restores a frame the peer sent through its blob cache, and confirms
+  // the blobs it stores to the peer. Returns false if the frame cannot be
+  // restored and has to be dropped. Called by the reading thread, in the
+  // order frames arrive.
+  bool DecodeBlob(Frame* frame);
+  // Applies a BLOB frame received from the peer.
+  void OnBlobFrame(const Frame& frame);
+  // Restores the full value of a keyed frame the peer sent as a diff.
+  // Returns false if the frame has to be dropped. Called by the reading
+  // thread after DecodeBlob().
+  bool DecodeState(Frame* frame);
+
+  // Queues a control frame ahead of all data, outside flow control.
+  void SendControl(Frame frame);
+
+  // Records that the sequenced frame |sequence| of |channel| arrived.
+  // Acknowledgements pending while the writer is busy are coalesced into a
+  // single ACK frame.
+  void Acknowledge(uint16_t channel, uint64_t sequence);
+
+  // Accounting for frames received from the peer: every frame passed to
+  // OnReceived must later be passed to OnConsumed once the application has
+  // taken it, from any thread.
+  void OnReceived(size_t bytes);
+  void OnConsumed(size_t bytes);
+
+  FlowStats GetStats();
+  BlobStats GetBlobStats();
+  StateSyncStats GetStateSyncStats();
+  // Payload bytes waiting to be written.
+  size_t queued_bytes();
+
+  const std::shared_ptr<MemoryAccount>& memory() const { return memory_; }
+
+  // Stops the writer thread. Frames still queued fail with
+  // ERROR_OPERATION_ABORTED.
+  void Stop();
+
+ private:
+  // The sending half of state sync. Shared with the completions of keyed
+  // frames, which may run on the timer thread after the queue is gone.
+  struct StateSync {
+    explicit StateSync(size_t capacity) : encoder(capacity) {}
+
+    std::mutex mutex;
+    StateEncoder encoder;
+    // Snapshot interval of every state-sync channel.
+    std::unordered_map<uint16_t, uint32_t> intervals;
+  };
+
+  // The unsent frame a frame of |key| on |channel| would replace, or null.
+  // Called under |mutex_|.
+  std::shared_ptr<PendingFrame> FindReplaceable(uint16_t channel, const std::string& key);
+  // Queues |pending| without the lock.
+  bool Post(const std::shared_ptr<PendingFrame>& pending);
+  // Counts |size| bytes against the queue limit, unless they would exceed
+  // it with |replaced| bytes taken out.
+  bool Reserve(size_t size, size_t replaced);
+  // Moves posted frames to the scheduler. Called under |mutex_|.
+  void DrainPosted();
+  // Queues |pending| whose blob payload, if |digest| is set, hashes to it.
+  // A keyed frame on a conflating channel may take the place of an unsent
+  // one, which is moved to |replaced| for the caller to complete.
+  bool Admit(const std::shared_ptr<PendingFrame>& pending, const std::string* key,
+             const BlobDigest* digest, size_t data_offset, uint32_t timeout_ms,
+             std::shared_ptr<PendingFrame>* replaced);
+  void Run();
+  // Wakes the writer after a change made under |mutex_|.
+  void Wake();
+  void FailAll(std::unique_lock<std::mutex>& lock, uint32_t error);
+  // Called without |mutex_| once |frame| is settled.
+  void CancelDeadline(const PendingFrame& frame);
+
+  ChunkWriter writer_;
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  // Bumped by Wake(), so a spinning writer notices work without the lock.
+  std::atomic<uint64_t> wakeups_{0};
+  // Set while the writer waits on |wakeup_|; posting producers then wake
+  // it under |mutex_|, so that the wakeup cannot be missed.
+  std::atomic<bool> sleeping_{false};
+  // Frames queued without the lock, in the order they were posted.
+  MpscQueue<std::shared_ptr<PendingFrame>> posted_;
+  // Producers between their check of |stopping_| and their post.
+  std::atomic<int> posting_{0};
+  ChannelScheduler scheduler_;
+  FlowController flow_;
+  // Control frames bypass the scheduler and flow control.
+  std::deque<Frame> control_frames_;
+  AckMap pending_acks_;
+  // Set with a blob cache and LENGTH_PREFIXED framing. Used under |mutex_|,
+  // so that it sees frames in queue order.
+  std::unique_ptr<BlobEncoder> blob_encoder_;
+  std::vector<BlobHeld> pending_held_;
+  // Set with a state cache and LENGTH_PREFIXED framing.
+  std::shared_ptr<StateSync> state_sync_;
+  // The decoders are used by the reading thread; the lock is for the
+  // stats.
+  std::mutex decode_mutex_;
+  BlobDecoder blob_decoder_;
+  StateDecoder state_decoder_;
+  // Reserved by producers before they queue, so posts need no lock.
+  std::atomic<size_t> queued_bytes_{0};
+  uint64_t conflated_ = 0;
+  std::shared_ptr<MemoryAccount> memory_;
+  // Acquired with the first deadline.
+  std::shared_ptr<TimerService> timers_;
+  size_t max_queued_bytes_;
+  size_t coalesce_bytes_;
+  // Set for TuningProfile::AUTO only.
+  std::unique_ptr<AutoTuner> tuner_;
+  PollingOptions polling_;
+  // Off for newline framing, whose peers never grant credit.
+  bool flow_control_;
+  // Written under |mutex_|; read without it by posting producers.
+  std::atomic<bool> stopping_{false};
+  std::thread thread_;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_SEND_QUEUE_H_
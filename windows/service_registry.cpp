@@ -0,0 +1,437 @@
+#include "service_registry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <utility>
+
+namespace flutter_ipc {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t kRegistryMagic = 0x53435049;  // "IPCS"
+constexpr uint32_t kRegistryVersion = 1;
+
+uint64_t FileTimeValue(const FILETIME& time) {
+  return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+}
+
+// Milliseconds left until |deadline|, rounded up.
+uint32_t MillisecondsUntil(Clock::time_point deadline) {
+  Clock::duration left = deadline - Clock::now();
+  if (left <= Clock::duration::zero()) {
+    return 0;
+  }
+  auto milliseconds = std::chrono::ceil<std::chrono::milliseconds>(left).count();
+  return static_cast<uint32_t>(std::min<int64_t>(milliseconds, INFINITE - 1));
+}
+
+}  // namespace
+
+// Lives at the start of the shared memory, which the paging file hands
+// over zeroed. The counters are lock-free atomics and so work across
+// processes.
+struct ServiceRegistry::Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity;
+  // Threads in WaitForChange(), of every process.
+  std::atomic<int32_t> waiters;
+  std::atomic<uint64_t> generation;
+  uint8_t reserved[40];
+};
+
+// Guarded by the named mutex.
+struct ServiceRegistry::Entry {
+  char name[kMaxNameLength + 1];
+  uint32_t process_id;
+  // ServiceState, or 0 for a free slot.
+  uint32_t state;
+  uint32_t capacity;
+  uint32_t reserved;
+  // A FILETIME, to tell the process from a later one with its ID.
+  uint64_t process_start;
+  uint64_t generation;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared counters must be lock-free");
+
+// static
+ServiceRegistry& ServiceRegistry::GetInstance() {
+  // The layout version is part of the name, so builds that disagree on it
+  // keep to registries of their own.
+  static ServiceRegistry instance("flutter_ipc_services_v1");
+  return instance;
+}
+
+ServiceRegistry::ServiceRegistry(const std::string& name) {
+  static_assert(sizeof(Header) == 64, "registry header is 64 bytes");
+  static_assert(sizeof(Entry) == 256, "registry entries are 256 bytes");
+  constexpr size_t kRegistrySize = sizeof(Header) + kMaxServices * sizeof(Entry);
+
+  FILETIME created, exited, kernel, user;
+  if (GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) {
+    process_start_ = FileTimeValue(created);
+  }
+
+  // Session-local, like the pipes a client can reach without a server name.
+  std::string object_name = "Local\\" + name;
+  mutex_ = CreateMutexA(NULL, FALSE, (object_name + "_lock").c_str());
+  changed_ = CreateSemaphoreA(NULL, 0, LONG_MAX, (object_name + "_changed").c_str());
+  mapping_ = CreateFileMappingA(
+    INVALID_HANDLE_VALUE, // Backed by the paging file
+    NULL,
+    PAGE_READWRITE,
+    0,
+    static_cast<DWORD>(kRegistrySize),
+    object_name.c_str()
+  );
+  if (mutex_ == NULL || changed_ == NULL || mapping_ == NULL) {
+    return;
+  }
+  void* view = MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, kRegistrySize);
+  if (!view) {
+    return;
+  }
+
+  // The first process to get here lays the table out.
+  Header* header = static_cast<Header*>(view);
+  DWORD wait = WaitForSingleObject(mutex_, INFINITE);
+  if (wait != WAIT_OBJECT_0 && wait != WAIT_ABANDONED) {
+    UnmapViewOfFile(view);
+    return;
+  }
+  if (header->magic == 0) {
+    header->magic = kRegistryMagic;
+    header->version = kRegistryVersion;
+    header->capacity = kMaxServices;
+  }
+  bool compatible = header->magic == kRegistryMagic && header->version == kRegistryVersion &&
+                    header->capacity == kMaxServices;
+  ReleaseMutex(mutex_);
+  if (!compatible) {
+    UnmapViewOfFile(view);
+    return;
+  }
+  header_ = header;
+  entries_ = reinterpret_cast<Entry*>(header + 1);
+}
+
+ServiceRegistry::~ServiceRegistry() {
+  if (header_) {
+    UnmapViewOfFile(header_);
+  }
+  for (HANDLE handle : {mapping_, mutex_, changed_}) {
+    if (handle != NULL) {
+      CloseHandle(handle);
+    }
+  }
+}
+
+bool ServiceRegistry::Lock() {
+  if (!valid()) {
+    return false;
+  }
+  DWORD wait = WaitForSingleObject(mutex_, INFINITE);
+  if (wait == WAIT_ABANDONED) {
+    // Its last owner died, maybe halfway through a change; whatever it
+    // left goes with its entries.
+    SweepLocked();
+    return true;
+  }
+  return wait == WAIT_OBJECT_0;
+}
+
+void ServiceRegistry::Unlock() {
+  ReleaseMutex(mutex_);
+}
+
+void ServiceRegistry::Changed(Entry* entry) {
+  entry->generation = header_->generation.fetch_add(1) + 1;
+  // Every waiter counted itself before it read the generation, so it is
+  // either released here or saw the new generation.
+  int32_t waiters = header_->waiters.load();
+  if (waiters > 0) {
+    ReleaseSemaphore(changed_, waiters, NULL);
+  }
+}
+
+bool ServiceRegistry::ReapIfDead(Entry* entry) {
+  if (entry->process_id == GetCurrentProcessId() && entry->process_start == process_start_) {
+    return false;
+  }
+  bool dead = false;
+  HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, entry->process_id);
+  if (process == NULL) {
+    // Access denied still means it is alive.
+    dead = GetLastError() == ERROR_INVALID_PARAMETER;
+  } else {
+    DWORD exit_code = 0;
+    FILETIME created, exited, kernel, user;
+    dead = (GetExitCodeProcess(process, &exit_code) && exit_code != STILL_ACTIVE) ||
+           (GetProcessTimes(process, &created, &exited, &kernel, &user) &&
+            FileTimeValue(created) != entry->process_start);
+    CloseHandle(process);
+  }
+  if (dead) {
+    entry->state = 0;
+    Changed(entry);
+  }
+  return dead;
+}
+
+size_t ServiceRegistry::SweepLocked() {
+  size_t reaped = 0;
+  for (size_t i = 0; i < kMaxServices; ++i) {
+    if (entries_[i].state != 0 && ReapIfDead(&entries_[i])) {
+      ++reaped;
+    }
+  }
+  return reaped;
+}
+
+size_t ServiceRegistry::Sweep() {
+  if (!Lock()) {
+    return 0;
+  }
+  size_t reaped = SweepLocked();
+  Unlock();
+  return reaped;
+}
+
+// static
+void ServiceRegistry::ReadEntry(const Entry& entry, ServiceInfo* info) {
+  info->name = entry.name;
+  info->state = static_cast<ServiceState>(entry.state);
+  info->capacity = entry.capacity;
+  info->process_id = entry.process_id;
+  info->generation = entry.generation;
+}
+
+bool ServiceRegistry::Lookup(const std::string& name, ServiceInfo* info) {
+  if (name.size() > kMaxNameLength || !Lock()) {
+    return false;
+  }
+  bool found = false;
+  for (size_t i = 0; i < kMaxServices; ++i) {
+    Entry* entry = &entries_[i];
+    if (entry->state == 0 || name != entry->name || ReapIfDead(entry)) {
+      continue;
+    }
+    if (found && info->state == ServiceState::AVAILABLE) {
+      continue;
+    }
+    ReadEntry(*entry, info);
+    found = true;
+  }
+  Unlock();
+  return found;
+}
+
+std::vector<ServiceInfo> ServiceRegistry::List() {
+  std::vector<ServiceInfo> services;
+  if (!Lock()) {
+    return services;
+  }
+  SweepLocked();
+  for (size_t i = 0; i < kMaxServices; ++i) {
+    const Entry& entry = entries_[i];
+    if (entry.state == 0) {
+      continue;
+    }
+    ServiceInfo info;
+    ReadEntry(entry, &info);
+    services.push_back(std::move(info));
+  }
+  Unlock();
+  return services;
+}
+
+uint64_t ServiceRegistry::generation() const {
+  return header_ ? header_->generation.load() : 0;
+}
+
+bool ServiceRegistry::WaitForChange(uint64_t generation, uint32_t timeout_ms, HANDLE cancel) {
+  if (!valid()) {
+    if (cancel != NULL) {
+      WaitForSingleObject(cancel, timeout_ms);
+    } else {
+      Sleep(timeout_ms);
+    }
+    return false;
+  }
+  Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+  header_->waiters.fetch_add(1);
+  bool changed = false;
+  // A release may be left over from a waiter that gave up; the generation
+  // tells a real change.
+  while (!(changed = header_->generation.load() != generation)) {
+    uint32_t left = MillisecondsUntil(deadline);
+    if (left == 0) {
+      break;
+    }
+    HANDLE handles[2] = {changed_, cancel};
+    DWORD wait = WaitForMultipleObjects(cancel != NULL ? 2 : 1, handles, FALSE, left);
+    if (wait != WAIT_OBJECT_0 && wait != WAIT_TIMEOUT) {
+      break;
+    }
+  }
+  header_->waiters.fetch_sub(1);
+  return changed;
+}
+
+bool ServiceRegistry::WaitUntilAvailable(const std::string& name, uint32_t timeout_ms, HANDLE cancel,
+                                         ServiceInfo* info) {
+  Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (true) {
+    uint64_t seen = generation();
+    if (Lookup(name, info) && info->state == ServiceState::AVAILABLE) {
+      return true;
+    }
+    uint32_t left = MillisecondsUntil(deadline);
+    if (left == 0 || !WaitForChange(seen, left, cancel)) {
+      return false;
+    }
+  }
+}
+
+int ServiceRegistry::Register(const std::string& name, uint32_t capacity, ServiceState state) {
+  if (name.empty() || name.size() > kMaxNameLength || !Lock()) {
+    return -1;
+  }
+  // Makes room left by processes that are gone.
+  SweepLocked();
+  int slot = -1;
+  for (size_t i = 0; i < kMaxServices; ++i) {
+    Entry* entry = &entries_[i];
+    if (entry->state != 0) {
+      continue;
+    }
+    memset(entry->name, 0, sizeof(entry->name));
+    memcpy(entry->name, name.data(), name.size());
+    entry->process_id = GetCurrentProcessId();
+    entry->process_start = process_start_;
+    entry->capacity = capacity;
+    entry->state = static_cast<uint32_t>(state);
+    Changed(entry);
+    slot = static_cast<int>(i);
+    break;
+  }
+  Unlock();
+  return slot;
+}
+
+void ServiceRegistry::Update(int slot, const std::function<ServiceState()>& state) {
+  if (!Lock()) {
+    return;
+  }
+  Entry* entry = &entries_[slot];
+  uint32_t value = static_cast<uint32_t>(state());
+  if (entry->state != 0 && entry->state != value) {
+    entry->state = value;
+    Changed(entry);
+  }
+  Unlock();
+}
+
+void ServiceRegistry::Unregister(int slot) {
+  if (!Lock()) {
+    return;
+  }
+  Entry* entry = &entries_[slot];
+  if (entry->state != 0 && entry->process_id == GetCurrentProcessId()) {
+    entry->state = 0;
+    Changed(entry);
+  }
+  Unlock();
+}
+
+// static
+std::unique_ptr<ServiceRegistration> ServiceRegistration::Create(ServiceRegistry* registry, const std::string& name,
+                                                                 uint32_t capacity,
+                                                                 std::function<ServiceState()> state) {
+  int slot = registry->Register(name, capacity, state());
+  if (slot < 0) {
+    return nullptr;
+  }
+  return std::unique_ptr<ServiceRegistration>(new ServiceRegistration(registry, slot, std::move(state)));
+}
+
+ServiceRegistration::ServiceRegistration(ServiceRegistry* registry, int slot, std::function<ServiceState()> state)
+    : registry_(registry), slot_(slot), state_(std::move(state)) {}
+
+ServiceRegistration::~ServiceRegistration() {
+  registry_->Unregister(slot_);
+}
+
+void ServiceRegistration::Refresh() {
+  registry_->Update(slot_, state_);
+}
+
+ServiceWatcher::ServiceWatcher(ServiceRegistry* registry)
+    : registry_(registry), wake_(CreateEventW(NULL, FALSE, FALSE, NULL)) {}
+
+ServiceWatcher::~ServiceWatcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  SetEvent(wake_);
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  CloseHandle(wake_);
+}
+
+void ServiceWatcher::Watch(const std::string& name, uint32_t timeout_ms, Callback callback) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    waiters_.push_back(Waiter{name, Clock::now() + std::chrono::milliseconds(timeout_ms), std::move(callback)});
+    if (!thread_.joinable()) {
+      thread_ = std::thread(&ServiceWatcher::Run, this);
+    }
+  }
+  SetEvent(wake_);
+}
+
+void ServiceWatcher::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    // Read before the lookups, so a change during them is not waited for.
+    uint64_t seen = registry_->generation();
+    std::vector<Waiter> waiting;
+    waiting.swap(waiters_);
+    lock.unlock();
+
+    Clock::time_point now = Clock::now();
+    Clock::time_point next = now + std::chrono::hours(1);
+    for (auto it = waiting.begin(); it != waiting.end();) {
+      ServiceInfo info;
+      bool found = registry_->Lookup(it->name, &info) && info.state == ServiceState::AVAILABLE;
+      if (found || now >= it->deadline) {
+        it->callback(found, info);
+        it = waiting.erase(it);
+        continue;
+      }
+      next = std::min(next, it->deadline);
+      ++it;
+    }
+
+    lock.lock();
+    for (Waiter& waiter : waiting) {
+      waiters_.push_back(std::move(waiter));
+    }
+    if (stopping_) {
+      break;
+    }
+    lock.unlock();
+    // A new watch, or the destructor, sets |wake_|.
+    registry_->WaitForChange(seen, MillisecondsUntil(next), wake_);
+    lock.lock();
+  }
+}
+
+}  // namespace flutter_ipc
@@ -0,0 +1,174 @@
+#ifndef FLUTTER_PLUGIN_SERVICE_REGISTRY_H_
+#define FLUTTER_PLUGIN_SERVICE_REGISTRY_H_
+
+#include <windows.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace flutter_ipc {
+
+// What a registered server can do for a client right now.
+enum class ServiceState : uint32_t {
+  STARTING = 1,   // Created, not listening yet
+  AVAILABLE = 2,  // Listening; a client connects at once
+  BUSY = 3,       // Has its client
+};
+
+// A server as the registry knows it.
+struct ServiceInfo {
+  std::string name;
+  ServiceState state = ServiceState::STARTING;
+  // Pipe instances the server opened.
+  uint32_t capacity = 0;
+  DWORD process_id = 0;
+  // The registry's generation when the entry last changed.
+  uint64_t generation = 0;
+};
+
+// A table of the servers of every process in this session, in shared
+// memory, so that a client learns whether a server exists and listens
+// without opening its pipe. Changes take a named mutex; a process that
+// dies holding it abandons it to the next one. Entries of processes that
+// exited without closing their servers are swept when they are looked at.
+// Thread-safe. If the shared memory cannot be set up, the registry is
+// always empty and clients fall back to probing the pipe.
+class ServiceRegistry {
+ public:
+  static constexpr size_t kMaxServices = 256;
+  // Servers with longer pipe names are not registered.
+  static constexpr size_t kMaxNameLength = 223;
+
+  // The registry every server and client of the plugin uses.
+  static ServiceRegistry& GetInstance();
+
+  // Opens the registry called |name| in this session, creating it if no
+  // process has it open.
+  explicit ServiceRegistry(const std::string& name);
+  ~ServiceRegistry();
+
+  // Disallow copy and assign.
+  ServiceRegistry(const ServiceRegistry&) = delete;
+  ServiceRegistry& operator=(const ServiceRegistry&) = delete;
+
+  bool valid() const { return header_ != nullptr; }
+
+  // Returns false if no live server is registered for |name|. Of several,
+  // an AVAILABLE one.
+  bool Lookup(const std::string& name, ServiceInfo* info);
+  std::vector<ServiceInfo> List();
+  // Waits until a server for |name| is AVAILABLE. Returns false once
+  // |timeout_ms| passes or |cancel|, if not NULL, is signaled first.
+  bool WaitUntilAvailable(const std::string& name, uint32_t timeout_ms, HANDLE cancel, ServiceInfo* info);
+  // Bumped by every change to the table.
+  uint64_t generation() const;
+  // Waits for the generation to move past |generation|. Returns false
+  // once |timeout_ms| passes or |cancel|, if not NULL, is signaled first.
+  bool WaitForChange(uint64_t generation, uint32_t timeout_ms, HANDLE cancel);
+  // Drops the entries of processes that are gone; returns how many.
+  size_t Sweep();
+
+ private:
+  friend class ServiceRegistration;
+  struct Header;
+  struct Entry;
+
+  // Returns false if the registry is not usable.
+  bool Lock();
+  void Unlock();
+  // With the lock held: the entry was added, changed or removed.
+  void Changed(Entry* entry);
+  // With the lock held: clears |entry| if its process is gone.
+  bool ReapIfDead(Entry* entry);
+  size_t SweepLocked();
+  static void ReadEntry(const Entry& entry, ServiceInfo* info);
+  // Returns the slot of the new entry, or -1.
+  int Register(const std::string& name, uint32_t capacity, ServiceState state);
+  // Calls |state| with the lock held.
+  void Update(int slot, const std::function<ServiceState()>& state);
+  void Unregister(int slot);
+
+  HANDLE mapping_ = NULL;
+  HANDLE mutex_ = NULL;
+  // Released once per waiter at every change.
+  HANDLE changed_ = NULL;
+  Header* header_ = nullptr;
+  Entry* entries_ = nullptr;
+  // When this process started, to tell it from a later one with its ID.
+  uint64_t process_start_ = 0;
+};
+
+// Keeps a server in a registry while it lives, in the state it reports.
+class ServiceRegistration {
+ public:
+  // Returns null if the server cannot be registered: the registry is not
+  // usable or full, or |name| is too long.
+  static std::unique_ptr<ServiceRegistration> Create(ServiceRegistry* registry, const std::string& name,
+                                                     uint32_t capacity, std::function<ServiceState()> state);
+  ~ServiceRegistration();
+
+  // Disallow copy and assign.
+  ServiceRegistration(const ServiceRegistration&) = delete;
+  ServiceRegistration& operator=(const ServiceRegistration&) = delete;
+
+  // Publishes the state the server reports now. Reads it under the
+  // registry's lock, so concurrent refreshes leave the latest in place.
+  void Refresh();
+
+ private:
+  ServiceRegistration(ServiceRegistry* registry, int slot, std::function<ServiceState()> state);
+
+  ServiceRegistry* registry_;
+  int slot_;
+  std::function<ServiceState()> state_;
+};
+
+// Waits for servers to become available on a thread of its own, for
+// callers that cannot block.
+class ServiceWatcher {
+ public:
+  // Runs on the watcher's thread; |found| is false if the wait timed out.
+  using Callback = std::function<void(bool found, const ServiceInfo& info)>;
+
+  explicit ServiceWatcher(ServiceRegistry* registry);
+  // Pending callbacks never run.
+  ~ServiceWatcher();
+
+  // Disallow copy and assign.
+  ServiceWatcher(const ServiceWatcher&) = delete;
+  ServiceWatcher& operator=(const ServiceWatcher&) = delete;
+
+  // Calls |callback| once a server for |name| is AVAILABLE, or after
+  // |timeout_ms|.
+  void Watch(const std::string& name, uint32_t timeout_ms, Callback callback);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Waiter {
+    std::string name;
+    Clock::time_point deadline;
+    Callback callback;
+  };
+
+  void Run();
+
+  ServiceRegistry* registry_;
+  // Set for a new watch and to stop.
+  HANDLE wake_;
+  std::mutex mutex_;
+  std::vector<Waiter> waiters_;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_SERVICE_REGISTRY_H_
@@ -0,0 +1,113 @@
+#include "session.h"
+
+#include <cstring>
+
+namespace flutter_ipc {
+
+namespace {
+
+#pragma pack(push, 1)
+// Entry of an ACK frame. The payload is a uint32 count followed by that
+// many entries.
+struct AckEntry {
+  uint16_t channel;
+  uint64_t sequence;
+};
+#pragma pack(pop)
+
+Frame MakeControlFrame(FrameType type, std::string payload) {
+  Frame frame(type, std::move(payload));
+  frame.flags = kFrameFlagControl;
+  return frame;
+}
+
+}  // namespace
+
+Frame EncodeHelloFrame(uint64_t session_id) {
+  std::string payload(sizeof(session_id), '\0');
+  memcpy(&payload[0], &session_id, sizeof(session_id));
+  return MakeControlFrame(FrameType::HELLO, std::move(payload));
+}
+
+bool DecodeHelloFrame(const Frame& frame, uint64_t* session_id) {
+  if (frame.type != FrameType::HELLO || frame.payload.size() != sizeof(*session_id)) {
+    return false;
+  }
+  memcpy(session_id, frame.payload.data(), sizeof(*session_id));
+  return true;
+}
+
+Frame EncodeAckFrame(const AckMap& acks) {
+  uint32_t count = static_cast<uint32_t>(acks.size());
+  std::string payload(sizeof(count) + count * sizeof(AckEntry), '\0');
+  memcpy(&payload[0], &count, sizeof(count));
+  size_t offset = sizeof(count);
+  for (const auto& ack : acks) {
+    AckEntry entry = {ack.first, ack.second};
+    memcpy(&payload[offset], &entry, sizeof(entry));
+    offset += sizeof(entry);
+  }
+  return MakeControlFrame(FrameType::ACK, std::move(payload));
+}
+
+bool DecodeAckFrame(const Frame& frame, AckMap* acks) {
+  uint32_t count = 0;
+  if (frame.type != FrameType::ACK || frame.payload.size() < sizeof(count)) {
+    return false;
+  }
+  memcpy(&count, frame.payload.data(), sizeof(count));
+  if (frame.payload.size() != sizeof(count) + static_cast<size_t>(count) * sizeof(AckEntry)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    AckEntry entry;
+    memcpy(&entry, &frame.payload[sizeof(count) + i * sizeof(AckEntry)], sizeof(entry));
+    (*acks)[entry.channel] = entry.sequence;
+  }
+  return true;
+}
+
+void AddSequence(Frame* frame, uint64_t sequence) {
+  frame->payload.insert(0, reinterpret_cast<const char*>(&sequence), sizeof(sequence));
+  frame->flags |= kFrameFlagSequenced;
+}
+
+bool PeekSequence(const Frame& frame, uint64_t* sequence) {
+  if (!(frame.flags & kFrameFlagSequenced) || frame.payload.size() < sizeof(*sequence)) {
+    return false;
+  }
+  memcpy(sequence, frame.payload.data(), sizeof(*sequence));
+  return true;
+}
+
+void SessionTracker::OnHello(uint64_t session_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (session_id != session_id_) {
+    session_id_ = session_id;
+    delivered_.clear();
+  }
+}
+
+SessionTracker::Verdict SessionTracker::Accept(Frame* frame, uint64_t* sequence) {
+  *sequence = 0;
+  if (!PeekSequence(*frame, sequence)) {
+    return Verdict::MALFORMED;
+  }
+  frame->payload.erase(0, sizeof(*sequence));
+  frame->flags &= ~kFrameFlagSequenced;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t& delivered = delivered_[frame->channel];
+  if (*sequence <= delivered) {
+    return Verdict::DUPLICATE;
+  }
+  // Delivering past a missing frame would acknowledge it, and the client
+  // would never replay it.
+  if (*sequence != delivered + 1) {
+    return Verdict::GAP;
+  }
+  delivered = *sequence;
+  return Verdict::DELIVER;
+}
+
+}  // namespace flutter_ipc
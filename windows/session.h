@@ -0,0 +1,66 @@
+#ifndef FLUTTER_PLUGIN_SESSION_H_
+#define FLUTTER_PLUGIN_SESSION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+#include "frame.h"
+
+namespace flutter_ipc {
+
+// Per-channel sequence numbers acknowledged by the receiver.
+using AckMap = std::map<uint16_t, uint64_t>;
+
+struct SessionStats {
+  uint64_t session_id = 0;
+  uint64_t reconnects = 0;
+  size_t outbox_frames = 0;
+  size_t outbox_bytes = 0;
+  size_t outbox_capacity = 0;
+};
+
+Frame EncodeHelloFrame(uint64_t session_id);
+bool DecodeHelloFrame(const Frame& frame, uint64_t* session_id);
+
+Frame EncodeAckFrame(const AckMap& acks);
+bool DecodeAckFrame(const Frame& frame, AckMap* acks);
+
+// Prefixes the payload of |frame| with |sequence| and flags it as
+// sequenced.
+void AddSequence(Frame* frame, uint64_t sequence);
+// Reads the sequence number of a sequenced frame without removing it.
+bool PeekSequence(const Frame& frame, uint64_t* sequence);
+
+// Receiving end of resumable sessions. Remembers, per channel, the last
+// sequence number delivered in the current session, so frames replayed by
+// a client after a reconnect are delivered exactly once and in order.
+// Survives the connection it was learnt on. Thread-safe.
+class SessionTracker {
+ public:
+  enum class Verdict {
+    DELIVER,    // The next frame of its channel
+    DUPLICATE,  // Delivered before; acknowledged again and dropped
+    GAP,        // Frames in front of it are missing; the connection is
+                // dropped so that the client replays from its last ack
+    MALFORMED,
+  };
+
+  // A different ID starts a new session; the same one resumes it.
+  void OnHello(uint64_t session_id);
+
+  // Strips the sequence number of a sequenced |frame| into |sequence|
+  // (which stays 0 for a malformed frame; real ones start at 1). Only the
+  // frame right after the last one delivered on its channel is delivered.
+  Verdict Accept(Frame* frame, uint64_t* sequence);
+
+ private:
+  std::mutex mutex_;
+  uint64_t session_id_ = 0;
+  AckMap delivered_;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_SESSION_H_
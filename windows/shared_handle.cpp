@@ -0,0 +1,285 @@
+#include "shared_handle.h"
+
+#include <cstring>
+
+namespace flutter_ipc {
+
+namespace {
+
+#pragma pack(push, 1)
+// Wire descriptor of one handle inside a HANDLES frame. The payload is a
+// uint32 count, that many descriptors, then the message text.
+struct HandleDescriptor {
+  uint64_t value;  // Handle value in the sender's process, for the taking
+  uint64_t size;
+  uint8_t kind;    // SharedHandleKind
+  uint8_t reserved[7];
+};
+#pragma pack(pop)
+
+// Reads the descriptor count of a HANDLES payload. Returns false if the
+// payload is too short for them.
+bool ReadHandleCount(const std::string& payload, uint32_t* count) {
+  if (payload.size() < sizeof(*count)) {
+    return false;
+  }
+  memcpy(count, payload.data(), sizeof(*count));
+  return *count <= (payload.size() - sizeof(*count)) / sizeof(HandleDescriptor);
+}
+
+bool IsKnownKind(uint8_t kind) {
+  return kind == static_cast<uint8_t>(SharedHandleKind::SHARED_MEMORY) ||
+         kind == static_cast<uint8_t>(SharedHandleKind::FILE);
+}
+
+// Whether |handle| is the object |descriptor| says it is, and at least as
+// large, so that reads within the size stay inside the mapping.
+bool MatchesDescriptor(HANDLE handle, const HandleDescriptor& descriptor) {
+  if (descriptor.kind == static_cast<uint8_t>(SharedHandleKind::FILE)) {
+    LARGE_INTEGER file_size;
+    return GetFileType(handle) == FILE_TYPE_DISK && GetFileSizeEx(handle, &file_size) &&
+           descriptor.size <= static_cast<uint64_t>(file_size.QuadPart);
+  }
+  // Only a section maps, and a view of all of it shows its size.
+  void* view = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+  if (!view) {
+    return false;
+  }
+  MEMORY_BASIC_INFORMATION info;
+  bool large_enough = VirtualQuery(view, &info, sizeof(info)) == sizeof(info) &&
+                      descriptor.size <= info.RegionSize;
+  UnmapViewOfFile(view);
+  return large_enough;
+}
+
+}  // namespace
+
+SharedHandle::SharedHandle(HANDLE handle, SharedHandleKind kind, uint64_t size)
+    : handle_(handle), kind_(kind), size_(size), file_mapping_(NULL), view_(nullptr) {}
+
+SharedHandle::~SharedHandle() {
+  if (view_) {
+    UnmapViewOfFile(view_);
+  }
+  if (file_mapping_ != NULL) {
+    CloseHandle(file_mapping_);
+  }
+  if (handle_ != NULL && handle_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(handle_);
+  }
+}
+
+// static
+std::unique_ptr<SharedHandle> SharedHandle::CreateSharedMemory(uint64_t size) {
+  if (size == 0) {
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return nullptr;
+  }
+
+  HANDLE section = CreateFileMappingW(
+    INVALID_HANDLE_VALUE, // Backed by the paging file
+    NULL,
+    PAGE_READWRITE,
+    static_cast<DWORD>(size >> 32),
+    static_cast<DWORD>(size & 0xFFFFFFFF),
+    NULL
+  );
+  if (section == NULL) {
+    return nullptr;
+  }
+  return std::make_unique<SharedHandle>(section, SharedHandleKind::SHARED_MEMORY, size);
+}
+
+// static
+std::unique_ptr<SharedHandle> SharedHandle::OpenFile(const std::string& path) {
+  int wide_length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+  if (wide_length == 0) {
+    return nullptr;
+  }
+  std::wstring wide_path(wide_length - 1, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wide_path[0], wide_length);
+
+  HANDLE file = CreateFileW(
+    wide_path.c_str(),
+    GENERIC_READ,
+    FILE_SHARE_READ,
+    NULL,
+    OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL,
+    NULL
+  );
+  if (file == INVALID_HANDLE_VALUE) {
+    return nullptr;
+  }
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size)) {
+    DWORD error = GetLastError();
+    CloseHandle(file);
+    SetLastError(error);
+    return nullptr;
+  }
+  return std::make_unique<SharedHandle>(file, SharedHandleKind::FILE, static_cast<uint64_t>(file_size.QuadPart));
+}
+
+bool SharedHandle::EnsureMapped() {
+  if (view_) {
+    return true;
+  }
+
+  if (kind_ == SharedHandleKind::SHARED_MEMORY) {
+    view_ = static_cast<uint8_t*>(MapViewOfFile(handle_, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+    return view_ != nullptr;
+  }
+
+  file_mapping_ = CreateFileMappingW(handle_, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (file_mapping_ == NULL) {
+    return false;
+  }
+  view_ = static_cast<uint8_t*>(MapViewOfFile(file_mapping_, FILE_MAP_READ, 0, 0, 0));
+  return view_ != nullptr;
+}
+
+bool SharedHandle::Read(uint64_t offset, size_t length, std::vector<uint8_t>* data) {
+  if (offset > size_ || length > size_ - offset) {
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return false;
+  }
+  if (length == 0) {
+    data->clear();
+    return true;
+  }
+  if (!EnsureMapped()) {
+    return false;
+  }
+  data->assign(view_ + offset, view_ + offset + length);
+  return true;
+}
+
+bool SharedHandle::Write(uint64_t offset, const uint8_t* data, size_t length) {
+  if (kind_ != SharedHandleKind::SHARED_MEMORY) {
+    SetLastError(ERROR_ACCESS_DENIED);
+    return false;
+  }
+  if (offset > size_ || length > size_ - offset) {
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return false;
+  }
+  if (length == 0) {
+    return true;
+  }
+  if (!EnsureMapped()) {
+    return false;
+  }
+  memcpy(view_ + offset, data, length);
+  return true;
+}
+
+bool EncodeHandleFrame(const std::vector<const SharedHandle*>& handles,
+                       const std::string& message, Frame* frame,
+                       std::vector<uint64_t>* copies) {
+  uint32_t count = static_cast<uint32_t>(handles.size());
+  std::string payload(sizeof(count) + count * sizeof(HandleDescriptor), '\0');
+  memcpy(&payload[0], &count, sizeof(count));
+
+  copies->clear();
+  for (uint32_t i = 0; i < count; ++i) {
+    // A copy of its own, so the peer can take it without touching ours.
+    HANDLE copy = NULL;
+    if (!DuplicateHandle(GetCurrentProcess(), handles[i]->handle(), GetCurrentProcess(),
+                         &copy, 0, FALSE, DUPLICATE_SAME_ACCESS)) {
+      DWORD error = GetLastError();
+      ReleaseHandleCopies(*copies);
+      copies->clear();
+      SetLastError(error);
+      return false;
+    }
+    copies->push_back(reinterpret_cast<uint64_t>(copy));
+
+    HandleDescriptor descriptor = {};
+    descriptor.value = reinterpret_cast<uint64_t>(copy);
+    descriptor.size = handles[i]->size();
+    descriptor.kind = static_cast<uint8_t>(handles[i]->kind());
+    memcpy(&payload[sizeof(count) + i * sizeof(HandleDescriptor)], &descriptor, sizeof(descriptor));
+  }
+
+  payload += message;
+  *frame = Frame(FrameType::HANDLES, std::move(payload));
+  return true;
+}
+
+void ReleaseHandleCopies(const std::vector<uint64_t>& copies) {
+  for (uint64_t value : copies) {
+    CloseHandle(reinterpret_cast<HANDLE>(value));
+  }
+}
+
+bool TakeHandleFrame(Frame* frame, DWORD source_process_id) {
+  std::string& payload = frame->payload;
+  uint32_t count = 0;
+  if (!ReadHandleCount(payload, &count)) {
+    SetLastError(ERROR_INVALID_DATA);
+    return false;
+  }
+  HANDLE source_process = OpenProcess(PROCESS_DUP_HANDLE, FALSE, source_process_id);
+  if (source_process == NULL) {
+    return false;
+  }
+
+  // Every copy is taken, even past a bad one: the sender made them for us
+  // and closes none of them itself.
+  std::vector<HANDLE> taken;
+  bool valid = true;
+  for (uint32_t i = 0; i < count; ++i) {
+    char* slot = &payload[sizeof(count) + i * sizeof(HandleDescriptor)];
+    HandleDescriptor descriptor;
+    memcpy(&descriptor, slot, sizeof(descriptor));
+    HANDLE local = NULL;
+    if (!DuplicateHandle(source_process, reinterpret_cast<HANDLE>(descriptor.value), GetCurrentProcess(),
+                         &local, 0, FALSE, DUPLICATE_SAME_ACCESS | DUPLICATE_CLOSE_SOURCE)) {
+      valid = false;
+      continue;
+    }
+    taken.push_back(local);
+    if (!IsKnownKind(descriptor.kind) || !MatchesDescriptor(local, descriptor)) {
+      valid = false;
+      continue;
+    }
+    descriptor.value = reinterpret_cast<uint64_t>(local);
+    memcpy(slot, &descriptor, sizeof(descriptor));
+  }
+  CloseHandle(source_process);
+
+  if (!valid) {
+    for (HANDLE handle : taken) {
+      CloseHandle(handle);
+    }
+    SetLastError(ERROR_INVALID_DATA);
+  }
+  return valid;
+}
+
+bool DecodeHandleFrame(const Frame& frame,
+                       std::vector<std::unique_ptr<SharedHandle>>* handles,
+                       std::string* message) {
+  const std::string& payload = frame.payload;
+  uint32_t count = 0;
+  if (!ReadHandleCount(payload, &count)) {
+    return false;
+  }
+
+  // TakeHandleFrame() moved every handle into this process and checked it,
+  // so we own them from here on.
+  handles->clear();
+  for (uint32_t i = 0; i < count; ++i) {
+    HandleDescriptor descriptor;
+    memcpy(&descriptor, &payload[sizeof(count) + i * sizeof(HandleDescriptor)], sizeof(descriptor));
+    handles->push_back(std::make_unique<SharedHandle>(
+        reinterpret_cast<HANDLE>(descriptor.value),
+        static_cast<SharedHandleKind>(descriptor.kind), descriptor.size));
+  }
+  message->assign(payload, sizeof(count) + count * sizeof(HandleDescriptor), std::string::npos);
+  return true;
+}
+
+}  // namespace flutter_ipc
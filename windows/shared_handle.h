@@ -0,0 +1,81 @@
+#ifndef FLUTTER_PLUGIN_SHARED_HANDLE_H_
+#define FLUTTER_PLUGIN_SHARED_HANDLE_H_
+
+#include <windows.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "frame.h"
+
+namespace flutter_ipc {
+
+enum class SharedHandleKind : uint8_t {
+  SHARED_MEMORY = 0,  // Pagefile-backed section, readable and writable
+  FILE = 1,           // File opened for reading
+};
+
+// An OS handle that can be attached to a message. The peer receives its own
+// duplicate of the handle and maps the same section or file, so bulk data
+// never travels through the pipe. The mapping is created lazily on the first
+// Read() or Write().
+class SharedHandle {
+ public:
+  SharedHandle(HANDLE handle, SharedHandleKind kind, uint64_t size);
+  ~SharedHandle();
+
+  // Disallow copy and assign.
+  SharedHandle(const SharedHandle&) = delete;
+  SharedHandle& operator=(const SharedHandle&) = delete;
+
+  static std::unique_ptr<SharedHandle> CreateSharedMemory(uint64_t size);
+  // |path| is UTF-8.
+  static std::unique_ptr<SharedHandle> OpenFile(const std::string& path);
+
+  bool Read(uint64_t offset, size_t length, std::vector<uint8_t>* data);
+  bool Write(uint64_t offset, const uint8_t* data, size_t length);
+
+  HANDLE handle() const { return handle_; }
+  SharedHandleKind kind() const { return kind_; }
+  uint64_t size() const { return size_; }
+
+ private:
+  bool EnsureMapped();
+
+  HANDLE handle_;
+  SharedHandleKind kind_;
+  uint64_t size_;
+  HANDLE file_mapping_;
+  uint8_t* view_;
+};
+
+// Duplicates |handles| within this process, as copies for the peer to
+// take, and builds a HANDLES frame carrying their descriptors followed by
+// |message|. The copies are returned in |copies| so that a failed send can
+// close them again.
+bool EncodeHandleFrame(const std::vector<const SharedHandle*>& handles,
+                       const std::string& message, Frame* frame,
+                       std::vector<uint64_t>* copies);
+
+// Closes copies made for a peer that never took them.
+void ReleaseHandleCopies(const std::vector<uint64_t>& copies);
+
+// Moves the handles of a HANDLES frame received from |source_process_id|
+// into this process and rewrites their descriptors to the local values.
+// The values are looked up in the sender's handle table, so a bogus one
+// fails instead of naming a handle of ours. Returns false, closing
+// whatever was taken, if a descriptor has an unknown kind or a handle is
+// not the file or section of at least the size its descriptor claims.
+bool TakeHandleFrame(Frame* frame, DWORD source_process_id);
+
+// Takes ownership of the handles of a frame that went through
+// TakeHandleFrame().
+bool DecodeHandleFrame(const Frame& frame,
+                       std::vector<std::unique_ptr<SharedHandle>>* handles,
+                       std::string* message);
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_SHARED_HANDLE_H_
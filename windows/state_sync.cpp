@@ -0,0 +1,386 @@
+#include "state_sync.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace flutter_ipc {
+
+namespace {
+
+// What follows the key of a frame with kFrameFlagDelta: a kind byte and the
+// uint32 version of the key, then the value or the diff.
+enum StateKind : uint8_t {
+  SNAPSHOT = 0,
+  DELTA = 1,
+};
+constexpr size_t kStateHeaderSize = 1 + sizeof(uint32_t);
+
+// Operations of a diff, in the low bit of their varint length.
+enum DeltaOp : uint8_t {
+  ADD = 0,
+  COPY = 1,
+};
+
+// Shorter matches cost about as much to encode as the bytes they save.
+constexpr size_t kMinMatch = 8;
+constexpr uint32_t kNoPosition = UINT32_MAX;
+// Caps the match table at 4 MB.
+constexpr int kMaxTableBits = 20;
+constexpr uint64_t kHashPrime = 0x9E3779B185EBCA87ULL;
+
+inline uint64_t Load64(const char* data) {
+  uint64_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+void AppendVarint(std::string* out, uint64_t value) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+bool ReadVarint(const char** data, const char* end, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && *data < end; shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(*(*data)++);
+    *value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void AppendAdd(std::string* delta, const char* data, size_t size) {
+  if (size != 0) {
+    AppendVarint(delta, static_cast<uint64_t>(size) << 1 | ADD);
+    delta->append(data, size);
+  }
+}
+
+void AppendCopy(std::string* delta, size_t offset, size_t size) {
+  if (size != 0) {
+    AppendVarint(delta, static_cast<uint64_t>(size) << 1 | COPY);
+    AppendVarint(delta, offset);
+  }
+}
+
+// Bytes |a| and |b| have in common from the start, up to |limit|; eight at
+// a time while they last.
+size_t CommonPrefix(const char* a, const char* b, size_t limit) {
+  size_t length = 0;
+  while (length + sizeof(uint64_t) <= limit && Load64(a + length) == Load64(b + length)) {
+    length += sizeof(uint64_t);
+  }
+  while (length < limit && a[length] == b[length]) {
+    ++length;
+  }
+  return length;
+}
+
+// Bytes |a| and |b| have in common before |a_end| and |b_end|, up to |limit|.
+size_t CommonSuffix(const char* a_end, const char* b_end, size_t limit) {
+  size_t length = 0;
+  while (length + sizeof(uint64_t) <= limit &&
+         Load64(a_end - length - sizeof(uint64_t)) == Load64(b_end - length - sizeof(uint64_t))) {
+    length += sizeof(uint64_t);
+  }
+  while (length < limit && a_end[-1 - static_cast<ptrdiff_t>(length)] == b_end[-1 - static_cast<ptrdiff_t>(length)]) {
+    ++length;
+  }
+  return length;
+}
+
+inline size_t HashWindow(const char* data, int bits) {
+  return static_cast<size_t>((Load64(data) * kHashPrime) >> (64 - bits));
+}
+
+// Finds the key of a keyed frame: |value_offset| receives where the value
+// starts.
+bool ReadKey(const Frame& frame, std::string* key, size_t* value_offset) {
+  size_t offset = FramePrefixLength(frame.flags);
+  uint16_t length = 0;
+  if (!(frame.flags & kFrameFlagKeyed) || frame.payload.size() < offset + sizeof(length)) {
+    return false;
+  }
+  memcpy(&length, &frame.payload[offset], sizeof(length));
+  offset += sizeof(length);
+  if (frame.payload.size() - offset < length) {
+    return false;
+  }
+  key->assign(frame.payload, offset, length);
+  *value_offset = offset + length;
+  return true;
+}
+
+}  // namespace
+
+bool AddStateKey(Frame* frame, const std::string& key) {
+  if (key.size() > UINT16_MAX) {
+    return false;
+  }
+  uint16_t length = static_cast<uint16_t>(key.size());
+  std::string header(reinterpret_cast<const char*>(&length), sizeof(length));
+  header += key;
+  frame->payload.insert(FramePrefixLength(frame->flags), header);
+  frame->flags |= kFrameFlagKeyed;
+  return true;
+}
+
+bool ReadStateKey(const Frame& frame, std::string* key) {
+  size_t value_offset = 0;
+  return ReadKey(frame, key, &value_offset);
+}
+
+bool TakeStateKey(Frame* frame, std::string* key) {
+  size_t value_offset = 0;
+  if (!ReadKey(*frame, key, &value_offset)) {
+    return false;
+  }
+  size_t offset = FramePrefixLength(frame->flags);
+  frame->payload.erase(offset, value_offset - offset);
+  frame->flags &= ~(kFrameFlagKeyed | kFrameFlagDelta);
+  return true;
+}
+
+std::string EncodeDelta(const std::string& base, const std::string& target) {
+  std::string delta;
+  AppendVarint(&delta, target.size());
+  // Most updates change a few fields; what comes before the first change
+  // and after the last is copied without a search.
+  size_t limit = std::min(base.size(), target.size());
+  size_t prefix = CommonPrefix(base.data(), target.data(), limit);
+  size_t suffix = CommonSuffix(base.data() + base.size(), target.data() + target.size(), limit - prefix);
+  AppendCopy(&delta, 0, prefix);
+
+  size_t base_begin = prefix;
+  size_t base_end = base.size() - suffix;
+  size_t begin = prefix;
+  size_t end = target.size() - suffix;
+  size_t literal = begin;
+  if (end - begin >= kMinMatch && base_end - base_begin >= kMinMatch) {
+    // Every window of the changed part of |base|, later ones winning.
+    size_t windows = base_end - base_begin - kMinMatch + 1;
+    int bits = 8;
+    while (bits < kMaxTableBits && (size_t{1} << bits) < windows) {
+      ++bits;
+    }
+    std::vector<uint32_t> table(size_t{1} << bits, kNoPosition);
+    for (size_t i = base_begin; i + kMinMatch <= base_end; ++i) {
+      table[HashWindow(&base[i], bits)] = static_cast<uint32_t>(i);
+    }
+
+    size_t i = begin;
+    while (i + kMinMatch <= end) {
+      uint32_t candidate = table[HashWindow(&target[i], bits)];
+      if (candidate == kNoPosition || Load64(&base[candidate]) != Load64(&target[i])) {
+        ++i;
+        continue;
+      }
+      size_t from = candidate;
+      size_t length = kMinMatch + CommonPrefix(&base[from + kMinMatch], &target[i + kMinMatch],
+                                               std::min(base.size() - from, end - i) - kMinMatch);
+      // The match may also reach back into bytes not emitted yet.
+      while (i > literal && from > 0 && base[from - 1] == target[i - 1]) {
+        --i;
+        --from;
+        ++length;
+      }
+      AppendAdd(&delta, target.data() + literal, i - literal);
+      AppendCopy(&delta, from, length);
+      i += length;
+      literal = i;
+    }
+  }
+  AppendAdd(&delta, target.data() + literal, end - literal);
+  AppendCopy(&delta, base.size() - suffix, suffix);
+  return delta;
+}
+
+bool ApplyDelta(const std::string& base, const char* delta, size_t size, size_t max_size,
+                std::string* target) {
+  const char* end = delta + size;
+  uint64_t target_size = 0;
+  if (!ReadVarint(&delta, end, &target_size) || target_size > max_size) {
+    return false;
+  }
+  target->clear();
+  target->reserve(static_cast<size_t>(target_size));
+  while (delta < end) {
+    uint64_t op = 0;
+    if (!ReadVarint(&delta, end, &op)) {
+      return false;
+    }
+    uint64_t length = op >> 1;
+    if (length > target_size - target->size()) {
+      return false;
+    }
+    if (op & COPY) {
+      uint64_t offset = 0;
+      if (!ReadVarint(&delta, end, &offset) || offset > base.size() || length > base.size() - offset) {
+        return false;
+      }
+      target->append(base, static_cast<size_t>(offset), static_cast<size_t>(length));
+    } else {
+      if (length > static_cast<uint64_t>(end - delta)) {
+        return false;
+      }
+      target->append(delta, static_cast<size_t>(length));
+      delta += length;
+    }
+  }
+  return target->size() == target_size;
+}
+
+StateEncoder::StateEncoder(size_t capacity) : capacity_(capacity) {}
+
+void StateEncoder::Encode(Frame* frame, uint32_t snapshot_interval) {
+  std::string key;
+  size_t value_offset = 0;
+  if ((frame->flags & kFrameFlagDelta) || !ReadKey(*frame, &key, &value_offset)) {
+    return;
+  }
+  std::string& payload = frame->payload;
+  size_t size = payload.size() - value_offset;
+  ++updates_;
+  value_bytes_ += size;
+  Keys& keys = channels_[frame->channel];
+  auto found = keys.find(key);
+  size_t previous = found != keys.end() ? found->second.value.size() : 0;
+  if (size > capacity_ - (bytes_ - previous)) {
+    // Goes out as it is, which also tells the receiver to forget the key.
+    if (found != keys.end()) {
+      bytes_ -= previous;
+      keys.erase(found);
+    }
+    ++snapshots_;
+    encoded_bytes_ += size;
+    return;
+  }
+
+  Entry& entry = found != keys.end() ? found->second : keys[key];
+  std::string header(1, static_cast<char>(SNAPSHOT));
+  uint32_t version = entry.version + 1;
+  header.append(reinterpret_cast<const char*>(&version), sizeof(version));
+  std::string delta;
+  if (entry.since_snapshot != 0 && entry.since_snapshot < snapshot_interval) {
+    delta = EncodeDelta(entry.value, payload.substr(value_offset));
+  }
+  if (!delta.empty() && delta.size() < size) {
+    header[0] = static_cast<char>(DELTA);
+    entry.value.assign(payload, value_offset, size);
+    payload.resize(value_offset);
+    payload += header;
+    payload += delta;
+    ++entry.since_snapshot;
+    ++deltas_;
+    encoded_bytes_ += kStateHeaderSize + delta.size();
+  } else {
+    entry.value.assign(payload, value_offset, size);
+    payload.insert(value_offset, header);
+    entry.since_snapshot = 1;
+    ++snapshots_;
+    encoded_bytes_ += kStateHeaderSize + size;
+  }
+  entry.version = version;
+  bytes_ += size - previous;
+  frame->flags |= kFrameFlagDelta;
+}
+
+void StateEncoder::Resync(uint16_t channel_id, const std::string& key) {
+  auto channel = channels_.find(channel_id);
+  if (channel == channels_.end()) {
+    return;
+  }
+  auto found = channel->second.find(key);
+  if (found != channel->second.end()) {
+    found->second.since_snapshot = 0;
+  }
+}
+
+void StateEncoder::AddStats(StateSyncStats* stats) const {
+  stats->updates += updates_;
+  stats->snapshots += snapshots_;
+  stats->deltas += deltas_;
+  stats->value_bytes += value_bytes_;
+  stats->encoded_bytes += encoded_bytes_;
+  for (const auto& channel : channels_) {
+    stats->tracked_keys += channel.second.size();
+  }
+  stats->tracked_bytes += bytes_;
+}
+
+StateDecoder::StateDecoder(size_t capacity) : capacity_(capacity) {}
+
+bool StateDecoder::Decode(Frame* frame) {
+  if (!(frame->flags & kFrameFlagKeyed)) {
+    return true;
+  }
+  std::string key;
+  size_t value_offset = 0;
+  if (!ReadKey(*frame, &key, &value_offset)) {
+    return false;
+  }
+  Keys& keys = channels_[frame->channel];
+  auto found = keys.find(key);
+  size_t previous = found != keys.end() ? found->second.value.size() : 0;
+  std::string& payload = frame->payload;
+  if (!(frame->flags & kFrameFlagDelta)) {
+    // The sender stopped tracking the key.
+    if (found != keys.end()) {
+      bytes_ -= previous;
+      keys.erase(found);
+    }
+    return true;
+  }
+  if (payload.size() < value_offset + kStateHeaderSize) {
+    return false;
+  }
+
+  uint8_t kind = static_cast<uint8_t>(payload[value_offset]);
+  uint32_t version = 0;
+  memcpy(&version, &payload[value_offset + 1], sizeof(version));
+  size_t body = value_offset + kStateHeaderSize;
+  std::string value;
+  if (kind == SNAPSHOT) {
+    value.assign(payload, body, std::string::npos);
+  } else if (kind == DELTA) {
+    if (found == keys.end() || found->second.version + 1 != version ||
+        !ApplyDelta(found->second.value, &payload[body], payload.size() - body, capacity_, &value)) {
+      ++misses_;
+      return false;
+    }
+  } else {
+    return false;
+  }
+
+  if (value.size() > capacity_ - (bytes_ - previous)) {
+    if (found != keys.end()) {
+      bytes_ -= previous;
+      keys.erase(found);
+    }
+  } else {
+    Entry& entry = found != keys.end() ? found->second : keys[key];
+    entry.version = version;
+    entry.value = value;
+    bytes_ += value.size() - previous;
+  }
+  payload.resize(value_offset);
+  payload += value;
+  frame->flags &= ~kFrameFlagDelta;
+  return true;
+}
+
+void StateDecoder::AddStats(StateSyncStats* stats) const {
+  for (const auto& channel : channels_) {
+    stats->held_keys += channel.second.size();
+  }
+  stats->held_bytes += bytes_;
+  stats->misses += misses_;
+}
+
+}  // namespace flutter_ipc
@@ -0,0 +1,122 @@
+#ifndef FLUTTER_PLUGIN_STATE_SYNC_H_
+#define FLUTTER_PLUGIN_STATE_SYNC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "frame.h"
+
+namespace flutter_ipc {
+
+// Puts |key| in front of the payload, past any sequence numbers, and sets
+// kFrameFlagKeyed. Keys are at most UINT16_MAX bytes.
+bool AddStateKey(Frame* frame, const std::string& key);
+// Reads the key of a keyed frame, encoded or not. Returns false if it has
+// none or it is malformed.
+bool ReadStateKey(const Frame& frame, std::string* key);
+// Removes the key from a keyed frame. Returns false, leaving |frame| alone,
+// if it has none or it is malformed.
+bool TakeStateKey(Frame* frame, std::string* key);
+
+// A binary diff turning |base| into |target|: a run of operations that
+// copy a range of |base| or add literal bytes. Matches are found through a
+// hash of every 8-byte window of the part of |base| that changed, so the
+// cost follows the size of the change more than that of the document.
+std::string EncodeDelta(const std::string& base, const std::string& target);
+// Applies a diff from EncodeDelta(). Returns false for a malformed one, or
+// one whose result would exceed |max_size|.
+bool ApplyDelta(const std::string& base, const char* delta, size_t size, size_t max_size,
+                std::string* target);
+
+// Counters of one connection's state sync, both directions.
+struct StateSyncStats {
+  // Keyed updates sent, how many went out in full and as a delta, and the
+  // value bytes they held against the bytes that went out for them.
+  uint64_t updates = 0;
+  uint64_t snapshots = 0;
+  uint64_t deltas = 0;
+  uint64_t value_bytes = 0;
+  uint64_t encoded_bytes = 0;
+  // Last versions kept to diff against, and those kept of the peer's keys.
+  uint64_t tracked_keys = 0;
+  uint64_t tracked_bytes = 0;
+  uint64_t held_keys = 0;
+  uint64_t held_bytes = 0;
+  // Deltas from the peer that did not apply to the version held; those
+  // updates are dropped until the next snapshot of the key.
+  uint64_t misses = 0;
+};
+
+// The sending half of state sync. It keeps the last value sent under every
+// key of a state-sync channel and replaces the next value with a diff
+// against it, numbering the versions of each key. Every
+// |snapshot_interval|-th update of a key goes out in full, so a receiver
+// that lost track of it recovers. Keys whose values would take the
+// encoder past its capacity are no longer tracked and go out as plain
+// keyed frames, which tell the receiver to forget them too. Not
+// thread-safe; Encode() must be called in queue order.
+class StateEncoder {
+ public:
+  explicit StateEncoder(size_t capacity);
+
+  // Rewrites a keyed |frame| into a snapshot or a delta.
+  void Encode(Frame* frame, uint32_t snapshot_interval);
+
+  // Sends the next update of |key| in full: the receiver may not have seen
+  // the last one.
+  void Resync(uint16_t channel, const std::string& key);
+
+  void AddStats(StateSyncStats* stats) const;
+
+ private:
+  struct Entry {
+    uint32_t version = 0;
+    // Updates since the last snapshot; 0 sends the next one in full.
+    uint32_t since_snapshot = 0;
+    std::string value;
+  };
+  using Keys = std::unordered_map<std::string, Entry>;
+
+  size_t capacity_;
+  size_t bytes_ = 0;
+  std::unordered_map<uint16_t, Keys> channels_;
+  uint64_t updates_ = 0;
+  uint64_t snapshots_ = 0;
+  uint64_t deltas_ = 0;
+  uint64_t value_bytes_ = 0;
+  uint64_t encoded_bytes_ = 0;
+};
+
+// The receiving half: applies the snapshots and deltas of a StateEncoder
+// and hands on the keyed frame with the full value. Holds at most
+// |capacity| bytes; past it a key is forgotten and its deltas miss until
+// the next snapshot. Not thread-safe; frames must be decoded in the order
+// they arrive.
+class StateDecoder {
+ public:
+  explicit StateDecoder(size_t capacity);
+
+  // Restores |frame| if it carries kFrameFlagDelta. Returns false for a
+  // malformed frame or a delta against a version that is not held.
+  bool Decode(Frame* frame);
+
+  void AddStats(StateSyncStats* stats) const;
+
+ private:
+  struct Entry {
+    uint32_t version = 0;
+    std::string value;
+  };
+  using Keys = std::unordered_map<std::string, Entry>;
+
+  size_t capacity_;
+  size_t bytes_ = 0;
+  std::unordered_map<uint16_t, Keys> channels_;
+  uint64_t misses_ = 0;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_STATE_SYNC_H_
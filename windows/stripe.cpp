@@ -0,0 +1,130 @@
+#include "stripe.h"
+
+#include <cstring>
+#include <utility>
+
+namespace flutter_ipc {
+
+const char* StripePolicyName(StripePolicy policy) {
+  return policy == StripePolicy::LEAST_QUEUED ? "leastQueued" : "roundRobin";
+}
+
+bool ParseStripePolicy(const std::string& name, StripePolicy* policy) {
+  for (StripePolicy candidate : {StripePolicy::ROUND_ROBIN, StripePolicy::LEAST_QUEUED}) {
+    if (name == StripePolicyName(candidate)) {
+      *policy = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+void AddStripeSequence(Frame* frame, uint64_t sequence) {
+  frame->payload.insert(0, reinterpret_cast<const char*>(&sequence), sizeof(sequence));
+  frame->flags |= kFrameFlagStriped;
+}
+
+bool TakeStripeSequence(Frame* frame, uint64_t* sequence) {
+  if (!(frame->flags & kFrameFlagStriped) || frame->payload.size() < sizeof(*sequence)) {
+    return false;
+  }
+  memcpy(sequence, frame->payload.data(), sizeof(*sequence));
+  frame->payload.erase(0, sizeof(*sequence));
+  frame->flags &= ~kFrameFlagStriped;
+  return true;
+}
+
+StripeSender::StripeSender(StripePolicy policy, bool ordered) : policy_(policy), ordered_(ordered) {}
+
+int StripeSender::PickLane(const std::vector<size_t>& queued_bytes) {
+  size_t count = queued_bytes.size();
+  int picked = -1;
+  // Starting after the last pick, so that equally loaded connections take
+  // turns.
+  for (size_t i = 0; i < count; ++i) {
+    size_t lane = (next_lane_ + i) % count;
+    if (queued_bytes[lane] == SIZE_MAX) {
+      continue;
+    }
+    if (picked < 0 || queued_bytes[lane] < queued_bytes[picked]) {
+      picked = static_cast<int>(lane);
+    }
+    if (policy_ == StripePolicy::ROUND_ROBIN) {
+      break;
+    }
+  }
+  if (picked >= 0) {
+    next_lane_ = (picked + 1) % count;
+  }
+  return picked;
+}
+
+void StripeSender::Stamp(Frame* frame) const {
+  auto it = sequences_.find(frame->channel);
+  AddStripeSequence(frame, (it != sequences_.end() ? it->second : 0) + 1);
+}
+
+void StripeSender::Commit(uint16_t channel) {
+  ++sequences_[channel];
+}
+
+void StripeSender::Reset() {
+  next_lane_ = 0;
+  sequences_.clear();
+}
+
+StripeReorderer::StripeReorderer(Deliver deliver) : deliver_(std::move(deliver)) {}
+
+void StripeReorderer::Add(Frame frame, Consumed consumed) {
+  uint64_t sequence = 0;
+  if (!TakeStripeSequence(&frame, &sequence)) {
+    deliver_(std::move(frame), std::move(consumed));
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Channel& channel = channels_[frame.channel];
+  if (sequence != channel.next) {
+    // A duplicate can only come from a confused peer; drop it.
+    if (sequence < channel.next || !channel.held.emplace(sequence, std::make_pair(std::move(frame), consumed)).second) {
+      consumed();
+      return;
+    }
+    ++held_;
+    return;
+  }
+
+  deliver_(std::move(frame), std::move(consumed));
+  ++channel.next;
+  // Frames that were waiting for this one follow it.
+  for (auto it = channel.held.begin(); it != channel.held.end() && it->first == channel.next;
+       it = channel.held.erase(it)) {
+    deliver_(std::move(it->second.first), std::move(it->second.second));
+    ++channel.next;
+    --held_;
+  }
+}
+
+void StripeReorderer::Reset() {
+  std::vector<Consumed> dropped;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& channel : channels_) {
+      for (auto& frame : channel.second.held) {
+        dropped.push_back(std::move(frame.second.second));
+      }
+    }
+    channels_.clear();
+    held_ = 0;
+  }
+  for (auto& consumed : dropped) {
+    consumed();
+  }
+}
+
+size_t StripeReorderer::held() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return held_;
+}
+
+}  // namespace flutter_ipc
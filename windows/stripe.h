@@ -0,0 +1,102 @@
+#ifndef FLUTTER_PLUGIN_STRIPE_H_
+#define FLUTTER_PLUGIN_STRIPE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "frame.h"
+
+namespace flutter_ipc {
+
+// How a pooled endpoint picks the connection for its next frame.
+enum class StripePolicy {
+  ROUND_ROBIN,   // Each connection in turn
+  LEAST_QUEUED,  // The connection with the fewest bytes waiting to be written
+};
+
+const char* StripePolicyName(StripePolicy policy);
+bool ParseStripePolicy(const std::string& name, StripePolicy* policy);
+
+// Puts |sequence| in front of the payload and sets kFrameFlagStriped.
+void AddStripeSequence(Frame* frame, uint64_t sequence);
+// Removes the stripe sequence number from a frame that has one. Returns
+// false, leaving |frame| alone, if it has none.
+bool TakeStripeSequence(Frame* frame, uint64_t* sequence);
+
+// The sending half of a pool: picks the connection each frame goes out on
+// and, for ordered delivery, numbers the frames of every channel from 1.
+// Not thread-safe.
+class StripeSender {
+ public:
+  StripeSender(StripePolicy policy, bool ordered);
+
+  // Returns the index into |queued_bytes|, one entry per connection, of the
+  // connection for the next frame. Connections at SIZE_MAX are down and
+  // skipped; returns -1 if all of them are.
+  int PickLane(const std::vector<size_t>& queued_bytes);
+
+  // Numbers |frame| with the next sequence number of its channel. Only
+  // Commit() uses the number up, so a frame that could not be queued
+  // leaves no gap.
+  void Stamp(Frame* frame) const;
+  void Commit(uint16_t channel);
+
+  // Numbering starts over, for a new peer.
+  void Reset();
+
+  bool ordered() const { return ordered_; }
+
+ private:
+  StripePolicy policy_;
+  bool ordered_;
+  size_t next_lane_ = 0;
+  // Last sequence number used, by channel.
+  std::unordered_map<uint16_t, uint64_t> sequences_;
+};
+
+// The receiving half of a pool: frames numbered by a StripeSender arrive
+// over several connections, and are passed on in the order they were
+// numbered, channel by channel. A frame that overtook others is held, with
+// its flow-control credit, until they have arrived. Frames without a
+// number pass straight through. Thread-safe; |deliver| runs under the
+// reorderer's lock, so it must not block.
+class StripeReorderer {
+ public:
+  using Consumed = std::function<void()>;
+  using Deliver = std::function<void(Frame frame, Consumed consumed)>;
+
+  explicit StripeReorderer(Deliver deliver);
+
+  // Disallow copy and assign.
+  StripeReorderer(const StripeReorderer&) = delete;
+  StripeReorderer& operator=(const StripeReorderer&) = delete;
+
+  void Add(Frame frame, Consumed consumed);
+
+  // Drops held frames, consuming them, and expects numbering to start over.
+  void Reset();
+
+  // Frames held back right now.
+  size_t held() const;
+
+ private:
+  struct Channel {
+    uint64_t next = 1;
+    std::map<uint64_t, std::pair<Frame, Consumed>> held;
+  };
+
+  Deliver deliver_;
+  mutable std::mutex mutex_;
+  std::unordered_map<uint16_t, Channel> channels_;
+  size_t held_ = 0;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_STRIPE_H_
@@ -4,11 +4,45 @@
 #include <gtest/gtest.h>
 #include <windows.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <variant>
+#include <vector>
 
+#include "blob_cache.h"
+#include "capture.h"
+#include "channel_mux.h"
+#include "completion_port.h"
+#include "connection_monitor.h"
+#include "connection_options.h"
+#include "flow_control.h"
 #include "flutter_ipc_plugin.h"
+#include "handler_pool.h"
+#include "json_decoder.h"
+#include "memory_budget.h"
+#include "mpsc_queue.h"
+#include "network_shaper.h"
+#include "outbox.h"
+#include "record_reader.h"
+#include "router.h"
+#include "send_queue.h"
+#include "service_registry.h"
+#include "session.h"
+#include "shared_handle.h"
+#include "state_sync.h"
+#include "stripe.h"
+#include "timing_wheel.h"
+#include "utf8.h"
+#include "value_codec.h"
 
 namespace flutter_ipc {
 namespace test {
@@ -39,5 +73,1355 @@ TEST(FlutterIpcPlugin, GetPlatformVersion) {
   EXPECT_TRUE(result_string.rfind("Windows ", 0) == 0);
 }
 
+TEST(InProcessPipe, DeliversToOppositeEndAndDrainsAfterClose) {
+  InProcessPipe pipe;
+  EXPECT_TRUE(pipe.Write(InProcessPipe::End::CLIENT, Frame(FrameType::TEXT, "to server")));
+  EXPECT_TRUE(pipe.Write(InProcessPipe::End::SERVER, Frame(FrameType::TEXT, "to client")));
+  pipe.Close();
+
+  // Writes fail once closed, but queued frames are still readable.
+  EXPECT_FALSE(pipe.Write(InProcessPipe::End::CLIENT, Frame(FrameType::TEXT, "late")));
+  Frame frame;
+  ASSERT_TRUE(pipe.Read(InProcessPipe::End::SERVER, &frame));
+  EXPECT_EQ(frame.payload, "to server");
+  ASSERT_TRUE(pipe.Read(InProcessPipe::End::CLIENT, &frame));
+  EXPECT_EQ(frame.payload, "to client");
+  EXPECT_FALSE(pipe.Read(InProcessPipe::End::SERVER, &frame));
+}
+
+TEST(ValueCodec, RoundTripsStructuredValues) {
+  EncodableValue value(EncodableMap{
+      {EncodableValue("id"), EncodableValue(42)},
+      {EncodableValue("big"), EncodableValue(int64_t{1} << 40)},
+      {EncodableValue("ratio"), EncodableValue(0.5)},
+      {EncodableValue("tags"), EncodableValue(flutter::EncodableList{
+                                   EncodableValue("a"), EncodableValue()})},
+      {EncodableValue("bytes"), EncodableValue(std::vector<uint8_t>{1, 2, 3})},
+  });
+
+  Frame frame = EncodeValueFrame(value);
+  EXPECT_EQ(frame.type, FrameType::VALUE);
+
+  EncodableValue decoded;
+  ASSERT_TRUE(DecodeValueFrame(frame, &decoded));
+  EXPECT_TRUE(decoded == value);
+
+  // A truncated payload is rejected rather than read out of bounds.
+  frame.payload.pop_back();
+  EXPECT_FALSE(DecodeValueFrame(frame, &decoded));
+}
+
+TEST(SharedHandle, TakesAttachedHandlesFromTheSenderAndChecksThem) {
+  auto memory = SharedHandle::CreateSharedMemory(4096);
+  ASSERT_TRUE(memory);
+  const uint8_t data[] = {1, 2, 3};
+  ASSERT_TRUE(memory->Write(10, data, sizeof(data)));
+  // Each frame carries copies of its own, which taking it uses up.
+  auto encode = [&](Frame* frame) {
+    std::vector<uint64_t> copies;
+    EXPECT_TRUE(EncodeHandleFrame({memory.get()}, "hello", frame, &copies));
+    EXPECT_EQ(copies.size(), 1u);
+    return copies;
+  };
+
+  Frame frame;
+  encode(&frame);
+  ASSERT_TRUE(TakeHandleFrame(&frame, GetCurrentProcessId()));
+  std::vector<std::unique_ptr<SharedHandle>> handles;
+  std::string message;
+  ASSERT_TRUE(DecodeHandleFrame(frame, &handles, &message));
+  EXPECT_EQ(message, "hello");
+  ASSERT_EQ(handles.size(), 1u);
+  EXPECT_EQ(handles[0]->kind(), SharedHandleKind::SHARED_MEMORY);
+  EXPECT_EQ(handles[0]->size(), 4096u);
+  std::vector<uint8_t> read;
+  ASSERT_TRUE(handles[0]->Read(10, sizeof(data), &read));
+  EXPECT_EQ(read, std::vector<uint8_t>(data, data + sizeof(data)));
+
+  // Descriptors are laid out as uint32 count, then uint64 value, uint64
+  // size, uint8 kind and padding. A handle the sender does not hold, a
+  // kind nobody knows and a size past the section are all refused.
+  const size_t value_offset = sizeof(uint32_t);
+  const size_t size_offset = value_offset + sizeof(uint64_t);
+  const size_t kind_offset = size_offset + sizeof(uint64_t);
+  Frame bogus;
+  std::vector<uint64_t> untaken = encode(&bogus);
+  uint64_t bogus_value = 0x7FFFFFF0;
+  memcpy(&bogus.payload[value_offset], &bogus_value, sizeof(bogus_value));
+  EXPECT_FALSE(TakeHandleFrame(&bogus, GetCurrentProcessId()));
+  Frame unknown;
+  encode(&unknown);
+  unknown.payload[kind_offset] = 7;
+  EXPECT_FALSE(TakeHandleFrame(&unknown, GetCurrentProcessId()));
+  Frame oversized;
+  encode(&oversized);
+  uint64_t claimed = 1 << 20;
+  memcpy(&oversized.payload[size_offset], &claimed, sizeof(claimed));
+  EXPECT_FALSE(TakeHandleFrame(&oversized, GetCurrentProcessId()));
+
+  // Truncated payloads are rejected rather than read out of bounds.
+  Frame truncated;
+  std::vector<uint64_t> copies = encode(&truncated);
+  untaken.insert(untaken.end(), copies.begin(), copies.end());
+  truncated.payload.resize(kind_offset);
+  EXPECT_FALSE(TakeHandleFrame(&truncated, GetCurrentProcessId()));
+  EXPECT_FALSE(DecodeHandleFrame(truncated, &handles, &message));
+  truncated.payload.resize(2);
+  EXPECT_FALSE(DecodeHandleFrame(truncated, &handles, &message));
+  // Nothing took those copies, so the sender closes them.
+  ReleaseHandleCopies(untaken);
+}
+
+TEST(ChannelScheduler, InterleavesChunksByPriorityAndReassembles) {
+  ChannelScheduler scheduler(4);
+  scheduler.ConfigureChannel(1, ChannelOptions{1, 1});
+
+  auto bulk = std::make_shared<PendingFrame>();
+  bulk->frame = Frame(FrameType::TEXT, "0123456789");
+  scheduler.Enqueue(bulk);
+
+  FrameChunk chunk;
+  ASSERT_TRUE(scheduler.NextChunk(&chunk));
+  Frame first = chunk.TakeFrame();
+  EXPECT_EQ(first.payload, "0123");
+
+  // The urgent frame overtakes the rest of the bulk transfer.
+  auto urgent = std::make_shared<PendingFrame>();
+  urgent->frame = Frame(FrameType::TEXT, "hi");
+  urgent->frame.channel = 1;
+  scheduler.Enqueue(urgent);
+  ASSERT_TRUE(scheduler.NextChunk(&chunk));
+  EXPECT_EQ(chunk.owner, urgent);
+  EXPECT_TRUE(chunk.last);
+
+  FrameAssembler assembler;
+  Frame frame;
+  EXPECT_EQ(assembler.GrownFrameBytes(first), 4u);
+  EXPECT_FALSE(assembler.Add(std::move(first), &frame));
+  // Whole frames pass through without growing anything.
+  EXPECT_EQ(assembler.GrownFrameBytes(chunk.TakeFrame()), 0u);
+  while (scheduler.NextChunk(&chunk)) {
+    EXPECT_EQ(chunk.owner, bulk);
+    Frame next = chunk.TakeFrame();
+    EXPECT_EQ(assembler.GrownFrameBytes(next), assembler.pending_bytes() + next.payload.size());
+    if (assembler.Add(std::move(next), &frame)) {
+      EXPECT_TRUE(chunk.last);
+    }
+  }
+  EXPECT_EQ(frame.payload, "0123456789");
+  EXPECT_EQ(frame.flags, 0);
+  EXPECT_TRUE(scheduler.IsEmpty());
+}
+
+TEST(ChannelScheduler, ReplacesUnsentFramesOfAKeyInPlace) {
+  ChannelScheduler scheduler(4);
+  ChannelOptions options;
+  options.conflate = true;
+  scheduler.ConfigureChannel(2, options);
+  auto make = [](uint16_t channel, const std::string& payload) {
+    auto pending = std::make_shared<PendingFrame>();
+    pending->frame = Frame(FrameType::TEXT, payload);
+    pending->frame.channel = channel;
+    return pending;
+  };
+
+  const std::string cursor = "cursor";
+  const std::string progress = "progress";
+  scheduler.Enqueue(make(2, "c1"), &cursor);
+  scheduler.Enqueue(make(2, "progress1"), &progress);
+  // Channels that do not conflate queue every frame.
+  scheduler.Enqueue(make(0, "plain"), &cursor);
+  EXPECT_EQ(scheduler.FindConflatable(0, cursor), nullptr);
+
+  auto queued = scheduler.FindConflatable(2, cursor);
+  ASSERT_NE(queued, nullptr);
+  EXPECT_EQ(queued->frame.payload, "c1");
+  auto newer = make(2, "c2");
+  scheduler.Replace(queued, newer);
+  EXPECT_EQ(scheduler.FindConflatable(2, cursor), newer);
+  EXPECT_EQ(scheduler.QueuedFrames(), 3u);
+
+  // The newest value keeps the place of the first.
+  FrameChunk chunk;
+  ASSERT_TRUE(scheduler.NextChunk(&chunk));
+  EXPECT_EQ(chunk.owner, newer);
+  EXPECT_EQ(scheduler.FindConflatable(2, cursor), nullptr);
+  ASSERT_TRUE(scheduler.NextChunk(&chunk));
+  EXPECT_EQ(chunk.TakeFrame().payload, "prog");
+  // Partially sent, so a newer value queues behind it.
+  EXPECT_EQ(scheduler.FindConflatable(2, progress), nullptr);
+  scheduler.Enqueue(make(2, "progress2"), &progress);
+  EXPECT_NE(scheduler.FindConflatable(2, progress), nullptr);
+
+  options.conflate = false;
+  scheduler.ConfigureChannel(2, options);
+  EXPECT_EQ(scheduler.FindConflatable(2, progress), nullptr);
+  EXPECT_EQ(scheduler.TakeAll().size(), 3u);
+}
+
+TEST(FlowController, SendsWithinGrantedCreditOnly) {
+  FlowWindow window;
+  window.bytes = 100;
+  window.messages = 8;
+  FlowController receiver(window);
+  FlowController sender(FlowWindow{});
+  EXPECT_FALSE(sender.CanSend());
+
+  // The receiver announces its window when the connection starts.
+  uint32_t bytes = 0;
+  uint32_t messages = 0;
+  ASSERT_TRUE(DecodeCreditFrame(EncodeCreditFrame(window.bytes, window.messages), &bytes, &messages));
+  sender.OnCredit(bytes, messages);
+
+  int sent = 0;
+  while (sender.CanSend()) {
+    sender.OnSent(30, true);
+    receiver.OnReceived(30);
+    ++sent;
+  }
+  EXPECT_EQ(sent, 4);  // The last one overdraws the window by 20 bytes
+  EXPECT_EQ(receiver.Stats(FlowController::Clock::now()).unconsumed_messages, 4u);
+
+  // Credit comes back as the application consumes, a quarter window at a time.
+  for (int i = 0; i < sent; ++i) {
+    if (receiver.OnConsumed(30, &bytes, &messages)) {
+      sender.OnCredit(bytes, messages);
+    }
+  }
+  EXPECT_TRUE(sender.CanSend());
+  EXPECT_EQ(sender.Stats(FlowController::Clock::now()).send_credit_bytes, 100);
+}
+
+TEST(AutoTuner, BatchesSmallFramesAndFitsChunksToLargeOnes) {
+  AutoTuner tuner;
+  size_t chunk_size = 0;
+  size_t coalesce_bytes = 0;
+  for (size_t i = 1; i < AutoTuner::kWindow; ++i) {
+    ASSERT_FALSE(tuner.Observe(100, &chunk_size, &coalesce_bytes));
+  }
+  ASSERT_TRUE(tuner.Observe(100, &chunk_size, &coalesce_bytes));
+  EXPECT_EQ(chunk_size, 4096u);
+  EXPECT_EQ(coalesce_bytes, 4096u);
+
+  for (size_t i = 0; i < AutoTuner::kWindow; ++i) {
+    tuner.Observe(100 * 1024, &chunk_size, &coalesce_bytes);
+  }
+  EXPECT_EQ(chunk_size, 128u * 1024);
+  EXPECT_EQ(coalesce_bytes, 0u);
+}
+
+TEST(SendQueue, SpinningWriterPicksUpEveryFrame) {
+  ConnectionOptions options;
+  options.framing = Framing::NEWLINE;  // No credit to wait for
+  options.polling.spin_us = 500;
+  std::mutex mutex;
+  std::condition_variable written;
+  std::vector<std::string> payloads;
+  SendQueue queue([&](std::vector<FrameChunk>& chunks) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& chunk : chunks) {
+      if (chunk.last) {
+        payloads.push_back(chunk.owner->frame.payload);
+      }
+    }
+    written.notify_all();
+    return true;
+  }, options);
+
+  // One frame at a time, so that each has to wake the writer: while it
+  // spins, just as it gives up spinning, and long after it went to sleep.
+  // Frames with a deadline are queued under the lock, the others without.
+  const std::chrono::microseconds pauses[] = {
+      std::chrono::microseconds(0), std::chrono::microseconds(400), std::chrono::microseconds(5000)};
+  constexpr size_t kFrames = 120;
+  for (size_t i = 0; i < kFrames; ++i) {
+    std::this_thread::sleep_for(pauses[i % 3]);
+    uint32_t timeout_ms = (i / 3) % 2 == 0 ? 0 : 10000;
+    ASSERT_TRUE(queue.Enqueue(Frame(FrameType::TEXT, std::to_string(i)), nullptr, timeout_ms));
+    std::unique_lock<std::mutex> lock(mutex);
+    ASSERT_TRUE(written.wait_for(lock, std::chrono::seconds(5), [&] { return payloads.size() == i + 1; }));
+    EXPECT_EQ(payloads.back(), std::to_string(i));
+  }
+  queue.Stop();
+}
+
+TEST(CompletionPortReader, CutsReadsIntoChunksAndReadsAgain) {
+  auto reader = CompletionPortReader::Acquire();
+  ASSERT_TRUE(reader);
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::vector<Frame> chunks;
+  int closes = 0;
+  auto wait_until = [&](const std::function<bool()>& done) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return changed.wait_for(lock, std::chrono::seconds(5), done);
+  };
+  auto open_pipe = [&](const std::string& name, HANDLE* server, HANDLE* client) {
+    std::string full_name = "\\\\.\\pipe\\flutter_ipc_test_" + name + "_" + std::to_string(GetCurrentProcessId());
+    *server = CreateNamedPipeA(full_name.c_str(), PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED,
+                               PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT, 1, 0, 1 << 20, 0, NULL);
+    *client = CreateFileA(full_name.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    return *server != INVALID_HANDLE_VALUE && *client != INVALID_HANDLE_VALUE &&
+           reader->Attach(*server, [&](Frame chunk) {
+             std::lock_guard<std::mutex> lock(mutex);
+             chunks.push_back(std::move(chunk));
+             changed.notify_all();
+             return true;
+           }, [&]() {
+             std::lock_guard<std::mutex> lock(mutex);
+             ++closes;
+             changed.notify_all();
+           });
+  };
+  // One pipe message, as a writer sends a batch of chunks.
+  auto write = [](HANDLE client, const std::vector<Frame>& frames) {
+    std::string message;
+    for (const auto& frame : frames) {
+      FrameHeader header = {static_cast<uint32_t>(frame.payload.size()), static_cast<uint8_t>(frame.type),
+                            frame.flags, frame.channel};
+      message.append(reinterpret_cast<const char*>(&header), sizeof(header));
+      message += frame.payload;
+    }
+    DWORD written = 0;
+    return WriteFile(client, message.data(), static_cast<DWORD>(message.size()), &written, NULL) &&
+           written == message.size();
+  };
+
+  HANDLE server = INVALID_HANDLE_VALUE;
+  HANDLE client = INVALID_HANDLE_VALUE;
+  uint64_t reads = reader->GetStats().reads;
+  ASSERT_TRUE(open_pipe("read", &server, &client));
+
+  // Two chunks in one read, then a chunk larger than a read, which the
+  // reader completes over the reads that follow.
+  Frame value(FrameType::VALUE, "bc");
+  value.channel = 3;
+  Frame large(FrameType::TEXT, std::string(CompletionPortReader::kReadSize * 3 / 2, 'x'));
+  large.flags = kFrameFlagMoreChunks;
+  ASSERT_TRUE(write(client, {Frame(FrameType::TEXT, "a"), value}));
+  ASSERT_TRUE(write(client, {large}));
+  ASSERT_TRUE(wait_until([&] { return chunks.size() == 3; }));
+  EXPECT_EQ(chunks[0].payload, "a");
+  EXPECT_EQ(chunks[1].type, FrameType::VALUE);
+  EXPECT_EQ(chunks[1].channel, 3);
+  EXPECT_EQ(chunks[1].payload, "bc");
+  EXPECT_EQ(chunks[2].flags, kFrameFlagMoreChunks);
+  EXPECT_EQ(chunks[2].payload, large.payload);
+  EXPECT_GE(reader->GetStats().reads - reads, 3u);
+
+  // The peer going away is reported once; the pipe is then detached.
+  CloseHandle(client);
+  ASSERT_TRUE(wait_until([&] { return closes == 1; }));
+  reader->Detach(server);
+  CloseHandle(server);
+
+  // A pipe detached while its read is outstanding is read no more, and its
+  // close is not reported.
+  ASSERT_TRUE(open_pipe("detach", &server, &client));
+  reader->Detach(server);
+  ASSERT_TRUE(write(client, {Frame(FrameType::TEXT, "late")}));
+  CloseHandle(client);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(chunks.size(), 3u);
+    EXPECT_EQ(closes, 1);
+  }
+  CloseHandle(server);
+}
+
+TEST(Utf8, RejectsMalformedSequencesAtAnyOffset) {
+  const std::string valid[] = {
+    "", "plain ascii", "\xC3\xA9t\xC3\xA9", "\xE2\x82\xAC", "\xED\x9F\xBF",
+    "\xF0\x9F\x9A\x80", "\xF4\x8F\xBF\xBF",
+  };
+  const std::string invalid[] = {
+    "\x80", "\xC0\xAF", "\xC3", "\xE0\x80\xAF", "\xED\xA0\x80",
+    "\xF4\x90\x80\x80", "\xF8\x88\x80\x80\x80", "\xE2\x82",
+  };
+  // Shifting each sample across the vector block boundaries.
+  for (size_t padding : {0, 15, 31, 62}) {
+    std::string prefix(padding, 'a');
+    for (const auto& sample : valid) {
+      std::string text = prefix + sample + std::string(40, 'b');
+      EXPECT_TRUE(IsValidUtf8(text.data(), text.size())) << padding;
+      EXPECT_TRUE(IsValidUtf8Scalar(text.data(), text.size())) << padding;
+    }
+    for (const auto& sample : invalid) {
+      std::string text = prefix + sample + std::string(40, 'b');
+      EXPECT_FALSE(IsValidUtf8(text.data(), text.size())) << padding;
+      EXPECT_FALSE(IsValidUtf8Scalar(text.data(), text.size())) << padding;
+      std::string truncated = prefix + sample;
+      EXPECT_FALSE(IsValidUtf8(truncated.data(), truncated.size())) << padding;
+    }
+  }
+}
+
+TEST(JsonDecoder, DecodesLikeJsonDecodeAndReportsErrorOffsets) {
+  // Long enough that the escapes land in the vector scan of the string.
+  std::string json = "{\"id\": 7, \"big\": 12345678901, \"ratio\": -2.5e-1, "
+                     "\"tags\": [true, null, \"0123456789abcdef\\u00e9\\ud83d\\ude80\\n\"], "
+                     "\"id\": 8}";
+  flutter::EncodableValue value;
+  std::string error;
+  ASSERT_TRUE(DecodeJson(json.data(), json.size(), &value, &error)) << error;
+  const auto& map = std::get<flutter::EncodableMap>(value);
+  EXPECT_EQ(map.size(), 4u);
+  EXPECT_EQ(map.at(flutter::EncodableValue("id")), flutter::EncodableValue(8));
+  EXPECT_EQ(map.at(flutter::EncodableValue("big")), flutter::EncodableValue(int64_t{12345678901}));
+  EXPECT_EQ(map.at(flutter::EncodableValue("ratio")), flutter::EncodableValue(-0.25));
+  const auto& tags = std::get<flutter::EncodableList>(map.at(flutter::EncodableValue("tags")));
+  ASSERT_EQ(tags.size(), 3u);
+  EXPECT_EQ(tags[0], flutter::EncodableValue(true));
+  EXPECT_TRUE(tags[1].IsNull());
+  EXPECT_EQ(tags[2], flutter::EncodableValue("0123456789abcdef\xC3\xA9\xF0\x9F\x9A\x80\n"));
+
+  const std::pair<std::string, size_t> invalid[] = {
+    {"[1,]", 3}, {"{\"a\" 1}", 5}, {"01", 1}, {"\"\\ud800\"", 7},
+    {"\"tab\there\"", 4}, {"tru", 0}, {std::string(600, '['), 512},
+  };
+  for (const auto& sample : invalid) {
+    EXPECT_FALSE(DecodeJson(sample.first.data(), sample.first.size(), &value, &error)) << sample.first;
+    EXPECT_NE(error.find("at offset " + std::to_string(sample.second)), std::string::npos) << error;
+  }
+}
+
+TEST(RecordReader, SlicesRecordsAcrossTheWrapAndDropsOverlongOnes) {
+  for (size_t padding : {0, 17, 63, 100}) {
+    std::string text = std::string(padding, 'x') + "\n";
+    EXPECT_EQ(FindDelimiter(text.data(), text.size(), '\n'), padding);
+    EXPECT_EQ(FindDelimiter(text.data(), padding, '\n'), padding);
+  }
+
+  // Small records fill the ring a few times over, so some wrap around its
+  // end; reads stop at arbitrary points within records.
+  RecordReader reader(100);
+  std::string stream;
+  std::vector<std::string> expected;
+  for (int i = 0; i < 5000; ++i) {
+    std::string record = "record " + std::to_string(i) + std::string(i % 90, '.');
+    stream += record + (i % 3 == 0 ? "\r\n" : "\n");
+    expected.push_back(record);
+    if (i % 1000 == 0) {
+      stream += std::string(RecordReader::kReadSize * 2, 'z') + "\n";
+    }
+  }
+  std::vector<std::string> records;
+  size_t position = 0;
+  for (size_t step = 1; position < stream.size(); step = step * 7 % 4093 + 1) {
+    size_t size = 0;
+    char* buffer = reader.ReadBuffer(&size);
+    ASSERT_GT(size, 0u);
+    size = std::min({size, step, stream.size() - position});
+    memcpy(buffer, stream.data() + position, size);
+    position += size;
+    reader.Commit(size, [&](const char* data, size_t length) { records.emplace_back(data, length); });
+  }
+  EXPECT_EQ(records, expected);
+  EXPECT_EQ(reader.dropped(), 5u);
+}
+
+TEST(MemoryBudget, RejectsPausesAndShedsTheLargestConnection) {
+  MemoryBudget budget;
+  MemoryAccount sender(100, BudgetPolicy::REJECT_SENDS, &budget);
+  EXPECT_TRUE(sender.ChargeSend(60));
+  EXPECT_FALSE(sender.ChargeSend(60));
+  sender.ReleaseSend(60);
+  EXPECT_TRUE(sender.ChargeSend(60));
+  EXPECT_EQ(sender.GetStats().rejected_sends, 1u);
+
+  // Reads wait while the reader holds more than its limit.
+  MemoryAccount reader(100, BudgetPolicy::PAUSE_READS, &budget);
+  reader.ChargeReceive(80);
+  reader.SetReassembly(30);
+  HANDLE stop_event = CreateEventW(NULL, TRUE, TRUE, NULL);
+  EXPECT_FALSE(reader.WaitForRoom(stop_event));
+  reader.ReleaseReceive(80);
+  EXPECT_TRUE(reader.WaitForRoom(stop_event));
+  EXPECT_EQ(reader.GetStats().read_pauses, 1u);
+  EXPECT_EQ(reader.GetStats().peak_bytes, 110u);
+
+  // Over the global limit, the account holding the most goes first, and
+  // only once until it has given its memory back.
+  std::vector<std::string> shed;
+  sender.SetShedHandler([&]() { shed.push_back("sender"); });
+  reader.SetShedHandler([&]() { shed.push_back("reader"); });
+  budget.Configure(100, BudgetPolicy::DISCONNECT);
+  reader.ChargeReceive(20);
+  reader.ChargeReceive(10);
+  EXPECT_EQ(shed, std::vector<std::string>{"sender"});
+  sender.ReleaseSend(60);
+  reader.ChargeReceive(50);
+  EXPECT_EQ(shed, (std::vector<std::string>{"sender", "reader"}));
+  EXPECT_EQ(budget.GetStats().disconnects, 2u);
+
+  // A global pause holds every reader, whoever holds the memory.
+  reader.ReleaseReceive(80);
+  reader.SetReassembly(0);
+  budget.Configure(100, BudgetPolicy::PAUSE_READS);
+  sender.ChargeReceive(150);
+  EXPECT_FALSE(reader.WaitForRoom(stop_event));
+  sender.ReleaseReceive(150);
+  EXPECT_TRUE(reader.WaitForRoom(stop_event));
+  CloseHandle(stop_event);
+}
+
+TEST(MemoryBudget, KeepsReadingWhileQueuedSendsFillAPauseLimit) {
+  // Sends wait for the credit the peer's frames carry, so a pause over
+  // them would never end.
+  MemoryBudget budget;
+  MemoryAccount account(100, BudgetPolicy::PAUSE_READS, &budget);
+  HANDLE stop_event = CreateEventW(NULL, TRUE, TRUE, NULL);
+  EXPECT_TRUE(account.ChargeSend(150));
+  EXPECT_TRUE(account.WaitForRoom(stop_event));
+  budget.Configure(100, BudgetPolicy::PAUSE_READS);
+  EXPECT_TRUE(account.WaitForRoom(stop_event));
+
+  // Received memory still pauses, whatever the sends do.
+  account.ChargeReceive(120);
+  EXPECT_FALSE(account.WaitForRoom(stop_event));
+  account.ReleaseSend(150);
+  EXPECT_FALSE(account.WaitForRoom(stop_event));
+  account.ReleaseReceive(120);
+  EXPECT_TRUE(account.WaitForRoom(stop_event));
+  EXPECT_EQ(account.GetStats().read_pauses, 1u);
+  EXPECT_EQ(budget.GetStats().read_pauses, 1u);
+
+  // One frame may be no larger than the tighter of the two limits.
+  EXPECT_EQ(account.frame_limit(), 100u);
+  budget.Configure(0, BudgetPolicy::PAUSE_READS);
+  EXPECT_EQ(account.frame_limit(), 100u);
+  CloseHandle(stop_event);
+}
+
+TEST(Outbox, ReplaysUnacknowledgedFramesIntoSameSessionOnce) {
+  // Small enough that the records wrap around the end of the mapping.
+  auto outbox = Outbox::Create(64);
+  ASSERT_TRUE(outbox);
+  uint64_t sequence = 0;
+  for (int i = 0; i < 3; ++i) {
+    Frame frame(FrameType::TEXT, "msg" + std::to_string(i));
+    AddSequence(&frame, ++sequence);
+    ASSERT_TRUE(outbox->Append(frame));
+  }
+  Frame overflow(FrameType::TEXT, "msg3");
+  AddSequence(&overflow, sequence + 1);
+  EXPECT_FALSE(outbox->Append(overflow));
+
+  // The server saw the first two frames before the connection dropped.
+  SessionTracker session;
+  session.OnHello(42);
+  std::vector<Frame> frames;
+  outbox->ForEach([&](Frame frame) { frames.push_back(std::move(frame)); });
+  ASSERT_EQ(frames.size(), 3u);
+  for (int i = 0; i < 2; ++i) {
+    uint64_t accepted_sequence = 0;
+    EXPECT_EQ(session.Accept(&frames[i], &accepted_sequence), SessionTracker::Verdict::DELIVER);
+    EXPECT_EQ(frames[i].payload, "msg" + std::to_string(i));
+  }
+  outbox->Acknowledge(AckMap{{0, 1}});
+  EXPECT_EQ(outbox->count(), 2u);
+  ASSERT_TRUE(outbox->Append(overflow));
+
+  // After the reconnect the same session gets the replay; only the frames
+  // it has not delivered yet pass.
+  session.OnHello(42);
+  std::vector<std::string> delivered;
+  outbox->ForEach([&](Frame frame) {
+    uint64_t replayed_sequence = 0;
+    if (session.Accept(&frame, &replayed_sequence) == SessionTracker::Verdict::DELIVER) {
+      delivered.push_back(frame.payload);
+    }
+  });
+  EXPECT_EQ(delivered, (std::vector<std::string>{"msg2", "msg3"}));
+
+  AckMap acks;
+  ASSERT_TRUE(DecodeAckFrame(EncodeAckFrame(AckMap{{0, 4}}), &acks));
+  outbox->Acknowledge(acks);
+  EXPECT_EQ(outbox->count(), 0u);
+  EXPECT_EQ(outbox->size(), 0u);
+}
+
+TEST(Outbox, RecoversAFrameMissingFromTheMiddleOfASession) {
+  auto outbox = Outbox::Create(256);
+  ASSERT_TRUE(outbox);
+  SessionTracker session;
+  session.OnHello(7);
+  uint64_t sequence = 0;
+  auto append = [&](const std::string& payload) {
+    Frame frame(FrameType::TEXT, payload);
+    AddSequence(&frame, sequence + 1);
+    EXPECT_TRUE(outbox->Append(frame));
+    return frame;
+  };
+
+  // A frame the send queue refuses is taken back and its number reused.
+  Frame first = append("msg1");
+  Frame duplicate = first;
+  ++sequence;
+  append("refused");
+  outbox->RemoveNewest();
+  Frame second = append("msg2");
+  ++sequence;
+  EXPECT_EQ(outbox->count(), 2u);
+  uint64_t accepted_sequence = 0;
+  EXPECT_EQ(session.Accept(&first, &accepted_sequence), SessionTracker::Verdict::DELIVER);
+  EXPECT_EQ(session.Accept(&second, &accepted_sequence), SessionTracker::Verdict::DELIVER);
+  EXPECT_EQ(accepted_sequence, 2u);
+
+  // A frame lost on the way is not stepped over: what follows it is not
+  // delivered nor acknowledged, and the connection is dropped.
+  append("msg3");
+  ++sequence;
+  Frame fourth = append("msg4");
+  ++sequence;
+  EXPECT_EQ(session.Accept(&fourth, &accepted_sequence), SessionTracker::Verdict::GAP);
+  outbox->Acknowledge(AckMap{{0, 2}});
+  EXPECT_EQ(outbox->count(), 2u);
+
+  // The replay after the reconnect fills the gap, in order.
+  session.OnHello(7);
+  std::vector<std::string> delivered;
+  outbox->ForEach([&](Frame frame) {
+    uint64_t replayed_sequence = 0;
+    if (session.Accept(&frame, &replayed_sequence) == SessionTracker::Verdict::DELIVER) {
+      delivered.push_back(frame.payload);
+    }
+  });
+  EXPECT_EQ(delivered, (std::vector<std::string>{"msg3", "msg4"}));
+  EXPECT_EQ(session.Accept(&duplicate, &accepted_sequence), SessionTracker::Verdict::DUPLICATE);
+}
+
+TEST(HandlerPool, RunsEachKeyInPostingOrder) {
+  constexpr int kKeys = 8;
+  constexpr int kTasks = 4000;
+  std::vector<std::vector<int>> seen(kKeys);
+  std::mutex done_mutex;
+  std::condition_variable done;
+  int remaining = kTasks;
+  {
+    HandlerPool pool(4);
+    for (int i = 0; i < kTasks; ++i) {
+      int key = i % kKeys;
+      pool.Post(key, [&, key, i]() {
+        seen[key].push_back(i);
+        std::lock_guard<std::mutex> lock(done_mutex);
+        if (--remaining == 0) {
+          done.notify_one();
+        }
+      });
+    }
+    std::unique_lock<std::mutex> lock(done_mutex);
+    done.wait(lock, [&] { return remaining == 0; });
+  }
+
+  for (const auto& tasks : seen) {
+    ASSERT_EQ(tasks.size(), static_cast<size_t>(kTasks / kKeys));
+    EXPECT_TRUE(std::is_sorted(tasks.begin(), tasks.end()));
+  }
+}
+
+TEST(FrameRouter, FansOutToMembersButNotBackToTheSource) {
+  FrameRouter router;
+  std::map<std::string, std::vector<Frame>> sent;
+  std::vector<SendCompletion> completions;
+  for (const char* id : {"source", "a", "b", "c"}) {
+    router.AddMember(id, [&sent, &completions, id](Frame frame, SendCompletion on_complete) {
+      sent[id].push_back(std::move(frame));
+      completions.push_back(std::move(on_complete));
+      return true;
+    });
+  }
+  router.AddMember("full", [](Frame frame, SendCompletion on_complete) { return false; });
+  router.SetRoute(1, {"source", "a", "b", "c"});
+  router.SetRoute(2, {"a", "full"});
+  router.SetRoute(3, {"source"});
+
+  // Every member on the route gets a copy, except the source. The source's
+  // frame is consumed once, after the last copy has left its queue.
+  int consumed = 0;
+  Frame frame(FrameType::TEXT, "fan-out");
+  frame.channel = 1;
+  frame.flags = kFrameFlagSequenced;
+  FrameConsumed on_consumed = [&consumed]() { ++consumed; };
+  EXPECT_TRUE(router.Route("source", &frame, &on_consumed));
+  EXPECT_TRUE(sent["source"].empty());
+  for (const char* id : {"a", "b", "c"}) {
+    ASSERT_EQ(sent[id].size(), 1u);
+    EXPECT_EQ(sent[id][0].payload, "fan-out");
+    EXPECT_EQ(sent[id][0].flags, 0);
+  }
+  ASSERT_EQ(completions.size(), 3u);
+  completions[0](true, ERROR_SUCCESS);
+  completions[1](false, ERROR_NO_DATA);
+  EXPECT_EQ(consumed, 0);
+  completions[2](true, ERROR_SUCCESS);
+  EXPECT_EQ(consumed, 1);
+
+  // A destination that refuses the copy counts as done with it.
+  consumed = 0;
+  completions.clear();
+  frame = Frame(FrameType::TEXT, "partly refused");
+  frame.channel = 2;
+  on_consumed = [&consumed]() { ++consumed; };
+  EXPECT_TRUE(router.Route("b", &frame, &on_consumed));
+  ASSERT_EQ(completions.size(), 1u);
+  EXPECT_EQ(consumed, 0);
+  completions[0](true, ERROR_SUCCESS);
+  EXPECT_EQ(consumed, 1);
+
+  // Frames without a route, whose only destination is their source, or
+  // that carry handles are left to the hub, untouched.
+  completions.clear();
+  on_consumed = [&consumed]() { ++consumed; };
+  for (auto route : std::vector<std::pair<FrameType, uint16_t>>{
+           {FrameType::TEXT, 4}, {FrameType::TEXT, 3}, {FrameType::HANDLES, 1}}) {
+    frame = Frame(route.first, "unrouted");
+    frame.channel = route.second;
+    EXPECT_FALSE(router.Route("source", &frame, &on_consumed));
+    EXPECT_EQ(frame.payload, "unrouted");
+    EXPECT_TRUE(on_consumed);
+  }
+  EXPECT_TRUE(completions.empty());
+  EXPECT_EQ(consumed, 1);
+
+  RouterStats stats = router.GetStats();
+  EXPECT_EQ(stats.forwarded, 2u);
+  EXPECT_EQ(stats.unrouted, 3u);
+  EXPECT_EQ(stats.dropped, 1u);
+
+  // A removed member is no longer sent to.
+  router.RemoveMember("a");
+  frame = Frame(FrameType::TEXT, "after removal");
+  frame.channel = 1;
+  EXPECT_TRUE(router.Route("source", &frame, &on_consumed));
+  EXPECT_EQ(sent["a"].size(), 2u);
+  EXPECT_EQ(sent["b"].size(), 2u);
+  EXPECT_EQ(sent["c"].size(), 2u);
+}
+
+TEST(TimingWheel, ExpiresInOrderAcrossLevelsAndCancels) {
+  TimingWheel wheel(1000);
+  std::vector<int> fired;
+  // Delays within the first level, in the second and third, and beyond the
+  // whole wheel, which waits in the top level.
+  const uint64_t delays[] = {5, 64, 70, 4096 + 3, 300000, 1};
+  std::vector<TimerId> ids;
+  for (int i = 0; i < 6; ++i) {
+    ids.push_back(wheel.Schedule(delays[i], [&fired, i]() { fired.push_back(i); }));
+  }
+  TimerId cancelled = wheel.Schedule(70, [&fired]() { fired.push_back(-1); });
+  EXPECT_EQ(wheel.size(), 7u);
+  EXPECT_EQ(wheel.TicksUntilNextEvent(), 1u);
+  EXPECT_TRUE(wheel.Cancel(cancelled));
+  EXPECT_FALSE(wheel.Cancel(cancelled));
+
+  std::vector<std::pair<TimerId, TimerCallback>> expired;
+  auto advance = [&](uint64_t now) {
+    wheel.Advance(now, &expired);
+    for (auto& timer : expired) {
+      timer.second();
+    }
+    expired.clear();
+  };
+  advance(1000 + 69);
+  EXPECT_EQ(fired, (std::vector<int>{5, 0, 1}));
+  advance(1000 + 70);
+  EXPECT_EQ(fired, (std::vector<int>{5, 0, 1, 2}));
+  advance(1000 + 4096 + 2);
+  EXPECT_EQ(fired.size(), 4u);
+  advance(1000 + 4096 + 3);
+  EXPECT_EQ(fired.back(), 3);
+  // A cancelled timer's ID is not reused for a new one.
+  TimerId reused = wheel.Schedule(1, []() {});
+  EXPECT_NE(reused, cancelled);
+  EXPECT_FALSE(wheel.Cancel(ids[0]));
+  advance(1000 + 300000);
+  EXPECT_EQ(fired.back(), 4);
+  EXPECT_EQ(wheel.size(), 0u);
+  EXPECT_EQ(wheel.TicksUntilNextEvent(), UINT64_MAX);
+}
+
+TEST(TimingWheel, ServiceOutlivesACallbackThatDropsTheLastReference) {
+  std::mutex mutex;
+  std::condition_variable fired;
+  int runs = 0;
+  auto signal = [&]() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++runs;
+    fired.notify_all();
+  };
+  auto wait_for_runs = [&](int count) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return fired.wait_for(lock, std::chrono::seconds(5), [&] { return runs >= count; });
+  };
+
+  for (int i = 1; i <= 3; ++i) {
+    // The callback holds the only reference and lets go of it while it
+    // runs; the next round gets a new service.
+    auto service = std::make_shared<std::shared_ptr<TimerService>>(TimerService::Acquire());
+    std::shared_ptr<TimerService> timers = *service;
+    EXPECT_FALSE(timers->Cancel(0));
+    timers->Schedule(0, [service, signal]() {
+      service->reset();
+      signal();
+    });
+    timers.reset();
+    ASSERT_TRUE(wait_for_runs(i));
+  }
+}
+
+TEST(ConnectionMonitor, CallsBackWithoutItsLockAndStopWaitsForIt) {
+  ConnectionOptions options;
+  options.idle_timeout_ms = 40;
+  std::mutex mutex;
+  std::condition_variable timed_out;
+  bool handled = false;
+
+  // A handler that closes the connection stops the monitor from within.
+  ConnectionMonitor monitor(options);
+  int drops = 0;
+  monitor.SetTimeoutHandler([&](ConnectionMonitor::Timeout timeout) {
+    EXPECT_EQ(timeout, ConnectionMonitor::Timeout::IDLE);
+    monitor.Stop();
+    std::lock_guard<std::mutex> lock(mutex);
+    handled = true;
+    timed_out.notify_all();
+  });
+  monitor.StartConnection(std::weak_ptr<SendQueue>(), [&]() { ++drops; });
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    ASSERT_TRUE(timed_out.wait_for(lock, std::chrono::seconds(5), [&] { return handled; }));
+  }
+  monitor.Stop();
+  EXPECT_EQ(drops, 1);
+
+  // Stopped from another thread, it waits for a drop that is running.
+  ConnectionMonitor dropping(options);
+  std::atomic<bool> dropping_now{false};
+  std::atomic<bool> dropped{false};
+  dropping.StartConnection(std::weak_ptr<SendQueue>(), [&]() {
+    dropping_now = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    dropped = true;
+  });
+  while (!dropping_now) {
+    std::this_thread::yield();
+  }
+  dropping.Stop();
+  EXPECT_TRUE(dropped);
+}
+
+TEST(Stripe, ReordersEachChannelAndSkipsDownConnections) {
+  StripeSender sender(StripePolicy::LEAST_QUEUED, true);
+  // Ties go round in turn; a connection at SIZE_MAX is down.
+  EXPECT_EQ(sender.PickLane({0, 0, 0}), 0);
+  EXPECT_EQ(sender.PickLane({0, 0, 0}), 1);
+  EXPECT_EQ(sender.PickLane({100, SIZE_MAX, 50}), 2);
+  EXPECT_EQ(sender.PickLane({SIZE_MAX, SIZE_MAX}), -1);
+
+  // Three frames on channel 1 and one on channel 2, numbered in send order.
+  std::vector<Frame> frames;
+  for (int i = 0; i < 4; ++i) {
+    Frame frame(FrameType::TEXT, std::string(1, static_cast<char>('a' + i)));
+    frame.channel = i == 3 ? 2 : 1;
+    sender.Stamp(&frame);
+    sender.Commit(frame.channel);
+    frames.push_back(std::move(frame));
+  }
+
+  std::string delivered;
+  int consumed = 0;
+  StripeReorderer reorderer([&](Frame frame, StripeReorderer::Consumed done) {
+    delivered += frame.payload;
+    EXPECT_EQ(frame.flags & kFrameFlagStriped, 0);
+    done();
+  });
+  auto add = [&](const Frame& frame) { reorderer.Add(frame, [&consumed]() { ++consumed; }); };
+  // The last frame of channel 1 overtakes the others, and waits for them;
+  // channel 2 is not held up by it.
+  add(frames[2]);
+  add(frames[3]);
+  EXPECT_EQ(delivered, "d");
+  EXPECT_EQ(reorderer.held(), 1u);
+  add(frames[0]);
+  add(frames[0]);
+  add(frames[1]);
+  EXPECT_EQ(delivered, "dabc");
+  EXPECT_EQ(reorderer.held(), 0u);
+  // The duplicate is dropped, but its credit still comes back.
+  EXPECT_EQ(consumed, 5);
+
+  // Frames from a peer that does not number them pass straight through.
+  add(Frame(FrameType::TEXT, "e"));
+  EXPECT_EQ(delivered, "dabce");
+}
+
+TEST(BlobCache, RefersToConfirmedBlobsAndEvictsLeastRecentlySent) {
+  // Every implementation hashes alike, and trailing zeros count.
+  std::string data(300, '\0');
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<char>(i * 7);
+  }
+  for (size_t size = 0; size <= data.size(); ++size) {
+    EXPECT_TRUE(HashBlob(data.data(), size) == HashBlobScalar(data.data(), size));
+  }
+  EXPECT_FALSE(HashBlob("\0", 1) == HashBlob("\0\0", 2));
+
+  // Room for two of the three payloads.
+  BlobEncoder encoder(2500, 64);
+  BlobDecoder decoder(2500);
+  const std::string a(1000, 'a'), b(1000, 'b'), c(1000, 'c');
+  std::vector<BlobHeld> held;
+  Frame reference;
+  // Sends |payload| through both halves, behind a sequence number, and
+  // returns the size it took on the wire.
+  auto send = [&](const std::string& payload) {
+    Frame frame(FrameType::TEXT, std::string(8, 's') + payload);
+    frame.flags |= kFrameFlagSequenced;
+    size_t offset = 0;
+    EXPECT_TRUE(encoder.Eligible(frame, &offset));
+    EXPECT_EQ(offset, 8u);
+    encoder.Encode(&frame, offset, HashBlob(payload.data(), payload.size()));
+    size_t wire_size = frame.payload.size();
+    if (wire_size < 100) {
+      reference = frame;
+    }
+    EXPECT_TRUE(decoder.Decode(&frame, &held));
+    EXPECT_EQ(frame.payload, std::string(8, 's') + payload);
+    EXPECT_EQ(frame.flags, kFrameFlagSequenced);
+    return wire_size;
+  };
+
+  // Sent in full until the receiver confirms it holds the blob.
+  EXPECT_GT(send(a), 1000u);
+  EXPECT_GT(send(a), 1000u);
+  encoder.OnHeld(held);
+  held.clear();
+  EXPECT_EQ(send(a), 8u + 17u);
+
+  // |b| fits beside |a|; |c| evicts |a|, sent longer ago.
+  send(b);
+  send(c);
+  encoder.OnHeld(held);
+  held.clear();
+  EXPECT_EQ(send(b), 8u + 17u);
+  EXPECT_EQ(send(c), 8u + 17u);
+  EXPECT_GT(send(a), 1000u);
+
+  BlobStats stats;
+  encoder.AddStats(&stats);
+  decoder.AddStats(&stats);
+  EXPECT_EQ(stats.candidates, 8u);
+  EXPECT_EQ(stats.hits, 3u);
+  EXPECT_EQ(stats.bytes_saved, 3u * (1000 - 17));
+  EXPECT_EQ(stats.held_blobs, 2u);
+  EXPECT_EQ(stats.held_bytes, 2000u);
+
+  // A receiver that never stored the blob drops the reference.
+  BlobDecoder stranger(2500);
+  EXPECT_FALSE(stranger.Decode(&reference, &held));
+  stats = BlobStats();
+  stranger.AddStats(&stats);
+  EXPECT_EQ(stats.unknown_references, 1u);
+
+  // Small and binary frames are left alone.
+  size_t offset = 0;
+  EXPECT_FALSE(encoder.Eligible(Frame(FrameType::TEXT, std::string(63, 'x')), &offset));
+  EXPECT_FALSE(encoder.Eligible(Frame(FrameType::HANDLES, a), &offset));
+}
+
+TEST(StateSync, DiffsKeyedUpdatesAndRecoversWithSnapshots) {
+  // Diffs round-trip whatever changed, and copy what did not.
+  std::string document;
+  for (int i = 0; i < 600; ++i) {
+    document += "\"field" + std::to_string(i) + "\": " + std::to_string(i * 31) + ", ";
+  }
+  std::string edited = document;
+  edited.replace(100, 3, "12345");
+  edited.insert(3000, "\"added\": true, ");
+  edited.erase(5000, 40);
+  const std::pair<std::string, std::string> cases[] = {
+    {"", document}, {document, ""}, {document, document}, {document, edited}, {edited, document},
+  };
+  for (const auto& change : cases) {
+    std::string delta = EncodeDelta(change.first, change.second);
+    std::string restored;
+    EXPECT_TRUE(ApplyDelta(change.first, delta.data(), delta.size(), SIZE_MAX, &restored));
+    EXPECT_EQ(restored, change.second);
+  }
+  EXPECT_LT(EncodeDelta(document, edited).size(), 100u);
+  std::string restored;
+  std::string delta = EncodeDelta(document, edited);
+  EXPECT_FALSE(ApplyDelta(document, delta.data(), delta.size() - 1, SIZE_MAX, &restored));
+  EXPECT_FALSE(ApplyDelta(document, delta.data(), delta.size(), edited.size() - 1, &restored));
+
+  StateEncoder encoder(1 << 20);
+  StateDecoder decoder(1 << 20);
+  // Sends |value| under |key| through both halves, behind a sequence
+  // number, and returns the encoded frame. Snapshots every third update.
+  auto encode = [&](const std::string& key, const std::string& value) {
+    Frame frame(FrameType::TEXT, value);
+    EXPECT_TRUE(AddStateKey(&frame, key));
+    frame.payload.insert(0, std::string(8, 's'));
+    frame.flags |= kFrameFlagSequenced;
+    encoder.Encode(&frame, 3);
+    return frame;
+  };
+  auto decode = [&](Frame frame, const std::string& key, const std::string& value) {
+    EXPECT_TRUE(decoder.Decode(&frame));
+    EXPECT_EQ(frame.payload.substr(0, 8), std::string(8, 's'));
+    frame.payload.erase(0, 8);
+    frame.flags &= ~kFrameFlagSequenced;
+    std::string taken;
+    EXPECT_TRUE(TakeStateKey(&frame, &taken));
+    EXPECT_EQ(taken, key);
+    EXPECT_EQ(frame.payload, value);
+  };
+
+  Frame first = encode("doc", document);
+  EXPECT_GT(first.payload.size(), document.size());
+  decode(first, "doc", document);
+  Frame second = encode("doc", edited);
+  EXPECT_LT(second.payload.size(), 200u);
+  decode(second, "doc", edited);
+  decode(encode("doc", document), "doc", document);
+  // The third update since the snapshot goes out in full again.
+  EXPECT_GT(encode("doc", edited).payload.size(), edited.size());
+
+  // A lost update makes the next diff miss, until the sender resyncs.
+  encode("doc", document);
+  Frame missed = encode("doc", edited);
+  EXPECT_FALSE(decoder.Decode(&missed));
+  encoder.Resync(0, "doc");
+  decode(encode("doc", document), "doc", document);
+
+  // Keys are tracked apart, and past the capacity not at all.
+  StateEncoder small(1000);
+  Frame large(FrameType::TEXT, document);
+  AddStateKey(&large, "other");
+  small.Encode(&large, 3);
+  EXPECT_EQ(large.flags, kFrameFlagKeyed);
+
+  StateSyncStats stats;
+  encoder.AddStats(&stats);
+  decoder.AddStats(&stats);
+  EXPECT_EQ(stats.updates, 7u);
+  EXPECT_EQ(stats.snapshots, 3u);
+  EXPECT_EQ(stats.deltas, 4u);
+  EXPECT_EQ(stats.tracked_keys, 1u);
+  EXPECT_EQ(stats.held_keys, 1u);
+  EXPECT_EQ(stats.misses, 1u);
+
+  // A broker forwards the update with its key, so the next hop diffs and
+  // decodes it by key as well.
+  Frame received = encode("doc", edited);
+  ASSERT_TRUE(decoder.Decode(&received));
+  received.payload.erase(0, 8);
+  received.flags &= ~kFrameFlagSequenced;
+  FrameRouter::PrepareForward(&received);
+  EXPECT_EQ(received.flags, kFrameFlagKeyed);
+  StateEncoder next_encoder(1 << 20);
+  StateDecoder next_decoder(1 << 20);
+  next_encoder.Encode(&received, 3);
+  ASSERT_TRUE(next_decoder.Decode(&received));
+  std::string forwarded_key;
+  EXPECT_TRUE(TakeStateKey(&received, &forwarded_key));
+  EXPECT_EQ(forwarded_key, "doc");
+  EXPECT_EQ(received.payload, edited);
+}
+
+TEST(NetworkShaper, PlansReproduciblyAndCutsWritesShort) {
+  ShapingOptions options;
+  options.seed = 42;
+  options.jitter_us = 100;
+  options.spike_rate = 0.1;
+  options.spike_us = 5000;
+  options.short_write_rate = 0.3;
+  options.disconnect_rate = 0.05;
+  NetworkShaper::Clock::time_point now;
+  // The same seed makes the same choices; another one does not.
+  NetworkShaper shaper(options);
+  NetworkShaper same(options);
+  options.seed = 43;
+  NetworkShaper other(options);
+  int differences = 0;
+  for (int i = 0; i < 100; ++i) {
+    now += std::chrono::seconds(1);
+    auto plan = shaper.PlanWrite(1000, now);
+    auto again = same.PlanWrite(1000, now);
+    auto another = other.PlanWrite(1000, now);
+    EXPECT_EQ(plan.disconnect, again.disconnect);
+    EXPECT_TRUE(plan.start == again.start);
+    EXPECT_EQ(plan.split, again.split);
+    EXPECT_LT(plan.split, 1000u);
+    differences += plan.start != another.start;
+  }
+  EXPECT_GT(differences, 50);
+  ShapingStats stats = shaper.GetStats();
+  EXPECT_EQ(stats.writes, 100u);
+  EXPECT_GT(stats.disconnects, 0u);
+  EXPECT_LT(stats.disconnects, 20u);
+
+  // Writes queue behind each other for the link.
+  ShapingOptions capped;
+  capped.bandwidth = 1000;
+  NetworkShaper link(capped);
+  EXPECT_TRUE(link.PlanWrite(500, now).start == now + std::chrono::milliseconds(500));
+  EXPECT_TRUE(link.PlanWrite(500, now).start == now + std::chrono::seconds(1));
+  EXPECT_TRUE(link.PlanRead() == NetworkShaper::Clock::duration::zero());
+
+  // A cut falls inside a data chunk, but never a control frame.
+  auto make = [](Frame frame, bool last) {
+    FrameChunk chunk;
+    chunk.owner = std::make_shared<PendingFrame>();
+    chunk.owner->frame = std::move(frame);
+    chunk.length = chunk.owner->frame.payload.size();
+    chunk.last = last;
+    return chunk;
+  };
+  std::vector<FrameChunk> chunks = {
+    make(EncodeCreditFrame(100, 1), true),
+    make(Frame(FrameType::TEXT, std::string(20, 'x')), true),
+  };
+  size_t credit = sizeof(FrameHeader) + chunks[0].length;
+  std::vector<FrameChunk> first;
+  std::vector<FrameChunk> rest;
+  SplitChunks(chunks, credit - 1, true, &first, &rest);
+  EXPECT_EQ(first.size(), 1u);
+  EXPECT_EQ(rest.size(), 1u);
+  first.clear();
+  rest.clear();
+  SplitChunks(chunks, credit + sizeof(FrameHeader) + 1, true, &first, &rest);
+  ASSERT_EQ(first.size(), 2u);
+  ASSERT_EQ(rest.size(), 1u);
+  EXPECT_EQ(first[1].length, 1u);
+  EXPECT_FALSE(first[1].last);
+  EXPECT_EQ(rest[0].offset, 1u);
+  EXPECT_EQ(rest[0].length, 19u);
+  EXPECT_TRUE(rest[0].last);
+  first.clear();
+  rest.clear();
+  SplitChunks(chunks, credit + sizeof(FrameHeader) + 5, false, &first, &rest);
+  EXPECT_EQ(first.size(), 2u);
+  EXPECT_TRUE(rest.empty());
+
+  // A planned disconnect drops the transport instead of writing.
+  ShapingOptions dropping;
+  dropping.disconnect_rate = 1;
+  NetworkShaper broken(dropping);
+  bool dropped = false;
+  bool written = false;
+  EXPECT_FALSE(broken.Write(
+      chunks, true, [&](std::vector<FrameChunk>&) { return written = true; }, [&]() { dropped = true; }));
+  EXPECT_TRUE(dropped);
+  EXPECT_FALSE(written);
+}
+
+TEST(Capture, RecordsFramesFromManyThreadsAndReadsThemBack) {
+  char temp_dir[MAX_PATH];
+  ASSERT_NE(GetTempPathA(MAX_PATH, temp_dir), 0u);
+  std::string path = std::string(temp_dir) + "flutter_ipc_capture_test_" + std::to_string(GetCurrentProcessId()) + ".bin";
+
+  CaptureSource server(CaptureRole::SERVER, "pipe_a");
+  CaptureSource lane(CaptureRole::SERVER, "pipe_a");
+  lane.Disable();
+  Frame before(FrameType::TEXT, "before");
+  CaptureFrame(&server, CaptureKind::SENT, before);  // No capture yet
+
+  // Payloads are cut after 16 bytes.
+  ASSERT_TRUE(StartCapture(path, 1 << 20, 16));
+  EXPECT_FALSE(StartCapture(path, 1 << 20, 16));
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < 4; ++thread) {
+    threads.emplace_back([&server, thread]() {
+      for (int i = 0; i < 100; ++i) {
+        Frame frame(FrameType::TEXT, std::to_string(thread) + ":" + std::to_string(i));
+        CaptureFrame(&server, CaptureKind::SENT, frame);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  Frame large(FrameType::VALUE, std::string(100, 'x'));
+  large.channel = 7;
+  CaptureFrame(&lane, CaptureKind::RECEIVED, large);
+  CaptureFrame(&server, CaptureKind::RECEIVED, large);
+  CaptureStats stats;
+  ASSERT_TRUE(StopCapture(&stats));
+  EXPECT_FALSE(StopCapture(&stats));
+  EXPECT_EQ(stats.records, 402u);
+  EXPECT_EQ(stats.dropped, 0u);
+
+  auto reader = CaptureReader::Open(path);
+  ASSERT_TRUE(reader != nullptr);
+  EXPECT_EQ(reader->header().max_payload, 16u);
+  CaptureRecord record;
+  int connections = 0;
+  int received = 0;
+  std::vector<int> next(4, 0);
+  bool in_order = true;
+  std::chrono::nanoseconds last_time(0);
+  while (reader->Next(&record)) {
+    EXPECT_EQ(record.connection, server.id());
+    if (record.kind == CaptureKind::CONNECTION) {
+      ++connections;
+      EXPECT_EQ(std::string(record.data, record.captured), "pipe_a");
+      EXPECT_EQ(record.type, static_cast<uint8_t>(CaptureRole::SERVER));
+    } else if (record.kind == CaptureKind::SENT) {
+      // Each thread's frames are in the order it sent them.
+      std::string payload(record.data, record.captured);
+      int thread = payload[0] - '0';
+      in_order = in_order && thread >= 0 && thread < 4 &&
+                 payload == std::to_string(thread) + ":" + std::to_string(next[thread]++);
+    } else if (record.kind == CaptureKind::RECEIVED) {
+      ++received;
+      EXPECT_EQ(record.channel, 7);
+      EXPECT_EQ(record.type, static_cast<uint8_t>(FrameType::VALUE));
+      EXPECT_EQ(record.length, 100u);
+      EXPECT_EQ(record.captured, 16u);
+      EXPECT_GE(record.time, last_time);
+    }
+    if (record.kind != CaptureKind::CONNECTION) {
+      last_time = std::max(last_time, record.time);
+    }
+  }
+  EXPECT_EQ(connections, 1);
+  EXPECT_EQ(received, 1);
+  EXPECT_TRUE(in_order);
+  EXPECT_EQ(next, std::vector<int>(4, 100));
+  reader.reset();
+
+  // What does not fit in the file is dropped, and the file is cut to the
+  // records that do.
+  auto writer = CaptureWriter::Create(path, sizeof(CaptureFileHeader) + 64, 1024);
+  ASSERT_TRUE(writer != nullptr);
+  EXPECT_TRUE(writer->Append(CaptureKind::SENT, 1, 0, 0, 0, std::string(20, 'a')));
+  EXPECT_FALSE(writer->Append(CaptureKind::SENT, 1, 0, 0, 0, "b"));
+  EXPECT_EQ(writer->GetStats().dropped, 1u);
+  writer->Close();
+  reader = CaptureReader::Open(path);
+  ASSERT_TRUE(reader != nullptr);
+  ASSERT_TRUE(reader->Next(&record));
+  EXPECT_EQ(std::string(record.data, record.captured), std::string(20, 'a'));
+  EXPECT_FALSE(reader->Next(&record));
+  reader.reset();
+  DeleteFileA(path.c_str());
+}
+
+TEST(MpscQueue, KeepsEachProducersOrderUnderContention) {
+  constexpr int kProducers = 4;
+  constexpr uint64_t kPushes = 20000;
+  MpscQueue<uint64_t> queue;
+  uint64_t value = 0;
+  EXPECT_TRUE(queue.Empty());
+  EXPECT_FALSE(queue.Pop(&value));
+
+  std::vector<std::thread> producers;
+  for (uint64_t producer = 0; producer < kProducers; ++producer) {
+    producers.emplace_back([&queue, producer]() {
+      for (uint64_t i = 0; i < kPushes; ++i) {
+        queue.Push(producer << 32 | i);
+      }
+    });
+  }
+  // Popped while the producers are still pushing.
+  std::vector<uint64_t> next(kProducers, 0);
+  uint64_t popped = 0;
+  bool in_order = true;
+  while (popped < kProducers * kPushes) {
+    if (!queue.Pop(&value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    uint64_t producer = value >> 32;
+    in_order = in_order && producer < kProducers && (value & 0xFFFFFFFF) == next[producer]++;
+    ++popped;
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  EXPECT_TRUE(in_order);
+  EXPECT_TRUE(queue.Empty());
+
+  // Values still queued are released with the queue.
+  auto shared = std::make_shared<int>(1);
+  {
+    MpscQueue<std::shared_ptr<int>> holder;
+    holder.Push(shared);
+    EXPECT_EQ(shared.use_count(), 2);
+  }
+  EXPECT_EQ(shared.use_count(), 1);
+}
+
+TEST(ServiceRegistry, PublishesServerStateAndWakesWaiters) {
+  std::string name = "flutter_ipc_services_test_" + std::to_string(GetCurrentProcessId());
+  ServiceRegistry registry(name);
+  ASSERT_TRUE(registry.valid());
+  ServiceInfo info;
+  EXPECT_FALSE(registry.Lookup("pipe_a", &info));
+  EXPECT_FALSE(registry.WaitUntilAvailable("pipe_a", 10, NULL, &info));
+
+  std::atomic<ServiceState> state{ServiceState::STARTING};
+  uint64_t generation = registry.generation();
+  auto registration = ServiceRegistration::Create(&registry, "pipe_a", 2, [&state]() { return state.load(); });
+  ASSERT_TRUE(registration != nullptr);
+  EXPECT_GT(registry.generation(), generation);
+  ASSERT_TRUE(registry.Lookup("pipe_a", &info));
+  EXPECT_EQ(info.state, ServiceState::STARTING);
+  EXPECT_EQ(info.capacity, 2u);
+  EXPECT_EQ(info.process_id, GetCurrentProcessId());
+  EXPECT_FALSE(ServiceRegistration::Create(&registry, std::string(ServiceRegistry::kMaxNameLength + 1, 'x'), 1,
+                                           [] { return ServiceState::AVAILABLE; }));
+
+  // A waiter, and a watcher on a view of the same table, are both woken
+  // by the change rather than their timeouts.
+  ServiceRegistry other_view(name);
+  ServiceWatcher watcher(&other_view);
+  std::mutex mutex;
+  std::condition_variable watched;
+  int callbacks = 0;
+  bool watch_found = false;
+  bool timeout_found = true;
+  watcher.Watch("pipe_a", 10000, [&](bool found, const ServiceInfo& watched_info) {
+    std::lock_guard<std::mutex> lock(mutex);
+    watch_found = found && watched_info.state == ServiceState::AVAILABLE;
+    ++callbacks;
+    watched.notify_all();
+  });
+  watcher.Watch("pipe_b", 20, [&](bool found, const ServiceInfo&) {
+    std::lock_guard<std::mutex> lock(mutex);
+    timeout_found = found;
+    ++callbacks;
+    watched.notify_all();
+  });
+  ServiceInfo waited;
+  bool available = false;
+  auto start = std::chrono::steady_clock::now();
+  std::thread waiter([&]() { available = registry.WaitUntilAvailable("pipe_a", 10000, NULL, &waited); });
+  Sleep(20);
+  state = ServiceState::AVAILABLE;
+  registration->Refresh();
+  waiter.join();
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    watched.wait_for(lock, std::chrono::seconds(10), [&] { return callbacks == 2; });
+  }
+  EXPECT_TRUE(available);
+  EXPECT_EQ(waited.state, ServiceState::AVAILABLE);
+  EXPECT_TRUE(watch_found);
+  EXPECT_FALSE(timeout_found);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+
+  // Live entries survive a sweep; closed servers disappear.
+  EXPECT_EQ(other_view.Sweep(), 0u);
+  ASSERT_EQ(other_view.List().size(), 1u);
+  EXPECT_EQ(other_view.List()[0].name, "pipe_a");
+  registration.reset();
+  EXPECT_FALSE(other_view.Lookup("pipe_a", &info));
+  EXPECT_TRUE(registry.List().empty());
+}
+
 }  // namespace test
 }  // namespace flutter_ipc
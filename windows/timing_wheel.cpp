@@ -0,0 +1,260 @@
+#include "timing_wheel.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace flutter_ipc {
+
+TimingWheel::TimingWheel(uint64_t now)
+    : now_(now), slots_(kSlots * kLevels, kNone) {}
+
+TimerId TimingWheel::Schedule(uint64_t delay, TimerCallback callback) {
+  uint32_t index;
+  if (!free_.empty()) {
+    index = free_.back();
+    free_.pop_back();
+  } else {
+    index = static_cast<uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+    nodes_.back().generation = 1;
+  }
+  Node& node = nodes_[index];
+  node.callback = std::move(callback);
+  node.expiry = now_ + std::max<uint64_t>(delay, 1);
+  Insert(index);
+  ++size_;
+  return (static_cast<uint64_t>(node.generation) << 32) | index;
+}
+
+bool TimingWheel::Cancel(TimerId id) {
+  uint32_t index = static_cast<uint32_t>(id);
+  if (index >= nodes_.size() || nodes_[index].generation != static_cast<uint32_t>(id >> 32) ||
+      nodes_[index].slot == kNone) {
+    return false;
+  }
+  Unlink(index);
+  Node& node = nodes_[index];
+  node.callback = nullptr;
+  // Skips 0, so that a recycled node never matches an old ID.
+  node.generation = node.generation + 1 == 0 ? 1 : node.generation + 1;
+  free_.push_back(index);
+  --size_;
+  return true;
+}
+
+void TimingWheel::Advance(uint64_t now, std::vector<std::pair<TimerId, TimerCallback>>* expired) {
+  while (now_ < now) {
+    if (size_ == 0) {
+      now_ = now;
+      return;
+    }
+    ++now_;
+    // Higher levels first: a timer may move down more than one level in
+    // one tick.
+    for (int level = kLevels - 1; level > 0; --level) {
+      uint64_t mask = (uint64_t{1} << (kSlotBits * level)) - 1;
+      if ((now_ & mask) == 0 && level_sizes_[level] != 0) {
+        Cascade(level);
+      }
+    }
+
+    uint32_t& head = slots_[now_ & (kSlots - 1)];
+    while (head != kNone) {
+      uint32_t index = head;
+      TimerId id = (static_cast<uint64_t>(nodes_[index].generation) << 32) | index;
+      expired->emplace_back(id, std::move(nodes_[index].callback));
+      Cancel(id);
+    }
+  }
+}
+
+uint64_t TimingWheel::TicksUntilNextEvent() const {
+  if (size_ == 0) {
+    return UINT64_MAX;
+  }
+  // Timers above level 0 move no earlier than the next turn of level 0.
+  uint64_t limit = HigherLevelsEmpty() ? kSlots : kSlots - (now_ & (kSlots - 1));
+  if (level_sizes_[0] != 0) {
+    for (uint64_t ticks = 1; ticks < limit; ++ticks) {
+      if (slots_[(now_ + ticks) & (kSlots - 1)] != kNone) {
+        return ticks;
+      }
+    }
+  }
+  return limit;
+}
+
+void TimingWheel::Insert(uint32_t index) {
+  Node& node = nodes_[index];
+  uint64_t delta = node.expiry > now_ ? node.expiry - now_ : 0;
+  int level = 0;
+  while (level < kLevels - 1 && delta >= (uint64_t{1} << (kSlotBits * (level + 1)))) {
+    ++level;
+  }
+  // Beyond the top level's reach, a timer waits a whole turn of it and is
+  // placed again.
+  uint64_t position = delta >> (kSlotBits * kLevels) != 0 ? now_ : node.expiry;
+  uint32_t slot = static_cast<uint32_t>(level * kSlots + ((position >> (kSlotBits * level)) & (kSlots - 1)));
+
+  node.slot = slot;
+  node.prev = kNone;
+  node.next = slots_[slot];
+  if (node.next != kNone) {
+    nodes_[node.next].prev = index;
+  }
+  slots_[slot] = index;
+  ++level_sizes_[level];
+}
+
+void TimingWheel::Unlink(uint32_t index) {
+  Node& node = nodes_[index];
+  if (node.prev != kNone) {
+    nodes_[node.prev].next = node.next;
+  } else {
+    slots_[node.slot] = node.next;
+  }
+  if (node.next != kNone) {
+    nodes_[node.next].prev = node.prev;
+  }
+  --level_sizes_[node.slot / kSlots];
+  node.slot = kNone;
+}
+
+void TimingWheel::Cascade(int level) {
+  uint32_t slot = static_cast<uint32_t>(level * kSlots + ((now_ >> (kSlotBits * level)) & (kSlots - 1)));
+  uint32_t index = slots_[slot];
+  while (index != kNone) {
+    uint32_t next = nodes_[index].next;
+    Unlink(index);
+    Insert(index);
+    index = next;
+  }
+}
+
+bool TimingWheel::HigherLevelsEmpty() const {
+  for (int level = 1; level < kLevels; ++level) {
+    if (level_sizes_[level] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// static
+std::shared_ptr<TimerService> TimerService::Acquire() {
+  static std::mutex mutex;
+  static std::weak_ptr<TimerService> instance;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto service = instance.lock();
+  if (!service) {
+    service.reset(new TimerService());
+    service->thread_ = std::thread(&TimerService::Run, service.get(), std::weak_ptr<TimerService>(service));
+    instance = service;
+  }
+  return service;
+}
+
+TimerService::TimerService() : start_ms_(NowMs()) {}
+
+TimerService::~TimerService() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wakeup_.notify_one();
+  // Run() drops the last reference after a callback released the others,
+  // and touches nothing once it has.
+  if (thread_.get_id() == std::this_thread::get_id()) {
+    thread_.detach();
+  } else {
+    thread_.join();
+  }
+}
+
+TimerId TimerService::Schedule(uint64_t delay_ms, TimerCallback callback) {
+  TimerId id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The wheel lags behind the clock while the thread sleeps.
+    uint64_t due = (NowMs() - start_ms_ + delay_ms + kTickMs - 1) / kTickMs;
+    id = wheel_.Schedule(due > wheel_.now() ? due - wheel_.now() : 1, std::move(callback));
+  }
+  wakeup_.notify_one();
+  return id;
+}
+
+bool TimerService::Cancel(TimerId id) {
+  // Would otherwise wait for a running timer while none runs.
+  if (id == 0) {
+    return false;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (wheel_.Cancel(id)) {
+    return true;
+  }
+  auto due_it = std::find_if(due_.begin(), due_.end(), [id](const auto& timer) { return timer.first == id; });
+  if (due_it != due_.end()) {
+    due_.erase(due_it);
+    return true;
+  }
+  if (std::this_thread::get_id() != thread_.get_id()) {
+    finished_.wait(lock, [&] { return running_ != id; });
+  }
+  return false;
+}
+
+// static
+uint64_t TimerService::NowMs() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void TimerService::Run(std::weak_ptr<TimerService> self) {
+  std::vector<std::pair<TimerId, TimerCallback>> expired;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    wheel_.Advance((NowMs() - start_ms_) / kTickMs, &expired);
+    for (auto& timer : expired) {
+      due_.push_back(std::move(timer));
+    }
+    expired.clear();
+
+    if (!due_.empty()) {
+      std::shared_ptr<TimerService> owner = self.lock();
+      if (!owner) {
+        return; // Being destroyed by a thread that joins this one
+      }
+      while (!due_.empty() && !stopping_) {
+        auto timer = std::move(due_.front());
+        due_.pop_front();
+        running_ = timer.first;
+        lock.unlock();
+        timer.second();
+        // Destroyed before Cancel() is told, so its captures are gone too.
+        timer.second = nullptr;
+        lock.lock();
+        running_ = 0;
+        finished_.notify_all();
+      }
+      lock.unlock();
+      owner.reset();
+      if (self.expired()) {
+        return; // Destroyed, here or by a thread that joins this one
+      }
+      lock.lock();
+    }
+
+    uint64_t ticks = wheel_.TicksUntilNextEvent();
+    if (ticks == UINT64_MAX) {
+      wakeup_.wait(lock);
+      continue;
+    }
+    uint64_t wake_ms = start_ms_ + (wheel_.now() + ticks) * kTickMs;
+    uint64_t now_ms = NowMs();
+    if (wake_ms > now_ms) {
+      wakeup_.wait_for(lock, std::chrono::milliseconds(wake_ms - now_ms));
+    }
+  }
+}
+
+}  // namespace flutter_ipc
@@ -0,0 +1,133 @@
+#ifndef FLUTTER_PLUGIN_TIMING_WHEEL_H_
+#define FLUTTER_PLUGIN_TIMING_WHEEL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace flutter_ipc {
+
+// Names a scheduled timer. 0 never names one.
+using TimerId = uint64_t;
+using TimerCallback = std::function<void()>;
+
+// Timers in a hierarchical timing wheel: kLevels wheels of kSlots slots,
+// each slot of a level spanning a whole turn of the level below. A timer
+// sits in the lowest level whose turn reaches its expiry and moves down
+// as time catches up with it, so scheduling and cancelling are O(1) and
+// advancing costs O(1) per tick plus the timers that move or expire. Time
+// is counted in ticks of the caller's choosing. Not thread-safe.
+class TimingWheel {
+ public:
+  static constexpr int kSlotBits = 6;
+  static constexpr size_t kSlots = size_t{1} << kSlotBits;
+  static constexpr int kLevels = 4;
+
+  explicit TimingWheel(uint64_t now = 0);
+
+  // Disallow copy and assign.
+  TimingWheel(const TimingWheel&) = delete;
+  TimingWheel& operator=(const TimingWheel&) = delete;
+
+  // Runs |callback| at the first Advance() that reaches now() + |delay|,
+  // at least one tick from now.
+  TimerId Schedule(uint64_t delay, TimerCallback callback);
+  // Returns false if the timer has expired or was cancelled already.
+  bool Cancel(TimerId id);
+
+  // Moves time forward to |now|, appending the timers that expire on the
+  // way to |expired| in expiry order.
+  void Advance(uint64_t now, std::vector<std::pair<TimerId, TimerCallback>>* expired);
+
+  // Ticks until the next Advance() that can expire or move a timer;
+  // UINT64_MAX if no timer is scheduled.
+  uint64_t TicksUntilNextEvent() const;
+
+  uint64_t now() const { return now_; }
+  size_t size() const { return size_; }
+
+ private:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  struct Node {
+    TimerCallback callback;
+    uint64_t expiry = 0;
+    uint32_t generation = 0;
+    uint32_t slot = kNone;  // Index into |slots_|, kNone while free
+    uint32_t prev = kNone;
+    uint32_t next = kNone;
+  };
+
+  void Insert(uint32_t index);
+  void Unlink(uint32_t index);
+  // Moves the timers of a higher level slot down.
+  void Cascade(int level);
+  bool HigherLevelsEmpty() const;
+
+  uint64_t now_;
+  size_t size_ = 0;
+  std::vector<Node> nodes_;
+  std::vector<uint32_t> free_;
+  // Heads of the doubly-linked slot lists, level by level.
+  std::vector<uint32_t> slots_;
+  // Timers per level, so empty levels are skipped.
+  size_t level_sizes_[kLevels] = {};
+};
+
+// One TimingWheel shared by every connection of the process, advanced by
+// a thread that sleeps until the next tick with anything to do. Callbacks
+// run on that thread and must not block; they may schedule and cancel
+// timers, and drop the last reference to the service. Thread-safe.
+class TimerService {
+ public:
+  static constexpr uint64_t kTickMs = 10;
+
+  // The process-wide instance, created on first use and destroyed with the
+  // last reference.
+  static std::shared_ptr<TimerService> Acquire();
+
+  ~TimerService();
+
+  // Disallow copy and assign.
+  TimerService(const TimerService&) = delete;
+  TimerService& operator=(const TimerService&) = delete;
+
+  // Runs |callback| once, |delay_ms| from now, rounded up to whole ticks.
+  TimerId Schedule(uint64_t delay_ms, TimerCallback callback);
+  // Returns false if the timer has fired or was cancelled already, or if
+  // |id| is 0. A callback that is running right now is waited for, unless
+  // Cancel() is called from the timer thread.
+  bool Cancel(TimerId id);
+
+  // Milliseconds on the clock the timers run on.
+  static uint64_t NowMs();
+
+ private:
+  TimerService();
+
+  // Holds |self| while callbacks run, so that the service is destroyed
+  // between them at the earliest.
+  void Run(std::weak_ptr<TimerService> self);
+
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::condition_variable finished_;
+  TimingWheel wheel_;
+  uint64_t start_ms_;
+  // Expired, waiting for their turn to run.
+  std::deque<std::pair<TimerId, TimerCallback>> due_;
+  TimerId running_ = 0;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_TIMING_WHEEL_H_
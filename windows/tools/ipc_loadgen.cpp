@@ -0,0 +1,467 @@
+// Open-loop load generator for the native transport.
+//
+// Starts --peers client/server pairs in this process and has every client
+// send at a fixed share of --rate messages per second for --duration
+// seconds, whether or not earlier messages have been delivered. Latency is
+// measured from the time a message was scheduled to be sent, not from when
+// the sender got around to it, so a stalled sender cannot hide the queueing
+// delay it caused (coordinated omission).
+//
+// The shaping flags put degraded conditions on every connection, drawn
+// from --seed so that a run can be repeated: a bandwidth cap in bytes per
+// second, a latency of fixed plus exponential jitter microseconds per
+// write, spikes, short writes and read stalls as RATE:MICROSECONDS, and
+// disconnects as a rate per write. A dropped peer reconnects from its
+// sender, which counts against its latency.
+//
+//   ipc_loadgen --peers=50 --rate=50000 --duration=10 --size=uniform:64:4096
+//   ipc_loadgen --transport=memory --json > run.json
+//   ipc_loadgen --bandwidth=10000000 --jitter=200 --read-stalls=0.01:5000 --seed=7
+
+#include <windows.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "flutter_ipc_plugin.h"
+
+namespace flutter_ipc {
+namespace loadgen {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  int peers = 10;
+  double rate = 10000;  // Messages per second, over all peers
+  double duration = 10;  // Seconds
+  std::string size = "fixed:256";
+  std::string transport = "kernel";
+  bool json = false;
+  ShapingOptions shaping;
+};
+
+// Payload sizes drawn from "fixed:N", "uniform:MIN:MAX" or
+// "exponential:MEAN". Every payload holds at least the send timestamp.
+class SizeDistribution {
+ public:
+  bool Parse(const std::string& spec) {
+    spec_ = spec;
+    if (sscanf(spec.c_str(), "fixed:%zu", &min_) == 1) {
+      kind_ = Kind::FIXED;
+    } else if (sscanf(spec.c_str(), "uniform:%zu:%zu", &min_, &max_) == 2 && min_ <= max_) {
+      kind_ = Kind::UNIFORM;
+    } else if (sscanf(spec.c_str(), "exponential:%zu", &min_) == 1 && min_ > 0) {
+      kind_ = Kind::EXPONENTIAL;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  size_t Next(std::mt19937_64& random) const {
+    size_t size = min_;
+    if (kind_ == Kind::UNIFORM) {
+      size = std::uniform_int_distribution<size_t>(min_, max_)(random);
+    } else if (kind_ == Kind::EXPONENTIAL) {
+      size = static_cast<size_t>(std::exponential_distribution<double>(1.0 / min_)(random));
+    }
+    return std::max(size, sizeof(int64_t));
+  }
+
+  const std::string& spec() const { return spec_; }
+
+ private:
+  enum class Kind { FIXED, UNIFORM, EXPONENTIAL };
+  Kind kind_ = Kind::FIXED;
+  size_t min_ = 0;
+  size_t max_ = 0;
+  std::string spec_;
+};
+
+// Log-linear histogram of nanosecond latencies with 64 sub-buckets per
+// power of two, so every percentile is within about 1.6% of the truth.
+class LatencyHistogram {
+ public:
+  static constexpr int kSubBucketBits = 6;
+  static constexpr int kSubBuckets = 1 << kSubBucketBits;
+
+  LatencyHistogram() : counts_(64 * kSubBuckets, 0) {}
+
+  void Record(int64_t nanoseconds) {
+    uint64_t value = static_cast<uint64_t>(std::max<int64_t>(nanoseconds, 0));
+    ++counts_[Index(value)];
+    ++total_;
+    max_ = std::max(max_, value);
+  }
+
+  void Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < counts_.size(); ++i) {
+      counts_[i] += other.counts_[i];
+    }
+    total_ += other.total_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  // In microseconds.
+  double Percentile(double fraction) const {
+    if (total_ == 0) {
+      return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(fraction * (total_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); ++i) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return std::min(UpperBound(i), max_) / 1000.0;
+      }
+    }
+    return max_ / 1000.0;
+  }
+
+  double Max() const { return max_ / 1000.0; }
+  uint64_t total() const { return total_; }
+
+ private:
+  static size_t Index(uint64_t value) {
+    if (value < kSubBuckets) {
+      return static_cast<size_t>(value);
+    }
+    int exponent = 63;
+    while (!(value >> exponent)) {
+      --exponent;
+    }
+    int shift = exponent - kSubBucketBits;
+    size_t sub_bucket = static_cast<size_t>((value >> shift) & (kSubBuckets - 1));
+    return static_cast<size_t>(shift + 1) * kSubBuckets + sub_bucket;
+  }
+
+  static uint64_t UpperBound(size_t index) {
+    if (index < kSubBuckets) {
+      return index;
+    }
+    int shift = static_cast<int>(index / kSubBuckets) - 1;
+    uint64_t sub_bucket = index % kSubBuckets;
+    return ((kSubBuckets + sub_bucket + 1) << shift) - 1;
+  }
+
+  std::vector<uint64_t> counts_;
+  uint64_t total_ = 0;
+  uint64_t max_ = 0;
+};
+
+struct Peer {
+  std::unique_ptr<NamedPipeServer> server;
+  std::unique_ptr<NamedPipeClient> client;
+  // Only touched by the server's I/O thread until the server is closed.
+  LatencyHistogram histogram;
+  std::atomic<uint64_t> received{0};
+  uint64_t sent = 0;
+  uint64_t refused = 0;
+  uint64_t reconnects = 0;
+};
+
+// Parses "RATE:MICROSECONDS".
+bool ParseRateAndTime(const std::string& value, double* rate, uint32_t* micros) {
+  return sscanf(value.c_str(), "%lf:%u", rate, micros) == 2 && *rate >= 0 && *rate <= 1;
+}
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    size_t equals = arg.find('=');
+    std::string key = arg.substr(0, equals);
+    std::string value = equals == std::string::npos ? std::string() : arg.substr(equals + 1);
+    if (key == "--peers") {
+      options->peers = atoi(value.c_str());
+    } else if (key == "--rate") {
+      options->rate = atof(value.c_str());
+    } else if (key == "--duration") {
+      options->duration = atof(value.c_str());
+    } else if (key == "--size") {
+      options->size = value;
+    } else if (key == "--transport") {
+      options->transport = value;
+    } else if (key == "--json") {
+      options->json = true;
+    } else if (key == "--seed") {
+      options->shaping.seed = strtoull(value.c_str(), nullptr, 10);
+    } else if (key == "--bandwidth") {
+      options->shaping.bandwidth = strtoull(value.c_str(), nullptr, 10);
+    } else if (key == "--latency") {
+      options->shaping.latency_us = static_cast<uint32_t>(atoi(value.c_str()));
+    } else if (key == "--jitter") {
+      options->shaping.jitter_us = static_cast<uint32_t>(atoi(value.c_str()));
+    } else if (key == "--spikes") {
+      if (!ParseRateAndTime(value, &options->shaping.spike_rate, &options->shaping.spike_us)) {
+        return false;
+      }
+    } else if (key == "--short-writes") {
+      if (!ParseRateAndTime(value, &options->shaping.short_write_rate, &options->shaping.short_write_pause_us)) {
+        return false;
+      }
+    } else if (key == "--read-stalls") {
+      if (!ParseRateAndTime(value, &options->shaping.read_stall_rate, &options->shaping.read_stall_us)) {
+        return false;
+      }
+    } else if (key == "--disconnects") {
+      options->shaping.disconnect_rate = atof(value.c_str());
+    } else {
+      return false;
+    }
+  }
+  return options->peers >= 1 && options->rate > 0 && options->duration > 0 &&
+         (options->transport == "kernel" || options->transport == "memory");
+}
+
+// Sets up a dropped connection again, as an application would.
+bool Reconnect(Peer* peer, bool in_process) {
+  peer->client->Disconnect();
+  while (peer->server->IsConnected()) {
+    Sleep(1);
+  }
+  if (!peer->server->WaitForConnection() ||
+      !(in_process ? peer->client->ConnectInProcess() : peer->client->Connect())) {
+    return false;
+  }
+  while (!peer->server->IsConnected()) {
+    Sleep(1);
+  }
+  ++peer->reconnects;
+  return true;
+}
+
+// Sends peer |peer|'s share of the load on its own schedule: message i is
+// due at start + i * interval, however late the previous one went out.
+void RunSender(Peer* peer, const SizeDistribution& sizes, Clock::time_point start,
+               Clock::duration interval, Clock::time_point end, uint64_t seed, bool in_process) {
+  std::mt19937_64 random(seed);
+  for (uint64_t i = 0;; ++i) {
+    Clock::time_point due = start + interval * i;
+    if (due >= end) {
+      break;
+    }
+    // The system timer is coarse, so sleep most of the way and spin the
+    // rest.
+    Clock::time_point now = Clock::now();
+    if (due - now > std::chrono::milliseconds(2)) {
+      std::this_thread::sleep_until(due - std::chrono::milliseconds(2));
+    }
+    while (Clock::now() < due) {
+      std::this_thread::yield();
+    }
+
+    Frame frame(FrameType::TEXT, std::string(sizes.Next(random), '\0'));
+    int64_t scheduled = std::chrono::duration_cast<std::chrono::nanoseconds>(due - start).count();
+    memcpy(&frame.payload[0], &scheduled, sizeof(scheduled));
+    if (peer->client->SendFrame(std::move(frame))) {
+      ++peer->sent;
+      continue;
+    }
+    ++peer->refused;
+    if (!peer->client->IsConnected() && !Reconnect(peer, in_process)) {
+      break;
+    }
+  }
+}
+
+void PrintReport(const Options& options, const std::vector<std::unique_ptr<Peer>>& peers,
+                 double elapsed) {
+  LatencyHistogram latency;
+  uint64_t sent = 0;
+  uint64_t received = 0;
+  uint64_t refused = 0;
+  uint64_t reconnects = 0;
+  ShapingStats shaping;
+  for (const auto& peer : peers) {
+    latency.Merge(peer->histogram);
+    sent += peer->sent;
+    received += peer->received;
+    refused += peer->refused;
+    reconnects += peer->reconnects;
+    for (const ShapingStats& stats : {peer->server->GetShapingStats(), peer->client->GetShapingStats()}) {
+      shaping.writes += stats.writes;
+      shaping.short_writes += stats.short_writes;
+      shaping.read_stalls += stats.read_stalls;
+      shaping.disconnects += stats.disconnects;
+      shaping.write_delay += stats.write_delay;
+    }
+  }
+  double throughput = received / elapsed;
+  const ShapingOptions& shape = options.shaping;
+
+  if (options.json) {
+    printf("{\n"
+           "  \"config\": {\"peers\": %d, \"rate\": %.0f, \"duration\": %.3f, "
+           "\"size\": \"%s\", \"transport\": \"%s\",\n"
+           "             \"shaping\": {\"seed\": %llu, \"bandwidth\": %llu, \"latency_us\": %u, "
+           "\"jitter_us\": %u, \"spikes\": [%g, %u], \"short_writes\": [%g, %u], "
+           "\"read_stalls\": [%g, %u], \"disconnects\": %g}},\n"
+           "  \"sent\": %llu,\n"
+           "  \"received\": %llu,\n"
+           "  \"refused\": %llu,\n"
+           "  \"reconnects\": %llu,\n"
+           "  \"throughput\": %.1f,\n"
+           "  \"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"p99_9\": %.1f, \"max\": %.1f},\n"
+           "  \"shaped\": {\"writes\": %llu, \"short_writes\": %llu, \"read_stalls\": %llu, "
+           "\"disconnects\": %llu, \"write_delay_ms\": %.1f}\n"
+           "}\n",
+           options.peers, options.rate, options.duration, options.size.c_str(),
+           options.transport.c_str(), static_cast<unsigned long long>(shape.seed),
+           static_cast<unsigned long long>(shape.bandwidth), shape.latency_us, shape.jitter_us,
+           shape.spike_rate, shape.spike_us, shape.short_write_rate, shape.short_write_pause_us,
+           shape.read_stall_rate, shape.read_stall_us, shape.disconnect_rate,
+           static_cast<unsigned long long>(sent), static_cast<unsigned long long>(received),
+           static_cast<unsigned long long>(refused), static_cast<unsigned long long>(reconnects),
+           throughput, latency.Percentile(0.5), latency.Percentile(0.99),
+           latency.Percentile(0.999), latency.Max(),
+           static_cast<unsigned long long>(shaping.writes),
+           static_cast<unsigned long long>(shaping.short_writes),
+           static_cast<unsigned long long>(shaping.read_stalls),
+           static_cast<unsigned long long>(shaping.disconnects), shaping.write_delay.count() / 1000.0);
+    return;
+  }
+
+  printf("%d peers, %.0f msg/s offered for %.1f s, size %s, %s transport\n",
+         options.peers, options.rate, options.duration, options.size.c_str(),
+         options.transport.c_str());
+  printf("sent %llu, received %llu, refused %llu, throughput %.0f msg/s\n",
+         static_cast<unsigned long long>(sent), static_cast<unsigned long long>(received),
+         static_cast<unsigned long long>(refused), throughput);
+  printf("latency p50 %.1f us  p99 %.1f us  p99.9 %.1f us  max %.1f us\n",
+         latency.Percentile(0.5), latency.Percentile(0.99), latency.Percentile(0.999),
+         latency.Max());
+  if (shape.enabled()) {
+    printf("shaped with seed %llu: %llu writes, %llu cut short, %llu read stalls, "
+           "%llu disconnects (%llu reconnects), writes held %.1f ms\n",
+           static_cast<unsigned long long>(shape.seed), static_cast<unsigned long long>(shaping.writes),
+           static_cast<unsigned long long>(shaping.short_writes),
+           static_cast<unsigned long long>(shaping.read_stalls),
+           static_cast<unsigned long long>(shaping.disconnects),
+           static_cast<unsigned long long>(reconnects), shaping.write_delay.count() / 1000.0);
+  }
+}
+
+}  // namespace
+
+int Run(int argc, char** argv) {
+  Options options;
+  SizeDistribution sizes;
+  if (!ParseOptions(argc, argv, &options) || !sizes.Parse(options.size)) {
+    fprintf(stderr,
+            "usage: ipc_loadgen [--peers=N] [--rate=MSGS_PER_SEC] [--duration=SECONDS]\n"
+            "                   [--size=fixed:N|uniform:MIN:MAX|exponential:MEAN]\n"
+            "                   [--transport=kernel|memory] [--json]\n"
+            "                   [--seed=N] [--bandwidth=BYTES_PER_SEC] [--latency=US] [--jitter=US]\n"
+            "                   [--spikes=RATE:US] [--short-writes=RATE:US] [--read-stalls=RATE:US]\n"
+            "                   [--disconnects=RATE]\n");
+    return 2;
+  }
+
+  std::vector<std::unique_ptr<Peer>> peers;
+  Clock::time_point start;
+  std::string prefix = "flutter_ipc_loadgen_" + std::to_string(GetCurrentProcessId()) + "_";
+  for (int i = 0; i < options.peers; ++i) {
+    auto peer = std::make_unique<Peer>();
+    Peer* raw_peer = peer.get();
+    // Every connection draws its own conditions, from seeds derived from
+    // the run's.
+    ConnectionOptions server_options;
+    server_options.shaping = options.shaping;
+    server_options.shaping.seed = options.shaping.seed * 1000003 + 2 * i;
+    ConnectionOptions client_options = server_options;
+    client_options.shaping.seed += 1;
+    peer->server = std::make_unique<NamedPipeServer>(prefix + std::to_string(i), server_options);
+    peer->server->SetFrameHandler([raw_peer, &start](Frame frame, FrameConsumed consumed) {
+      int64_t scheduled = 0;
+      memcpy(&scheduled, frame.payload.data(), sizeof(scheduled));
+      int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+      raw_peer->histogram.Record(now - scheduled);
+      ++raw_peer->received;
+      consumed();
+    });
+    if (!peer->server->Create() || !peer->server->WaitForConnection()) {
+      fprintf(stderr, "cannot create server %d (error %lu)\n", i, GetLastError());
+      return 1;
+    }
+    peer->client = std::make_unique<NamedPipeClient>(peer->server->GetPipeName(), false, client_options);
+    bool connected = options.transport == "memory" ? peer->client->ConnectInProcess()
+                                                   : peer->client->Connect();
+    if (!connected) {
+      fprintf(stderr, "cannot connect client %d (error %lu)\n", i, GetLastError());
+      return 1;
+    }
+    peers.push_back(std::move(peer));
+  }
+  for (const auto& peer : peers) {
+    while (!peer->server->IsConnected()) {
+      Sleep(1);
+    }
+  }
+
+  auto interval = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(options.peers / options.rate));
+  start = Clock::now();
+  Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(options.duration));
+  std::vector<std::thread> senders;
+  for (size_t i = 0; i < peers.size(); ++i) {
+    // Staggered, so the peers do not all fire at the same instant.
+    Clock::time_point peer_start = start + interval * i / peers.size();
+    senders.emplace_back(RunSender, peers[i].get(), std::cref(sizes), peer_start, interval, end, i + 1,
+                         options.transport == "memory");
+  }
+  for (auto& sender : senders) {
+    sender.join();
+  }
+
+  // Let the queues drain, giving up on messages stuck for over a second.
+  // Throughput counts up to the last delivery.
+  uint64_t last_received = UINT64_MAX;
+  Clock::time_point last_progress = Clock::now();
+  while (true) {
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    for (const auto& peer : peers) {
+      sent += peer->sent;
+      received += peer->received;
+    }
+    if (received != last_received) {
+      last_received = received;
+      last_progress = Clock::now();
+    } else if (Clock::now() - last_progress > std::chrono::seconds(1)) {
+      break;
+    }
+    if (received == sent) {
+      break;
+    }
+    Sleep(10);
+  }
+  double elapsed = std::chrono::duration<double>(last_progress - start).count();
+
+  // Closing joins the I/O threads, after which the histograms are ours.
+  for (auto& peer : peers) {
+    peer->client->Disconnect();
+    peer->server->Close();
+  }
+  PrintReport(options, peers, elapsed);
+  return 0;
+}
+
+}  // namespace loadgen
+}  // namespace flutter_ipc
+
+int main(int argc, char** argv) {
+  return flutter_ipc::loadgen::Run(argc, argv);
+}
@@ -0,0 +1,389 @@
+// Replays a capture taken with FlutterIpc.startCapture through the native
+// transport.
+//
+// Every server and client in the capture becomes a server/client pair in
+// this process. A frame the captured side sent goes out again from the
+// same side, and a frame it received is sent by the peer, each at the time
+// it was recorded divided by --speed; with --speed=max they go out as fast
+// as the queues take them. Payloads cut short by the capture are padded
+// back to their length, so the byte load is the same. When both ends of a
+// connection were captured by one process every frame is in the capture
+// twice; replay only one --direction then.
+//
+// Reports the rate, the throughput, how far the sends fell behind the
+// captured schedule and how long frames took to arrive, so that runs of
+// two builds on the same capture can be compared.
+//
+//   ipc_replay session.fipccap
+//   ipc_replay session.fipccap --speed=10 --transport=memory
+//   ipc_replay session.fipccap --speed=max --direction=sent --json > run.json
+
+#include <windows.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "capture.h"
+#include "flutter_ipc_plugin.h"
+
+namespace flutter_ipc {
+namespace replay {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::string path;
+  double speed = 1;  // 0 for as fast as possible
+  std::string transport = "kernel";
+  std::string direction = "both";
+  bool json = false;
+};
+
+// A captured server or client, and the pair that stands in for it.
+struct Pair {
+  uint32_t id = 0;
+  CaptureRole role = CaptureRole::SERVER;
+  std::string name;
+  std::unique_ptr<NamedPipeServer> server;
+  std::unique_ptr<NamedPipeClient> client;
+};
+
+// Frames on their way, matched to their arrival by order: the transport
+// keeps the frames of one channel in the order they were sent.
+class Deliveries {
+ public:
+  using Key = std::tuple<uint32_t, bool, uint16_t>;  // Pair, sent by the server, channel
+
+  void Sent(const Key& key, Clock::time_point time) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_flight_[key].push_back(time);
+    ++sent_;
+  }
+
+  // A send that was given up on.
+  void Unsent(const Key& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_flight_[key].pop_back();
+    --sent_;
+  }
+
+  void Received(const Key& key, size_t bytes) {
+    Clock::time_point now = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::deque<Clock::time_point>& queue = in_flight_[key];
+    if (!queue.empty()) {
+      latencies_.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - queue.front()).count());
+      queue.pop_front();
+    }
+    ++received_;
+    bytes_ += bytes;
+    last_ = now;
+    arrived_.notify_all();
+  }
+
+  // Waits until every frame sent has arrived, giving up once none has for
+  // |patience|.
+  void Drain(Clock::duration patience) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t seen = received_;
+    while (received_ < sent_) {
+      if (!arrived_.wait_for(lock, patience, [&] { return received_ != seen; })) {
+        break;
+      }
+      seen = received_;
+    }
+  }
+
+  // Only once the pairs are closed.
+  uint64_t sent() const { return sent_; }
+  uint64_t received() const { return received_; }
+  uint64_t bytes() const { return bytes_; }
+  Clock::time_point last() const { return last_; }
+  std::vector<int64_t>* latencies() { return &latencies_; }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable arrived_;
+  std::map<Key, std::deque<Clock::time_point>> in_flight_;
+  std::vector<int64_t> latencies_;
+  uint64_t sent_ = 0;
+  uint64_t received_ = 0;
+  uint64_t bytes_ = 0;
+  Clock::time_point last_;
+};
+
+struct Result {
+  uint64_t refused = 0;
+  // Frames left out: handles cannot be replayed, and frames of sources
+  // whose CONNECTION record was dropped have no pair.
+  uint64_t skipped = 0;
+  uint64_t lost = 0;
+  Clock::duration max_lag{0};
+  Clock::duration total_lag{0};
+  Clock::duration captured{0};
+  double elapsed = 0;
+};
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    size_t equals = arg.find('=');
+    std::string key = arg.substr(0, equals);
+    std::string value = equals == std::string::npos ? std::string() : arg.substr(equals + 1);
+    if (key == "--speed") {
+      options->speed = value == "max" ? 0 : atof(value.c_str());
+      if (value != "max" && options->speed <= 0) {
+        return false;
+      }
+    } else if (key == "--transport") {
+      options->transport = value;
+    } else if (key == "--direction") {
+      options->direction = value;
+    } else if (key == "--json") {
+      options->json = true;
+    } else if (arg.compare(0, 2, "--") != 0 && options->path.empty()) {
+      options->path = arg;
+    } else {
+      return false;
+    }
+  }
+  return !options->path.empty() && (options->transport == "kernel" || options->transport == "memory") &&
+         (options->direction == "both" || options->direction == "sent" || options->direction == "received");
+}
+
+bool Connect(Pair* pair, const std::string& pipe_name, bool in_process, Deliveries* deliveries) {
+  uint32_t id = pair->id;
+  pair->server = std::make_unique<NamedPipeServer>(pipe_name);
+  pair->server->SetFrameHandler([deliveries, id](Frame frame, FrameConsumed consumed) {
+    deliveries->Received(Deliveries::Key(id, false, frame.channel), frame.payload.size());
+    consumed();
+  });
+  if (!pair->server->Create() || !pair->server->WaitForConnection()) {
+    return false;
+  }
+  pair->client = std::make_unique<NamedPipeClient>(pair->server->GetPipeName());
+  pair->client->SetFrameHandler([deliveries, id](Frame frame, FrameConsumed consumed) {
+    deliveries->Received(Deliveries::Key(id, true, frame.channel), frame.payload.size());
+    consumed();
+  });
+  if (!(in_process ? pair->client->ConnectInProcess() : pair->client->Connect())) {
+    return false;
+  }
+  while (!pair->server->IsConnected()) {
+    Sleep(1);
+  }
+  return true;
+}
+
+// Rebuilds the frame of |record|. The key of a keyed frame is only kept
+// when its payload was captured whole.
+Frame MakeFrame(const CaptureRecord& record) {
+  std::string payload(record.data, record.captured);
+  payload.resize(record.length, '\0');
+  Frame frame(static_cast<FrameType>(record.type), std::move(payload));
+  frame.channel = record.channel;
+  if (record.captured == record.length) {
+    frame.flags = record.flags & kFrameFlagKeyed;
+  }
+  return frame;
+}
+
+// Sends the frames of the capture in the order they were recorded, each no
+// earlier than it was due.
+bool Replay(const Options& options, CaptureReader* reader, std::map<uint32_t, Pair>* pairs,
+            Deliveries* deliveries, Result* result) {
+  Clock::time_point start = Clock::now();
+  CaptureRecord record;
+  while (reader->Next(&record)) {
+    if (record.kind == CaptureKind::CONNECTION) {
+      continue;
+    }
+    bool sent = record.kind == CaptureKind::SENT;
+    if ((sent && options.direction == "received") || (!sent && options.direction == "sent")) {
+      continue;
+    }
+    auto pair = pairs->find(record.connection);
+    FrameType type = static_cast<FrameType>(record.type);
+    if (pair == pairs->end() || (type != FrameType::TEXT && type != FrameType::VALUE)) {
+      ++result->skipped;
+      continue;
+    }
+    result->captured = record.time;
+
+    if (options.speed > 0) {
+      Clock::time_point due = start + std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double, std::nano>(record.time.count() / options.speed));
+      // The system timer is coarse, so sleep most of the way and spin the
+      // rest.
+      Clock::time_point now = Clock::now();
+      if (due - now > std::chrono::milliseconds(2)) {
+        std::this_thread::sleep_until(due - std::chrono::milliseconds(2));
+      }
+      while ((now = Clock::now()) < due) {
+        std::this_thread::yield();
+      }
+      result->max_lag = std::max(result->max_lag, now - due);
+      result->total_lag += now - due;
+    }
+
+    bool from_server = (pair->second.role == CaptureRole::SERVER) == sent;
+    Deliveries::Key key(pair->first, from_server, record.channel);
+    deliveries->Sent(key, Clock::now());
+    // A full queue just means the pipe is behind; retry.
+    while (!(from_server ? pair->second.server->SendFrame(MakeFrame(record))
+                         : pair->second.client->SendFrame(MakeFrame(record)))) {
+      bool connected = from_server ? pair->second.server->IsConnected() : pair->second.client->IsConnected();
+      if (!connected) {
+        deliveries->Unsent(key);
+        fprintf(stderr, "connection %u dropped during the replay\n", pair->first);
+        return false;
+      }
+      ++result->refused;
+      Sleep(0);
+    }
+  }
+  return true;
+}
+
+double Percentile(const std::vector<int64_t>& sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  return sorted[static_cast<size_t>(fraction * (sorted.size() - 1))] / 1000.0;
+}
+
+void PrintReport(const Options& options, size_t pairs, Deliveries* deliveries, const Result& result) {
+  std::vector<int64_t>& latencies = *deliveries->latencies();
+  std::sort(latencies.begin(), latencies.end());
+  double max_latency = latencies.empty() ? 0 : latencies.back() / 1000.0;
+  double elapsed = std::max(result.elapsed, 1e-9);
+  double captured = std::chrono::duration<double>(result.captured).count();
+  double rate = deliveries->received() / elapsed;
+  double throughput = deliveries->bytes() / elapsed / 1e6;
+  double mean_lag = deliveries->sent() == 0
+      ? 0 : std::chrono::duration<double, std::micro>(result.total_lag).count() / deliveries->sent();
+  double max_lag = std::chrono::duration<double, std::micro>(result.max_lag).count();
+
+  if (options.json) {
+    printf("{\n"
+           "  \"config\": {\"capture\": \"%s\", \"speed\": %g, \"transport\": \"%s\", \"direction\": \"%s\"},\n"
+           "  \"connections\": %zu,\n"
+           "  \"sent\": %llu,\n"
+           "  \"received\": %llu,\n"
+           "  \"lost\": %llu,\n"
+           "  \"skipped\": %llu,\n"
+           "  \"refused\": %llu,\n"
+           "  \"captured_s\": %.3f,\n"
+           "  \"elapsed_s\": %.3f,\n"
+           "  \"rate\": %.1f,\n"
+           "  \"throughput_mb_s\": %.2f,\n"
+           "  \"lag_us\": {\"mean\": %.1f, \"max\": %.1f},\n"
+           "  \"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"p99_9\": %.1f, \"max\": %.1f}\n"
+           "}\n",
+           options.path.c_str(), options.speed, options.transport.c_str(), options.direction.c_str(), pairs,
+           static_cast<unsigned long long>(deliveries->sent()),
+           static_cast<unsigned long long>(deliveries->received()),
+           static_cast<unsigned long long>(result.lost), static_cast<unsigned long long>(result.skipped),
+           static_cast<unsigned long long>(result.refused), captured, result.elapsed, rate, throughput,
+           mean_lag, max_lag, Percentile(latencies, 0.5), Percentile(latencies, 0.99),
+           Percentile(latencies, 0.999), max_latency);
+    return;
+  }
+
+  char speed[32] = "full speed";
+  if (options.speed > 0) {
+    snprintf(speed, sizeof(speed), "%gx speed", options.speed);
+  }
+  printf("%s: %zu connections, %.1f s captured, replayed %s at %s, %s transport\n", options.path.c_str(),
+         pairs, captured, options.direction.c_str(), speed, options.transport.c_str());
+  printf("sent %llu, received %llu, lost %llu, skipped %llu, refused %llu\n",
+         static_cast<unsigned long long>(deliveries->sent()),
+         static_cast<unsigned long long>(deliveries->received()),
+         static_cast<unsigned long long>(result.lost), static_cast<unsigned long long>(result.skipped),
+         static_cast<unsigned long long>(result.refused));
+  printf("%.3f s, %.0f msg/s, %.2f MB/s\n", result.elapsed, rate, throughput);
+  if (options.speed > 0) {
+    printf("behind schedule: mean %.1f us  max %.1f us\n", mean_lag, max_lag);
+  }
+  printf("latency p50 %.1f us  p99 %.1f us  p99.9 %.1f us  max %.1f us\n", Percentile(latencies, 0.5),
+         Percentile(latencies, 0.99), Percentile(latencies, 0.999), max_latency);
+}
+
+}  // namespace
+
+int Run(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    fprintf(stderr,
+            "usage: ipc_replay CAPTURE [--speed=FACTOR|max] [--transport=kernel|memory]\n"
+            "                  [--direction=both|sent|received] [--json]\n");
+    return 2;
+  }
+  std::unique_ptr<CaptureReader> reader = CaptureReader::Open(options.path);
+  if (!reader) {
+    fprintf(stderr, "cannot read capture %s (error %lu)\n", options.path.c_str(), GetLastError());
+    return 1;
+  }
+
+  // A frame may be recorded before the announcement of its source, so the
+  // sources are collected first.
+  std::map<uint32_t, Pair> pairs;
+  CaptureRecord record;
+  while (reader->Next(&record)) {
+    if (record.kind == CaptureKind::CONNECTION) {
+      Pair& pair = pairs[record.connection];
+      pair.id = record.connection;
+      pair.role = static_cast<CaptureRole>(record.type);
+      pair.name.assign(record.data, record.captured);
+    }
+  }
+  reader->Rewind();
+
+  Deliveries deliveries;
+  std::string prefix = "flutter_ipc_replay_" + std::to_string(GetCurrentProcessId()) + "_";
+  for (auto& entry : pairs) {
+    if (!Connect(&entry.second, prefix + std::to_string(entry.first), options.transport == "memory",
+                 &deliveries)) {
+      fprintf(stderr, "cannot connect a pair for %s (error %lu)\n", entry.second.name.c_str(), GetLastError());
+      return 1;
+    }
+  }
+
+  Result result;
+  Clock::time_point start = Clock::now();
+  bool completed = Replay(options, reader.get(), &pairs, &deliveries, &result);
+  deliveries.Drain(std::chrono::seconds(1));
+
+  // Closing joins the I/O threads, after which the counts are ours.
+  for (auto& entry : pairs) {
+    entry.second.client->Disconnect();
+    entry.second.server->Close();
+  }
+  result.lost = deliveries.sent() - deliveries.received();
+  // Throughput counts up to the last delivery.
+  result.elapsed = deliveries.received() == 0
+      ? 0 : std::chrono::duration<double>(deliveries.last() - start).count();
+  PrintReport(options, pairs.size(), &deliveries, result);
+  return completed ? 0 : 1;
+}
+
+}  // namespace replay
+}  // namespace flutter_ipc
+
+int main(int argc, char** argv) {
+  return flutter_ipc::replay::Run(argc, argv);
+}
@@ -0,0 +1,290 @@
+#include "utf8.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "cpu_features.h"
+
+namespace flutter_ipc {
+
+namespace {
+
+#if defined(FLUTTER_IPC_X86)
+
+// The vector validators classify every byte together with the one to three
+// bytes before it through three 16-entry lookups, following Keiser and
+// Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte" (2021).
+// Each lookup yields a set of error bits; a byte pair is malformed if some
+// bit survives in all three.
+constexpr uint8_t kTooShort = 1 << 0;      // Lead byte followed by a non-continuation
+constexpr uint8_t kTooLong = 1 << 1;       // ASCII followed by a continuation
+constexpr uint8_t kOverlong3 = 1 << 2;     // E0 80..9F
+constexpr uint8_t kTooLarge = 1 << 3;      // F4 90..BF or F5..FF
+constexpr uint8_t kSurrogate = 1 << 4;     // ED A0..BF
+constexpr uint8_t kOverlong2 = 1 << 5;     // C0..C1
+constexpr uint8_t kTooLarge1000 = 1 << 6;  // F5..FF 80..8F
+constexpr uint8_t kOverlong4 = 1 << 6;     // F0 80..8F
+constexpr uint8_t kTwoConts = 1 << 7;      // Two continuations in a row
+constexpr uint8_t kCarry = kTooShort | kTooLong | kTwoConts;
+
+// Indexed by the high nibble of the previous byte.
+constexpr uint8_t kByte1High[16] = {
+  kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong,
+  kTwoConts, kTwoConts, kTwoConts, kTwoConts,
+  kTooShort | kOverlong2,
+  kTooShort,
+  kTooShort | kOverlong3 | kSurrogate,
+  kTooShort | kTooLarge | kTooLarge1000 | kOverlong4,
+};
+
+// Indexed by the low nibble of the previous byte.
+constexpr uint8_t kByte1Low[16] = {
+  kCarry | kOverlong3 | kOverlong2 | kOverlong4,
+  kCarry | kOverlong2,
+  kCarry,
+  kCarry,
+  kCarry | kTooLarge,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000 | kSurrogate,
+  kCarry | kTooLarge | kTooLarge1000,
+  kCarry | kTooLarge | kTooLarge1000,
+};
+
+// Indexed by the high nibble of the current byte.
+constexpr uint8_t kByte2High[16] = {
+  kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,
+  kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge1000 | kOverlong4,
+  kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge,
+  kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+  kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+  kTooShort, kTooShort, kTooShort, kTooShort,
+};
+
+struct Ssse3State {
+  __m128i error;
+  __m128i previous;
+  // Nonzero where the previous block ends in the middle of a sequence.
+  __m128i incomplete;
+};
+
+FLUTTER_IPC_TARGET("ssse3")
+inline void CheckBlockSsse3(__m128i input, Ssse3State* state) {
+  if (_mm_movemask_epi8(input) == 0) {
+    // All ASCII: fine unless the previous block was left hanging.
+    state->error = _mm_or_si128(state->error, state->incomplete);
+    state->incomplete = _mm_setzero_si128();
+    state->previous = input;
+    return;
+  }
+
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  const __m128i byte_1_high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kByte1High));
+  const __m128i byte_1_low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kByte1Low));
+  const __m128i byte_2_high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kByte2High));
+
+  __m128i prev1 = _mm_alignr_epi8(input, state->previous, 15);
+  __m128i special = _mm_and_si128(
+      _mm_and_si128(
+          _mm_shuffle_epi8(byte_1_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+          _mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, nibble))),
+      _mm_shuffle_epi8(byte_2_high, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+
+  // Third and fourth bytes of a sequence must be continuations, which is
+  // the only place where two continuations may follow each other.
+  __m128i prev2 = _mm_alignr_epi8(input, state->previous, 14);
+  __m128i prev3 = _mm_alignr_epi8(input, state->previous, 13);
+  __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+  __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+  __m128i must_continue = _mm_and_si128(_mm_or_si128(third, fourth),
+                                        _mm_set1_epi8(static_cast<char>(0x80)));
+  state->error = _mm_or_si128(state->error, _mm_xor_si128(must_continue, special));
+
+  const __m128i max_complete = _mm_setr_epi8(
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+  state->incomplete = _mm_subs_epu8(input, max_complete);
+  state->previous = input;
+}
+
+FLUTTER_IPC_TARGET("ssse3")
+bool IsValidUtf8Ssse3(const char* data, size_t size) {
+  Ssse3State state = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+  size_t offset = 0;
+  for (; offset + 16 <= size; offset += 16) {
+    CheckBlockSsse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset)), &state);
+  }
+  if (offset < size) {
+    // Zero padding is ASCII, so a sequence cut off by the end still fails.
+    char tail[16] = {};
+    memcpy(tail, data + offset, size - offset);
+    CheckBlockSsse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tail)), &state);
+  }
+  __m128i error = _mm_or_si128(state.error, state.incomplete);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+
+struct Avx2State {
+  __m256i error;
+  __m256i previous;
+  __m256i incomplete;
+};
+
+// The bytes of |input| shifted right by N across the whole register, with
+// the last N bytes of |previous| shifted in.
+#define FLUTTER_IPC_PREV_AVX2(input, previous, n) \
+  _mm256_alignr_epi8((input), _mm256_permute2x128_si256((previous), (input), 0x21), 16 - (n))
+
+FLUTTER_IPC_TARGET("avx2")
+inline void CheckBlockAvx2(__m256i input, Avx2State* state) {
+  if (_mm256_movemask_epi8(input) == 0) {
+    state->error = _mm256_or_si256(state->error, state->incomplete);
+    state->incomplete = _mm256_setzero_si256();
+    state->previous = input;
+    return;
+  }
+
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  const __m256i byte_1_high = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(kByte1High)));
+  const __m256i byte_1_low = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(kByte1Low)));
+  const __m256i byte_2_high = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(kByte2High)));
+
+  __m256i prev1 = FLUTTER_IPC_PREV_AVX2(input, state->previous, 1);
+  __m256i special = _mm256_and_si256(
+      _mm256_and_si256(
+          _mm256_shuffle_epi8(byte_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+          _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, nibble))),
+      _mm256_shuffle_epi8(byte_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+
+  __m256i prev2 = FLUTTER_IPC_PREV_AVX2(input, state->previous, 2);
+  __m256i prev3 = FLUTTER_IPC_PREV_AVX2(input, state->previous, 3);
+  __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+  __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+  __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                           _mm256_set1_epi8(static_cast<char>(0x80)));
+  state->error = _mm256_or_si256(state->error, _mm256_xor_si256(must_continue, special));
+
+  const __m256i max_complete = _mm256_setr_epi8(
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+  state->incomplete = _mm256_subs_epu8(input, max_complete);
+  state->previous = input;
+}
+
+#undef FLUTTER_IPC_PREV_AVX2
+
+FLUTTER_IPC_TARGET("avx2")
+bool IsValidUtf8Avx2(const char* data, size_t size) {
+  Avx2State state = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+  size_t offset = 0;
+  for (; offset + 32 <= size; offset += 32) {
+    CheckBlockAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset)), &state);
+  }
+  if (offset < size) {
+    char tail[32] = {};
+    memcpy(tail, data + offset, size - offset);
+    CheckBlockAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(tail)), &state);
+  }
+  __m256i error = _mm256_or_si256(state.error, state.incomplete);
+  return _mm256_testz_si256(error, error) != 0;
+}
+
+#endif  // FLUTTER_IPC_X86
+
+}  // namespace
+
+bool IsValidUtf8Scalar(const char* data, size_t size) {
+  const auto* bytes = reinterpret_cast<const unsigned char*>(data);
+  size_t i = 0;
+  while (i < size) {
+    // Skips ASCII eight bytes at a time.
+    if (size - i >= 8) {
+      uint64_t word;
+      memcpy(&word, bytes + i, sizeof(word));
+      if ((word & 0x8080808080808080ull) == 0) {
+        i += 8;
+        continue;
+      }
+    }
+
+    unsigned char lead = bytes[i];
+    if (lead < 0x80) {
+      ++i;
+      continue;
+    }
+    size_t length;
+    uint32_t code_point;
+    uint32_t minimum;
+    if ((lead & 0xE0) == 0xC0) {
+      length = 2;
+      code_point = lead & 0x1F;
+      minimum = 0x80;
+    } else if ((lead & 0xF0) == 0xE0) {
+      length = 3;
+      code_point = lead & 0x0F;
+      minimum = 0x800;
+    } else if ((lead & 0xF8) == 0xF0) {
+      length = 4;
+      code_point = lead & 0x07;
+      minimum = 0x10000;
+    } else {
+      return false;
+    }
+    if (size - i < length) {
+      return false;
+    }
+    for (size_t j = 1; j < length; ++j) {
+      if ((bytes[i + j] & 0xC0) != 0x80) {
+        return false;
+      }
+      code_point = (code_point << 6) | (bytes[i + j] & 0x3F);
+    }
+    if (code_point < minimum || code_point > 0x10FFFF ||
+        (code_point >= 0xD800 && code_point <= 0xDFFF)) {
+      return false;
+    }
+    i += length;
+  }
+  return true;
+}
+
+bool IsValidUtf8(const char* data, size_t size) {
+#if defined(FLUTTER_IPC_X86)
+  // Short strings are not worth the setup.
+  if (size >= 32) {
+    const CpuFeatures& features = GetCpuFeatures();
+    if (features.avx2) {
+      return IsValidUtf8Avx2(data, size);
+    }
+    if (features.ssse3) {
+      return IsValidUtf8Ssse3(data, size);
+    }
+  }
+#endif
+  return IsValidUtf8Scalar(data, size);
+}
+
+const char* Utf8ValidatorName() {
+#if defined(FLUTTER_IPC_X86)
+  const CpuFeatures& features = GetCpuFeatures();
+  if (features.avx2) {
+    return "avx2";
+  }
+  if (features.ssse3) {
+    return "ssse3";
+  }
+#endif
+  return "scalar";
+}
+
+}  // namespace flutter_ipc
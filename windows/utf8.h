@@ -0,0 +1,23 @@
+#ifndef FLUTTER_PLUGIN_UTF8_H_
+#define FLUTTER_PLUGIN_UTF8_H_
+
+#include <cstddef>
+
+namespace flutter_ipc {
+
+// Returns whether |data| is well-formed UTF-8: no overlong encodings,
+// surrogates, code points above U+10FFFF or truncated sequences. Uses AVX2
+// or SSSE3 when the processor has them.
+bool IsValidUtf8(const char* data, size_t size);
+
+// The portable implementation, one byte at a time. For tests and
+// benchmarks.
+bool IsValidUtf8Scalar(const char* data, size_t size);
+
+// Which implementation IsValidUtf8 uses on this processor: "avx2",
+// "ssse3" or "scalar".
+const char* Utf8ValidatorName();
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_UTF8_H_
@@ -0,0 +1,93 @@
+#include "value_codec.h"
+
+#include <flutter/byte_streams.h>
+#include <flutter/standard_codec_serializer.h>
+
+#include <cstring>
+#include <string>
+
+namespace flutter_ipc {
+
+namespace {
+
+// Appends to a frame payload. Alignment is relative to the payload start,
+// which is also where the receiver starts reading.
+class PayloadWriter : public flutter::ByteStreamWriter {
+ public:
+  explicit PayloadWriter(std::string* payload) : payload_(payload) {}
+
+  void WriteByte(uint8_t byte) override {
+    payload_->push_back(static_cast<char>(byte));
+  }
+
+  void WriteBytes(const uint8_t* bytes, size_t length) override {
+    payload_->append(reinterpret_cast<const char*>(bytes), length);
+  }
+
+  void WriteAlignment(uint8_t alignment) override {
+    size_t mod = payload_->size() % alignment;
+    if (mod) {
+      payload_->append(alignment - mod, '\0');
+    }
+  }
+
+ private:
+  std::string* payload_;
+};
+
+// Reads a frame payload in place. Reads past the end yield zeros and set
+// the overflow flag instead of touching memory beyond the payload.
+class PayloadReader : public flutter::ByteStreamReader {
+ public:
+  explicit PayloadReader(const std::string& payload) : payload_(payload) {}
+
+  uint8_t ReadByte() override {
+    if (position_ >= payload_.size()) {
+      overflowed_ = true;
+      return 0;
+    }
+    return static_cast<uint8_t>(payload_[position_++]);
+  }
+
+  void ReadBytes(uint8_t* buffer, size_t length) override {
+    if (length > payload_.size() - position_) {
+      overflowed_ = true;
+      memset(buffer, 0, length);
+      position_ = payload_.size();
+      return;
+    }
+    memcpy(buffer, payload_.data() + position_, length);
+    position_ += length;
+  }
+
+  void ReadAlignment(uint8_t alignment) override {
+    size_t mod = position_ % alignment;
+    if (mod) {
+      position_ += alignment - mod;
+    }
+  }
+
+  bool AtCleanEnd() const { return !overflowed_ && position_ == payload_.size(); }
+
+ private:
+  const std::string& payload_;
+  size_t position_ = 0;
+  bool overflowed_ = false;
+};
+
+}  // namespace
+
+Frame EncodeValueFrame(const flutter::EncodableValue& value) {
+  Frame frame(FrameType::VALUE, std::string());
+  PayloadWriter writer(&frame.payload);
+  flutter::StandardCodecSerializer::GetInstance().WriteValue(value, &writer);
+  return frame;
+}
+
+bool DecodeValueFrame(const Frame& frame, flutter::EncodableValue* value) {
+  PayloadReader reader(frame.payload);
+  *value = flutter::StandardCodecSerializer::GetInstance().ReadValue(&reader);
+  return reader.AtCleanEnd();
+}
+
+}  // namespace flutter_ipc
@@ -0,0 +1,20 @@
+#ifndef FLUTTER_PLUGIN_VALUE_CODEC_H_
+#define FLUTTER_PLUGIN_VALUE_CODEC_H_
+
+#include <flutter/encodable_value.h>
+
+#include "frame.h"
+
+namespace flutter_ipc {
+
+// Serializes |value| in the StandardMessageCodec binary format straight
+// into the payload of a VALUE frame, without an intermediate buffer.
+Frame EncodeValueFrame(const flutter::EncodableValue& value);
+
+// Decodes a VALUE frame payload. Returns false if the payload is truncated
+// or has trailing bytes.
+bool DecodeValueFrame(const Frame& frame, flutter::EncodableValue* value);
+
+}  // namespace flutter_ipc
+
+#endif  // FLUTTER_PLUGIN_VALUE_CODEC_H_